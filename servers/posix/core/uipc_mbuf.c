@@ -87,9 +87,226 @@ mutex_t m_reclaim_lock = &m_reclaim_lock_data;
 
 mbinit()
 {
+	int i;
+
 	mbuf_zone = zinit(MSIZE, 10000 * MSIZE, 10 * MSIZE, TRUE, "mbufs"); 
 	mcl_zone = zinit(MCLBYTES, 1000 * MCLBYTES, 10 * MCLBYTES, TRUE,
 			 "mbuf clusters");
+	for (i = 0; i < MBC_NCACHE; i++)
+		mutex_init(&mbcache[i].mbc_lock);
+}
+
+/*
+ * Per-thread mbuf and cluster caches.
+ *
+ * MGET and MCLGET go to the zone for every element, taking the zone
+ * lock each time, and every thread allocating mbufs contends on the
+ * same two locks.  The function interfaces below (m_get, m_gethdr,
+ * m_free, m_freem, m_clget and the cluster ext_free routine) instead
+ * use a small cache picked by hashing the calling cthread, moving
+ * mbufs and clusters to and from the zones MBC_BATCH at a time under
+ * a single zone lock.  If the cache is held by another thread the
+ * zone is used directly, so a cache lock is never waited on.
+ */
+#define	MBC_NCACHE	8			/* caches to spread threads on */
+#define	MBC_BATCH	16			/* elements per refill/drain */
+#define	MBC_HIWAT	(4 * MBC_BATCH)		/* drain above this many */
+
+struct mbcstat {
+	u_long	mbc_allocs;		/* mbufs handed out from the cache */
+	u_long	mbc_frees;		/* mbufs taken back into the cache */
+	u_long	mbc_clallocs;		/* clusters handed out */
+	u_long	mbc_clfrees;		/* clusters taken back */
+	u_long	mbc_refills;		/* batches taken from a zone */
+	u_long	mbc_drains;		/* batches given back to a zone */
+	u_long	mbc_misses;		/* cache busy, zone used directly */
+};
+
+struct mbcache {
+	struct	mutex mbc_lock;
+	vm_offset_t mbc_mbufs;		/* free mbufs, linked by first word */
+	vm_offset_t mbc_clusters;	/* free clusters, likewise */
+	int	mbc_nmbufs;
+	int	mbc_nclusters;
+	struct	mbcstat mbc_stat;
+} mbcache[MBC_NCACHE];
+
+static struct mbcache *
+mbc_self()
+{
+	return (&mbcache[((vm_offset_t)cthread_self() >> 4) % MBC_NCACHE]);
+}
+
+/*
+ * Take an element off a cache list, refilling the list from its
+ * zone in one batch when it is empty.  Returns 0 if the zone has
+ * nothing free; the caller then lets the zone grow.
+ */
+static vm_offset_t
+mbc_alloc(zone, head, count, stat)
+	zone_t zone;
+	vm_offset_t *head;
+	int *count;
+	struct mbcstat *stat;
+{
+	vm_offset_t elem;
+	int i;
+
+	if (*head == 0) {
+		mutex_lock(&zone->lock);
+		for (i = 0; i < MBC_BATCH; i++) {
+			REMOVE_FROM_ZONE(zone, elem, vm_offset_t);
+			if (elem == 0)
+				break;
+			*(vm_offset_t *)elem = *head;
+			*head = elem;
+			(*count)++;
+		}
+		mutex_unlock(&zone->lock);
+		if (*head == 0)
+			return (0);
+		stat->mbc_refills++;
+	}
+	elem = *head;
+	*head = *(vm_offset_t *)elem;
+	(*count)--;
+	return (elem);
+}
+
+/*
+ * Hand up to n elements of a cache list back to its zone.
+ */
+static void
+mbc_release(zone, head, count, n)
+	zone_t zone;
+	vm_offset_t *head;
+	int *count;
+	int n;
+{
+	vm_offset_t elem;
+
+	mutex_lock(&zone->lock);
+	while (n-- > 0 && (elem = *head) != 0) {
+		*head = *(vm_offset_t *)elem;
+		(*count)--;
+		ADD_TO_ZONE(zone, elem);
+	}
+	mutex_unlock(&zone->lock);
+}
+
+/*
+ * Put an element on a cache list, draining a batch to the
+ * zone when the list grows past MBC_HIWAT.
+ */
+static void
+mbc_free(zone, head, count, stat, elem)
+	zone_t zone;
+	vm_offset_t *head;
+	int *count;
+	struct mbcstat *stat;
+	vm_offset_t elem;
+{
+	*(vm_offset_t *)elem = *head;
+	*head = elem;
+	if (++(*count) > MBC_HIWAT) {
+		mbc_release(zone, head, count, MBC_BATCH);
+		stat->mbc_drains++;
+	}
+}
+
+static struct mbuf *
+mbc_getmbuf()
+{
+	register struct mbcache *c = mbc_self();
+	struct mbuf *m;
+
+	if (!mutex_try_lock(&c->mbc_lock)) {
+		c->mbc_stat.mbc_misses++;	/* racy, statistics only */
+		ZGET(mbuf_zone, m, struct mbuf *);
+		return (m);
+	}
+	m = (struct mbuf *)mbc_alloc(mbuf_zone, &c->mbc_mbufs,
+	    &c->mbc_nmbufs, &c->mbc_stat);
+	if (m)
+		c->mbc_stat.mbc_allocs++;
+	mutex_unlock(&c->mbc_lock);
+	return (m);
+}
+
+static void
+mbc_putmbuf(m)
+	struct mbuf *m;
+{
+	register struct mbcache *c = mbc_self();
+
+	if (!mutex_try_lock(&c->mbc_lock)) {
+		c->mbc_stat.mbc_misses++;
+		ZFREE(mbuf_zone, (vm_offset_t)m);
+		return;
+	}
+	c->mbc_stat.mbc_frees++;
+	mbc_free(mbuf_zone, &c->mbc_mbufs, &c->mbc_nmbufs, &c->mbc_stat,
+	    (vm_offset_t)m);
+	mutex_unlock(&c->mbc_lock);
+}
+
+static caddr_t
+mbc_getcluster()
+{
+	register struct mbcache *c = mbc_self();
+	caddr_t cl;
+
+	if (!mutex_try_lock(&c->mbc_lock)) {
+		c->mbc_stat.mbc_misses++;
+		ZALLOC(mcl_zone, cl, caddr_t);
+		return (cl);
+	}
+	cl = (caddr_t)mbc_alloc(mcl_zone, &c->mbc_clusters,
+	    &c->mbc_nclusters, &c->mbc_stat);
+	if (cl)
+		c->mbc_stat.mbc_clallocs++;
+	mutex_unlock(&c->mbc_lock);
+	if (cl == 0)
+		cl = (caddr_t)zalloc(mcl_zone);
+	return (cl);
+}
+
+static void
+mbc_putcluster(cl)
+	caddr_t cl;
+{
+	register struct mbcache *c = mbc_self();
+
+	if (!mutex_try_lock(&c->mbc_lock)) {
+		c->mbc_stat.mbc_misses++;
+		ZFREE(mcl_zone, (vm_offset_t)cl);
+		return;
+	}
+	c->mbc_stat.mbc_clfrees++;
+	mbc_free(mcl_zone, &c->mbc_clusters, &c->mbc_nclusters,
+	    &c->mbc_stat, (vm_offset_t)cl);
+	mutex_unlock(&c->mbc_lock);
+}
+
+/*
+ * Give everything held in the caches back to the zones.
+ */
+void
+mbcache_drain()
+{
+	register struct mbcache *c;
+
+	for (c = mbcache; c < &mbcache[MBC_NCACHE]; c++) {
+		mutex_lock(&c->mbc_lock);
+		if (c->mbc_nmbufs)
+			mbc_release(mbuf_zone, &c->mbc_mbufs,
+			    &c->mbc_nmbufs, c->mbc_nmbufs);
+		if (c->mbc_nclusters)
+			mbc_release(mcl_zone, &c->mbc_clusters,
+			    &c->mbc_nclusters, c->mbc_nclusters);
+		c->mbc_stat.mbc_drains++;
+		mutex_unlock(&c->mbc_lock);
+	}
 }
 
 m_reclaim()
@@ -98,6 +315,8 @@ m_reclaim()
 	register struct protosw *pr;
 	int s = splimp();
 
+	mbcache_drain();
+
 	for (dp = domains; dp; dp = dp->dom_next)
 		for (pr = dp->dom_protosw; pr < dp->dom_protoswNPROTOSW; pr++)
 			if (pr->pr_drain)
@@ -145,7 +364,15 @@ m_get(int nowait, int type)
 {
 	register struct mbuf *m;
 
-	MGET(m, nowait, type);
+	m = mbc_getmbuf();
+	if (m == 0)
+		return (m_get_retry(type));
+	m->m_type = type;
+	XXX_MBUFLOCK(mbstat.m_mtypes[type]++;)
+	m->m_next = (struct mbuf *)NULL;
+	m->m_nextpkt = (struct mbuf *)NULL;
+	m->m_data = m->m_dat;
+	m->m_flags = 0;
 	return (m);
 }
 
@@ -154,7 +381,11 @@ m_gethdr(int nowait, int type)
 {
 	register struct mbuf *m;
 
-	MGETHDR(m, nowait, type);
+	m = m_get(nowait, type);
+	if (m) {
+		m->m_data = m->m_pktdat;
+		m->m_flags = M_PKTHDR;
+	}
 	return (m);
 }
 
@@ -163,32 +394,54 @@ m_getclr(int nowait, int type)
 {
 	register struct mbuf *m;
 
-	MGET(m, nowait, type);
+	m = m_get(nowait, type);
 	if (m == 0)
 		return (0);
 	memset(mtod(m, 0, caddr_t), MLEN);
 	return (m);
 }
 
+/*
+ * Function form of MCLGET, taking the cluster from the caches.
+ */
+void
+m_clget(struct mbuf *m, int how)
+{
+	caddr_t cl;
+
+	cl = mbc_getcluster();
+	if (cl) {
+		m->m_ext.ext_buf = cl;
+		m->m_data = m->m_ext.ext_buf;
+		m->m_flags |= M_EXT;
+		m->m_ext.ext_size = MCLBYTES;
+		m->m_ext.ext_free = mcl_free_routine;
+	}
+}
+
 struct mbuf *
 m_free(struct mbuf *m)
 {
 	register struct mbuf *n;
 
-	MFREE(m, n);
+	if (m->m_flags & M_EXT) {
+		if (m->m_ext.ext_free)
+			(*(m->m_ext.ext_free))(m->m_ext.ext_buf,
+			    m->m_ext.ext_size);
+		else
+			mbc_putcluster(m->m_ext.ext_buf);
+	}
+	n = m->m_next;
+	mbc_putmbuf(m);
 	return (n);
 }
 
 void
 m_freem(struct mbuf *m)
 {
-	register struct mbuf *n;
 
-	if (m == NULL)
-		return;
-	do {
-		MFREE(m, n);
-	} while (m = n);
+	while (m)
+		m = m_free(m);
 }
 
 /*
@@ -205,7 +458,7 @@ m_prepend(struct mbuf *m, int len, int how)
 {
 	struct mbuf *mn;
 
-	MGET(mn, how, m->m_type);
+	mn = m_get(how, m->m_type);
 	if (mn == (struct mbuf *)NULL) {
 		m_freem(m);
 		return ((struct mbuf *)NULL);
@@ -257,7 +510,7 @@ m_copym(struct mbuf *m, int off0, int len, int wait)
 				panic("m_copym");
 			break;
 		}
-		MGET(n, wait, m->m_type);
+		n = m_get(wait, m->m_type);
 		*np = n;
 		if (n == 0)
 			goto nospace;
@@ -274,17 +527,21 @@ m_copym(struct mbuf *m, int off0, int len, int wait)
 			vm_offset_t new_addr, pgoff;
 			kern_return_t kr;
 			mach_msg_type_number_t new_count;
-			vm_offset_t md = (vm_offset_t)m->m_data;
+			vm_offset_t md = (vm_offset_t)m->m_data + off;
 
+			/*
+			 * Read only the pages under the copied bytes, which
+			 * need not be the first pages of a multi-page mbuf.
+			 */
 			pgoff = md - trunc_page(md);
 			kr = vm_read(mach_task_self(),
-				     md - pgoff,
+				     trunc_page(md),
 				     round_page(n->m_len + pgoff),
 				     &new_addr,
 				     &new_count);
 			if (kr)
 			    panic("m_copym");
-			n->m_data = (caddr_t)(new_addr + pgoff + off);
+			n->m_data = (caddr_t)(new_addr + pgoff);
 			n->m_ext.ext_free = mcl_vm_free_routine;
 			n->m_ext.ext_size = new_count;
 			n->m_ext.ext_buf = (caddr_t)new_addr;
@@ -468,7 +725,7 @@ m_pullup(struct mbuf *n, int len)
 	} else {
 		if (len > MHLEN)
 			goto bad;
-		MGET(m, M_DONTWAIT, n->m_type);
+		m = m_get(M_DONTWAIT, n->m_type);
 		if (m == 0)
 			goto bad;
 		m->m_len = 0;
@@ -522,7 +779,7 @@ m_split(m0, len0, wait)
 		return (0);
 	remain = m->m_len - len;
 	if (m0->m_flags & M_PKTHDR) {
-		MGETHDR(n, wait, m0->m_type);
+		n = m_gethdr(wait, m0->m_type);
 		if (n == 0)
 			return (0);
 		n->m_pkthdr.rcvif = m0->m_pkthdr.rcvif;
@@ -546,7 +803,7 @@ m_split(m0, len0, wait)
 		m->m_next = 0;
 		return (n);
 	} else {
-		MGET(n, wait, m->m_type);
+		n = m_get(wait, m->m_type);
 		if (n == 0)
 			return (0);
 		M_ALIGN(n, remain);
@@ -580,7 +837,7 @@ mclgetx(void (*fun)(char *), caddr_t arg, caddr_t addr, int len, int wait)
 {
         register struct mbuf *m;
 
-        MGETHDR(m, wait, MT_DATA);
+        m = m_gethdr(wait, MT_DATA);
         if (m == 0)
                 return (0);
         m->m_data = addr ;
@@ -604,5 +861,5 @@ mcl_vm_free_routine(caddr_t buf, int size)
 void
 mcl_free_routine(caddr_t *buf, int size)
 {
-	MCLFREE(buf);
+	mbc_putcluster((caddr_t)buf);
 }
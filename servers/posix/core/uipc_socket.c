@@ -35,6 +35,7 @@
 
 #include "diagnostic.h"
 
+#include <serv/server_defs.h>
 #include <sys/param.h>
 #include <sys/systm.h>
 #include <sys/proc.h>
@@ -51,6 +52,10 @@
 #include <sys/auth.h>
 #include <sys/audit.h>
 
+#include <vm/vm.h>
+
+extern void m_clget (struct mbuf *, int);
+
 /*
  * Socket operation routines.
  * These routines are called by the routines in
@@ -290,6 +295,61 @@ bad:
 }
 
 #define	SBLOCKWAIT(f)	(((f) & MSG_DONTWAIT) ? M_NOWAIT : M_WAITOK)
+/*
+ * Zero-copy send.  A large page-aligned run of a user write is not
+ * copied: its pages are mapped copy-on-write into the server with
+ * vm_read and hung off an external mbuf, whose ext_free hands them
+ * back with vm_deallocate once the protocol is done with the data.
+ * sosend_zcmin is the smallest run worth the VM operations (a page
+ * multiple); 0 turns the path off.
+ */
+int	sosend_zcmin = 16 * 1024;
+u_long	sosend_zcbytes;			/* bytes sent without copying */
+
+static struct mbuf *
+sosend_zcopy(uio, maxlen, pkthdr)
+	register struct uio *uio;
+	long maxlen;
+	int pkthdr;
+{
+	register struct iovec *iov = uio->uio_iov;
+	proc_invocation_t pk = get_proc_invocation();
+	register struct mbuf *m;
+	vm_offset_t addr;
+	mach_msg_type_number_t count;
+	long len;
+
+	if (sosend_zcmin == 0 || uio->uio_segflg != UIO_USERSPACE ||
+	    pk->k_reply_msg == 0 || uio->uio_iovcnt == 0)
+		return (0);
+	len = trunc_page(min(iov->iov_len, maxlen));
+	if (len < sosend_zcmin ||
+	    trunc_page((vm_offset_t)iov->iov_base) != (vm_offset_t)iov->iov_base)
+		return (0);
+	if (vm_read(uio->uio_procp->p_task, (vm_offset_t)iov->iov_base,
+	    (vm_size_t)len, &addr, &count) != KERN_SUCCESS)
+		return (0);
+	m = mclgetx((void (*)(char *))mcl_vm_free_routine, (caddr_t)addr,
+	    (caddr_t)addr, (int)len, M_WAIT);
+	if (m == 0) {
+		(void) vm_deallocate(mach_task_self(), addr, (vm_size_t)count);
+		return (0);
+	}
+	m->m_ext.ext_size = count;
+	if (pkthdr) {
+		m->m_pkthdr.len = 0;
+		m->m_pkthdr.rcvif = (struct ifnet *)0;
+	} else
+		m->m_flags &= ~M_PKTHDR;
+
+	iov->iov_base += len;
+	iov->iov_len -= len;
+	uio->uio_resid -= len;
+	uio->uio_offset += len;
+	sosend_zcbytes += len;
+	return (m);
+}
+
 /*
  * Send on a socket.
  * If send must go all at once and message is larger than
@@ -382,6 +442,32 @@ restart:
 			goto restart;
 		}
 		splx(s);
+		/*
+		 * A connected AF_UNIX stream copies plain data straight
+		 * into its peer's ring; see unp_ringsend.
+		 */
+		if (so->so_type == SOCK_STREAM &&
+		    so->so_proto->pr_domain->dom_family == AF_UNIX &&
+		    (len = unp_ringsend(so, uio, space,
+		    uio && control == 0 && (flags & MSG_OOB) == 0, &error))) {
+			if (len > 0) {
+				resid = uio->uio_resid;
+				if (error)
+					goto release;
+				continue;
+			}
+			s = splnet();
+			if (error)
+				snderr(error);
+			if (so->so_state & SS_NBIO)
+				snderr(EWOULDBLOCK);
+			sbunlock(&so->so_snd);
+			error = sbwait(&so->so_snd);
+			splx(s);
+			if (error)
+				goto out;
+			goto restart;
+		}
 		mp = &top;
 		space -= clen;
 		do {
@@ -393,17 +479,29 @@ restart:
 			if (flags & MSG_EOR)
 				top->m_flags |= M_EOR;
 		    } else do {
+			/*
+			 * Stream sockets take large aligned runs of
+			 * user memory without copying.
+			 */
+			if (!atomic && space >= sosend_zcmin &&
+			    (m = sosend_zcopy(uio, min(resid, space),
+			    top == 0))) {
+				len = m->m_len;
+				space -= len;
+				error = 0;
+				goto mapped;
+			}
 			if (top == 0) {
-				MGETHDR(m, M_WAIT, MT_DATA);
+				m = m_gethdr(M_WAIT, MT_DATA);
 				mlen = MHLEN;
 				m->m_pkthdr.len = 0;
 				m->m_pkthdr.rcvif = (struct ifnet *)0;
 			} else {
-				MGET(m, M_WAIT, MT_DATA);
+				m = m_get(M_WAIT, MT_DATA);
 				mlen = MLEN;
 			}
 			if (resid >= MINCLSIZE && space >= MCLBYTES) {
-				MCLGET(m, M_WAIT);
+				m_clget(m, M_WAIT);
 				if ((m->m_flags & M_EXT) == 0)
 					goto nopages;
 				mlen = MCLBYTES;
@@ -429,6 +527,7 @@ nopages:
 					MH_ALIGN(m, len);
 			}
 			error = uiomove(mtod(m, caddr_t), (int)len, uio);
+mapped:
 			resid = uio->uio_resid;
 			m->m_len = len;
 			*mp = m;
@@ -541,6 +640,32 @@ restart:
 		return (error);
 	s = splnet();
 
+	/*
+	 * Bytes a connected AF_UNIX stream peer left in our ring are
+	 * counted in sb_cc with no mbufs behind them.  Copy them out
+	 * directly, or turn them into mbufs for a caller that wants
+	 * the chain.
+	 */
+	if (so->so_rcv.sb_mb == 0 && so->so_rcv.sb_cc &&
+	    pr->pr_domain->dom_family == AF_UNIX) {
+		splx(s);
+		if (mp == 0) {
+			error = unp_ringrecv(so, uio, flags);
+			s = splnet();
+			if (error == 0 && uio->uio_resid > 0 &&
+			    (flags & (MSG_WAITALL|MSG_PEEK)) == MSG_WAITALL &&
+			    so->so_error == 0 &&
+			    (so->so_state & SS_CANTRCVMORE) == 0) {
+				sbunlock(&so->so_rcv);
+				splx(s);
+				goto restart;
+			}
+			goto release;
+		}
+		unp_ringflush(so);
+		s = splnet();
+	}
+
 	m = so->so_rcv.sb_mb;
 	/*
 	 * If we have less data than requested, block awaiting more
@@ -755,6 +880,12 @@ dontblock:
 				splx(s);
 				return (0);
 			}
+			if (so->so_rcv.sb_mb == 0 && so->so_rcv.sb_cc &&
+			    pr->pr_domain->dom_family == AF_UNIX) {
+				splx(s);
+				unp_ringflush(so);
+				s = splnet();
+			}
 			if (m = so->so_rcv.sb_mb)
 				nextrecord = m->m_nextpkt;
 		}
@@ -814,6 +945,8 @@ sorflush(so)
 	sb->sb_flags |= SB_NOINTR;
 	(void) sblock(sb, M_WAITOK);
 	s = splimp();
+	if (pr->pr_domain->dom_family == AF_UNIX)
+		unp_ringdrain(so);
 	socantrcvmore(so);
 	sbunlock(sb);
 	asb = *sb;
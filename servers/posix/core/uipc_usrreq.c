@@ -48,6 +48,7 @@
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/mbuf.h>
+#include <sys/malloc.h>
 
 /*
  * Unix communications domain.
@@ -60,6 +61,8 @@
 struct	sockaddr sun_noname = { sizeof(sun_noname), AF_UNIX };
 ino_t	unp_ino;			/* prototype for fake inode numbers */
 
+static void unp_ringalloc(), unp_ringfree();
+
 /*ARGSUSED*/
 uipc_usrreq(so, req, m, nam, control)
 	struct socket *so;
@@ -357,6 +360,7 @@ unp_detach(unp)
 	while (unp->unp_refs)
 		unp_drop(unp->unp_refs, ECONNRESET);
 	soisdisconnected(unp->unp_socket);
+	unp_ringfree(unp->unp_socket);
 	unp->unp_socket->so_pcb = 0;
 	m_freem(unp->unp_addr);
 	(void) m_free(dtom(unp));
@@ -496,6 +500,8 @@ unp_connect2(so, so2)
 
 	case SOCK_STREAM:
 		unp2->unp_conn = unp;
+		unp_ringalloc(so, so2);
+		unp_ringalloc(so2, so);
 		soisconnected(so);
 		soisconnected(so2);
 		break;
@@ -542,6 +548,301 @@ unp_disconnect(unp)
 	}
 }
 
+/*
+ * Connected stream sockets carry plain data in a ring owned by the
+ * receiving socket instead of in mbuf chains: the sender copies from
+ * its uio straight into the ring and the receiver copies straight out.
+ * Ring bytes are counted in the receiver's sb_cc, so select, FIONREAD
+ * and the send-side backpressure of PRU_SEND and PRU_RCVD see them as
+ * usual.  The ring is only written while the receive sockbuf holds no
+ * mbufs; anything that must take the mbuf path (rights, a full ring)
+ * waits for the ring to drain first, so the byte order is kept.
+ * The sender copies without splnet and may sleep in uiomove while the
+ * peer is closed; it holds the ring busy meanwhile, and a ring freed
+ * while busy is only unhashed, to be freed by the sender when done.
+ */
+struct unp_ring {
+	struct	unp_ring *ur_next;	/* hash chain */
+	struct	socket *ur_so;		/* receiving socket, 0 once freed */
+	caddr_t	ur_buf;
+	u_int	ur_size;		/* power of 2 */
+	u_int	ur_head;		/* next byte to read */
+	u_int	ur_tail;		/* next byte to write */
+	int	ur_busy;		/* senders copying into ur_buf */
+};
+
+#define	UNP_RINGMAX	(64 * 1024)
+#define	UNP_RINGHASHSIZE 64
+#define	UNP_RINGHASH(so) \
+	(((u_long)(so) >> 6) & (UNP_RINGHASHSIZE - 1))
+
+struct	unp_ring *unp_ringhash[UNP_RINGHASHSIZE];
+int	unp_doring = 1;
+
+static struct unp_ring *
+unp_ringfind(so)
+	struct socket *so;
+{
+	register struct unp_ring *ur;
+
+	for (ur = unp_ringhash[UNP_RINGHASH(so)]; ur; ur = ur->ur_next)
+		if (ur->ur_so == so)
+			return (ur);
+	return (0);
+}
+
+/*
+ * Give so a ring large enough for everything its peer may have
+ * outstanding.  Without memory the connection just uses mbufs.
+ */
+static void
+unp_ringalloc(so, so2)
+	struct socket *so, *so2;
+{
+	register struct unp_ring *ur;
+	u_int size;
+
+	if (unp_doring == 0 || unp_ringfind(so))
+		return;
+	for (size = 1024; size < so2->so_snd.sb_hiwat && size < UNP_RINGMAX;
+	    size <<= 1)
+		;
+	ur = malloc(sizeof (*ur), M_PCB, M_NOWAIT);
+	if (ur == 0)
+		return;
+	ur->ur_buf = malloc(size, M_PCB, M_NOWAIT);
+	if (ur->ur_buf == 0) {
+		free(ur, M_PCB);
+		return;
+	}
+	ur->ur_so = so;
+	ur->ur_size = size;
+	ur->ur_head = ur->ur_tail = 0;
+	ur->ur_busy = 0;
+	ur->ur_next = unp_ringhash[UNP_RINGHASH(so)];
+	unp_ringhash[UNP_RINGHASH(so)] = ur;
+}
+
+/*
+ * Throw away whatever the ring of so holds.  Called before the
+ * receive sockbuf is flushed, which only knows about mbufs.
+ */
+void
+unp_ringdrain(so)
+	struct socket *so;
+{
+	register struct unp_ring *ur;
+
+	if ((ur = unp_ringfind(so)) == 0)
+		return;
+	so->so_rcv.sb_cc -= ur->ur_tail - ur->ur_head;
+	ur->ur_head = ur->ur_tail;
+}
+
+static void
+unp_ringfree(so)
+	struct socket *so;
+{
+	register struct unp_ring **urp, *ur;
+
+	for (urp = &unp_ringhash[UNP_RINGHASH(so)]; ur = *urp;
+	    urp = &ur->ur_next)
+		if (ur->ur_so == so)
+			break;
+	if (ur == 0)
+		return;
+	*urp = ur->ur_next;
+	so->so_rcv.sb_cc -= ur->ur_tail - ur->ur_head;
+	if (ur->ur_busy) {
+		ur->ur_so = 0;		/* the sender frees it */
+		return;
+	}
+	free(ur->ur_buf, M_PCB);
+	free(ur, M_PCB);
+}
+
+/*
+ * Called by sosend for a connected stream.  If data is set, copy as
+ * much of uio as space and the peer's ring allow and return the count.
+ * Return 0 if the send should take the mbuf path, and -1 if it has to
+ * wait for the ring to drain first.
+ */
+int
+unp_ringsend(so, uio, space, data, errorp)
+	struct socket *so;
+	struct uio *uio;
+	long space;
+	int data;
+	int *errorp;
+{
+	struct unpcb *unp = sotounpcb(so);
+	register struct unp_ring *ur;
+	register struct sockbuf *rcv;
+	struct socket *so2;
+	u_int cnt, n, off, chunk;
+	int resid, s;
+
+	*errorp = 0;
+	if (unp == 0 || unp->unp_conn == 0)
+		return (0);
+	so2 = unp->unp_conn->unp_socket;
+	if ((ur = unp_ringfind(so2)) == 0)
+		return (0);
+	rcv = &so2->so_rcv;
+	cnt = ur->ur_tail - ur->ur_head;
+	if (data == 0 || uio->uio_resid == 0 || rcv->sb_mb ||
+	    (so2->so_state & SS_CANTRCVMORE))
+		return (cnt ? -1 : 0);
+	n = min(uio->uio_resid, space);
+	if (n > ur->ur_size - cnt)
+		n = ur->ur_size - cnt;
+	if (n == 0)
+		return (-1);
+
+	resid = uio->uio_resid;
+	off = ur->ur_tail;
+	ur->ur_busy++;
+	while (n > 0) {
+		chunk = ur->ur_size - (off & (ur->ur_size - 1));
+		if (chunk > n)
+			chunk = n;
+		*errorp = uiomove(ur->ur_buf + (off & (ur->ur_size - 1)),
+		    (int)chunk, uio);
+		if (*errorp)
+			break;
+		off += chunk;
+		n -= chunk;
+	}
+	n = resid - uio->uio_resid;
+
+	/*
+	 * The peer may have gone away while we copied.
+	 */
+	s = splnet();
+	if (--ur->ur_busy == 0 && ur->ur_so == 0) {
+		free(ur->ur_buf, M_PCB);
+		free(ur, M_PCB);
+		ur = 0;
+	}
+	if (ur == 0 || unp->unp_conn == 0 || ur->ur_so != so2) {
+		splx(s);
+		if (*errorp == 0)
+			*errorp = EPIPE;
+		return (n ? n : -1);
+	}
+	ur->ur_tail += n;
+	rcv->sb_cc += n;
+	so->so_snd.sb_hiwat -= rcv->sb_cc - unp->unp_conn->unp_cc;
+	unp->unp_conn->unp_cc = rcv->sb_cc;
+	if (rcv->sb_flags & SB_NOTIFY)
+		sorwakeup(so2);
+	splx(s);
+	return (n);
+}
+
+/*
+ * Called by soreceive, with the receive sockbuf locked, when so has
+ * ring bytes and no mbufs.  Copy them out and return the space to the
+ * sender as PRU_RCVD would.
+ */
+int
+unp_ringrecv(so, uio, flags)
+	struct socket *so;
+	struct uio *uio;
+	int flags;
+{
+	struct unpcb *unp = sotounpcb(so);
+	register struct unp_ring *ur;
+	register struct sockbuf *snd;
+	struct socket *so2;
+	u_int n, off, chunk;
+	int resid, error = 0, s;
+
+	if ((ur = unp_ringfind(so)) == 0)
+		return (0);
+	n = min(ur->ur_tail - ur->ur_head, uio->uio_resid);
+	resid = uio->uio_resid;
+	off = ur->ur_head;
+	while (n > 0) {
+		chunk = ur->ur_size - (off & (ur->ur_size - 1));
+		if (chunk > n)
+			chunk = n;
+		error = uiomove(ur->ur_buf + (off & (ur->ur_size - 1)),
+		    (int)chunk, uio);
+		if (error)
+			break;
+		off += chunk;
+		n -= chunk;
+	}
+	if (flags & MSG_PEEK)
+		return (error);
+	if (uio->uio_procp)
+		uio->uio_procp->p_stats->p_ru.ru_msgrcv++;
+
+	n = resid - uio->uio_resid;
+	s = splnet();
+	ur->ur_head += n;
+	so->so_rcv.sb_cc -= n;
+	if (unp && unp->unp_conn) {
+		so2 = unp->unp_conn->unp_socket;
+		snd = &so2->so_snd;
+		snd->sb_hiwat += unp->unp_cc - so->so_rcv.sb_cc;
+		unp->unp_cc = so->so_rcv.sb_cc;
+		if (snd->sb_flags & SB_NOTIFY)
+			sowwakeup(so2);
+	}
+	splx(s);
+	return (error);
+}
+
+/*
+ * Move the ring contents of so into an mbuf chain on its receive
+ * sockbuf, for readers that want mbufs.  The receive sockbuf must
+ * be locked.
+ */
+void
+unp_ringflush(so)
+	struct socket *so;
+{
+	register struct unp_ring *ur;
+	register struct mbuf *m;
+	struct mbuf *top, **mp;
+	u_int cnt, off, len;
+	int s;
+
+	if ((ur = unp_ringfind(so)) == 0 ||
+	    (cnt = ur->ur_tail - ur->ur_head) == 0)
+		return;
+	top = 0;
+	mp = &top;
+	off = ur->ur_head;
+	while (cnt > 0) {
+		m = m_get(M_WAIT, MT_DATA);
+		len = MLEN;
+		if (cnt >= MINCLSIZE) {
+			m_clget(m, M_WAIT);
+			if (m->m_flags & M_EXT)
+				len = MCLBYTES;
+		}
+		if (len > cnt)
+			len = cnt;
+		if (len > ur->ur_size - (off & (ur->ur_size - 1)))
+			len = ur->ur_size - (off & (ur->ur_size - 1));
+		memcpy(mtod(m, caddr_t), ur->ur_buf + (off & (ur->ur_size - 1)),
+		    len);
+		m->m_len = len;
+		*mp = m;
+		mp = &m->m_next;
+		off += len;
+		cnt -= len;
+	}
+	s = splnet();
+	so->so_rcv.sb_cc -= off - ur->ur_head;
+	ur->ur_head = off;
+	sbappend(&so->so_rcv, top);
+	splx(s);
+}
+
 #ifdef notdef
 unp_abort(unp)
 	struct unpcb *unp;
@@ -50,6 +50,7 @@
 #include "ext2fs.h"
 #include "minixfs.h"
 #include "msdosfs.h"
+#include "tmpfs.h"
 
 #include <sys/param.h>
 #include <sys/mount.h>
@@ -178,6 +179,13 @@ extern	struct vfsops minixfs_vfsops;
 #define	MINIXFS_VFSOPS	NULL
 #endif
 
+#if TMPFS
+extern	struct vfsops tmpfs_vfsops;
+#define	TMPFS_VFSOPS	&tmpfs_vfsops
+#else
+#define	TMPFS_VFSOPS	NULL
+#endif
+
 #if MSDOSFS
 extern	struct vfsops msdosfs_vfsops;
 #define	PC_VFSOPS	&msdosfs_vfsops
@@ -204,9 +212,17 @@ struct vfsops *vfssw[] = {
 	UNION_VFSOPS,		/* 15 = MOUNT_UNION */
 	EXT2FS_VFSOPS,		/* 16 = MOUNT_EXT2FS */
 	MINIXFS_VFSOPS,		/* 17 = MOUNT_MINIXFS */
+	TMPFS_VFSOPS,		/* 18 = MOUNT_TMPFS */
 	0
 };
 
+/*
+ * Number of usable slots in vfssw[].  The <sys/mount.h> we build against
+ * stops MOUNT_MAXTYPE at MOUNT_MINIXFS, so mount(2) and vfs_init() size
+ * the table from here rather than from that header.
+ */
+int	nvfssw = sizeof(vfssw) / sizeof(vfssw[0]) - 1;
+
 
 /*
  *
@@ -244,6 +260,7 @@ extern struct vnodeopv_desc ext2fs_fifoop_opv_desc;
 extern struct vnodeopv_desc minixfs_vnodeop_opv_desc;
 extern struct vnodeopv_desc minixfs_specop_opv_desc;
 extern struct vnodeopv_desc minixfs_fifoop_opv_desc;
+extern struct vnodeopv_desc tmpfs_vnodeop_opv_desc;
 extern struct vnodeopv_desc msdosfs_vnodeop_opv_desc;
 
 struct vnodeopv_desc *vfs_opv_descs[] = {
@@ -316,6 +333,9 @@ struct vnodeopv_desc *vfs_opv_descs[] = {
 	&minixfs_fifoop_opv_desc,
 #endif
 #endif
+#if TMPFS
+	&tmpfs_vnodeop_opv_desc,
+#endif
 #if MSDOSFS
 	&msdosfs_vnodeop_opv_desc,
 #endif
@@ -212,6 +212,7 @@ vfs_op_init()
 extern struct vnodeops dead_vnodeops;
 extern struct vnodeops spec_vnodeops;
 extern void vclean();
+extern int nvfssw;
 struct vattr va_null;
 
 /*
@@ -238,7 +239,7 @@ vfsinit()
 	 * Initialize each file system type.
 	 */
 	vattr_null(&va_null);
-	for (vfsp = &vfssw[0]; vfsp <= &vfssw[MOUNT_MAXTYPE]; vfsp++) {
+	for (vfsp = &vfssw[0]; vfsp < &vfssw[nvfssw]; vfsp++) {
 		if (*vfsp == NULL)
 			continue;
 		(*(*vfsp)->vfs_init)();
@@ -85,6 +85,7 @@ mount(p, uap, retval)
 	register struct mount *mp;
 	int error, flag = 0;
 	struct nameidata nd;
+	extern int nvfssw;
 
 	/*
 	 * Must be super user
@@ -125,7 +126,7 @@ mount(p, uap, retval)
 		vput(vp);
 		return (ENOTDIR);
 	}
-	if ((u_long)uap->type > MOUNT_MAXTYPE || vfssw[uap->type] == NULL) {
+	if ((u_long)uap->type >= nvfssw || vfssw[uap->type] == NULL) {
 		vput(vp);
 		return (ENODEV);
 	}
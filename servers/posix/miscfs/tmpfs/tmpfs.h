@@ -0,0 +1,194 @@
+/*
+ *	File:	miscfs/tmpfs/tmpfs.h
+ *
+ *	Memory file system kept directly in the server's address space.
+ *	Nodes and directories are plain in-core structures and the data
+ *	of each regular file is a region of anonymous memory of its own,
+ *	so nothing goes through bmap, the buffer cache or a block device.
+ */
+
+#ifndef _MISCFS_TMPFS_TMPFS_H_
+#define	_MISCFS_TMPFS_TMPFS_H_
+
+#ifndef MOUNT_TMPFS
+#define	MOUNT_TMPFS	18		/* vfssw[] slot, see vfs_conf.c */
+#endif
+
+/*
+ * Arguments to mount tmpfs.
+ */
+struct tmpfs_args {
+	u_long	ta_size;		/* bytes of file data, 0 for no limit */
+	u_long	ta_nodes;		/* files, 0 for no limit */
+	uid_t	ta_uid;			/* owner of the root directory */
+	gid_t	ta_gid;
+	mode_t	ta_mode;		/* its permissions */
+};
+
+#ifdef KERNEL
+#include <sys/queue.h>
+
+/*
+ * A name in a directory.  All the names of a file system are hashed
+ * together on (directory, name); td_seq orders the entries of one
+ * directory for readdir and is never reused within it.
+ */
+struct tmpfs_dirent {
+	LIST_ENTRY(tmpfs_dirent) td_hash;	/* tm_dirhashtbl chain */
+	TAILQ_ENTRY(tmpfs_dirent) td_entries;	/* tn_dirlist, by td_seq */
+	struct	tmpfs_node *td_dir;	/* directory holding the name */
+	struct	tmpfs_node *td_node;	/* file named */
+	u_long	td_hashval;
+	u_long	td_seq;			/* readdir cookie */
+	u_short	td_namelen;
+	char	*td_name;
+};
+
+TAILQ_HEAD(tmpfs_dirlist, tmpfs_dirent);
+
+/*
+ * The in-core, and only, inode of a file.
+ */
+struct tmpfs_node {
+	LIST_ENTRY(tmpfs_node) tn_entries;	/* tm_nodes */
+	struct	tmpfs_mount *tn_mount;
+	struct	vnode *tn_vnode;	/* NULL while it has none */
+	enum	vtype tn_type;
+	ino_t	tn_ino;
+	long	tn_gen;
+	mode_t	tn_mode;		/* permissions, ALLPERMS */
+	short	tn_nlink;
+	uid_t	tn_uid;
+	gid_t	tn_gid;
+	u_long	tn_flags;		/* chflags(2) flags */
+	int	tn_status;		/* TN_* below */
+	off_t	tn_size;
+	struct	timespec tn_atime;
+	struct	timespec tn_mtime;
+	struct	timespec tn_ctime;
+	u_long	tn_modrev;
+	union {
+		struct {
+			struct	tmpfs_dirlist tu_list;
+			struct	tmpfs_node *tu_parent;
+			u_long	tu_nextseq;
+			u_long	tu_rdseq;	/* readdir position, 0 if none */
+			struct	tmpfs_dirent *tu_rdde;	/* first at tu_rdseq */
+		} tu_dir;
+		struct {
+			vm_address_t tu_va;	/* data, 0 if none */
+			vm_size_t tu_vsize;	/* bytes mapped at tu_va */
+		} tu_reg;
+		char	*tu_link;		/* symbolic link target */
+	} tn_u;
+};
+
+#define	tn_dirlist	tn_u.tu_dir.tu_list
+#define	tn_parent	tn_u.tu_dir.tu_parent
+#define	tn_nextseq	tn_u.tu_dir.tu_nextseq
+#define	tn_rdseq	tn_u.tu_dir.tu_rdseq
+#define	tn_rdde		tn_u.tu_dir.tu_rdde
+#define	tn_va		tn_u.tu_reg.tu_va
+#define	tn_vsize	tn_u.tu_reg.tu_vsize
+#define	tn_link		tn_u.tu_link
+
+/* tn_status */
+#define	TN_LOCKED	0x0001		/* node lock held */
+#define	TN_WANTED	0x0002		/* someone waits for TN_LOCKED */
+#define	TN_ALLOC	0x0004		/* vnode being allocated */
+#define	TN_WANTALLOC	0x0008		/* someone waits for TN_ALLOC */
+#define	TN_ACCESS	0x0010		/* access time to update */
+#define	TN_CHANGE	0x0020		/* change time to update */
+#define	TN_UPDATE	0x0040		/* modification time to update */
+
+/* First cookie of a directory entry; 0 and 1 are "." and "..". */
+#define	TMPFS_DIRSEQ	2
+
+/*
+ * Size of the struct dirent readdir returns for a name, which is also
+ * what a name adds to the size of its directory.  Users must include
+ * <sys/dirent.h>.
+ */
+#define	TMPFS_DIRSIZ(len) \
+	((sizeof (struct dirent) - (MAXNAMLEN + 1)) + (((len) + 1 + 3) &~ 3))
+
+struct tmpfs_mount {
+	struct	mount *tm_mount;
+	struct	tmpfs_node *tm_root;
+	LIST_HEAD(, tmpfs_node) tm_nodes;	/* every node, linked or not */
+	LIST_HEAD(tmpfs_dhead, tmpfs_dirent) *tm_dirhashtbl;
+	u_long	tm_dirhash;		/* hash mask */
+	ino_t	tm_nextino;
+	long	tm_gen;
+	u_long	tm_nodes_cnt;
+	u_long	tm_nodes_max;
+	u_long	tm_pages;		/* pages of file data in use */
+	u_long	tm_pages_max;
+};
+
+/* tm_nodes_max and tm_pages_max of a mount without limits */
+#define	TMPFS_NOLIMIT	((u_long)0x7fffffff)
+
+/* Nodes, and names, of all mounts together */
+#define	TMPFS_ZONEMAX	1000000
+
+#define	VFSTOTMPFS(mp)	((struct tmpfs_mount *)((mp)->mnt_data))
+#define	VTOTN(vp)	((struct tmpfs_node *)(vp)->v_data)
+#define	TNTOV(tn)	((tn)->tn_vnode)
+
+/*
+ * Vnodes carry the MFS tag: tmpfs is a memory file system too and
+ * nothing looks at the tag of a vnode that is not a device.
+ */
+#define	VT_TMPFS	VT_MFS
+
+#define	TN_TIMES(tn) {							\
+	if ((tn)->tn_status & (TN_ACCESS | TN_CHANGE | TN_UPDATE)) {	\
+		struct timeval _tv;					\
+		get_time(&_tv);						\
+		if ((tn)->tn_status & TN_ACCESS) {			\
+			(tn)->tn_atime.ts_sec = _tv.tv_sec;		\
+			(tn)->tn_atime.ts_nsec = _tv.tv_usec * 1000;	\
+		}							\
+		if ((tn)->tn_status & TN_UPDATE) {			\
+			(tn)->tn_mtime.ts_sec = _tv.tv_sec;		\
+			(tn)->tn_mtime.ts_nsec = _tv.tv_usec * 1000;	\
+			(tn)->tn_modrev++;				\
+		}							\
+		if ((tn)->tn_status & TN_CHANGE) {			\
+			(tn)->tn_ctime.ts_sec = _tv.tv_sec;		\
+			(tn)->tn_ctime.ts_nsec = _tv.tv_usec * 1000;	\
+		}							\
+		(tn)->tn_status &= ~(TN_ACCESS | TN_CHANGE | TN_UPDATE); \
+	}								\
+}
+
+struct mount;
+struct vnode;
+
+extern int (**tmpfs_vnodeop_p)();
+extern struct vfsops tmpfs_vfsops;
+extern zone_t tmpfs_node_zone;
+extern zone_t tmpfs_dirent_zone;
+
+__BEGIN_DECLS
+int	 tmpfs_alloc_node (struct tmpfs_mount *, enum vtype, mode_t,
+		uid_t, gid_t, struct tmpfs_node *, struct tmpfs_node **);
+void	 tmpfs_free_node (struct tmpfs_node *);
+int	 tmpfs_allocvp (struct mount *, struct tmpfs_node *,
+		struct vnode **);
+struct tmpfs_dirent *
+	 tmpfs_alloc_dirent (char *, int);
+void	 tmpfs_free_dirent (struct tmpfs_dirent *);
+void	 tmpfs_dir_attach
+	    (struct tmpfs_node *, struct tmpfs_dirent *, struct tmpfs_node *);
+void	 tmpfs_dir_remove (struct tmpfs_node *, struct tmpfs_dirent *);
+struct tmpfs_dirent *
+	 tmpfs_dir_lookup (struct tmpfs_node *, char *, int);
+struct tmpfs_dirent *
+	 tmpfs_dir_seek (struct tmpfs_node *, u_long);
+int	 tmpfs_reg_resize (struct tmpfs_node *, off_t);
+__END_DECLS
+#endif /* KERNEL */
+
+#endif /* !_MISCFS_TMPFS_TMPFS_H_ */
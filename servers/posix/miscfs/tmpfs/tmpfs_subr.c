@@ -0,0 +1,374 @@
+/*
+ *	File:	miscfs/tmpfs/tmpfs_subr.c
+ *
+ *	Nodes, directory entries and file data of tmpfs.
+ *
+ *	Changes to a directory never sleep once the entry to add has
+ *	been allocated, and readdir keeps its place in tn_rdseq and
+ *	tn_rdde, which tmpfs_dir_remove keeps valid.  A directory can
+ *	thus be changed by rename without holding its vnode lock.
+ *
+ *	The data of a regular file is one region of anonymous memory,
+ *	grown in place when the address space allows and moved with
+ *	vm_copy otherwise.  Bytes from tn_size to tn_vsize are always
+ *	zero, so growing a file never has to clear anything.
+ */
+
+#include <serv/server_defs.h>
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/time.h>
+#include <sys/proc.h>
+#include <sys/vnode.h>
+#include <sys/mount.h>
+#include <sys/malloc.h>
+#include <sys/dirent.h>
+
+#include <miscfs/tmpfs/tmpfs.h>
+
+zone_t	tmpfs_node_zone;
+zone_t	tmpfs_dirent_zone;
+
+/* Largest step by which a file's region grows past its size. */
+#define	TMPFS_MAXGROW	(1024 * 1024)
+
+#define	TMPFS_DIRHASH(tm, h)	(&(tm)->tm_dirhashtbl[(h) & (tm)->tm_dirhash])
+
+/*
+ * Allocate a node of the given type.  A new directory is empty; its
+ * parent is dnode, or itself for the root.
+ */
+int
+tmpfs_alloc_node(tm, type, mode, uid, gid, dnode, tnp)
+	struct tmpfs_mount *tm;
+	enum vtype type;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	struct tmpfs_node *dnode;
+	struct tmpfs_node **tnp;
+{
+	register struct tmpfs_node *tn;
+	struct timeval tv;
+
+	*tnp = NULL;
+	if (tm->tm_nodes_cnt >= tm->tm_nodes_max)
+		return (ENOSPC);
+	if ((tn = (struct tmpfs_node *)zalloc(tmpfs_node_zone)) == NULL)
+		return (ENOSPC);
+	memset((char *)tn, 0, sizeof (*tn));
+	tn->tn_mount = tm;
+	tn->tn_type = type;
+	tn->tn_ino = tm->tm_nextino++;
+	tn->tn_gen = ++tm->tm_gen;
+	tn->tn_mode = mode & ALLPERMS;
+	tn->tn_uid = uid;
+	tn->tn_gid = gid;
+	get_time(&tv);
+	tn->tn_atime.ts_sec = tv.tv_sec;
+	tn->tn_atime.ts_nsec = tv.tv_usec * 1000;
+	tn->tn_mtime = tn->tn_ctime = tn->tn_atime;
+	if (type == VDIR) {
+		TAILQ_INIT(&tn->tn_dirlist);
+		tn->tn_parent = dnode != NULL ? dnode : tn;
+		tn->tn_nextseq = TMPFS_DIRSEQ;
+		tn->tn_size = TMPFS_DIRSIZ(1) + TMPFS_DIRSIZ(2);
+		tn->tn_nlink = 2;
+	} else
+		tn->tn_nlink = 1;
+	LIST_INSERT_HEAD(&tm->tm_nodes, tn, tn_entries);
+	tm->tm_nodes_cnt++;
+	*tnp = tn;
+	return (0);
+}
+
+/*
+ * Free a node that is no longer named and has no vnode.  A directory
+ * must have no entries left.
+ */
+void
+tmpfs_free_node(tn)
+	register struct tmpfs_node *tn;
+{
+	struct tmpfs_mount *tm = tn->tn_mount;
+
+	switch (tn->tn_type) {
+	case VREG:
+		if (tn->tn_vsize)
+			(void) vm_deallocate(mach_task_self(), tn->tn_va,
+			    tn->tn_vsize);
+		tm->tm_pages -= atop(round_page(tn->tn_size));
+		break;
+	case VLNK:
+		if (tn->tn_link)
+			free(tn->tn_link, M_TEMP);
+		break;
+	}
+	LIST_REMOVE(tn, tn_entries);
+	tm->tm_nodes_cnt--;
+	zfree(tmpfs_node_zone, (vm_offset_t)tn);
+}
+
+/*
+ * Return a locked vnode for the node, making one if it has none.
+ */
+int
+tmpfs_allocvp(mp, tn, vpp)
+	struct mount *mp;
+	register struct tmpfs_node *tn;
+	struct vnode **vpp;
+{
+	struct vnode *vp;
+	int error;
+
+loop:
+	if ((vp = tn->tn_vnode) != NULL) {
+		if (vget(vp, 1))
+			goto loop;
+		*vpp = vp;
+		return (0);
+	}
+	/*
+	 * getnewvnode can block; keep others from making a second
+	 * vnode for the node meanwhile.
+	 */
+	if (tn->tn_status & TN_ALLOC) {
+		tn->tn_status |= TN_WANTALLOC;
+		sleep((caddr_t)tn, PINOD);
+		goto loop;
+	}
+	tn->tn_status |= TN_ALLOC;
+	if ((error = getnewvnode(VT_TMPFS, mp, tmpfs_vnodeop_p, &vp)) == 0) {
+		insmntque(vp, mp);
+		vp->v_data = tn;
+		vp->v_type = tn->tn_type;
+		if (tn == tn->tn_mount->tm_root)
+			vp->v_flag |= VROOT;
+		tn->tn_vnode = vp;
+		VOP_LOCK(vp);
+		*vpp = vp;
+	}
+	tn->tn_status &= ~TN_ALLOC;
+	if (tn->tn_status & TN_WANTALLOC) {
+		tn->tn_status &= ~TN_WANTALLOC;
+		wakeup((caddr_t)tn);
+	}
+	return (error);
+}
+
+static u_long
+tmpfs_dirhash(dnode, name, len)
+	struct tmpfs_node *dnode;
+	register char *name;
+	register int len;
+{
+	register u_long h;
+
+	h = (u_long)dnode / sizeof (struct tmpfs_node);
+	while (len-- > 0)
+		h = h * 33 + (u_char)*name++;
+	return (h);
+}
+
+/*
+ * Allocate an entry for a name, to be attached to a directory later.
+ * This is where changing a directory may sleep.  Returns NULL when
+ * the dirent zone is exhausted.
+ */
+struct tmpfs_dirent *
+tmpfs_alloc_dirent(name, len)
+	char *name;
+	int len;
+{
+	register struct tmpfs_dirent *de;
+
+	if ((de = (struct tmpfs_dirent *)zalloc(tmpfs_dirent_zone)) == NULL)
+		return (NULL);
+	de->td_name = malloc((u_long)len, M_TEMP, M_WAITOK);
+	memcpy(de->td_name, name, len);
+	de->td_namelen = len;
+	de->td_dir = de->td_node = NULL;
+	return (de);
+}
+
+void
+tmpfs_free_dirent(de)
+	struct tmpfs_dirent *de;
+{
+
+	free(de->td_name, M_TEMP);
+	zfree(tmpfs_dirent_zone, (vm_offset_t)de);
+}
+
+/*
+ * Enter de, naming tn, at the end of directory dnode.  The caller
+ * adjusts the link counts.
+ */
+void
+tmpfs_dir_attach(dnode, de, tn)
+	register struct tmpfs_node *dnode;
+	register struct tmpfs_dirent *de;
+	struct tmpfs_node *tn;
+{
+	struct tmpfs_mount *tm = dnode->tn_mount;
+
+	de->td_dir = dnode;
+	de->td_node = tn;
+	de->td_seq = dnode->tn_nextseq++;
+	de->td_hashval = tmpfs_dirhash(dnode, de->td_name, de->td_namelen);
+	LIST_INSERT_HEAD(TMPFS_DIRHASH(tm, de->td_hashval), de, td_hash);
+	TAILQ_INSERT_TAIL(&dnode->tn_dirlist, de, td_entries);
+	/* A readdir that had reached the end now has one more to see. */
+	if (dnode->tn_rdseq != 0 && dnode->tn_rdde == NULL &&
+	    de->td_seq >= dnode->tn_rdseq)
+		dnode->tn_rdde = de;
+	dnode->tn_size += TMPFS_DIRSIZ(de->td_namelen);
+	dnode->tn_status |= TN_CHANGE | TN_UPDATE;
+}
+
+/*
+ * Remove de from directory dnode and free it.  The caller adjusts
+ * the link counts.
+ */
+void
+tmpfs_dir_remove(dnode, de)
+	register struct tmpfs_node *dnode;
+	register struct tmpfs_dirent *de;
+{
+
+	if (dnode->tn_rdde == de)
+		dnode->tn_rdde = de->td_entries.tqe_next;
+	LIST_REMOVE(de, td_hash);
+	TAILQ_REMOVE(&dnode->tn_dirlist, de, td_entries);
+	dnode->tn_size -= TMPFS_DIRSIZ(de->td_namelen);
+	dnode->tn_status |= TN_CHANGE | TN_UPDATE;
+	tmpfs_free_dirent(de);
+}
+
+/*
+ * Find a name in a directory.  "." and ".." have no entries.
+ */
+struct tmpfs_dirent *
+tmpfs_dir_lookup(dnode, name, len)
+	struct tmpfs_node *dnode;
+	char *name;
+	int len;
+{
+	register struct tmpfs_dirent *de;
+	u_long h;
+
+	h = tmpfs_dirhash(dnode, name, len);
+	for (de = TMPFS_DIRHASH(dnode->tn_mount, h)->lh_first; de;
+	    de = de->td_hash.le_next)
+		if (de->td_hashval == h && de->td_dir == dnode &&
+		    de->td_namelen == len &&
+		    memcmp(de->td_name, name, len) == 0)
+			return (de);
+	return (NULL);
+}
+
+/*
+ * Return the first entry of dnode with a cookie of at least seq, NULL
+ * at the end.  Sequential readdir finds it at the remembered position.
+ */
+struct tmpfs_dirent *
+tmpfs_dir_seek(dnode, seq)
+	register struct tmpfs_node *dnode;
+	u_long seq;
+{
+	register struct tmpfs_dirent *de;
+
+	if (dnode->tn_rdseq != 0 && dnode->tn_rdseq == seq)
+		return (dnode->tn_rdde);
+	for (de = dnode->tn_dirlist.tqh_first; de; de = de->td_entries.tqe_next)
+		if (de->td_seq >= seq)
+			break;
+	return (de);
+}
+
+/*
+ * Make room for a file's data up to vsize bytes.
+ */
+static int
+tmpfs_reg_grow(tn, vsize)
+	register struct tmpfs_node *tn;
+	vm_size_t vsize;
+{
+	vm_address_t va;
+	vm_size_t want;
+
+	want = tn->tn_vsize + MIN(tn->tn_vsize, TMPFS_MAXGROW);
+	want = round_page(MAX(want, vsize));
+	if (tn->tn_vsize == 0) {
+		if (vm_allocate(mach_task_self(), &va, want, TRUE)
+		    != KERN_SUCCESS)
+			return (ENOSPC);
+		tn->tn_va = va;
+		tn->tn_vsize = want;
+		return (0);
+	}
+	va = tn->tn_va + tn->tn_vsize;
+	if (vm_allocate(mach_task_self(), &va, want - tn->tn_vsize, FALSE)
+	    == KERN_SUCCESS) {
+		tn->tn_vsize = want;
+		return (0);
+	}
+	/*
+	 * Something is mapped right after the data: move it to a new
+	 * region, by reference.
+	 */
+	if (vm_allocate(mach_task_self(), &va, want, TRUE) != KERN_SUCCESS)
+		return (ENOSPC);
+	if (vm_copy(mach_task_self(), tn->tn_va, tn->tn_vsize, va)
+	    != KERN_SUCCESS) {
+		(void) vm_deallocate(mach_task_self(), va, want);
+		return (ENOSPC);
+	}
+	(void) vm_deallocate(mach_task_self(), tn->tn_va, tn->tn_vsize);
+	tn->tn_va = va;
+	tn->tn_vsize = want;
+	return (0);
+}
+
+/*
+ * Set the size of a regular file, charging its pages to the mount.
+ * The caller tells the pager.
+ */
+int
+tmpfs_reg_resize(tn, newsize)
+	register struct tmpfs_node *tn;
+	off_t newsize;
+{
+	struct tmpfs_mount *tm = tn->tn_mount;
+	u_long opages, npages;
+	vm_size_t vsize;
+	int error;
+
+	opages = atop(round_page(tn->tn_size));
+	npages = atop(round_page(newsize));
+	vsize = round_page(newsize);
+	if (newsize > tn->tn_size) {
+		if (npages > opages &&
+		    tm->tm_pages + (npages - opages) > tm->tm_pages_max)
+			return (ENOSPC);
+		if (vsize > tn->tn_vsize &&
+		    (error = tmpfs_reg_grow(tn, vsize)))
+			return (error);
+		tm->tm_pages += npages - opages;
+	} else if (newsize < tn->tn_size) {
+		if (newsize < vsize)
+			memset((char *)tn->tn_va + newsize, 0,
+			    (size_t)(MIN((off_t)vsize, tn->tn_size) - newsize));
+		if (vsize < tn->tn_vsize) {
+			(void) vm_deallocate(mach_task_self(),
+			    tn->tn_va + vsize, tn->tn_vsize - vsize);
+			tn->tn_vsize = vsize;
+			if (vsize == 0)
+				tn->tn_va = 0;
+		}
+		tm->tm_pages -= opages - npages;
+	}
+	tn->tn_size = newsize;
+	return (0);
+}
@@ -0,0 +1,259 @@
+/*
+ *	File:	miscfs/tmpfs/tmpfs_vfsops.c
+ *
+ *	VFS operations of tmpfs.  A mount owns all its nodes; unmounting
+ *	throws them away along with the memory of their files.
+ */
+
+#include <serv/server_defs.h>
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/time.h>
+#include <sys/proc.h>
+#include <sys/vnode.h>
+#include <sys/mount.h>
+#include <sys/namei.h>
+#include <sys/malloc.h>
+#include <sys/dirent.h>
+
+#include <miscfs/tmpfs/tmpfs.h>
+
+/*
+ * Mount a new, empty tmpfs.
+ */
+int
+tmpfs_mount(mp, path, data, ndp, p)
+	struct mount *mp;
+	char *path;
+	caddr_t data;
+	struct nameidata *ndp;
+	struct proc *p;
+{
+	struct tmpfs_args args;
+	register struct tmpfs_mount *tm;
+	u_int size;
+	int error;
+
+	/*
+	 * There is nothing to update.
+	 */
+	if (mp->mnt_flag & MNT_UPDATE)
+		return (EOPNOTSUPP);
+	if (error = copyin(data, (caddr_t)&args, sizeof (struct tmpfs_args)))
+		return (error);
+
+	MALLOC(tm, struct tmpfs_mount *, sizeof(struct tmpfs_mount),
+	    M_UFSMNT, M_WAITOK);	/* XXX */
+	memset((caddr_t)tm, 0, sizeof(struct tmpfs_mount));
+	tm->tm_mount = mp;
+	LIST_INIT(&tm->tm_nodes);
+	tm->tm_dirhashtbl = hashinit(desiredvnodes, M_UFSMNT, &tm->tm_dirhash);
+	tm->tm_nextino = 2;		/* as ROOTINO of ufs */
+	if (args.ta_nodes == 0 || args.ta_nodes > TMPFS_NOLIMIT)
+		tm->tm_nodes_max = TMPFS_NOLIMIT;
+	else
+		tm->tm_nodes_max = args.ta_nodes;
+	if (args.ta_size == 0 || atop(round_page(args.ta_size)) > TMPFS_NOLIMIT)
+		tm->tm_pages_max = TMPFS_NOLIMIT;
+	else
+		tm->tm_pages_max = atop(round_page(args.ta_size));
+	if (error = tmpfs_alloc_node(tm, VDIR, args.ta_mode, args.ta_uid,
+	    args.ta_gid, (struct tmpfs_node *)NULL, &tm->tm_root)) {
+		free((caddr_t)tm->tm_dirhashtbl, M_UFSMNT);
+		free((caddr_t)tm, M_UFSMNT);
+		return (error);
+	}
+
+	mp->mnt_flag |= MNT_LOCAL;
+	mp->mnt_data = (qaddr_t)tm;
+	getnewfsid(mp, MOUNT_TMPFS);
+
+	(void) copyinstr(path, mp->mnt_stat.f_mntonname, MNAMELEN - 1, &size);
+	memset(mp->mnt_stat.f_mntonname + size, 0, MNAMELEN - size);
+	memset(mp->mnt_stat.f_mntfromname, 0, MNAMELEN);
+	memcpy(mp->mnt_stat.f_mntfromname, "tmpfs", sizeof("tmpfs"));
+	(void) tmpfs_statfs(mp, &mp->mnt_stat, p);
+	return (0);
+}
+
+int
+tmpfs_start(mp, flags, p)
+	struct mount *mp;
+	int flags;
+	struct proc *p;
+{
+
+	return (0);
+}
+
+/*
+ * Unmount: once every vnode is gone, so are all the names and files.
+ */
+int
+tmpfs_unmount(mp, mntflags, p)
+	struct mount *mp;
+	int mntflags;
+	struct proc *p;
+{
+	register struct tmpfs_mount *tm = VFSTOTMPFS(mp);
+	register struct tmpfs_node *tn;
+	struct tmpfs_dirent *de;
+	int error, flags = 0;
+	extern int doforce;
+
+	if (mntflags & MNT_FORCE) {
+		if (!doforce)
+			return (EINVAL);
+		flags |= FORCECLOSE;
+	}
+	if (error = vflush(mp, NULLVP, flags))
+		return (error);
+
+	for (tn = tm->tm_nodes.lh_first; tn; tn = tn->tn_entries.le_next) {
+		if (tn->tn_type != VDIR)
+			continue;
+		while (de = tn->tn_dirlist.tqh_first) {
+			TAILQ_REMOVE(&tn->tn_dirlist, de, td_entries);
+			tmpfs_free_dirent(de);
+		}
+	}
+	while (tn = tm->tm_nodes.lh_first)
+		tmpfs_free_node(tn);
+
+	free((caddr_t)tm->tm_dirhashtbl, M_UFSMNT);
+	free((caddr_t)tm, M_UFSMNT);	/* XXX */
+	mp->mnt_data = 0;
+	return (0);
+}
+
+/*
+ * Return locked reference to root.
+ */
+int
+tmpfs_root(mp, vpp)
+	struct mount *mp;
+	struct vnode **vpp;
+{
+
+	return (tmpfs_allocvp(mp, VFSTOTMPFS(mp)->tm_root, vpp));
+}
+
+int
+tmpfs_quotactl(mp, cmd, uid, arg, p)
+	struct mount *mp;
+	int cmd;
+	uid_t uid;
+	caddr_t arg;
+	struct proc *p;
+{
+
+	return (EOPNOTSUPP);
+}
+
+/*
+ * Blocks are pages of file data; without limits the free counts are
+ * as large as they can be.
+ */
+int
+tmpfs_statfs(mp, sbp, p)
+	struct mount *mp;
+	register struct statfs *sbp;
+	struct proc *p;
+{
+	register struct tmpfs_mount *tm = VFSTOTMPFS(mp);
+
+	sbp->f_type = MOUNT_TMPFS;
+	sbp->f_flags = 0;
+	sbp->f_bsize = vm_page_size;
+	sbp->f_iosize = MAXBSIZE;
+	sbp->f_blocks = tm->tm_pages_max;
+	sbp->f_bfree = tm->tm_pages_max - tm->tm_pages;
+	sbp->f_bavail = sbp->f_bfree;
+	sbp->f_files = tm->tm_nodes_max;
+	sbp->f_ffree = tm->tm_nodes_max - tm->tm_nodes_cnt;
+	if (sbp != &mp->mnt_stat) {
+		memcpy(&sbp->f_fsid, &mp->mnt_stat.f_fsid, sizeof(sbp->f_fsid));
+		memcpy(sbp->f_mntonname, mp->mnt_stat.f_mntonname, MNAMELEN);
+		memcpy(sbp->f_mntfromname, mp->mnt_stat.f_mntfromname, MNAMELEN);
+	}
+	strncpy(sbp->f_fstypename, mp->mnt_op->vfs_name, MFSNAMELEN);
+	return (0);
+}
+
+int
+tmpfs_sync(mp, waitfor)
+	struct mount *mp;
+	int waitfor;
+{
+
+	return (0);
+}
+
+/*
+ * There are no file handles, so no NFS export.
+ */
+int
+tmpfs_vget(mp, ino, vpp)
+	struct mount *mp;
+	ino_t ino;
+	struct vnode **vpp;
+{
+
+	return (EOPNOTSUPP);
+}
+
+int
+tmpfs_fhtovp(mp, fhp, setgen, vpp)
+	struct mount *mp;
+	struct fid *fhp;
+	int setgen;
+	struct vnode **vpp;
+{
+
+	return (EOPNOTSUPP);
+}
+
+int
+tmpfs_vptofh(vp, fhp)
+	struct vnode *vp;
+	struct fid *fhp;
+{
+
+	return (EOPNOTSUPP);
+}
+
+/*
+ * The zones are shared by all mounts.  They are exhaustible, so that
+ * running out of them fails the creation with ENOSPC instead of
+ * panicking the server.
+ */
+int
+tmpfs_init()
+{
+
+	tmpfs_node_zone = zinit(sizeof(struct tmpfs_node),
+	    sizeof(struct tmpfs_node) * TMPFS_ZONEMAX, vm_page_size, TRUE,
+	    "tmpfs nodes");
+	zchange(tmpfs_node_zone, TRUE, FALSE, TRUE);
+	tmpfs_dirent_zone = zinit(sizeof(struct tmpfs_dirent),
+	    sizeof(struct tmpfs_dirent) * TMPFS_ZONEMAX, vm_page_size, TRUE,
+	    "tmpfs dirents");
+	zchange(tmpfs_dirent_zone, TRUE, FALSE, TRUE);
+	return (0);
+}
+
+struct vfsops tmpfs_vfsops = {
+	"tmpfs",
+	tmpfs_mount,
+	tmpfs_start,
+	tmpfs_unmount,
+	tmpfs_root,
+	tmpfs_quotactl,
+	tmpfs_statfs,
+	tmpfs_sync,
+	tmpfs_vget,
+	tmpfs_fhtovp,
+	tmpfs_vptofh,
+	tmpfs_init,
+};
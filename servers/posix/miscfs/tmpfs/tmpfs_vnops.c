@@ -0,0 +1,1488 @@
+/*
+ *	File:	miscfs/tmpfs/tmpfs_vnops.c
+ *
+ *	Vnode operations of tmpfs.
+ *
+ *	Names are found by one hash probe and files are read and written
+ *	in place in their memory.  When the vnode pager pages a file in or
+ *	out, whole pages are moved with vm_copy, so a mapped file shares
+ *	its pages copy-on-write with the file instead of being copied
+ *	through a second cache.
+ */
+
+#include "diagnostic.h"
+
+#include <serv/server_defs.h>
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/resourcevar.h>
+#include <sys/kernel.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/proc.h>
+#include <sys/mount.h>
+#include <sys/vnode.h>
+#include <sys/malloc.h>
+#include <sys/dirent.h>
+#include <sys/uio.h>
+
+#include <miscfs/tmpfs/tmpfs.h>
+
+static int tmpfs_chmod (struct vnode *, int, struct ucred *, struct proc *);
+static int tmpfs_chown
+	(struct vnode *, uid_t, gid_t, struct ucred *, struct proc *);
+static int tmpfs_makenode (struct vnode *, struct vnode **,
+	struct componentname *, enum vtype, int, char *);
+
+/*
+ * Look up a name in a directory, following the protocol of ufs_lookup.
+ * There is no directory to search block by block, so the name cache is
+ * not used.
+ */
+int
+tmpfs_lookup(ap)
+	struct vop_lookup_args /* {
+		struct vnode *a_dvp;
+		struct vnode **a_vpp;
+		struct componentname *a_cnp;
+	} */ *ap;
+{
+	register struct vnode *dvp = ap->a_dvp;
+	struct vnode **vpp = ap->a_vpp;
+	register struct componentname *cnp = ap->a_cnp;
+	struct ucred *cred = cnp->cn_cred;
+	struct tmpfs_node *dnode = VTOTN(dvp);
+	struct tmpfs_node *tn;
+	struct tmpfs_dirent *de;
+	struct vnode *tvp;
+	int flags = cnp->cn_flags;
+	int nameiop = cnp->cn_nameiop;
+	int lockparent, wantparent, error;
+
+	*vpp = NULL;
+	lockparent = flags & LOCKPARENT;
+	wantparent = flags & (LOCKPARENT|WANTPARENT);
+
+	if (dvp->v_type != VDIR)
+		return (ENOTDIR);
+	if (error = VOP_ACCESS(dvp, VEXEC, cred, cnp->cn_proc))
+		return (error);
+
+	if (flags & ISDOTDOT) {
+		/*
+		 * A removed directory no longer has a parent.
+		 */
+		if (dnode->tn_nlink == 0)
+			return (ENOENT);
+		tn = dnode->tn_parent;
+	} else if (cnp->cn_namelen == 1 && cnp->cn_nameptr[0] == '.')
+		tn = dnode;
+	else if (de = tmpfs_dir_lookup(dnode, cnp->cn_nameptr,
+	    cnp->cn_namelen))
+		tn = de->td_node;
+	else {
+		/*
+		 * Creating the last component of the path in a directory
+		 * that has not been removed: tell the caller to go ahead.
+		 */
+		if ((nameiop == CREATE || nameiop == RENAME) &&
+		    (flags & ISLASTCN) && dnode->tn_nlink != 0) {
+			if (error = VOP_ACCESS(dvp, VWRITE, cred,
+			    cnp->cn_proc))
+				return (error);
+			cnp->cn_flags |= SAVENAME;
+			if (!lockparent)
+				VOP_UNLOCK(dvp);
+			return (EJUSTRETURN);
+		}
+		return (ENOENT);
+	}
+
+	if (nameiop == DELETE && (flags & ISLASTCN)) {
+		if (error = VOP_ACCESS(dvp, VWRITE, cred, cnp->cn_proc))
+			return (error);
+		if (tn == dnode) {
+			VREF(dvp);
+			*vpp = dvp;
+			return (0);
+		}
+		if (error = tmpfs_allocvp(dvp->v_mount, tn, &tvp))
+			return (error);
+		/*
+		 * In a sticky directory only the owner of the directory
+		 * or of the file may remove it.
+		 */
+		if ((dnode->tn_mode & S_ISTXT) && cred->cr_uid != 0 &&
+		    cred->cr_uid != dnode->tn_uid &&
+		    tn->tn_uid != cred->cr_uid) {
+			vput(tvp);
+			return (EPERM);
+		}
+		*vpp = tvp;
+		if (!lockparent)
+			VOP_UNLOCK(dvp);
+		return (0);
+	}
+
+	if (nameiop == RENAME && wantparent && (flags & ISLASTCN)) {
+		if (error = VOP_ACCESS(dvp, VWRITE, cred, cnp->cn_proc))
+			return (error);
+		if (tn == dnode)
+			return (EISDIR);
+		if (error = tmpfs_allocvp(dvp->v_mount, tn, &tvp))
+			return (error);
+		*vpp = tvp;
+		cnp->cn_flags |= SAVENAME;
+		if (!lockparent)
+			VOP_UNLOCK(dvp);
+		return (0);
+	}
+
+	/*
+	 * Lock order is from the root down, so the directory is
+	 * unlocked before its parent is locked.
+	 */
+	if (flags & ISDOTDOT) {
+		VOP_UNLOCK(dvp);
+		if (error = tmpfs_allocvp(dvp->v_mount, tn, &tvp)) {
+			VOP_LOCK(dvp);
+			return (error);
+		}
+		if (lockparent && (flags & ISLASTCN) &&
+		    (error = VOP_LOCK(dvp))) {
+			vput(tvp);
+			return (error);
+		}
+		*vpp = tvp;
+	} else if (tn == dnode) {
+		VREF(dvp);
+		*vpp = dvp;
+	} else {
+		if (error = tmpfs_allocvp(dvp->v_mount, tn, &tvp))
+			return (error);
+		if (!lockparent || !(flags & ISLASTCN))
+			VOP_UNLOCK(dvp);
+		*vpp = tvp;
+	}
+	return (0);
+}
+
+/*
+ * Create a regular file or a socket.
+ */
+int
+tmpfs_create(ap)
+	struct vop_create_args /* {
+		struct vnode *a_dvp;
+		struct vnode **a_vpp;
+		struct componentname *a_cnp;
+		struct vattr *a_vap;
+	} */ *ap;
+{
+
+	return (tmpfs_makenode(ap->a_dvp, ap->a_vpp, ap->a_cnp,
+	    ap->a_vap->va_type, ap->a_vap->va_mode, (char *)NULL));
+}
+
+/*
+ * Devices and fifos are not supported.
+ */
+/* ARGSUSED */
+int
+tmpfs_mknod(ap)
+	struct vop_mknod_args /* {
+		struct vnode *a_dvp;
+		struct vnode **a_vpp;
+		struct componentname *a_cnp;
+		struct vattr *a_vap;
+	} */ *ap;
+{
+
+	VOP_ABORTOP(ap->a_dvp, ap->a_cnp);
+	vput(ap->a_dvp);
+	return (EOPNOTSUPP);
+}
+
+/* ARGSUSED */
+int
+tmpfs_open(ap)
+	struct vop_open_args /* {
+		struct vnode *a_vp;
+		int  a_mode;
+		struct ucred *a_cred;
+		struct proc *a_p;
+	} */ *ap;
+{
+
+	/*
+	 * Files marked append-only must be opened for appending.
+	 */
+	if ((VTOTN(ap->a_vp)->tn_flags & APPEND) &&
+	    (ap->a_mode & (FWRITE | O_APPEND)) == FWRITE)
+		return (EPERM);
+	return (0);
+}
+
+int
+tmpfs_access(ap)
+	struct vop_access_args /* {
+		struct vnode *a_vp;
+		int  a_mode;
+		struct ucred *a_cred;
+		struct proc *a_p;
+	} */ *ap;
+{
+	register struct tmpfs_node *tn = VTOTN(ap->a_vp);
+	register struct ucred *cred = ap->a_cred;
+	mode_t mask, mode = ap->a_mode;
+	register gid_t *gp;
+	int i;
+
+	/* If immutable bit set, nobody gets to write it. */
+	if ((mode & VWRITE) && (tn->tn_flags & IMMUTABLE))
+		return (EPERM);
+
+	/* Otherwise, user id 0 always gets access. */
+	if (cred->cr_uid == 0)
+		return (0);
+
+	mask = 0;
+
+	/* Otherwise, check the owner. */
+	if (cred->cr_uid == tn->tn_uid) {
+		if (mode & VEXEC)
+			mask |= S_IXUSR;
+		if (mode & VREAD)
+			mask |= S_IRUSR;
+		if (mode & VWRITE)
+			mask |= S_IWUSR;
+		return ((tn->tn_mode & mask) == mask ? 0 : EACCES);
+	}
+
+	/* Otherwise, check the groups. */
+	for (i = 0, gp = cred->cr_groups; i < cred->cr_ngroups; i++, gp++)
+		if (tn->tn_gid == *gp) {
+			if (mode & VEXEC)
+				mask |= S_IXGRP;
+			if (mode & VREAD)
+				mask |= S_IRGRP;
+			if (mode & VWRITE)
+				mask |= S_IWGRP;
+			return ((tn->tn_mode & mask) == mask ? 0 : EACCES);
+		}
+
+	/* Otherwise, check everyone else. */
+	if (mode & VEXEC)
+		mask |= S_IXOTH;
+	if (mode & VREAD)
+		mask |= S_IROTH;
+	if (mode & VWRITE)
+		mask |= S_IWOTH;
+	return ((tn->tn_mode & mask) == mask ? 0 : EACCES);
+}
+
+/* ARGSUSED */
+int
+tmpfs_getattr(ap)
+	struct vop_getattr_args /* {
+		struct vnode *a_vp;
+		struct vattr *a_vap;
+		struct ucred *a_cred;
+		struct proc *a_p;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn = VTOTN(vp);
+	register struct vattr *vap = ap->a_vap;
+
+	TN_TIMES(tn);
+	vap->va_type = vp->v_type;
+	vap->va_mode = tn->tn_mode;
+	vap->va_nlink = tn->tn_nlink;
+	vap->va_uid = tn->tn_uid;
+	vap->va_gid = tn->tn_gid;
+	vap->va_fsid = vp->v_mount->mnt_stat.f_fsid.val[0];
+	vap->va_fileid = tn->tn_ino;
+	vap->va_size = tn->tn_size;
+	vap->va_blocksize = vp->v_mount->mnt_stat.f_iosize;
+	vap->va_atime = tn->tn_atime;
+	vap->va_mtime = tn->tn_mtime;
+	vap->va_ctime = tn->tn_ctime;
+	vap->va_gen = tn->tn_gen;
+	vap->va_flags = tn->tn_flags;
+	vap->va_rdev = NODEV;
+	if (vp->v_type == VREG)
+		vap->va_bytes = round_page(tn->tn_size);
+	else
+		vap->va_bytes = tn->tn_size;
+	vap->va_filerev = tn->tn_modrev;
+	return (0);
+}
+
+/*
+ * Set attribute vnode op, after ufs_setattr.
+ */
+int
+tmpfs_setattr(ap)
+	struct vop_setattr_args /* {
+		struct vnode *a_vp;
+		struct vattr *a_vap;
+		struct ucred *a_cred;
+		struct proc *a_p;
+	} */ *ap;
+{
+	register struct vattr *vap = ap->a_vap;
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn = VTOTN(vp);
+	register struct ucred *cred = ap->a_cred;
+	register struct proc *p = ap->a_p;
+	int error;
+
+	/*
+	 * Check for unsettable attributes.
+	 */
+	if ((vap->va_type != VNON) || (vap->va_nlink != VNOVAL) ||
+	    (vap->va_fsid != VNOVAL) || (vap->va_fileid != VNOVAL) ||
+	    (vap->va_blocksize != VNOVAL) || (vap->va_rdev != VNOVAL) ||
+	    ((int)vap->va_bytes != VNOVAL) || (vap->va_gen != VNOVAL)) {
+		return (EINVAL);
+	}
+	if (vap->va_flags != VNOVAL) {
+		if (cred->cr_uid != tn->tn_uid &&
+		    (error = suser(cred, &p->p_acflag)))
+			return (error);
+		if (cred->cr_uid == 0) {
+			if ((tn->tn_flags & (SF_IMMUTABLE | SF_APPEND)) &&
+			    securelevel > 0)
+				return (EPERM);
+			tn->tn_flags = vap->va_flags;
+		} else {
+			if (tn->tn_flags & (SF_IMMUTABLE | SF_APPEND))
+				return (EPERM);
+			tn->tn_flags &= SF_SETTABLE;
+			tn->tn_flags |= (vap->va_flags & UF_SETTABLE);
+		}
+		tn->tn_status |= TN_CHANGE;
+		if (vap->va_flags & (IMMUTABLE | APPEND))
+			return (0);
+	}
+	if (tn->tn_flags & (IMMUTABLE | APPEND))
+		return (EPERM);
+	/*
+	 * Go through the fields and update iff not VNOVAL.
+	 */
+	if (vap->va_uid != (uid_t)VNOVAL || vap->va_gid != (gid_t)VNOVAL)
+		if (error = tmpfs_chown(vp, vap->va_uid, vap->va_gid, cred, p))
+			return (error);
+	if (vap->va_size != VNOVAL) {
+		if (vp->v_type == VDIR)
+			return (EISDIR);
+		if (error = VOP_TRUNCATE(vp, vap->va_size, 0, cred, p))
+			return (error);
+	}
+	if (vap->va_atime.ts_sec != VNOVAL || vap->va_mtime.ts_sec != VNOVAL) {
+		if (cred->cr_uid != tn->tn_uid &&
+		    (error = suser(cred, &p->p_acflag)) &&
+		    ((vap->va_vaflags & VA_UTIMES_NULL) == 0 ||
+		    (error = VOP_ACCESS(vp, VWRITE, cred, p))))
+			return (error);
+		TN_TIMES(tn);
+		if (vap->va_atime.ts_sec != VNOVAL)
+			tn->tn_atime = vap->va_atime;
+		if (vap->va_mtime.ts_sec != VNOVAL) {
+			tn->tn_mtime = vap->va_mtime;
+			tn->tn_modrev++;
+		}
+		tn->tn_status |= TN_CHANGE;
+	}
+	error = 0;
+	if (vap->va_mode != (mode_t)VNOVAL)
+		error = tmpfs_chmod(vp, (int)vap->va_mode, cred, p);
+	return (error);
+}
+
+/*
+ * Change the mode on a file.
+ * Node must be locked before calling.
+ */
+static int
+tmpfs_chmod(vp, mode, cred, p)
+	register struct vnode *vp;
+	register int mode;
+	register struct ucred *cred;
+	struct proc *p;
+{
+	register struct tmpfs_node *tn = VTOTN(vp);
+	int error;
+
+	if (cred->cr_uid != tn->tn_uid &&
+	    (error = suser(cred, &p->p_acflag)))
+		return (error);
+	if (cred->cr_uid) {
+		if (vp->v_type != VDIR && (mode & S_ISTXT))
+			return (EFTYPE);
+		if (!groupmember(tn->tn_gid, cred) && (mode & S_ISGID))
+			return (EPERM);
+	}
+	tn->tn_mode = mode & ALLPERMS;
+	tn->tn_status |= TN_CHANGE;
+	if ((vp->v_flag & VTEXT) && (tn->tn_mode & S_ISTXT) == 0)
+		(void) vnode_pager_uncache(vp);
+	return (0);
+}
+
+/*
+ * Perform chown operation on a node;
+ * node must be locked prior to call.
+ */
+static int
+tmpfs_chown(vp, uid, gid, cred, p)
+	register struct vnode *vp;
+	uid_t uid;
+	gid_t gid;
+	struct ucred *cred;
+	struct proc *p;
+{
+	register struct tmpfs_node *tn = VTOTN(vp);
+	int error;
+
+	if (uid == (uid_t)VNOVAL)
+		uid = tn->tn_uid;
+	if (gid == (gid_t)VNOVAL)
+		gid = tn->tn_gid;
+	/*
+	 * If we don't own the file, are trying to change the owner
+	 * of the file, or are not a member of the target group,
+	 * the caller must be superuser or the call fails.
+	 */
+	if ((cred->cr_uid != tn->tn_uid || uid != tn->tn_uid ||
+	    !groupmember((gid_t)gid, cred)) &&
+	    (error = suser(cred, &p->p_acflag)))
+		return (error);
+	if (tn->tn_uid != uid || tn->tn_gid != gid)
+		tn->tn_status |= TN_CHANGE;
+	if (tn->tn_uid != uid && cred->cr_uid != 0)
+		tn->tn_mode &= ~S_ISUID;
+	if (tn->tn_gid != gid && cred->cr_uid != 0)
+		tn->tn_mode &= ~S_ISGID;
+	tn->tn_uid = uid;
+	tn->tn_gid = gid;
+	return (0);
+}
+
+/*
+ * Move up to len bytes between a file's memory and uio.  Whole pages
+ * at page aligned addresses in the server's own space, which is what
+ * the vnode pager asks for, are moved by reference with vm_copy.
+ */
+static int
+tmpfs_move(tn, uio, len)
+	struct tmpfs_node *tn;
+	register struct uio *uio;
+	off_t len;
+{
+	register struct iovec *iov;
+	vm_address_t fva;
+	vm_size_t n;
+	kern_return_t kr;
+	int resid, error;
+
+	error = 0;
+	while (len > 0 && uio->uio_resid > 0) {
+		iov = uio->uio_iov;
+		if (iov->iov_len == 0) {
+			uio->uio_iov++;
+			uio->uio_iovcnt--;
+			continue;
+		}
+		fva = tn->tn_va + (vm_size_t)uio->uio_offset;
+		n = MIN(len, iov->iov_len);
+		if (uio->uio_segflg == UIO_SYSSPACE && n >= vm_page_size &&
+		    trunc_page(fva) == fva &&
+		    trunc_page(iov->iov_base) == (vm_address_t)iov->iov_base) {
+			n = trunc_page(n);
+			if (uio->uio_rw == UIO_READ)
+				kr = vm_copy(mach_task_self(), fva, n,
+				    (vm_address_t)iov->iov_base);
+			else
+				kr = vm_copy(mach_task_self(),
+				    (vm_address_t)iov->iov_base, n, fva);
+			if (kr == KERN_SUCCESS) {
+				iov->iov_base = (caddr_t)iov->iov_base + n;
+				iov->iov_len -= n;
+				uio->uio_resid -= n;
+				uio->uio_offset += n;
+				len -= n;
+				continue;
+			}
+		}
+		resid = uio->uio_resid;
+		if (error = uiomove((caddr_t)fva, (int)n, uio))
+			break;
+		len -= resid - uio->uio_resid;
+	}
+	return (error);
+}
+
+/*
+ * Vnode op for reading.
+ */
+/* ARGSUSED */
+int
+tmpfs_read(ap)
+	struct vop_read_args /* {
+		struct vnode *a_vp;
+		struct uio *a_uio;
+		int  a_ioflag;
+		struct ucred *a_cred;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn = VTOTN(vp);
+	register struct uio *uio = ap->a_uio;
+	int error;
+
+#if DIAGNOSTIC
+	if (uio->uio_rw != UIO_READ)
+		panic("tmpfs_read: mode");
+#endif
+	if (vp->v_type == VDIR)
+		return (EISDIR);
+	if (vp->v_type != VREG)
+		return (EOPNOTSUPP);
+	if (uio->uio_offset < 0)
+		return (EINVAL);
+	tn->tn_status |= TN_ACCESS;
+	if (uio->uio_offset >= tn->tn_size)
+		return (0);
+	error = tmpfs_move(tn, uio, tn->tn_size - uio->uio_offset);
+	return (error);
+}
+
+/*
+ * Vnode op for writing, after ufs_write.
+ */
+int
+tmpfs_write(ap)
+	struct vop_write_args /* {
+		struct vnode *a_vp;
+		struct uio *a_uio;
+		int  a_ioflag;
+		struct ucred *a_cred;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn = VTOTN(vp);
+	register struct uio *uio = ap->a_uio;
+	int ioflag = ap->a_ioflag;
+	struct proc *p;
+	off_t osize;
+	int resid, error;
+
+#if DIAGNOSTIC
+	if (uio->uio_rw != UIO_WRITE)
+		panic("tmpfs_write: mode");
+#endif
+	if (vp->v_type != VREG)
+		return (EOPNOTSUPP);
+	if (ioflag & IO_APPEND)
+		uio->uio_offset = tn->tn_size;
+	if ((tn->tn_flags & APPEND) && uio->uio_offset != tn->tn_size)
+		return (EPERM);
+	if (uio->uio_offset < 0)
+		return (EINVAL);
+	if (uio->uio_resid == 0)
+		return (0);
+	/*
+	 * Maybe this should be above the vnode op call, but so long as
+	 * file servers have no limits, I don't think it matters.
+	 */
+	p = uio->uio_procp;
+	if (p && uio->uio_offset + uio->uio_resid >
+	    p->p_rlimit[RLIMIT_FSIZE].rlim_cur) {
+		psignal(p, SIGXFSZ);
+		return (EFBIG);
+	}
+
+	resid = uio->uio_resid;
+	osize = tn->tn_size;
+	if (uio->uio_offset + resid > osize) {
+		if (error = tmpfs_reg_resize(tn, uio->uio_offset + resid))
+			return (error);
+		vnode_pager_setsize(vp, (u_long)tn->tn_size);
+	}
+	error = tmpfs_move(tn, uio, (off_t)resid);
+	/*
+	 * If we successfully wrote any data, and we are not the superuser
+	 * we clear the setuid and setgid bits as a precaution against
+	 * tampering.
+	 */
+	if (resid > uio->uio_resid) {
+		tn->tn_status |= TN_CHANGE | TN_UPDATE;
+		if (ap->a_cred && ap->a_cred->cr_uid != 0)
+			tn->tn_mode &= ~(S_ISUID | S_ISGID);
+	}
+	if (error) {
+		if (ioflag & IO_UNIT) {
+			uio->uio_offset -= resid - uio->uio_resid;
+			uio->uio_resid = resid;
+		}
+		/* Give back what was grown but not written. */
+		if (tn->tn_size > osize) {
+			(void) tmpfs_reg_resize(tn, MAX(osize, uio->uio_offset));
+			vnode_pager_setsize(vp, (u_long)tn->tn_size);
+		}
+	}
+	return (error);
+}
+
+/*
+ * Remove a name.  Directories go with rmdir only.
+ */
+int
+tmpfs_remove(ap)
+	struct vop_remove_args /* {
+		struct vnode *a_dvp;
+		struct vnode *a_vp;
+		struct componentname *a_cnp;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct vnode *dvp = ap->a_dvp;
+	struct componentname *cnp = ap->a_cnp;
+	struct tmpfs_node *tn = VTOTN(vp);
+	struct tmpfs_node *dnode = VTOTN(dvp);
+	struct tmpfs_dirent *de;
+	int error = 0;
+
+	if (vp->v_type == VDIR)
+		error = EPERM;
+	else if ((tn->tn_flags & (IMMUTABLE | APPEND)) ||
+	    (dnode->tn_flags & APPEND))
+		error = EPERM;
+	else if ((de = tmpfs_dir_lookup(dnode, cnp->cn_nameptr,
+	    cnp->cn_namelen)) == NULL || de->td_node != tn)
+		error = ENOENT;
+	else {
+		tmpfs_dir_remove(dnode, de);
+		tn->tn_nlink--;
+		tn->tn_status |= TN_CHANGE;
+	}
+	if (dvp == vp)
+		vrele(vp);
+	else
+		vput(vp);
+	vput(dvp);
+	return (error);
+}
+
+/*
+ * link vnode call.  As in ufs_link, a_vp is the locked directory and
+ * a_tdvp the file.
+ */
+int
+tmpfs_link(ap)
+	struct vop_link_args /* {
+		struct vnode *a_vp;
+		struct vnode *a_tdvp;
+		struct componentname *a_cnp;
+	} */ *ap;
+{
+	register struct vnode *dvp = ap->a_vp;
+	register struct vnode *vp = ap->a_tdvp;
+	register struct componentname *cnp = ap->a_cnp;
+	struct tmpfs_node *tn;
+	struct tmpfs_dirent *de;
+	int error;
+
+#if DIAGNOSTIC
+	if ((cnp->cn_flags & HASBUF) == 0)
+		panic("tmpfs_link: no name");
+#endif
+	if (dvp->v_mount != vp->v_mount) {
+		VOP_ABORTOP(dvp, cnp);
+		error = EXDEV;
+		goto out2;
+	}
+	if (vp->v_type == VDIR) {
+		VOP_ABORTOP(dvp, cnp);
+		error = EPERM;
+		goto out2;
+	}
+	if (error = VOP_LOCK(vp)) {
+		VOP_ABORTOP(dvp, cnp);
+		goto out2;
+	}
+	tn = VTOTN(vp);
+	if (tn->tn_nlink >= LINK_MAX) {
+		VOP_ABORTOP(dvp, cnp);
+		error = EMLINK;
+		goto out1;
+	}
+	if (tn->tn_flags & (IMMUTABLE | APPEND)) {
+		VOP_ABORTOP(dvp, cnp);
+		error = EPERM;
+		goto out1;
+	}
+	if ((de = tmpfs_alloc_dirent(cnp->cn_nameptr,
+	    cnp->cn_namelen)) == NULL) {
+		VOP_ABORTOP(dvp, cnp);
+		error = ENOSPC;
+		goto out1;
+	}
+	tmpfs_dir_attach(VTOTN(dvp), de, tn);
+	tn->tn_nlink++;
+	tn->tn_status |= TN_CHANGE;
+	FREE(cnp->cn_pnbuf, M_NAMEI);
+out1:
+	VOP_UNLOCK(vp);
+out2:
+	vput(dvp);
+	return (error);
+}
+
+/*
+ * Rename vnode op.  Nothing is written anywhere, so unlike ufs_rename
+ * the whole change is made at once, after the last point where it
+ * could sleep; the source directory need not be locked for that.
+ */
+int
+tmpfs_rename(ap)
+	struct vop_rename_args  /* {
+		struct vnode *a_fdvp;
+		struct vnode *a_fvp;
+		struct componentname *a_fcnp;
+		struct vnode *a_tdvp;
+		struct vnode *a_tvp;
+		struct componentname *a_tcnp;
+	} */ *ap;
+{
+	struct vnode *tvp = ap->a_tvp;
+	register struct vnode *tdvp = ap->a_tdvp;
+	struct vnode *fvp = ap->a_fvp;
+	register struct vnode *fdvp = ap->a_fdvp;
+	register struct componentname *tcnp = ap->a_tcnp;
+	register struct componentname *fcnp = ap->a_fcnp;
+	struct tmpfs_node *fdnode, *fnode, *tdnode, *tnode, *tn;
+	struct tmpfs_dirent *fde, *tde, *nde;
+	struct ucred *cred = tcnp->cn_cred;
+	int error = 0;
+
+#if DIAGNOSTIC
+	if ((tcnp->cn_flags & HASBUF) == 0 ||
+	    (fcnp->cn_flags & HASBUF) == 0)
+		panic("tmpfs_rename: no name");
+#endif
+	/*
+	 * Check for cross-device rename.
+	 */
+	if ((fvp->v_mount != tdvp->v_mount) ||
+	    (tvp && (fvp->v_mount != tvp->v_mount))) {
+		error = EXDEV;
+abortit:
+		VOP_ABORTOP(tdvp, tcnp);
+		if (tdvp == tvp)
+			vrele(tdvp);
+		else
+			vput(tdvp);
+		if (tvp)
+			vput(tvp);
+		VOP_ABORTOP(fdvp, fcnp);
+		vrele(fdvp);
+		vrele(fvp);
+		return (error);
+	}
+	fdnode = VTOTN(fdvp);
+	fnode = VTOTN(fvp);
+	tdnode = VTOTN(tdvp);
+	tnode = tvp ? VTOTN(tvp) : NULL;
+
+	if (tnode && ((tnode->tn_flags & (IMMUTABLE | APPEND)) ||
+	    (tdnode->tn_flags & APPEND))) {
+		error = EPERM;
+		goto abortit;
+	}
+	if ((fnode->tn_flags & (IMMUTABLE | APPEND)) ||
+	    (fdnode->tn_flags & APPEND)) {
+		error = EPERM;
+		goto abortit;
+	}
+	if (fvp->v_type == VDIR) {
+		/*
+		 * Avoid ".", "..", and aliases of "." for obvious reasons.
+		 */
+		if ((fcnp->cn_namelen == 1 && fcnp->cn_nameptr[0] == '.') ||
+		    fdnode == fnode || (fcnp->cn_flags & ISDOTDOT)) {
+			error = EINVAL;
+			goto abortit;
+		}
+		/*
+		 * A directory moving to a new parent needs write access
+		 * to change its "..", and must not go below itself.
+		 */
+		if (fdnode != tdnode) {
+			if (error = VOP_ACCESS(fvp, VWRITE, cred,
+			    tcnp->cn_proc))
+				goto abortit;
+			for (tn = tdnode; tn != tn->tn_parent; tn = tn->tn_parent)
+				if (tn == fnode) {
+					error = EINVAL;
+					goto abortit;
+				}
+		}
+	}
+	if (tnode) {
+		/*
+		 * In a sticky directory only the owner of the directory
+		 * or of the file may replace it.
+		 */
+		if ((tdnode->tn_mode & S_ISTXT) && cred->cr_uid != 0 &&
+		    cred->cr_uid != tdnode->tn_uid &&
+		    tnode->tn_uid != cred->cr_uid) {
+			error = EPERM;
+			goto abortit;
+		}
+		if (tvp->v_type == VDIR) {
+			if (fvp->v_type != VDIR) {
+				error = EISDIR;
+				goto abortit;
+			}
+			if (tnode->tn_dirlist.tqh_first != NULL ||
+			    tnode->tn_nlink > 2) {
+				error = ENOTEMPTY;
+				goto abortit;
+			}
+		} else if (fvp->v_type == VDIR) {
+			error = ENOTDIR;
+			goto abortit;
+		}
+	}
+
+	/*
+	 * Both names are links to one file: just drop the source name.
+	 */
+	if (fnode == tnode) {
+		if ((fde = tmpfs_dir_lookup(fdnode, fcnp->cn_nameptr,
+		    fcnp->cn_namelen)) != NULL && fde->td_node == fnode) {
+			tmpfs_dir_remove(fdnode, fde);
+			fnode->tn_nlink--;
+			fnode->tn_status |= TN_CHANGE;
+		}
+		goto out;
+	}
+
+	if ((nde = tmpfs_alloc_dirent(tcnp->cn_nameptr,
+	    tcnp->cn_namelen)) == NULL) {
+		error = ENOSPC;
+		goto out;
+	}
+	/*
+	 * No sleeping from here on.  The source name may have gone
+	 * while the target was looked up.
+	 */
+	fde = tmpfs_dir_lookup(fdnode, fcnp->cn_nameptr, fcnp->cn_namelen);
+	if (fde == NULL || fde->td_node != fnode) {
+		tmpfs_free_dirent(nde);
+		error = ENOENT;
+		goto out;
+	}
+	if (tnode) {
+		tde = tmpfs_dir_lookup(tdnode, tcnp->cn_nameptr,
+		    tcnp->cn_namelen);
+		if (tde != NULL && tde->td_node == tnode) {
+			tmpfs_dir_remove(tdnode, tde);
+			if (tvp->v_type == VDIR) {
+				tnode->tn_nlink -= 2;
+				tnode->tn_parent = NULL;
+				tdnode->tn_nlink--;
+			} else
+				tnode->tn_nlink--;
+			tnode->tn_status |= TN_CHANGE;
+		}
+	}
+	tmpfs_dir_remove(fdnode, fde);
+	tmpfs_dir_attach(tdnode, nde, fnode);
+	if (fvp->v_type == VDIR && fdnode != tdnode) {
+		fdnode->tn_nlink--;
+		tdnode->tn_nlink++;
+		fnode->tn_parent = tdnode;
+	}
+	fnode->tn_status |= TN_CHANGE;
+out:
+	vrele(fdvp);
+	vrele(fvp);
+	vput(tdvp);
+	if (tvp)
+		vput(tvp);
+	return (error);
+}
+
+/*
+ * Mkdir system call
+ */
+int
+tmpfs_mkdir(ap)
+	struct vop_mkdir_args /* {
+		struct vnode *a_dvp;
+		struct vnode **a_vpp;
+		struct componentname *a_cnp;
+		struct vattr *a_vap;
+	} */ *ap;
+{
+
+	return (tmpfs_makenode(ap->a_dvp, ap->a_vpp, ap->a_cnp, VDIR,
+	    ap->a_vap->va_mode, (char *)NULL));
+}
+
+/*
+ * Rmdir system call.
+ */
+int
+tmpfs_rmdir(ap)
+	struct vop_rmdir_args /* {
+		struct vnode *a_dvp;
+		struct vnode *a_vp;
+		struct componentname *a_cnp;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct vnode *dvp = ap->a_dvp;
+	register struct componentname *cnp = ap->a_cnp;
+	struct tmpfs_node *tn = VTOTN(vp);
+	struct tmpfs_node *dnode = VTOTN(dvp);
+	struct tmpfs_dirent *de;
+	int error = 0;
+
+	/*
+	 * No rmdir "." please.
+	 */
+	if (dnode == tn) {
+		vrele(dvp);
+		vput(vp);
+		return (EINVAL);
+	}
+	/*
+	 * Rmdir ".." finds the directory holding this one, which is
+	 * not empty.
+	 */
+	if (tn->tn_dirlist.tqh_first != NULL || tn->tn_nlink > 2) {
+		error = ENOTEMPTY;
+		goto out;
+	}
+	if ((dnode->tn_flags & APPEND) ||
+	    (tn->tn_flags & (IMMUTABLE | APPEND))) {
+		error = EPERM;
+		goto out;
+	}
+	if ((de = tmpfs_dir_lookup(dnode, cnp->cn_nameptr,
+	    cnp->cn_namelen)) == NULL || de->td_node != tn) {
+		error = ENOENT;
+		goto out;
+	}
+	tmpfs_dir_remove(dnode, de);
+	dnode->tn_nlink--;
+	dnode->tn_status |= TN_CHANGE;
+	/*
+	 * Both the "." of the directory and its name in the parent
+	 * are gone; it is freed when its vnode goes inactive.
+	 */
+	tn->tn_nlink -= 2;
+	tn->tn_parent = NULL;
+	tn->tn_status |= TN_CHANGE;
+out:
+	vput(dvp);
+	vput(vp);
+	return (error);
+}
+
+/*
+ * symlink -- make a symbolic link
+ */
+int
+tmpfs_symlink(ap)
+	struct vop_symlink_args /* {
+		struct vnode *a_dvp;
+		struct vnode **a_vpp;
+		struct componentname *a_cnp;
+		struct vattr *a_vap;
+		char *a_target;
+	} */ *ap;
+{
+	int error;
+
+	if (error = tmpfs_makenode(ap->a_dvp, ap->a_vpp, ap->a_cnp, VLNK,
+	    ap->a_vap->va_mode, ap->a_target))
+		return (error);
+	vput(*ap->a_vpp);
+	return (0);
+}
+
+/*
+ * Vnode op for reading directories.  The offset is a cookie: 0 and 1
+ * for "." and "..", then the td_seq of the next entry to return.
+ */
+int
+tmpfs_readdir(ap)
+	struct vop_readdir_args /* {
+		struct vnode *a_vp;
+		struct uio *a_uio;
+		struct ucred *a_cred;
+	} */ *ap;
+{
+	register struct uio *uio = ap->a_uio;
+	struct vnode *vp = ap->a_vp;
+	struct tmpfs_node *dnode = VTOTN(vp);
+	struct tmpfs_dirent *de, *nde;
+	struct tmpfs_node *tn;
+	struct dirent d;
+	u_long cookie, next;
+	int resid, error = 0;
+
+	if (vp->v_type != VDIR)
+		return (ENOTDIR);
+	if (uio->uio_offset < 0)
+		return (EINVAL);
+	cookie = uio->uio_offset;
+	resid = uio->uio_resid;
+	while (uio->uio_resid > 0) {
+		memset((caddr_t)&d, 0, sizeof (d));
+		if (cookie == 0) {
+			tn = dnode;
+			d.d_namlen = 1;
+			memcpy(d.d_name, ".", 1);
+			next = 1;
+			nde = NULL;
+		} else if (cookie == 1) {
+			/*
+			 * A removed directory has no "..".
+			 */
+			if (dnode->tn_nlink == 0) {
+				cookie = TMPFS_DIRSEQ;
+				continue;
+			}
+			tn = dnode->tn_parent;
+			d.d_namlen = 2;
+			memcpy(d.d_name, "..", 2);
+			next = TMPFS_DIRSEQ;
+			nde = dnode->tn_dirlist.tqh_first;
+		} else {
+			if ((de = tmpfs_dir_seek(dnode, cookie)) == NULL)
+				break;
+			tn = de->td_node;
+			d.d_namlen = de->td_namelen;
+			memcpy(d.d_name, de->td_name, de->td_namelen);
+			next = de->td_seq + 1;
+			nde = de->td_entries.tqe_next;
+		}
+		d.d_fileno = tn->tn_ino;
+		switch (tn->tn_type) {
+		case VDIR:
+			d.d_type = DT_DIR;
+			break;
+		case VREG:
+			d.d_type = DT_REG;
+			break;
+		case VLNK:
+			d.d_type = DT_LNK;
+			break;
+		case VSOCK:
+			d.d_type = DT_SOCK;
+			break;
+		default:
+			d.d_type = DT_UNKNOWN;
+			break;
+		}
+		d.d_reclen = TMPFS_DIRSIZ(d.d_namlen);
+		if (d.d_reclen > uio->uio_resid) {
+			if (uio->uio_resid == resid)
+				error = EINVAL;
+			break;
+		}
+		/*
+		 * Remember where the next call starts before uiomove can
+		 * sleep; removing entries keeps the position valid.
+		 */
+		if (next >= TMPFS_DIRSEQ) {
+			dnode->tn_rdseq = next;
+			dnode->tn_rdde = nde;
+		}
+		if (error = uiomove((caddr_t)&d, (int)d.d_reclen, uio))
+			break;
+		cookie = next;
+	}
+	uio->uio_offset = cookie;
+	dnode->tn_status |= TN_ACCESS;
+	return (error);
+}
+
+/*
+ * Return target name of a symbolic link
+ */
+int
+tmpfs_readlink(ap)
+	struct vop_readlink_args /* {
+		struct vnode *a_vp;
+		struct uio *a_uio;
+		struct ucred *a_cred;
+	} */ *ap;
+{
+	struct tmpfs_node *tn = VTOTN(ap->a_vp);
+
+	tn->tn_status |= TN_ACCESS;
+	return (uiomove(tn->tn_link, (int)tn->tn_size, ap->a_uio));
+}
+
+/*
+ * Abort op, called after namei() when a CREATE/DELETE isn't actually
+ * done. If a buffer has been saved in anticipation of a CREATE, delete it.
+ */
+/* ARGSUSED */
+int
+tmpfs_abortop(ap)
+	struct vop_abortop_args /* {
+		struct vnode *a_dvp;
+		struct componentname *a_cnp;
+	} */ *ap;
+{
+	if ((ap->a_cnp->cn_flags & (HASBUF | SAVESTART)) == HASBUF)
+		FREE(ap->a_cnp->cn_pnbuf, M_NAMEI);
+	return (0);
+}
+
+/*
+ * Last reference to a vnode: a file without links goes with it.
+ */
+int
+tmpfs_inactive(ap)
+	struct vop_inactive_args /* {
+		struct vnode *a_vp;
+	} */ *ap;
+{
+	struct vnode *vp = ap->a_vp;
+
+	if (VTOTN(vp)->tn_nlink <= 0 && (vp->v_flag & VXLOCK) == 0)
+		vgone(vp);
+	return (0);
+}
+
+/*
+ * Detach the node from its vnode, freeing it if it has no links left.
+ */
+int
+tmpfs_reclaim(ap)
+	struct vop_reclaim_args /* {
+		struct vnode *a_vp;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn = VTOTN(vp);
+
+	tn->tn_vnode = NULL;
+	vp->v_data = NULL;
+	if (tn->tn_nlink <= 0)
+		tmpfs_free_node(tn);
+	return (0);
+}
+
+/*
+ * Lock a node. If its already locked, set the WANT bit and sleep.
+ */
+int
+tmpfs_lock(ap)
+	struct vop_lock_args /* {
+		struct vnode *a_vp;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn;
+
+start:
+	while (vp->v_flag & VXLOCK) {
+		vp->v_flag |= VXWANT;
+		sleep((caddr_t)vp, PINOD);
+	}
+	if (vp->v_tag == VT_NON)
+		return (ENOENT);
+	tn = VTOTN(vp);
+	if (tn->tn_status & TN_LOCKED) {
+		tn->tn_status |= TN_WANTED;
+		(void) sleep((caddr_t)tn, PINOD);
+		goto start;
+	}
+	tn->tn_status |= TN_LOCKED;
+	return (0);
+}
+
+/*
+ * Unlock a node.  If WANT bit is on, wakeup.
+ */
+int
+tmpfs_unlock(ap)
+	struct vop_unlock_args /* {
+		struct vnode *a_vp;
+	} */ *ap;
+{
+	register struct tmpfs_node *tn = VTOTN(ap->a_vp);
+
+#if DIAGNOSTIC
+	if ((tn->tn_status & TN_LOCKED) == 0) {
+		vprint("tmpfs_unlock: unlocked node", ap->a_vp);
+		panic("tmpfs_unlock NOT LOCKED");
+	}
+#endif
+	tn->tn_status &= ~TN_LOCKED;
+	if (tn->tn_status & TN_WANTED) {
+		tn->tn_status &= ~TN_WANTED;
+		wakeup((caddr_t)tn);
+	}
+	return (0);
+}
+
+/*
+ * Check for a locked node.
+ */
+int
+tmpfs_islocked(ap)
+	struct vop_islocked_args /* {
+		struct vnode *a_vp;
+	} */ *ap;
+{
+
+	if (VTOTN(ap->a_vp)->tn_status & TN_LOCKED)
+		return (1);
+	return (0);
+}
+
+/*
+ * Print out the contents of a node.
+ */
+int
+tmpfs_print(ap)
+	struct vop_print_args /* {
+		struct vnode *a_vp;
+	} */ *ap;
+{
+	register struct tmpfs_node *tn = VTOTN(ap->a_vp);
+
+	printf("tag VT_TMPFS, ino %d, nlink %d, size %d%s\n", tn->tn_ino,
+	    tn->tn_nlink, (int)tn->tn_size,
+	    (tn->tn_status & TN_LOCKED) ? " (LOCKED)" : "");
+	return (0);
+}
+
+/*
+ * Return POSIX pathconf information applicable to tmpfs.
+ */
+int
+tmpfs_pathconf(ap)
+	struct vop_pathconf_args /* {
+		struct vnode *a_vp;
+		int a_name;
+		int *a_retval;
+	} */ *ap;
+{
+
+	switch (ap->a_name) {
+	case _PC_LINK_MAX:
+		*ap->a_retval = LINK_MAX;
+		return (0);
+	case _PC_NAME_MAX:
+		*ap->a_retval = NAME_MAX;
+		return (0);
+	case _PC_PATH_MAX:
+		*ap->a_retval = PATH_MAX;
+		return (0);
+	case _PC_PIPE_BUF:
+		*ap->a_retval = PIPE_BUF;
+		return (0);
+	case _PC_CHOWN_RESTRICTED:
+		*ap->a_retval = 1;
+		return (0);
+	case _PC_NO_TRUNC:
+		*ap->a_retval = 1;
+		return (0);
+	default:
+		return (EINVAL);
+	}
+	/* NOTREACHED */
+}
+
+/*
+ * Truncate a regular file to the given length.
+ */
+/* ARGSUSED */
+int
+tmpfs_truncate(ap)
+	struct vop_truncate_args /* {
+		struct vnode *a_vp;
+		off_t a_length;
+		int a_flags;
+		struct ucred *a_cred;
+		struct proc *a_p;
+	} */ *ap;
+{
+	register struct vnode *vp = ap->a_vp;
+	register struct tmpfs_node *tn = VTOTN(vp);
+	int error;
+
+	if (ap->a_length < 0)
+		return (EINVAL);
+	if (vp->v_type != VREG)
+		return (vp->v_type == VDIR ? EISDIR : EOPNOTSUPP);
+	if (ap->a_length == tn->tn_size) {
+		tn->tn_status |= TN_CHANGE | TN_UPDATE;
+		return (0);
+	}
+	if (error = tmpfs_reg_resize(tn, ap->a_length))
+		return (error);
+	vnode_pager_setsize(vp, (u_long)tn->tn_size);
+	tn->tn_status |= TN_CHANGE | TN_UPDATE;
+	return (0);
+}
+
+/*
+ * Settle the times of a node; there is nothing to write.
+ */
+/* ARGSUSED */
+int
+tmpfs_update(ap)
+	struct vop_update_args /* {
+		struct vnode *a_vp;
+		struct timeval *a_access;
+		struct timeval *a_modify;
+		int a_waitfor;
+	} */ *ap;
+{
+
+	TN_TIMES(VTOTN(ap->a_vp));
+	return (0);
+}
+
+/*
+ * Make a node and enter it in directory dvp, after ufs_makeinode.
+ * target is the contents of a symbolic link.
+ */
+static int
+tmpfs_makenode(dvp, vpp, cnp, type, mode, target)
+	struct vnode *dvp;
+	struct vnode **vpp;
+	struct componentname *cnp;
+	enum vtype type;
+	int mode;
+	char *target;
+{
+	struct tmpfs_node *dnode = VTOTN(dvp);
+	struct tmpfs_node *tn;
+	struct tmpfs_dirent *de;
+	struct vnode *vp;
+	int len, error;
+
+#if DIAGNOSTIC
+	if ((cnp->cn_flags & HASBUF) == 0)
+		panic("tmpfs_makenode: no name");
+#endif
+	*vpp = NULL;
+	if (type == VDIR && dnode->tn_nlink >= LINK_MAX) {
+		error = EMLINK;
+		goto bad;
+	}
+	/*
+	 * Get the name first: it is the only part that may sleep
+	 * and the only one that is easy to give back.
+	 */
+	if ((de = tmpfs_alloc_dirent(cnp->cn_nameptr,
+	    cnp->cn_namelen)) == NULL) {
+		error = ENOSPC;
+		goto bad;
+	}
+	if (error = tmpfs_alloc_node(dnode->tn_mount, type, (mode_t)mode,
+	    cnp->cn_cred->cr_uid, dnode->tn_gid, dnode, &tn)) {
+		tmpfs_free_dirent(de);
+		goto bad;
+	}
+	if ((tn->tn_mode & S_ISGID) &&
+	    !groupmember(tn->tn_gid, cnp->cn_cred) &&
+	    suser(cnp->cn_cred, NULL))
+		tn->tn_mode &= ~S_ISGID;
+	if (target != NULL) {
+		len = strlen(target);
+		tn->tn_link = malloc((u_long)len, M_TEMP, M_WAITOK);
+		memcpy(tn->tn_link, target, len);
+		tn->tn_size = len;
+	}
+	if (error = tmpfs_allocvp(dvp->v_mount, tn, &vp)) {
+		tmpfs_free_node(tn);
+		tmpfs_free_dirent(de);
+		goto bad;
+	}
+	tmpfs_dir_attach(dnode, de, tn);
+	if (type == VDIR) {
+		dnode->tn_nlink++;
+		dnode->tn_status |= TN_CHANGE;
+	}
+	if ((cnp->cn_flags & SAVESTART) == 0)
+		FREE(cnp->cn_pnbuf, M_NAMEI);
+	vput(dvp);
+	*vpp = vp;
+	return (0);
+
+bad:
+	free(cnp->cn_pnbuf, M_NAMEI);
+	vput(dvp);
+	return (error);
+}
+
+#define tmpfs_close ((int (*) (struct  vop_close_args *))nullop)
+#define tmpfs_ioctl ((int (*) (struct  vop_ioctl_args *))enoioctl)
+#define tmpfs_select ((int (*) (struct  vop_select_args *))nullop)
+#define tmpfs_mmap ((int (*) (struct  vop_mmap_args *))eopnotsupp)
+#define tmpfs_fsync ((int (*) (struct  vop_fsync_args *))nullop)
+#define tmpfs_seek ((int (*) (struct  vop_seek_args *))nullop)
+#define tmpfs_bmap ((int (*) (struct  vop_bmap_args *))eopnotsupp)
+#define tmpfs_strategy ((int (*) (struct  vop_strategy_args *))eopnotsupp)
+#define tmpfs_advlock ((int (*) (struct vop_advlock_args *))eopnotsupp)
+
+int (**tmpfs_vnodeop_p)();
+struct vnodeopv_entry_desc tmpfs_vnodeop_entries[] = {
+	{ &vop_default_desc, vn_default_error },
+	{ &vop_lookup_desc, tmpfs_lookup },		/* lookup */
+	{ &vop_create_desc, tmpfs_create },		/* create */
+	{ &vop_mknod_desc, tmpfs_mknod },		/* mknod */
+	{ &vop_open_desc, tmpfs_open },			/* open */
+	{ &vop_close_desc, tmpfs_close },		/* close */
+	{ &vop_access_desc, tmpfs_access },		/* access */
+	{ &vop_getattr_desc, tmpfs_getattr },		/* getattr */
+	{ &vop_setattr_desc, tmpfs_setattr },		/* setattr */
+	{ &vop_read_desc, tmpfs_read },			/* read */
+	{ &vop_write_desc, tmpfs_write },		/* write */
+	{ &vop_ioctl_desc, tmpfs_ioctl },		/* ioctl */
+	{ &vop_select_desc, tmpfs_select },		/* select */
+	{ &vop_mmap_desc, tmpfs_mmap },			/* mmap */
+	{ &vop_fsync_desc, tmpfs_fsync },		/* fsync */
+	{ &vop_seek_desc, tmpfs_seek },			/* seek */
+	{ &vop_remove_desc, tmpfs_remove },		/* remove */
+	{ &vop_link_desc, tmpfs_link },			/* link */
+	{ &vop_rename_desc, tmpfs_rename },		/* rename */
+	{ &vop_mkdir_desc, tmpfs_mkdir },		/* mkdir */
+	{ &vop_rmdir_desc, tmpfs_rmdir },		/* rmdir */
+	{ &vop_symlink_desc, tmpfs_symlink },		/* symlink */
+	{ &vop_readdir_desc, tmpfs_readdir },		/* readdir */
+	{ &vop_readlink_desc, tmpfs_readlink },		/* readlink */
+	{ &vop_abortop_desc, tmpfs_abortop },		/* abortop */
+	{ &vop_inactive_desc, tmpfs_inactive },		/* inactive */
+	{ &vop_reclaim_desc, tmpfs_reclaim },		/* reclaim */
+	{ &vop_lock_desc, tmpfs_lock },			/* lock */
+	{ &vop_unlock_desc, tmpfs_unlock },		/* unlock */
+	{ &vop_bmap_desc, tmpfs_bmap },			/* bmap */
+	{ &vop_strategy_desc, tmpfs_strategy },		/* strategy */
+	{ &vop_print_desc, tmpfs_print },		/* print */
+	{ &vop_islocked_desc, tmpfs_islocked },		/* islocked */
+	{ &vop_pathconf_desc, tmpfs_pathconf },		/* pathconf */
+	{ &vop_advlock_desc, tmpfs_advlock },		/* advlock */
+	{ &vop_truncate_desc, tmpfs_truncate },		/* truncate */
+	{ &vop_update_desc, tmpfs_update },		/* update */
+	{ (struct vnodeop_desc*)NULL, (int(*)())NULL }
+};
+struct vnodeopv_desc tmpfs_vnodeop_opv_desc =
+	{ &tmpfs_vnodeop_p, tmpfs_vnodeop_entries };
@@ -42,9 +42,11 @@
  */
 
 #include "bpfilter.h"
+#include "map_uarea.h"
 
 #if NBPFILTER > 0
 
+#include <serv/server_defs.h>
 #include <sys/param.h>
 #include <sys/systm.h>
 #include <sys/mbuf.h>
@@ -127,10 +129,13 @@ static int	bpf_movein (struct uio *, int,
 		    struct mbuf **, struct sockaddr *, int *);
 static int	bpf_setif (struct bpf_d *, struct ifreq *);
 static int	bpf_setif (struct bpf_d *, struct ifreq *);
+static int	bpf_setring (struct bpf_d *, struct bpf_ringreq *);
 static inline void
 		bpf_wakeup (struct bpf_d *);
 static void	catchpacket (struct bpf_d *, u_char *, u_int,
 		    u_int, void (*)(const void *, void *, u_int));
+static void	catchpacket_ring (struct bpf_d *, u_char *, u_int,
+		    u_int, void (*)(const void *, void *, u_int));
 static void	reset_d (struct bpf_d *);
 
 static int
@@ -413,9 +418,9 @@ bpfread(dev, uio)
 
 	/*
 	 * Restrict application to use a buffer the same size as
-	 * as kernel buffers.
+	 * as kernel buffers.  A ring is read in place, not here.
 	 */
-	if (uio->uio_resid != d->bd_bufsize)
+	if (d->bd_ring || uio->uio_resid != d->bd_bufsize)
 		return (EINVAL);
 
 	s = splimp();
@@ -562,6 +567,7 @@ reset_d(d)
 	d->bd_hlen = 0;
 	d->bd_rcount = 0;
 	d->bd_dcount = 0;
+	d->bd_ringdrops = 0;
 }
 
 /*
@@ -579,6 +585,7 @@ reset_d(d)
  *  BIOCGSTATS		Get packet stats.
  *  BIOCIMMEDIATE	Set immediate mode.
  *  BIOCVERSION		Get filter language version.
+ *  BIOCSRING		Map a shared capture ring.
  */
 /* ARGSUSED */
 int
@@ -655,6 +662,16 @@ bpfioctl(dev, cmd, addr, flag)
 #endif
 		break;
 
+	/*
+	 * Map a shared capture ring into the caller.
+	 */
+	case BIOCSRING:
+		if (d->bd_bif != 0 || d->bd_ring != 0)
+			error = EINVAL;
+		else
+			error = bpf_setring(d, (struct bpf_ringreq *)addr);
+		break;
+
 	/*
 	 * Set link layer read filter.
 	 */
@@ -791,19 +808,24 @@ bpf_setf(d, fp)
 	struct bpf_program *fp;
 {
 	struct bpf_insn *fcode, *old;
-	u_int flen, size;
+	bpf_jit_func jit, oldjit;
+	u_int flen, size, jitsize, oldjitsize;
 	int s;
 
 	old = d->bd_filter;
+	oldjit = d->bd_jitcode;
+	oldjitsize = d->bd_jitsize;
 	if (fp->bf_insns == 0) {
 		if (fp->bf_len != 0)
 			return (EINVAL);
 		s = splimp();
 		d->bd_filter = 0;
+		d->bd_jitcode = 0;
 		reset_d(d);
 		splx(s);
 		if (old != 0)
 			free((caddr_t)old, M_DEVBUF);
+		bpf_jit_free(oldjit, oldjitsize);
 		return (0);
 	}
 	flen = fp->bf_len;
@@ -814,12 +836,17 @@ bpf_setf(d, fp)
 	fcode = (struct bpf_insn *)malloc(size, M_DEVBUF, M_WAITOK);
 	if (copyin((caddr_t)fp->bf_insns, (caddr_t)fcode, size) == 0 &&
 	    bpf_validate(fcode, (int)flen)) {
+		jitsize = 0;
+		jit = bpf_jit_compile(fcode, (int)flen, &jitsize);
 		s = splimp();
 		d->bd_filter = fcode;
+		d->bd_jitcode = jit;
+		d->bd_jitsize = jitsize;
 		reset_d(d);
 		splx(s);
 		if (old != 0)
 			free((caddr_t)old, M_DEVBUF);
+		bpf_jit_free(oldjit, oldjitsize);
 
 		return (0);
 	}
@@ -878,7 +905,7 @@ bpf_setif(d, ifr)
 		if ((ifp->if_flags & IFF_UP) == 0)
 			return (ENETDOWN);
 
-		if (d->bd_sbuf == 0) {
+		if (d->bd_sbuf == 0 && d->bd_ring == 0) {
 			error = bpf_allocbufs(d);
 			if (error != 0)
 				return (error);
@@ -959,7 +986,10 @@ bpf_select(dev, rw, p)
 	d = &bpf_dtab[minor(dev)];
 
 	s = splimp();
-	if (d->bd_hlen != 0 || (d->bd_immediate && d->bd_slen != 0)) {
+	if (d->bd_hlen != 0 || (d->bd_immediate && d->bd_slen != 0) ||
+	    (d->bd_ring && BPF_RING_SLOT(d->bd_ring, d->bd_ringslotsize,
+	    d->bd_ring->br_head & (d->bd_ringslots - 1))->bs_status ==
+	    BPF_SLOT_FULL)) {
 		/*
 		 * There is data waiting.
 		 */
@@ -1008,7 +1038,10 @@ bpf_tap(arg, pkt, pktlen)
 	bp = (struct bpf_if *)arg;
 	for (d = bp->bif_dlist; d != 0; d = d->bd_next) {
 		++d->bd_rcount;
-		slen = bpf_filter(d->bd_filter, pkt, pktlen, pktlen);
+		if (d->bd_jitcode)
+			slen = (*d->bd_jitcode)(pkt, pktlen, pktlen, 0);
+		else
+			slen = bpf_filter(d->bd_filter, pkt, pktlen, pktlen);
 		if (slen != 0)
 			catchpacket(d, pkt, pktlen, slen, bcopy);
 	}
@@ -1060,7 +1093,11 @@ bpf_mtap(arg, m)
 
 	for (d = bp->bif_dlist; d != 0; d = d->bd_next) {
 		++d->bd_rcount;
-		slen = bpf_filter(d->bd_filter, (u_char *)m, pktlen, 0);
+		if (d->bd_jitcode)
+			slen = (*d->bd_jitcode)(mtod(m, u_char *), pktlen,
+			    m->m_len, m);
+		else
+			slen = bpf_filter(d->bd_filter, (u_char *)m, pktlen, 0);
 		if (slen != 0)
 			catchpacket(d, (u_char *)m, pktlen, slen, bpf_mcopy);
 	}
@@ -1084,6 +1121,11 @@ catchpacket(d, pkt, pktlen, snaplen, cpfn)
 	register struct bpf_hdr *hp;
 	register int totlen, curlen;
 	register int hdrlen = d->bd_bif->bif_hdrlen;
+
+	if (d->bd_ring) {
+		catchpacket_ring(d, pkt, pktlen, snaplen, cpfn);
+		return;
+	}
 	/*
 	 * Figure out how many bytes to move.  If the packet is
 	 * greater or equal to the snapshot length, transfer that
@@ -1143,6 +1185,128 @@ catchpacket(d, pkt, pktlen, snaplen, cpfn)
 	d->bd_slen = curlen + totlen;
 }
 
+/*
+ * Move the packet into the next slot of d's shared ring.  If the
+ * reader has not yet handed that slot back, drop the packet and
+ * charge the drop to the next slot filled.  The header and data are
+ * written before the status, which the reader polls; the indirect
+ * copy call keeps the compiler from moving the stores past it.
+ */
+static void
+catchpacket_ring(d, pkt, pktlen, snaplen, cpfn)
+	register struct bpf_d *d;
+	register u_char *pkt;
+	register u_int pktlen, snaplen;
+	register void (*cpfn)(const void *, void *, u_int);
+{
+	register struct bpf_ring *r = d->bd_ring;
+	register struct bpf_slot *bs;
+	register struct bpf_hdr *hp;
+	register int hdrlen = d->bd_bif->bif_hdrlen;
+	u_int tail, caplen, room;
+
+	tail = d->bd_ringtail;
+	bs = BPF_RING_SLOT(r, d->bd_ringslotsize, tail & (d->bd_ringslots - 1));
+	if (bs->bs_status != BPF_SLOT_FREE) {
+		++d->bd_dcount;
+		++d->bd_ringdrops;
+		return;
+	}
+	room = d->bd_ringslotsize - ((caddr_t)&bs->bs_hdr - (caddr_t)bs) -
+	    hdrlen;
+	caplen = min(snaplen, pktlen);
+	if (caplen > room)
+		caplen = room;
+
+	hp = &bs->bs_hdr;
+#if BSD >= 199103
+	microtime(&hp->bh_tstamp);
+#elif defined(sun)
+	uniqtime(&hp->bh_tstamp);
+#else
+	hp->bh_tstamp = time;
+#endif
+	hp->bh_datalen = pktlen;
+	hp->bh_hdrlen = hdrlen;
+	hp->bh_caplen = caplen;
+	bs->bs_drops = d->bd_ringdrops;
+	d->bd_ringdrops = 0;
+	(*cpfn)(pkt, (u_char *)hp + hdrlen, caplen);
+	bs->bs_status = BPF_SLOT_FULL;
+
+	d->bd_ringtail = ++tail;
+	r->br_tail = tail;
+	/*
+	 * Wake the reader if it had caught up with us, and so may
+	 * be asleep in select.
+	 */
+	if (d->bd_immediate || r->br_head == tail - 1)
+		bpf_wakeup(d);
+}
+
+/*
+ * Create a ring for d in a default pager object and map it both
+ * here and into the calling process, as the u-area is shared.
+ * Without MAP_UAREA there is no default pager port to ask.
+ */
+static int
+bpf_setring(d, rq)
+	register struct bpf_d *d;
+	register struct bpf_ringreq *rq;
+{
+#if MAP_UAREA
+	struct proc *p = get_proc();
+	mach_port_t object;
+	vm_address_t kaddr = 0, uaddr = 0;
+	vm_size_t size;
+	kern_return_t kr;
+	struct bpf_ring *r;
+
+	if (rq->brr_nslots == 0 || (rq->brr_nslots & (rq->brr_nslots - 1)) ||
+	    rq->brr_slotsize < sizeof(struct bpf_slot) + BPF_MINBUFSIZE ||
+	    rq->brr_slotsize > BPF_MAXBUFSIZE ||
+	    rq->brr_slotsize != BPF_WORDALIGN(rq->brr_slotsize) ||
+	    rq->brr_nslots > BPF_MAXRINGSIZE / rq->brr_slotsize)
+		return (EINVAL);
+	size = round_page(BPF_WORDALIGN(sizeof(struct bpf_ring)) +
+	    rq->brr_nslots * rq->brr_slotsize);
+
+	kr = default_pager_object_create(default_pager_port, &object, size);
+	if (kr != KERN_SUCCESS)
+		return (ENOMEM);
+	kr = vm_map(mach_task_self(), &kaddr, size, 0, TRUE, object, 0,
+		    FALSE, VM_PROT_READ|VM_PROT_WRITE,
+		    VM_PROT_READ|VM_PROT_WRITE, VM_INHERIT_NONE);
+	if (kr == KERN_SUCCESS) {
+		kr = mmap_vm_map(p, 0, size, TRUE, object, 0, FALSE,
+				 VM_PROT_READ|VM_PROT_WRITE,
+				 VM_PROT_READ|VM_PROT_WRITE,
+				 VM_INHERIT_SHARE, &uaddr);
+		if (kr != KERN_SUCCESS)
+			(void) vm_deallocate(mach_task_self(), kaddr, size);
+	}
+	/* The mappings hold their own references. */
+	(void) mach_port_deallocate(mach_task_self(), object);
+	if (kr != KERN_SUCCESS)
+		return (ENOMEM);
+
+	r = (struct bpf_ring *)kaddr;
+	r->br_head = r->br_tail = 0;
+	r->br_nslots = rq->brr_nslots;
+	r->br_slotsize = rq->brr_slotsize;
+	d->bd_ringsize = size;
+	d->bd_ringslots = rq->brr_nslots;
+	d->bd_ringslotsize = rq->brr_slotsize;
+	d->bd_ringtail = 0;
+	d->bd_ringdrops = 0;
+	d->bd_ring = r;
+	rq->brr_addr = (caddr_t)uaddr;
+	return (0);
+#else
+	return (EOPNOTSUPP);
+#endif
+}
+
 /*
  * Initialize all nonzero fields of a descriptor.
  */
@@ -1184,8 +1348,12 @@ bpf_freed(d)
 		if (d->bd_fbuf != 0)
 			free(d->bd_fbuf, M_DEVBUF);
 	}
+	if (d->bd_ring != 0)
+		(void) vm_deallocate(mach_task_self(), (vm_address_t)d->bd_ring,
+				     (vm_size_t)d->bd_ringsize);
 	if (d->bd_filter)
 		free((caddr_t)d->bd_filter, M_DEVBUF);
+	bpf_jit_free(d->bd_jitcode, d->bd_jitsize);
 
 	D_MARKFREE(d);
 }
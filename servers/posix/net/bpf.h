@@ -107,6 +107,7 @@ struct bpf_version {
 #define BIOCGSTATS	_IOR(B,111, struct bpf_stat)
 #define BIOCIMMEDIATE	_IOW(B,112, u_int)
 #define BIOCVERSION	_IOR(B,113, struct bpf_version)
+#define BIOCSRING	_IOWR(B,114, struct bpf_ringreq)
 #else
 #define	BIOCGBLEN	_IOR('B',102, u_int)
 #define	BIOCSBLEN	_IOWR('B',102, u_int)
@@ -121,6 +122,7 @@ struct bpf_version {
 #define BIOCGSTATS	_IOR('B',111, struct bpf_stat)
 #define BIOCIMMEDIATE	_IOW('B',112, u_int)
 #define BIOCVERSION	_IOR('B',113, struct bpf_version)
+#define BIOCSRING	_IOWR('B',114, struct bpf_ringreq)
 #endif
 
 /*
@@ -142,6 +144,42 @@ struct bpf_hdr {
 #define SIZEOF_BPF_HDR 18
 #endif
 
+/*
+ * Shared capture ring, set up by BIOCSRING before BIOCSETIF.  The ring
+ * is mapped into the caller: a struct bpf_ring followed by br_nslots
+ * slots of br_slotsize bytes.  Each slot is a struct bpf_slot whose
+ * packet data starts bh_hdrlen bytes past bs_hdr.  The server fills
+ * the slot at br_tail and marks it BPF_SLOT_FULL; the reader consumes
+ * slots from br_head, marks each BPF_SLOT_FREE and advances br_head,
+ * without calling read().  select() reports the ring readable when the
+ * slot at br_head is full.
+ */
+struct bpf_ringreq {
+	u_int	brr_nslots;		/* slots, a power of two */
+	u_int	brr_slotsize;		/* bytes per slot, header included */
+	caddr_t	brr_addr;		/* returned: ring in the caller */
+};
+
+struct bpf_ring {
+	volatile u_int	br_head;	/* next slot to read, reader owned */
+	volatile u_int	br_tail;	/* next slot to fill, server owned */
+	u_int	br_nslots;		/* as requested */
+	u_int	br_slotsize;		/* as requested */
+};
+
+struct bpf_slot {
+	volatile u_int	bs_status;	/* BPF_SLOT_FREE or BPF_SLOT_FULL */
+	u_int	bs_drops;		/* packets dropped since last slot */
+	struct	bpf_hdr	bs_hdr;		/* header, data bh_hdrlen past it */
+};
+#define BPF_SLOT_FREE	0
+#define BPF_SLOT_FULL	1
+
+#define BPF_RING_SLOT(r, slotsize, i) \
+	((struct bpf_slot *)((caddr_t)(r) + \
+	    BPF_WORDALIGN(sizeof(struct bpf_ring)) + (i) * (slotsize)))
+#define BPF_MAXRINGSIZE	(16*1024*1024)
+
 /*
  * Data-link level type codes.
  * Currently, only DLT_EN10MB and DLT_SLIP are supported.
@@ -246,6 +284,17 @@ void	 bpf_mtap (caddr_t, struct mbuf *);
 void	 bpfattach (caddr_t *, struct ifnet *, u_int, u_int);
 void	 bpfilterattach (int);
 u_int	 bpf_filter (struct bpf_insn *, u_char *, u_int, u_int);
+u_int	 bpf_mload (struct mbuf *, int, int, int *);
+
+/*
+ * A filter compiled to native code: called with the packet buffer,
+ * the wire length, the buffer length and, for bpf_mtap, the chain
+ * the buffer is the first mbuf of.
+ */
+typedef u_int	(*bpf_jit_func) (u_char *, u_int, u_int, struct mbuf *);
+
+bpf_jit_func bpf_jit_compile (struct bpf_insn *, int, u_int *);
+void	 bpf_jit_free (bpf_jit_func, u_int);
 #endif
 
 /*
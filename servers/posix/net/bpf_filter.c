@@ -113,15 +113,13 @@ m_xword(m, k, err)
 	switch (len - k) {
 
 	case 1:
-		return (cp[k] << 24) | (np[0] << 16) | (np[1] << 8) | np[2];
+		return (cp[0] << 24) | (np[0] << 16) | (np[1] << 8) | np[2];
 
 	case 2:
-		return (cp[k] << 24) | (cp[k + 1] << 16) | (np[0] << 8) | 
-			np[1];
+		return (cp[0] << 24) | (cp[1] << 16) | (np[0] << 8) | np[1];
 
 	default:
-		return (cp[k] << 24) | (cp[k + 1] << 16) | (cp[k + 2] << 8) |
-			np[0];
+		return (cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | np[0];
 	}
     bad:
 	*err = 1;
@@ -154,11 +152,44 @@ m_xhalf(m, k, err)
 	if (m0 == 0)
 		goto bad;
 	*err = 0;
-	return (cp[k] << 8) | mtod(m0, u_char *)[0];
+	return (cp[0] << 8) | mtod(m0, u_char *)[0];
  bad:
 	*err = 1;
 	return 0;
 }
+
+/*
+ * Load a word, halfword or byte at offset k of an mbuf chain.
+ * Called by filters compiled by bpf_jit_compile for loads past
+ * the first mbuf.
+ */
+u_int
+bpf_mload(m, k, size, err)
+	register struct mbuf *m;
+	register int k;
+	int size, *err;
+{
+	switch (size) {
+
+	case 4:
+		return m_xword(m, k, err);
+
+	case 2:
+		return m_xhalf(m, k, err);
+
+	default:
+		while (m != 0 && k >= m->m_len) {
+			k -= m->m_len;
+			m = m->m_next;
+		}
+		if (m == 0) {
+			*err = 1;
+			return 0;
+		}
+		*err = 0;
+		return mtod(m, u_char *)[k];
+	}
+}
 #endif
 
 #include <net/bpf.h>
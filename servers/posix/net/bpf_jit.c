@@ -0,0 +1,524 @@
+/*
+ *	File:	net/bpf_jit.c
+ *
+ *	Compile BPF filter programs to native code.
+ *
+ *	bpf_setf hands every program that passed bpf_validate to
+ *	bpf_jit_compile.  On x86_64 the program is translated instruction
+ *	by instruction into a function that bpf_tap and bpf_mtap call in
+ *	place of the bpf_filter interpreter.  Loads within the contiguous
+ *	buffer are done inline; loads past it call bpf_mload to walk the
+ *	mbuf chain.  Elsewhere, or for a program the compiler does not
+ *	handle, bpf_jit_compile returns 0 and the interpreter is used.
+ */
+
+#include <serv/server_defs.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/mbuf.h>
+#include <sys/time.h>
+
+#include <net/bpf.h>
+
+#include <vm/vm.h>
+
+int	bpf_jit_enable = 1;
+
+#if defined(__x86_64__)
+
+/*
+ * Register use in the generated code:
+ *	eax	A
+ *	r15d	X
+ *	rbx	packet buffer
+ *	r12	length of the packet buffer
+ *	r13	mbuf chain, or 0 if the buffer is the whole packet
+ *	r14d	wire length
+ *	esi	offset of the current load
+ * Scratch memory lives in the frame at [rsp + 4*k], the error word
+ * for bpf_mload at [rsp + 64] and a saved A at [rsp + 68].
+ */
+#define	JIT_FRAME	80
+#define	JIT_ERR		64
+#define	JIT_SAVEA	68
+
+struct bpf_jit_state {
+	u_char	*js_buf;		/* code, or 0 while sizing */
+	u_int	js_off;			/* offset of next byte */
+	u_int	*js_refs;		/* offset of each instruction */
+	u_int	js_ret0;		/* offset of the return 0 stub */
+	u_int	js_epilog;		/* offset of the epilogue */
+};
+
+static void
+emit1(js, b)
+	register struct bpf_jit_state *js;
+	u_int b;
+{
+	if (js->js_buf)
+		js->js_buf[js->js_off] = b;
+	js->js_off++;
+}
+
+static void
+emit4(js, v)
+	register struct bpf_jit_state *js;
+	u_int v;
+{
+	emit1(js, v);
+	emit1(js, v >> 8);
+	emit1(js, v >> 16);
+	emit1(js, v >> 24);
+}
+
+static void
+emitn(js, s, n)
+	register struct bpf_jit_state *js;
+	register const u_char *s;
+	register int n;
+{
+	while (n-- > 0)
+		emit1(js, *s++);
+}
+
+#define	EMIT(js, bytes)	emitn(js, (const u_char *)bytes, sizeof (bytes) - 1)
+
+/*
+ * Jump to an offset with a 32 bit displacement.  Every jump has the
+ * same length, so the sizing pass and the emitting pass agree on the
+ * offset of each instruction.
+ */
+static void
+emit_jmp(js, to)
+	register struct bpf_jit_state *js;
+	u_int to;
+{
+	emit1(js, 0xe9);
+	emit4(js, to - (js->js_off + 4));
+}
+
+static void
+emit_jcc(js, cc, to)
+	register struct bpf_jit_state *js;
+	u_int cc, to;
+{
+	emit1(js, 0x0f);
+	emit1(js, 0x80 | cc);
+	emit4(js, to - (js->js_off + 4));
+}
+
+/* condition codes for emit_jcc */
+#define	CC_B	0x2
+#define	CC_AE	0x3
+#define	CC_E	0x4
+#define	CC_NE	0x5
+#define	CC_BE	0x6
+#define	CC_A	0x7
+
+/*
+ * Load size bytes at offset rsi into A (or into X for BPF_MSH).
+ */
+static void
+emit_load(js, size, msh)
+	register struct bpf_jit_state *js;
+	int size, msh;
+{
+	u_int slow, done;
+
+	/* lea rdi,[rsi+size]; cmp rdi,r12; ja slow */
+	EMIT(js, "\x48\x8d\x7e");
+	emit1(js, size);
+	EMIT(js, "\x4c\x39\xe7");
+	emit1(js, 0x0f);
+	emit1(js, 0x80 | CC_A);
+	slow = js->js_off;
+	emit4(js, 0);
+
+	switch (size) {
+	case 4:
+		EMIT(js, "\x8b\x04\x33");		/* mov eax,[rbx+rsi] */
+		EMIT(js, "\x0f\xc8");			/* bswap eax */
+		break;
+	case 2:
+		EMIT(js, "\x0f\xb7\x04\x33");		/* movzx eax,w[rbx+rsi] */
+		EMIT(js, "\x66\xc1\xc0\x08");		/* rol ax,8 */
+		break;
+	default:
+		if (msh) {
+			EMIT(js, "\x0f\xb6\x0c\x33");	/* movzx ecx,b[rbx+rsi] */
+			EMIT(js, "\x83\xe1\x0f");	/* and ecx,0xf */
+			EMIT(js, "\xc1\xe1\x02");	/* shl ecx,2 */
+			EMIT(js, "\x41\x89\xcf");	/* mov r15d,ecx */
+		} else
+			EMIT(js, "\x0f\xb6\x04\x33");	/* movzx eax,b[rbx+rsi] */
+		break;
+	}
+	emit1(js, 0xe9);
+	done = js->js_off;
+	emit4(js, 0);
+
+	/*
+	 * Past the buffer: fail unless there is a chain to walk.
+	 */
+	if (js->js_buf)
+		*(u_int *)(js->js_buf + slow) = js->js_off - (slow + 4);
+	EMIT(js, "\x4d\x85\xed");			/* test r13,r13 */
+	emit_jcc(js, CC_E, js->js_ret0);
+	EMIT(js, "\x48\x89\xf7");			/* mov rdi,rsi */
+	EMIT(js, "\x48\xc1\xef\x1f");			/* shr rdi,31 */
+	emit_jcc(js, CC_NE, js->js_ret0);
+	if (msh)
+		EMIT(js, "\x89\x44\x24\x44");		/* mov [rsp+68],eax */
+	EMIT(js, "\x4c\x89\xef");			/* mov rdi,r13 */
+	emit1(js, 0xba);				/* mov edx,size */
+	emit4(js, size);
+	EMIT(js, "\x48\x8d\x4c\x24\x40");		/* lea rcx,[rsp+64] */
+	EMIT(js, "\x48\xb8");				/* mov rax,bpf_mload */
+	emit4(js, (u_long)bpf_mload);
+	emit4(js, (u_long)bpf_mload >> 32);
+	EMIT(js, "\xff\xd0");				/* call rax */
+	EMIT(js, "\x83\x7c\x24\x40\x00");		/* cmp d[rsp+64],0 */
+	emit_jcc(js, CC_NE, js->js_ret0);
+	if (msh) {
+		EMIT(js, "\x83\xe0\x0f");		/* and eax,0xf */
+		EMIT(js, "\xc1\xe0\x02");		/* shl eax,2 */
+		EMIT(js, "\x41\x89\xc7");		/* mov r15d,eax */
+		EMIT(js, "\x8b\x44\x24\x44");		/* mov eax,[rsp+68] */
+	}
+	if (js->js_buf)
+		*(u_int *)(js->js_buf + done) = js->js_off - (done + 4);
+}
+
+/*
+ * Conditional jump on the flags just set, true to jt and false to jf
+ * instructions past insn i.
+ */
+static void
+emit_branch(js, i, cc, jt, jf)
+	register struct bpf_jit_state *js;
+	int i;
+	u_int cc, jt, jf;
+{
+	u_int *refs = js->js_refs;
+
+	if (jt == jf) {
+		if (jt)
+			emit_jmp(js, refs[i + 1 + jt]);
+	} else if (jt == 0)
+		emit_jcc(js, cc ^ 1, refs[i + 1 + jf]);
+	else {
+		emit_jcc(js, cc, refs[i + 1 + jt]);
+		if (jf)
+			emit_jmp(js, refs[i + 1 + jf]);
+	}
+}
+
+/*
+ * Translate the program once.  Returns 0 if it holds an instruction
+ * the compiler does not handle.
+ */
+static int
+bpf_jit_pass(js, f, len)
+	register struct bpf_jit_state *js;
+	struct bpf_insn *f;
+	int len;
+{
+	register struct bpf_insn *p;
+	register int i;
+	u_int k;
+
+	js->js_off = 0;
+
+	/*
+	 * push rbx,r12-r15; sub rsp,JIT_FRAME
+	 * mov rbx,rdi; mov r14d,esi; mov r12d,edx; mov r13,rcx
+	 * xor eax,eax; xor r15d,r15d
+	 */
+	EMIT(js, "\x53\x41\x54\x41\x55\x41\x56\x41\x57");
+	EMIT(js, "\x48\x83\xec");
+	emit1(js, JIT_FRAME);
+	EMIT(js, "\x48\x89\xfb\x41\x89\xf6\x41\x89\xd4\x49\x89\xcd");
+	EMIT(js, "\x31\xc0\x45\x31\xff");
+
+	for (i = 0; i < len; i++) {
+		p = &f[i];
+		k = (u_int)p->k;
+		js->js_refs[i] = js->js_off;
+
+		switch (p->code) {
+
+		default:
+			return (0);
+
+		case BPF_RET|BPF_K:
+			emit1(js, 0xb8);			/* mov eax,k */
+			emit4(js, k);
+			emit_jmp(js, js->js_epilog);
+			break;
+
+		case BPF_RET|BPF_A:
+			emit_jmp(js, js->js_epilog);
+			break;
+
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_ABS:
+		case BPF_LDX|BPF_MSH|BPF_B:
+			emit1(js, 0xbe);			/* mov esi,k */
+			emit4(js, k);
+			goto load;
+
+		case BPF_LD|BPF_W|BPF_IND:
+		case BPF_LD|BPF_H|BPF_IND:
+		case BPF_LD|BPF_B|BPF_IND:
+			EMIT(js, "\x44\x89\xfe");		/* mov esi,r15d */
+			EMIT(js, "\x48\x81\xc6");		/* add rsi,k */
+			emit4(js, k);
+		load:
+			emit_load(js,
+			    BPF_SIZE(p->code) == BPF_W ? 4 :
+			    BPF_SIZE(p->code) == BPF_H ? 2 : 1,
+			    BPF_CLASS(p->code) == BPF_LDX);
+			break;
+
+		case BPF_LD|BPF_W|BPF_LEN:
+			EMIT(js, "\x44\x89\xf0");		/* mov eax,r14d */
+			break;
+
+		case BPF_LDX|BPF_W|BPF_LEN:
+			EMIT(js, "\x45\x89\xf7");		/* mov r15d,r14d */
+			break;
+
+		case BPF_LD|BPF_IMM:
+			emit1(js, 0xb8);			/* mov eax,k */
+			emit4(js, k);
+			break;
+
+		case BPF_LDX|BPF_IMM:
+			EMIT(js, "\x41\xbf");			/* mov r15d,k */
+			emit4(js, k);
+			break;
+
+		/*
+		 * bpf_validate does not range check BPF_LDX|BPF_MEM
+		 * or BPF_STX; leave such programs to the interpreter.
+		 */
+		case BPF_LD|BPF_MEM:
+		case BPF_LDX|BPF_MEM:
+		case BPF_ST:
+		case BPF_STX:
+			if (k >= BPF_MEMWORDS)
+				return (0);
+			if (p->code == (BPF_LD|BPF_MEM))
+				EMIT(js, "\x8b\x44\x24");	/* mov eax,[rsp+d] */
+			else if (p->code == (BPF_LDX|BPF_MEM))
+				EMIT(js, "\x44\x8b\x7c\x24");	/* mov r15d,[rsp+d] */
+			else if (p->code == BPF_ST)
+				EMIT(js, "\x89\x44\x24");	/* mov [rsp+d],eax */
+			else
+				EMIT(js, "\x44\x89\x7c\x24");	/* mov [rsp+d],r15d */
+			emit1(js, k * 4);
+			break;
+
+		case BPF_JMP|BPF_JA:
+			if (k)
+				emit_jmp(js, js->js_refs[i + 1 + k]);
+			break;
+
+		case BPF_JMP|BPF_JGT|BPF_K:
+		case BPF_JMP|BPF_JGE|BPF_K:
+		case BPF_JMP|BPF_JEQ|BPF_K:
+			emit1(js, 0x3d);			/* cmp eax,k */
+			emit4(js, k);
+			goto branch;
+
+		case BPF_JMP|BPF_JSET|BPF_K:
+			emit1(js, 0xa9);			/* test eax,k */
+			emit4(js, k);
+			goto branch;
+
+		case BPF_JMP|BPF_JGT|BPF_X:
+		case BPF_JMP|BPF_JGE|BPF_X:
+		case BPF_JMP|BPF_JEQ|BPF_X:
+			EMIT(js, "\x44\x39\xf8");		/* cmp eax,r15d */
+			goto branch;
+
+		case BPF_JMP|BPF_JSET|BPF_X:
+			EMIT(js, "\x44\x85\xf8");		/* test eax,r15d */
+		branch:
+			emit_branch(js, i,
+			    BPF_OP(p->code) == BPF_JGT ? CC_A :
+			    BPF_OP(p->code) == BPF_JGE ? CC_AE :
+			    BPF_OP(p->code) == BPF_JEQ ? CC_E : CC_NE,
+			    p->jt, p->jf);
+			break;
+
+		case BPF_ALU|BPF_ADD|BPF_X:
+			EMIT(js, "\x44\x01\xf8");		/* add eax,r15d */
+			break;
+
+		case BPF_ALU|BPF_SUB|BPF_X:
+			EMIT(js, "\x44\x29\xf8");		/* sub eax,r15d */
+			break;
+
+		case BPF_ALU|BPF_MUL|BPF_X:
+			EMIT(js, "\x41\x0f\xaf\xc7");		/* imul eax,r15d */
+			break;
+
+		case BPF_ALU|BPF_DIV|BPF_X:
+			EMIT(js, "\x45\x85\xff");		/* test r15d,r15d */
+			emit_jcc(js, CC_E, js->js_ret0);
+			EMIT(js, "\x31\xd2");			/* xor edx,edx */
+			EMIT(js, "\x41\xf7\xf7");		/* div r15d */
+			break;
+
+		case BPF_ALU|BPF_AND|BPF_X:
+			EMIT(js, "\x44\x21\xf8");		/* and eax,r15d */
+			break;
+
+		case BPF_ALU|BPF_OR|BPF_X:
+			EMIT(js, "\x44\x09\xf8");		/* or eax,r15d */
+			break;
+
+		case BPF_ALU|BPF_LSH|BPF_X:
+			EMIT(js, "\x44\x89\xf9");		/* mov ecx,r15d */
+			EMIT(js, "\xd3\xe0");			/* shl eax,cl */
+			break;
+
+		case BPF_ALU|BPF_RSH|BPF_X:
+			EMIT(js, "\x44\x89\xf9");		/* mov ecx,r15d */
+			EMIT(js, "\xd3\xe8");			/* shr eax,cl */
+			break;
+
+		case BPF_ALU|BPF_ADD|BPF_K:
+			emit1(js, 0x05);			/* add eax,k */
+			emit4(js, k);
+			break;
+
+		case BPF_ALU|BPF_SUB|BPF_K:
+			emit1(js, 0x2d);			/* sub eax,k */
+			emit4(js, k);
+			break;
+
+		case BPF_ALU|BPF_MUL|BPF_K:
+			EMIT(js, "\x69\xc0");			/* imul eax,eax,k */
+			emit4(js, k);
+			break;
+
+		case BPF_ALU|BPF_DIV|BPF_K:
+			emit1(js, 0xb9);			/* mov ecx,k */
+			emit4(js, k);
+			EMIT(js, "\x31\xd2");			/* xor edx,edx */
+			EMIT(js, "\xf7\xf1");			/* div ecx */
+			break;
+
+		case BPF_ALU|BPF_AND|BPF_K:
+			emit1(js, 0x25);			/* and eax,k */
+			emit4(js, k);
+			break;
+
+		case BPF_ALU|BPF_OR|BPF_K:
+			emit1(js, 0x0d);			/* or eax,k */
+			emit4(js, k);
+			break;
+
+		case BPF_ALU|BPF_LSH|BPF_K:
+			EMIT(js, "\xc1\xe0");			/* shl eax,k */
+			emit1(js, k);
+			break;
+
+		case BPF_ALU|BPF_RSH|BPF_K:
+			EMIT(js, "\xc1\xe8");			/* shr eax,k */
+			emit1(js, k);
+			break;
+
+		case BPF_ALU|BPF_NEG:
+			EMIT(js, "\xf7\xd8");			/* neg eax */
+			break;
+
+		case BPF_MISC|BPF_TAX:
+			EMIT(js, "\x41\x89\xc7");		/* mov r15d,eax */
+			break;
+
+		case BPF_MISC|BPF_TXA:
+			EMIT(js, "\x44\x89\xf8");		/* mov eax,r15d */
+			break;
+		}
+	}
+
+	/*
+	 * ret0: xor eax,eax
+	 * epilog: add rsp,JIT_FRAME; pop r15-r12,rbx; ret
+	 */
+	js->js_ret0 = js->js_off;
+	EMIT(js, "\x31\xc0");
+	js->js_epilog = js->js_off;
+	EMIT(js, "\x48\x83\xc4");
+	emit1(js, JIT_FRAME);
+	EMIT(js, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5b\xc3");
+	return (1);
+}
+
+/*
+ * Compile a validated program.  Returns the entry point and sets
+ * *sizep to the size of the code, or returns 0 if the program is
+ * to be interpreted.
+ */
+bpf_jit_func
+bpf_jit_compile(f, len, sizep)
+	struct bpf_insn *f;
+	int len;
+	u_int *sizep;
+{
+	struct bpf_jit_state js;
+	u_int refs[BPF_MAXINSNS];
+	vm_address_t addr;
+	vm_size_t size;
+
+	if (bpf_jit_enable == 0 || len <= 0 || len > BPF_MAXINSNS)
+		return (0);
+	bzero((caddr_t)&js, sizeof (js));
+	js.js_refs = refs;
+
+	/*
+	 * Size the code, then emit it with every offset known.
+	 */
+	if (bpf_jit_pass(&js, f, len) == 0)
+		return (0);
+	size = round_page(js.js_off);
+	if (vm_allocate(mach_task_self(), &addr, size, TRUE) != KERN_SUCCESS)
+		return (0);
+	js.js_buf = (u_char *)addr;
+	(void) bpf_jit_pass(&js, f, len);
+	if (vm_protect(mach_task_self(), addr, size, FALSE,
+	    VM_PROT_READ|VM_PROT_EXECUTE) != KERN_SUCCESS) {
+		(void) vm_deallocate(mach_task_self(), addr, size);
+		return (0);
+	}
+	*sizep = size;
+	return ((bpf_jit_func)addr);
+}
+
+#else /* __x86_64__ */
+
+/* ARGSUSED */
+bpf_jit_func
+bpf_jit_compile(f, len, sizep)
+	struct bpf_insn *f;
+	int len;
+	u_int *sizep;
+{
+	return (0);
+}
+
+#endif /* __x86_64__ */
+
+void
+bpf_jit_free(func, size)
+	bpf_jit_func func;
+	u_int size;
+{
+	if (func)
+		(void) vm_deallocate(mach_task_self(), (vm_address_t)func,
+		    (vm_size_t)size);
+}
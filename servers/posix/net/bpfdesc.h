@@ -62,9 +62,23 @@ struct bpf_d {
 
 	int		bd_bufsize;	/* absolute length of buffers */
 
+	/*
+	 * Shared ring (BIOCSRING), used instead of the buffer slots.
+	 * The geometry is kept here since the reader can write the
+	 * copy in the ring header.
+	 */
+	struct bpf_ring	*bd_ring;	/* server mapping of ring, or 0 */
+	u_int		bd_ringsize;	/* bytes mapped at bd_ring */
+	u_int		bd_ringslots;	/* slots in ring */
+	u_int		bd_ringslotsize; /* bytes per slot */
+	u_int		bd_ringtail;	/* next slot to fill */
+	u_int		bd_ringdrops;	/* drops not yet charged to a slot */
+
 	struct bpf_if *	bd_bif;		/* interface descriptor */
 	u_long		bd_rtout;	/* Read timeout in 'ticks' */
 	struct bpf_insn *bd_filter; 	/* filter code */
+	bpf_jit_func	bd_jitcode;	/* compiled bd_filter, or 0 */
+	u_int		bd_jitsize;	/* size of bd_jitcode */
 	u_long		bd_rcount;	/* number of packets received */
 	u_long		bd_dcount;	/* number of packets dropped */
 
@@ -132,6 +132,7 @@ struct ifnet {
 		int	ifq_maxlen;
 		int	ifq_drops;
 	} if_snd;			/* output queue */
+	int	if_lsmax;		/* largest large-send packet, 0 if none */
 };
 #define	if_mtu		if_data.ifi_mtu
 #define	if_type		if_data.ifi_type
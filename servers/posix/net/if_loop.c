@@ -97,6 +97,9 @@ loopattach(n)
 	ifp->if_type = IFT_LOOP;
 	ifp->if_hdrlen = 0;
 	ifp->if_addrlen = 0;
+#if	INET
+	ifp->if_lsmax = IP_MAXPACKET;	/* passed up unsplit */
+#endif
 	if_attach(ifp);
 #if NBPFILTER > 0
 	bpfattach(&ifp->if_bpf, ifp, DLT_NULL, sizeof(u_int));
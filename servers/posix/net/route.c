@@ -62,6 +62,32 @@
 int	rttrash;		/* routes not in table but not freed */
 struct	sockaddr wildcard;	/* zero valued cookie for wildcard searches */
 
+/*
+ * Destination cache in front of the radix tree for AF_INET.
+ * Each slot holds a reference on the route it caches.  A change to
+ * the tables through rtrequest drops the slots it may have made wrong
+ * (rtcache_flush): those holding a deleted route, so that the cache
+ * does not keep it off rttrash, the slot of an added host route, and
+ * every slot, with rt_gen bumped, for an added network route.
+ * Cloning routes are never cached, so a lookup that should clone
+ * always reaches the tree, and a clone made from one changes no slot.
+ */
+#define	RTCACHE_SIZE	256		/* power of two */
+#define	RTCACHE_HASH(a) \
+	(((a) ^ ((a) >> 8) ^ ((a) >> 16) ^ ((a) >> 24)) & (RTCACHE_SIZE - 1))
+
+struct rtcache {
+	u_long	rc_dst;			/* destination, network order */
+	u_long	rc_gen;			/* rt_gen when filled */
+	struct	rtentry *rc_rt;		/* referenced route */
+};
+
+static struct rtcache rtcache[RTCACHE_SIZE];
+u_long	rt_gen = 1;		/* routing table generation */
+struct	rtcachestat rtcachestat;
+
+static void rtcache_flush (struct rtentry *, struct sockaddr *);
+
 void
 rtable_init(table)
 	void **table;
@@ -102,8 +128,36 @@ rtalloc1(dst, report)
 	register struct radix_node *rn;
 	struct rtentry *newrt = 0;
 	struct rt_addrinfo info;
+	struct rtcache *rc = 0;
 	int  s = splnet(), err = 0, msgtype = RTM_MISS;
 
+	/*
+	 * Only plain keys are cached: ARP passes a sockaddr_inarp whose
+	 * proxy bits sit where sin_zero is, and they select the route.
+	 */
+	if (dst->sa_family == AF_INET &&
+	    dst->sa_len == sizeof(struct sockaddr_in) &&
+	    ((u_int *)((struct sockaddr_in *)dst)->sin_zero)[0] == 0 &&
+	    ((u_int *)((struct sockaddr_in *)dst)->sin_zero)[1] == 0) {
+		u_long a = ((struct sockaddr_in *)dst)->sin_addr.s_addr;
+
+		rc = &rtcache[RTCACHE_HASH(a)];
+		if ((rt = rc->rc_rt) != 0) {
+			if (rc->rc_gen == rt_gen && rc->rc_dst == a &&
+			    (rt->rt_flags & RTF_UP)) {
+				rtcachestat.rcs_hits++;
+				rt->rt_refcnt++;
+				splx(s);
+				return (rt);
+			}
+			if (rc->rc_gen != rt_gen) {
+				rtcachestat.rcs_stale++;
+				rc->rc_rt = 0;
+				rtfree(rt);
+			}
+		}
+		rtcachestat.rcs_misses++;
+	}
 	if (rnh && (rn = rnh->rnh_matchaddr((caddr_t)dst, rnh)) &&
 	    ((rn->rn_flags & RNF_ROOT) == 0)) {
 		newrt = rt = (struct rtentry *)rn;
@@ -121,6 +175,19 @@ rtalloc1(dst, report)
 			}
 		} else
 			rt->rt_refcnt++;
+		/*
+		 * Remember the answer, unless it is a cloning route
+		 * that a later lookup may have to clone from.
+		 */
+		if (rc && newrt && (newrt->rt_flags & RTF_CLONING) == 0) {
+			if (rc->rc_rt)
+				rtfree(rc->rc_rt);
+			newrt->rt_refcnt++;
+			rc->rc_rt = newrt;
+			rc->rc_dst =
+			    ((struct sockaddr_in *)dst)->sin_addr.s_addr;
+			rc->rc_gen = rt_gen;
+		}
 	} else {
 		rtstat.rts_unreach++;
 	miss:	if (report) {
@@ -417,11 +484,51 @@ rtrequest(req, dst, gateway, netmask, flags, ret_nrt)
 		}
 		break;
 	}
+	if (req == RTM_DELETE)
+		rtcache_flush(rt, SA(0));
+	else if (req == RTM_ADD)
+		rtcache_flush((struct rtentry *)0, netmask ? SA(0) : dst);
 bad:
 	splx(s);
 	return (error);
 }
 
+/*
+ * Empty the destination cache slots holding rt, or the slot for the
+ * host address dst, or with neither given every slot, and give back
+ * the references they hold.  Called at splnet.
+ */
+static void
+rtcache_flush(rt, dst)
+	struct rtentry *rt;
+	struct sockaddr *dst;
+{
+	register struct rtcache *rc;
+	register struct rtentry *ort;
+	u_long a;
+
+	if (dst) {
+		if (dst->sa_family != AF_INET)
+			return;
+		a = ((struct sockaddr_in *)dst)->sin_addr.s_addr;
+		rc = &rtcache[RTCACHE_HASH(a)];
+		if ((ort = rc->rc_rt) != 0 && rc->rc_dst == a) {
+			rc->rc_rt = 0;
+			rtcachestat.rcs_stale++;
+			rtfree(ort);
+		}
+		return;
+	}
+	if (rt == 0)
+		rt_gen++;
+	for (rc = rtcache; rc < &rtcache[RTCACHE_SIZE]; rc++)
+		if ((ort = rc->rc_rt) != 0 && (rt == 0 || ort == rt)) {
+			rc->rc_rt = 0;
+			rtcachestat.rcs_stale++;
+			rtfree(ort);
+		}
+}
+
 int
 rt_setgate(rt0, dst, gate)
 	struct rtentry *rt0;
@@ -235,6 +235,17 @@ struct	route_cb route_cb;
 struct	rtstat	rtstat;
 struct	radix_node_head *rt_tables[AF_MAX+1];
 
+/*
+ * Statistics of the destination cache in front of rtalloc1.
+ */
+struct	rtcachestat {
+	u_long	rcs_hits;		/* lookups answered by the cache */
+	u_long	rcs_misses;		/* lookups that went to the tree */
+	u_long	rcs_stale;		/* entries dropped for rt_gen */
+};
+extern struct	rtcachestat rtcachestat;
+extern u_long	rt_gen;
+
 void	 route_init (void);
 int	 route_output (struct mbuf *, struct socket *);
 int	 route_usrreq (struct socket *,
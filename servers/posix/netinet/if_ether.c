@@ -73,13 +73,18 @@
 #define ETHERTYPE_IPTRAILERS ETHERTYPE_TRAIL
 
 
-/* timer values */
+/*
+ * Timer values.  An entry that goes unanswered after arp_maxtries
+ * requests is marked RTF_REJECT for arpt_down seconds: packets to it
+ * are refused at once instead of being held, and no requests go out.
+ */
 int	arpt_prune = (5*60*1);	/* walk list every 5 minutes */
 int	arpt_keep = (20*60);	/* once resolved, good for 20 more minutes */
 int	arpt_down = 20;		/* once declared down, don't send for 20 secs */
 #define	rt_expire rt_rmx.rmx_expire
 
 static	void arprequest (struct arpcom *, u_long *, u_long *, u_char *);
+static	void arpflushhold (struct llinfo_arp *);
 static	void arptfree (struct llinfo_arp *);
 static	void arptimer (void *);
 static	struct llinfo_arp *arplookup (u_long, int, int);
@@ -90,6 +95,8 @@ struct	llinfo_arp llinfo_arp = {&llinfo_arp, &llinfo_arp};
 struct	ifqueue arpintrq = {0, 0, 0, 50};
 int	arp_inuse, arp_allocated, arp_intimer;
 int	arp_maxtries = 5;
+int	arp_maxhold = 16;	/* packets held per unresolved entry */
+struct	arpstat arpstat;
 int	useloopback = 1;	/* use loopback interface for local traffic */
 int	arpinit_done = 0;
 
@@ -110,8 +117,10 @@ arptimer(ignored_arg)
 		register struct rtentry *rt = la->la_rt;
 		la = la->la_next;
 		get_time(&time);
-		if (rt->rt_expire && rt->rt_expire <= time.tv_sec)
+		if (rt->rt_expire && rt->rt_expire <= time.tv_sec) {
+			arpstat.as_expired++;
 			arptfree(la->la_prev); /* timer has expired, clear */
+		}
 	}
 	splx(s);
 }
@@ -220,8 +229,7 @@ arp_rtrequest(req, rt, sa)
 		remque(la);
 		rt->rt_llinfo = 0;
 		rt->rt_flags &= ~RTF_LLINFO;
-		if (la->la_hold)
-			m_freem(la->la_hold);
+		arpflushhold(la);
 		Free((caddr_t)la);
 	}
 }
@@ -237,6 +245,24 @@ arpwhohas(ac, addr)
 	arprequest(ac, &ac->ac_ipaddr.s_addr, &addr->s_addr, ac->ac_enaddr);
 }
 
+/*
+ * Drop the packets held on an entry.
+ */
+static void
+arpflushhold(la)
+	register struct llinfo_arp *la;
+{
+	register struct mbuf *m, *n;
+
+	for (m = la->la_hold; m; m = n) {
+		n = m->m_nextpkt;
+		m->m_nextpkt = 0;
+		m_freem(m);
+	}
+	la->la_hold = 0;
+	la->la_numheld = 0;
+}
+
 /*
  * Broadcast an ARP request. Caller specifies:
  *	- arp header source ip address
@@ -281,8 +307,9 @@ arprequest(ac, sip, tip, enaddr)
  * Resolve an IP address into an ethernet address.  If success,
  * desten is filled in.  If there is no entry in arptab,
  * set one up and broadcast a request for the IP address.
- * Hold onto this mbuf and resend it once the address
- * is finally resolved.  A return value of 1 indicates
+ * Queue this mbuf, up to arp_maxhold per entry, and resend
+ * the queue once the address is finally resolved.  A return
+ * value of 1 indicates
  * that desten has been filled in and the packet should be sent
  * normally; a 0 return indicates that the packet has been
  * taken over here, either now or for later transmission.
@@ -326,25 +353,59 @@ arpresolve(ac, rt, m, dst, desten)
 	get_time(&time);
 	if ((rt->rt_expire == 0 || rt->rt_expire > time.tv_sec) &&
 	    sdl->sdl_family == AF_LINK && sdl->sdl_alen != 0) {
+		arpstat.as_hits++;
 		memcpy(desten, LLADDR(sdl), sdl->sdl_alen);
 		return 1;
 	}
+	/*
+	 * The entry is down: refuse the packet until arpt_down
+	 * has passed, rather than holding it and asking again.
+	 */
+	if ((rt->rt_flags & RTF_REJECT) && rt->rt_expire > time.tv_sec) {
+		arpstat.as_negative++;
+		m_freem(m);
+		return (0);
+	}
 	/*
 	 * There is an arptab entry, but no ethernet address
-	 * response yet.  Replace the held mbuf with this
-	 * latest one.
+	 * response yet.  Queue this mbuf behind those already
+	 * held, dropping the oldest if the queue is full.
 	 */
-	if (la->la_hold)
-		m_freem(la->la_hold);
-	la->la_hold = m;
+	arpstat.as_misses++;
+	m->m_nextpkt = 0;
+	if (la->la_hold == 0)
+		la->la_hold = m;
+	else {
+		register struct mbuf *n;
+
+		for (n = la->la_hold; n->m_nextpkt; n = n->m_nextpkt)
+			;
+		n->m_nextpkt = m;
+		if (la->la_numheld >= arp_maxhold) {
+			n = la->la_hold;
+			la->la_hold = n->m_nextpkt;
+			n->m_nextpkt = 0;
+			m_freem(n);
+			la->la_numheld--;
+			arpstat.as_dropped++;
+		}
+	}
+	la->la_numheld++;
 	if (rt->rt_expire) {
 		rt->rt_flags &= ~RTF_REJECT;
-		get_time(&time);
 		if (la->la_asked == 0 || rt->rt_expire != time.tv_sec) {
 			rt->rt_expire = time.tv_sec;
-			if (la->la_asked++ < arp_maxtries)
+			if (la->la_asked++ < arp_maxtries) {
+				arpstat.as_requests++;
 				arpwhohas(ac, &(SIN(dst)->sin_addr));
-			else {
+			} else {
+				/*
+				 * Nobody answers: go down and drop
+				 * what we were holding for it.
+				 */
+				arpstat.as_timeouts++;
+				arpstat.as_dropped += la->la_numheld;
+				arpflushhold(la);
 				rt->rt_flags |= RTF_REJECT;
 				rt->rt_expire += arpt_down;
 				la->la_asked = 0;
@@ -489,10 +550,22 @@ in_arpinput(m)
 		}
 		rt->rt_flags &= ~RTF_REJECT;
 		la->la_asked = 0;
+		arpstat.as_replies++;
 		if (la->la_hold) {
-			(*ac->ac_if.if_output)(&ac->ac_if, la->la_hold,
-				rt_key(rt), rt);
+			register struct mbuf *m0, *n;
+
+			/*
+			 * Send the held packets in the order they came.
+			 */
+			m0 = la->la_hold;
 			la->la_hold = 0;
+			la->la_numheld = 0;
+			for (; m0; m0 = n) {
+				n = m0->m_nextpkt;
+				m0->m_nextpkt = 0;
+				(*ac->ac_if.if_output)(&ac->ac_if, m0,
+					rt_key(rt), rt);
+			}
 		}
 	}
 reply:
@@ -120,7 +120,9 @@ struct llinfo_arp {
 	struct	llinfo_arp *la_next;
 	struct	llinfo_arp *la_prev;
 	struct	rtentry *la_rt;
-	struct	mbuf *la_hold;		/* last packet until resolved/timeout */
+	struct	mbuf *la_hold;		/* packets until resolved/timeout,
+					   linked by m_nextpkt */
+	int	la_numheld;		/* packets on la_hold */
 	long	la_asked;		/* last time we QUERIED for this addr */
 #define la_timer la_rt->rt_rmx.rmx_expire /* deletion time in seconds */
 };
@@ -141,7 +143,25 @@ struct sockaddr_inarp {
 #define	RTF_USETRAILERS	RTF_PROTO1	/* use trailers */
 #define RTF_ANNOUNCE	RTF_PROTO2	/* announce new arp entry */
 
+/*
+ * ARP statistics.
+ */
+struct	arpstat {
+	u_long	as_hits;		/* resolved from the cache */
+	u_long	as_misses;		/* unresolved, packet held */
+	u_long	as_requests;		/* requests sent */
+	u_long	as_replies;		/* entries filled in from the wire */
+	u_long	as_dropped;		/* held packets dropped, queue full */
+	u_long	as_negative;		/* packets refused, entry down */
+	u_long	as_timeouts;		/* entries gone down unanswered */
+	u_long	as_expired;		/* entries aged out by arptimer */
+};
+
 #ifdef	KERNEL
+struct	arpstat arpstat;
+int	arpt_keep, arpt_down, arpt_prune;
+int	arp_maxtries, arp_maxhold;
+
 u_char	etherbroadcastaddr[6];
 u_char	ether_ipmulticast_min[6];
 u_char	ether_ipmulticast_max[6];
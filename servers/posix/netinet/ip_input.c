@@ -86,6 +86,23 @@ struct	ifqueue ipintrq;
 
 struct	ipstat	ipstat;
 struct	ipq	ipq;			/* ip reass. queue */
+
+/*
+ * Reassembly queues are hashed on (src, dst, id, proto).  The memory
+ * held by queued fragments, counted as data plus one mbuf each, is
+ * capped at ip_maxfragmem; a fragment that would exceed it evicts the
+ * oldest queues first.  No datagram may hold more than
+ * ip_maxfragsperpacket fragments.
+ */
+#define	IPREASS_NHASH	64		/* power of two */
+#define	IPREASS_HASH(src, dst, id, p) \
+	((((src) ^ (dst)) ^ (((src) ^ (dst)) >> 16) ^ (id) ^ (p)) & \
+	    (IPREASS_NHASH - 1))
+
+static struct ipq *ipq_hash[IPREASS_NHASH];
+int	ip_maxfragmem = 256 * 1024;
+int	ip_maxfragsperpacket = 128;
+int	ip_fragmem;			/* bytes now held for reassembly */
 u_short	ip_id;				/* ip packet ctr, for ids */
 int	ip_defttl;			/* default IP ttl */
 
@@ -142,6 +159,11 @@ ip_init()
 #endif
 }
 
+#if !ETHER_AS_SYSCALL
+extern void tcp_lro_flush (void);
+extern void tcp_lro_input (struct mbuf *, int);
+#endif /* !ETHER_AS_SYSCALL */
+
 struct	sockaddr_in ipaddr = { sizeof(ipaddr), AF_INET };
 struct	route ipforward_rt;
 
@@ -182,12 +204,24 @@ next:
 	IF_DEQUEUE(&ipintrq, m);
 	splx(s);
 #endif /* ETHER_AS_SYSCALL */
-	if (m == 0)
+	if (m == 0) {
+#if !ETHER_AS_SYSCALL
+		/*
+		 * End of this batch: pass up what TCP coalesced.
+		 */
+		tcp_lro_flush();
+#endif /* !ETHER_AS_SYSCALL */
 		return;
+	}
 #if	DIAGNOSTIC
 	if ((m->m_flags & M_PKTHDR) == 0)
 		panic("ipintr no HDR");
 #endif
+	/*
+	 * Only tcp_lro_input may vouch for a TCP checksum; whatever
+	 * the driver or an earlier life of the mbuf left is not trusted.
+	 */
+	m->m_flags &= ~M_TCPCKSUMOK;
 	/*
 	 * If no IP addresses have been set yet but the interfaces
 	 * are receiving, can't do anything with incoming packets yet.
@@ -375,7 +409,9 @@ ours:
 		 * Look for queue of fragments
 		 * of this datagram.
 		 */
-		for (fp = ipq.next; fp != &ipq; fp = fp->next)
+		for (fp = ipq_hash[IPREASS_HASH(ip->ip_src.s_addr,
+		    ip->ip_dst.s_addr, ip->ip_id, ip->ip_p)]; fp;
+		    fp = fp->ipq_hnext)
 			if (ip->ip_id == fp->ipq_id &&
 			    ip->ip_src.s_addr == fp->ipq_src.s_addr &&
 			    ip->ip_dst.s_addr == fp->ipq_dst.s_addr &&
@@ -417,6 +453,16 @@ found:
 	 * Switch out to protocol's input routine.
 	 */
 	ipstat.ips_delivered++;
+#if !ETHER_AS_SYSCALL
+	/*
+	 * TCP goes through the receive coalescing stage, which
+	 * holds in-order data until the queue above runs dry.
+	 */
+	if (ip->ip_p == IPPROTO_TCP) {
+		tcp_lro_input(m, hlen);
+		goto next;
+	}
+#endif /* !ETHER_AS_SYSCALL */
 	(*inetsw[ip_protox[ip->ip_p]].pr_input)(m, hlen);
 	goto next;
 bad:
@@ -438,8 +484,9 @@ ip_reass(ip, fp)
 	register struct mbuf *m = dtom(ip);
 	register struct ipasfrag *q;
 	struct mbuf *t;
+	struct ipq **hp;
 	int hlen = ip->ip_hl << 2;
-	int i, next;
+	int i, next, end;
 
 	/*
 	 * Presence of header sizes in mbufs
@@ -448,6 +495,17 @@ ip_reass(ip, fp)
 	m->m_data += hlen;
 	m->m_len -= hlen;
 
+	/*
+	 * Make room under ip_maxfragmem, oldest queues first.
+	 */
+	while (ip_fragmem + MSIZE + ip->ip_len > ip_maxfragmem &&
+	    ipq.prev != &ipq && ipq.prev != fp) {
+		ipstat.ips_fragdropped++;
+		ip_freef(ipq.prev);
+	}
+	if (ip_fragmem + MSIZE + ip->ip_len > ip_maxfragmem)
+		goto dropfrag;
+
 	/*
 	 * If first fragment to arrive, create a reassembly queue.
 	 */
@@ -462,16 +520,48 @@ ip_reass(ip, fp)
 		fp->ipq_next = fp->ipq_prev = (struct ipasfrag *)fp;
 		fp->ipq_src = ((struct ip *)ip)->ip_src;
 		fp->ipq_dst = ((struct ip *)ip)->ip_dst;
-		q = (struct ipasfrag *)fp;
-		goto insert;
+		hp = &ipq_hash[IPREASS_HASH(fp->ipq_src.s_addr,
+		    fp->ipq_dst.s_addr, fp->ipq_id, fp->ipq_p)];
+		if ((fp->ipq_hnext = *hp) != 0)
+			(*hp)->ipq_hprev = &fp->ipq_hnext;
+		fp->ipq_hprev = hp;
+		*hp = fp;
+		fp->ipq_nfrags = 0;
+		fp->ipq_bytes = 0;
+		fp->ipq_end = 0;
+		ip_fragmem += MSIZE;
 	}
 
 	/*
-	 * Find a segment which begins after this one does.
+	 * Fragments never reach past the end of the datagram, once
+	 * the last fragment has told us where that is.
 	 */
-	for (q = fp->ipq_next; q != (struct ipasfrag *)fp; q = q->ipf_next)
-		if (q->ip_off > ip->ip_off)
-			break;
+	end = ip->ip_off + ip->ip_len;
+	if (fp->ipq_nfrags >= ip_maxfragsperpacket ||
+	    (fp->ipq_end && end > fp->ipq_end))
+		goto dropfrag;
+	if ((ip->ipf_mff & 1) == 0) {
+		if (fp->ipq_end && end != fp->ipq_end)
+			goto dropfrag;
+		q = fp->ipq_prev;
+		if (q != (struct ipasfrag *)fp && q->ip_off + q->ip_len > end)
+			goto dropfrag;
+		fp->ipq_end = end;
+	}
+
+	/*
+	 * Find a segment which begins after this one does.  Queued
+	 * segments are sorted and disjoint, and fragments mostly
+	 * arrive in order, so try past the last one first.
+	 */
+	q = fp->ipq_prev;
+	if (q == (struct ipasfrag *)fp || q->ip_off <= ip->ip_off)
+		q = (struct ipasfrag *)fp;
+	else
+		for (q = fp->ipq_next; q != (struct ipasfrag *)fp;
+		    q = q->ipf_next)
+			if (q->ip_off > ip->ip_off)
+				break;
 
 	/*
 	 * If there is a preceding segment, it may provide some of
@@ -499,27 +589,31 @@ ip_reass(ip, fp)
 			q->ip_len -= i;
 			q->ip_off += i;
 			m_adj(dtom(q), i);
+			fp->ipq_bytes -= i;
+			ip_fragmem -= i;
 			break;
 		}
 		q = q->ipf_next;
+		fp->ipq_nfrags--;
+		fp->ipq_bytes -= q->ipf_prev->ip_len;
+		ip_fragmem -= MSIZE + q->ipf_prev->ip_len;
 		m_freem(dtom(q->ipf_prev));
 		ip_deq(q->ipf_prev);
 	}
 
-insert:
 	/*
 	 * Stick new segment in its place;
-	 * check for complete reassembly.
+	 * check for complete reassembly.  The queued segments are
+	 * disjoint and lie within ipq_end, so they cover the datagram
+	 * once their lengths add up to it.
 	 */
 	ip_enq(ip, q->ipf_prev);
-	next = 0;
-	for (q = fp->ipq_next; q != (struct ipasfrag *)fp; q = q->ipf_next) {
-		if (q->ip_off != next)
-			return (0);
-		next += q->ip_len;
-	}
-	if (q->ipf_prev->ipf_mff & 1)
+	fp->ipq_nfrags++;
+	fp->ipq_bytes += ip->ip_len;
+	ip_fragmem += MSIZE + ip->ip_len;
+	if (fp->ipq_end == 0 || fp->ipq_bytes != fp->ipq_end)
 		return (0);
+	next = fp->ipq_end;
 
 	/*
 	 * Reassembly is complete; concatenate fragments.
@@ -547,8 +641,9 @@ insert:
 	ip->ipf_mff &= ~1;
 	((struct ip *)ip)->ip_src = fp->ipq_src;
 	((struct ip *)ip)->ip_dst = fp->ipq_dst;
-	remque(fp);
-	(void) m_free(dtom(fp));
+	ip_fragmem -= fp->ipq_nfrags * MSIZE + fp->ipq_bytes;
+	fp->ipq_next = fp->ipq_prev = (struct ipasfrag *)fp;
+	ip_freef(fp);
 	m = dtom(ip);
 	m->m_len += (ip->ip_hl << 2);
 	m->m_data -= (ip->ip_hl << 2);
@@ -579,9 +674,13 @@ ip_freef(fp)
 
 	for (q = fp->ipq_next; q != (struct ipasfrag *)fp; q = p) {
 		p = q->ipf_next;
+		ip_fragmem -= MSIZE + q->ip_len;
 		ip_deq(q);
 		m_freem(dtom(q));
 	}
+	if ((*fp->ipq_hprev = fp->ipq_hnext) != 0)
+		fp->ipq_hnext->ipq_hprev = fp->ipq_hprev;
+	ip_fragmem -= MSIZE;
 	remque(fp);
 	(void) m_free(dtom(fp));
 }
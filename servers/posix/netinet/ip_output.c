@@ -286,7 +286,9 @@ sendit:
 	/*
 	 * If small enough for interface, can just send directly.
 	 */
-	if ((u_short)ip->ip_len <= ifp->if_mtu) {
+	if ((u_short)ip->ip_len <= ifp->if_mtu ||
+	    (m->m_flags & M_LARGESEND &&
+	    (u_short)ip->ip_len <= ifp->if_lsmax)) {
 		ip->ip_len = htons((u_short)ip->ip_len);
 		ip->ip_off = htons((u_short)ip->ip_off);
 		ip->ip_sum = 0;
@@ -298,7 +300,10 @@ sendit:
 	/*
 	 * Too large for interface; fragment if possible.
 	 * Must be able to put at least 8 bytes per fragment.
+	 * A large-send packet whose route moved to an interface
+	 * that cannot split it is fragmented like any other.
 	 */
+	m->m_flags &= ~M_LARGESEND;
 	if (ip->ip_off & IP_DF) {
 		error = EMSGSIZE;
 		ipstat.ips_cantfrag++;
@@ -49,7 +49,10 @@ struct ipovly {
  * Ip reassembly queue structure.  Each fragment
  * being reassembled is attached to one of these structures.
  * They are timed out after ipq_ttl drops to 0, and may also
- * be reclaimed if memory becomes tight.
+ * be reclaimed if memory becomes tight.  The queues are found
+ * through a hash on (src, dst, id, proto); the ipq list keeps
+ * them newest first, so the oldest is evicted first when the
+ * fragments held exceed ip_maxfragmem.
  */
 struct ipq {
 	struct	ipq *next,*prev;	/* to other reass headers */
@@ -59,6 +62,10 @@ struct ipq {
 	struct	ipasfrag *ipq_next,*ipq_prev;
 					/* to ip headers of fragments */
 	struct	in_addr ipq_src,ipq_dst;
+	struct	ipq *ipq_hnext,**ipq_hprev;	/* hash chain */
+	int	ipq_nfrags;		/* fragments queued */
+	int	ipq_bytes;		/* data bytes queued */
+	int	ipq_end;		/* datagram length, 0 until last frag */
 };
 
 /*
@@ -147,8 +154,23 @@ struct	ipstat {
 #define	IP_ROUTETOIF		SO_DONTROUTE	/* bypass routing tables */
 #define	IP_ALLOWBROADCAST	SO_BROADCAST	/* can send broadcast packets */
 
+/*
+ * mbuf flag marking a TCP large-send super-segment.  ip_output hands
+ * such a packet unfragmented to an interface whose if_lsmax covers it;
+ * the interface cuts it into MTU-sized segments on the way out.
+ */
+#define	M_LARGESEND		0x0400
+
+/*
+ * mbuf flag set by tcp_lro_input on segments whose TCP checksum it
+ * has already verified, including chains it has merged.
+ */
+#define	M_TCPCKSUMOK		0x0800
+
 extern struct	ipstat	ipstat;
 extern struct	ipq	ipq;			/* ip reass. queue */
+extern int	ip_maxfragmem;			/* bytes held for reassembly */
+extern int	ip_maxfragsperpacket;		/* fragments per datagram */
 extern u_short	ip_id;				/* ip packet ctr, for ids */
 extern int	ip_defttl;			/* default IP ttl */
 
@@ -255,7 +255,8 @@ tcp_input(m, iphlen)
 	ti->ti_x1 = 0;
 	ti->ti_len = (u_short)tlen;
 	HTONS(ti->ti_len);
-	if (ti->ti_sum = in_cksum(m, len)) {
+	if ((m->m_flags & M_TCPCKSUMOK) == 0 &&
+	    (ti->ti_sum = in_cksum(m, len))) {
 		tcpstat.tcps_rcvbadsum++;
 		goto drop;
 	}
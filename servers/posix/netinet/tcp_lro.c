@@ -0,0 +1,268 @@
+/*
+ *	File:	netinet/tcp_lro.c
+ *
+ *	Receive-side coalescing of TCP segments.
+ *
+ *	ipintr hands in-order data segments to tcp_lro_input instead of
+ *	tcp_input.  Consecutive segments of one connection are merged into
+ *	a single mbuf chain behind the headers of the first, so tcp_input
+ *	(PCB lookup, header prediction, sbappend and sorwakeup) runs once
+ *	per batch instead of once per segment.  Held chains are flushed
+ *	when ipintrq runs dry, on PSH, on anything out of order or not
+ *	plain data, and from tcp_fasttimo as a backstop.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/mbuf.h>
+#include <sys/socket.h>
+#include <sys/protosw.h>
+
+#include <net/if.h>
+#include <net/route.h>
+
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/ip.h>
+#include <netinet/in_pcb.h>
+#include <netinet/ip_var.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_seq.h>
+#include <netinet/tcp_timer.h>
+#include <netinet/tcp_var.h>
+#include <netinet/tcpip.h>
+
+int	tcp_do_lro = 1;
+
+#define	TCP_LRO_ENTRIES	8		/* flows coalesced at once */
+
+struct tcp_lro {
+	struct	mbuf *lro_m;		/* merged chain, headers first */
+	struct	mbuf *lro_tail;		/* last mbuf of lro_m */
+	struct	in_addr lro_src, lro_dst;
+	u_short	lro_sport, lro_dport;
+	tcp_seq	lro_nextseq;		/* seq of next in-order byte */
+	int	lro_off;		/* tcp header + options length */
+	int	lro_nsegs;		/* segments merged into lro_m */
+};
+
+static struct tcp_lro tcp_lro[TCP_LRO_ENTRIES];
+static int tcp_lro_next;		/* entry to recycle when full */
+
+/*
+ * Verify the TCP checksum of a segment still carrying its IP header,
+ * without overlaying the IP header the way tcp_input does: the header
+ * must survive intact for the merged packet.
+ */
+static int
+tcp_lro_cksum(m, tlen)
+	register struct mbuf *m;
+	int tlen;
+{
+	register struct ip *ip = mtod(m, struct ip *);
+	struct {
+		struct	in_addr ph_src, ph_dst;
+		u_char	ph_x1, ph_pr;
+		u_short	ph_len;
+	} ph;
+	struct mbuf m0;
+	int sum;
+
+	ph.ph_src = ip->ip_src;
+	ph.ph_dst = ip->ip_dst;
+	ph.ph_x1 = 0;
+	ph.ph_pr = IPPROTO_TCP;
+	ph.ph_len = htons((u_short)tlen);
+	m0.m_next = m;
+	m0.m_data = (caddr_t)&ph;
+	m0.m_len = sizeof (ph);
+	m->m_data += sizeof (struct ip);
+	m->m_len -= sizeof (struct ip);
+	sum = in_cksum(&m0, sizeof (ph) + tlen);
+	m->m_data -= sizeof (struct ip);
+	m->m_len += sizeof (struct ip);
+	return (sum);
+}
+
+/*
+ * Pass a held chain up to tcp_input.
+ */
+static void
+tcp_lro_deliver(lro)
+	register struct tcp_lro *lro;
+{
+	register struct mbuf *m = lro->lro_m;
+
+	if (m == 0)
+		return;
+	if (lro->lro_nsegs > 1) {
+		tcpstat.tcps_lroflush++;
+		tcpstat.tcps_lromerged += lro->lro_nsegs - 1;
+	}
+	lro->lro_m = lro->lro_tail = 0;
+	lro->lro_nsegs = 0;
+	tcp_input(m, sizeof (struct ip));
+}
+
+/*
+ * Flush every held chain.  Called by ipintr when its queue is
+ * empty and by tcp_fasttimo.
+ */
+void
+tcp_lro_flush()
+{
+	register struct tcp_lro *lro;
+
+	for (lro = tcp_lro; lro < &tcp_lro[TCP_LRO_ENTRIES]; lro++)
+		if (lro->lro_m)
+			tcp_lro_deliver(lro);
+}
+
+/*
+ * TCP input from ipintr.  ip_len has already been converted to
+ * host order and stripped of the IP header length, as tcp_input
+ * expects.
+ */
+void
+tcp_lro_input(m, iphlen)
+	register struct mbuf *m;
+	int iphlen;
+{
+	register struct tcpiphdr *ti;
+	register struct tcp_lro *lro, *free;
+	struct mbuf *n;
+	int tlen, off, len;
+	tcp_seq seq;
+
+	if (tcp_do_lro == 0 || iphlen != sizeof (struct ip)) {
+		tcp_lro_flush();
+		tcp_input(m, iphlen);
+		return;
+	}
+	if (m->m_len < sizeof (struct tcpiphdr)) {
+		if ((m = m_pullup(m, sizeof (struct tcpiphdr))) == 0) {
+			tcpstat.tcps_rcvshort++;
+			return;
+		}
+	}
+	ti = mtod(m, struct tcpiphdr *);
+	tlen = ((struct ip *)ti)->ip_len;
+	off = ti->ti_off << 2;
+	if (off < sizeof (struct tcphdr) || off > tlen) {
+		tcp_input(m, iphlen);
+		return;
+	}
+	if (m->m_len < sizeof (struct ip) + off) {
+		if ((m = m_pullup(m, sizeof (struct ip) + off)) == 0) {
+			tcpstat.tcps_rcvshort++;
+			return;
+		}
+		ti = mtod(m, struct tcpiphdr *);
+	}
+
+	/*
+	 * Find the held chain of this connection, if any.
+	 */
+	free = 0;
+	for (lro = tcp_lro; lro < &tcp_lro[TCP_LRO_ENTRIES]; lro++) {
+		if (lro->lro_m == 0) {
+			if (free == 0)
+				free = lro;
+			continue;
+		}
+		if (lro->lro_sport == ti->ti_sport &&
+		    lro->lro_dport == ti->ti_dport &&
+		    lro->lro_src.s_addr == ti->ti_src.s_addr &&
+		    lro->lro_dst.s_addr == ti->ti_dst.s_addr)
+			break;
+	}
+	if (lro == &tcp_lro[TCP_LRO_ENTRIES])
+		lro = 0;
+
+	/*
+	 * Only plain data segments whose options, if any, are the
+	 * RFC 1323 appendix A timestamp are coalesced.  Anything
+	 * else, or a segment that fails its checksum, flushes the
+	 * connection's chain and goes to tcp_input on its own.
+	 */
+	len = tlen - off;
+	if (len == 0 ||
+	    (ti->ti_flags & (TH_SYN|TH_FIN|TH_RST|TH_URG|TH_ACK)) != TH_ACK ||
+	    (off != sizeof (struct tcphdr) &&
+	    (off != sizeof (struct tcphdr) + TCPOLEN_TSTAMP_APPA ||
+	    *(u_long *)(ti + 1) != htonl(TCPOPT_TSTAMP_HDR))) ||
+	    tcp_lro_cksum(m, tlen))
+		goto unmerged;
+	m->m_flags |= M_TCPCKSUMOK;
+	seq = ntohl(ti->ti_seq);
+
+	if (lro) {
+		register struct tcpiphdr *hti;
+
+		hti = mtod(lro->lro_m, struct tcpiphdr *);
+		if (seq != lro->lro_nextseq || off != lro->lro_off ||
+		    ((struct ip *)hti)->ip_len + len >
+		    IP_MAXPACKET - sizeof (struct ip))
+			goto unmerged;
+
+		/*
+		 * Append the data and carry the newest ack, window,
+		 * timestamp and PUSH forward into the leading header.
+		 */
+		hti->ti_ack = ti->ti_ack;
+		hti->ti_win = ti->ti_win;
+		hti->ti_flags |= ti->ti_flags & TH_PUSH;
+		if (off > sizeof (struct tcphdr))
+			memcpy((caddr_t)(hti + 1), (caddr_t)(ti + 1),
+			    off - sizeof (struct tcphdr));
+		((struct ip *)hti)->ip_len += len;
+		lro->lro_m->m_pkthdr.len += len;
+
+		m_adj(m, sizeof (struct ip) + off);
+		m->m_flags &= ~M_PKTHDR;
+		while (m && m->m_len == 0)
+			m = m_free(m);
+		if (m) {
+			lro->lro_tail->m_next = m;
+			for (n = m; n->m_next; n = n->m_next)
+				;
+			lro->lro_tail = n;
+		}
+		lro->lro_nextseq += len;
+		lro->lro_nsegs++;
+		if (hti->ti_flags & TH_PUSH)
+			tcp_lro_deliver(lro);
+		return;
+	}
+
+	/*
+	 * First segment of a new chain.  A pushed segment would be
+	 * flushed at once, so it goes straight up.
+	 */
+	if (ti->ti_flags & TH_PUSH) {
+		tcp_input(m, iphlen);
+		return;
+	}
+	if ((lro = free) == 0) {
+		lro = &tcp_lro[tcp_lro_next];
+		tcp_lro_next = (tcp_lro_next + 1) % TCP_LRO_ENTRIES;
+		tcp_lro_deliver(lro);
+	}
+	lro->lro_m = m;
+	for (n = m; n->m_next; n = n->m_next)
+		;
+	lro->lro_tail = n;
+	lro->lro_src = ti->ti_src;
+	lro->lro_dst = ti->ti_dst;
+	lro->lro_sport = ti->ti_sport;
+	lro->lro_dport = ti->ti_dport;
+	lro->lro_nextseq = seq + len;
+	lro->lro_off = off;
+	lro->lro_nsegs = 1;
+	return;
+
+unmerged:
+	if (lro)
+		tcp_lro_deliver(lro);
+	tcp_input(m, iphlen);
+}
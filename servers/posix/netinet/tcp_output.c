@@ -45,6 +45,7 @@
 #include <sys/errno.h>
 #include <sys/kernel.h>
 
+#include <net/if.h>
 #include <net/route.h>
 
 #include <netinet/in.h>
@@ -65,9 +66,37 @@
 extern struct mbuf *m_copypack();
 #endif
 
+extern int tcp_do_largesend;
 
 #define MAX_TCPOPTLEN	32	/* max # bytes that go in options */
 
+/*
+ * Return the most data that may go out in one large-send
+ * super-segment on this connection, or 0 if the interface
+ * the connection is routed through cannot take one.
+ * The interface cuts the super-segment at if_mtu, so unless
+ * it is the loopback (which passes it up whole) the segment
+ * size must already fill the MTU for the peer's MSS to hold.
+ */
+static long
+tcp_lsmax(tp)
+	register struct tcpcb *tp;
+{
+	register struct inpcb *inp = tp->t_inpcb;
+	register struct rtentry *rt = inp->inp_route.ro_rt;
+	register struct ifnet *ifp;
+
+	if (tcp_do_largesend == 0 || inp->inp_options ||
+	    rt == 0 || (rt->rt_flags & RTF_UP) == 0 ||
+	    (ifp = rt->rt_ifp) == 0 || ifp->if_lsmax == 0)
+		return (0);
+	if ((ifp->if_flags & IFF_LOOPBACK) == 0 &&
+	    tp->t_maxseg + sizeof (struct tcpiphdr) < ifp->if_mtu)
+		return (0);
+	return (min(ifp->if_lsmax, IP_MAXPACKET) -
+	    sizeof (struct tcpiphdr) - MAX_TCPOPTLEN);
+}
+
 /*
  * Tcp output routine: figure out what should be sent and send it.
  */
@@ -83,6 +112,7 @@ tcp_output(tp)
 	u_char opt[MAX_TCPOPTLEN];
 	unsigned optlen, hdrlen;
 	int idle, sendalot;
+	long lsmax;
 
 	/*
 	 * Determine length of data that should be transmitted,
@@ -156,9 +186,28 @@ again:
 			tp->snd_nxt = tp->snd_una;
 		}
 	}
+	/*
+	 * New data beyond one segment may go out as a single
+	 * large-send super-segment if the interface can split it.
+	 * Retransmissions, probes, SYNs and urgent data are
+	 * always sent a segment at a time.
+	 */
+	lsmax = 0;
 	if (len > tp->t_maxseg) {
-		len = tp->t_maxseg;
-		sendalot = 1;
+		if ((flags & TH_SYN) == 0 && tp->t_force == 0 &&
+		    tp->snd_nxt == tp->snd_max &&
+		    SEQ_LEQ(tp->snd_up, tp->snd_nxt))
+			lsmax = tcp_lsmax(tp);
+		if (lsmax > tp->t_maxseg) {
+			if (len > lsmax) {
+				len = lsmax;
+				sendalot = 1;
+			}
+		} else {
+			lsmax = 0;
+			len = tp->t_maxseg;
+			sendalot = 1;
+		}
 	}
 	if (SEQ_LT(tp->snd_nxt + len, tp->snd_una + so->so_snd.sb_cc))
 		flags &= ~TH_FIN;
@@ -176,7 +225,7 @@ again:
 	 * to send into a small window), then must resend.
 	 */
 	if (len) {
-		if (len == tp->t_maxseg)
+		if (len >= tp->t_maxseg)
 			goto send;
 		if ((idle || tp->t_flags & TF_NODELAY) &&
 		    len + off >= so->so_snd.sb_cc)
@@ -320,8 +369,10 @@ send:
 	/*
 	 * Adjust data length if insertion of options will
 	 * bump the packet length beyond the t_maxseg length.
+	 * A large-send super-segment is cut by the interface
+	 * into segments that each carry the options.
 	 */
-	 if (len > tp->t_maxseg - optlen) {
+	 if (lsmax == 0 && len > tp->t_maxseg - optlen) {
 		len = tp->t_maxseg - optlen;
 		sendalot = 1;
 	 }
@@ -347,6 +398,8 @@ send:
 			tcpstat.tcps_sndpack++;
 			tcpstat.tcps_sndbyte += len;
 		}
+		if (len > tp->t_maxseg - optlen)
+			tcpstat.tcps_sndlarge++;
 #ifdef notyet
 		if ((m = m_copypack(so->so_snd.sb_mb, off,
 		    (int)len, max_linkhdr + hdrlen)) == 0) {
@@ -359,7 +412,7 @@ send:
 		m->m_len += hdrlen;
 		m->m_data -= hdrlen;
 #else
-		MGETHDR(m, M_DONTWAIT, MT_HEADER);
+		m = m_gethdr(M_DONTWAIT, MT_HEADER);
 		if (m == NULL) {
 			error = ENOBUFS;
 			goto out;
@@ -394,7 +447,7 @@ send:
 		else
 			tcpstat.tcps_sndwinup++;
 
-		MGETHDR(m, M_DONTWAIT, MT_HEADER);
+		m = m_gethdr(M_DONTWAIT, MT_HEADER);
 		if (m == NULL) {
 			error = ENOBUFS;
 			goto out;
@@ -536,6 +589,8 @@ send:
 	 * the template, but need a way to checksum without them.
 	 */
 	m->m_pkthdr.len = hdrlen + len;
+	if (len > tp->t_maxseg - optlen)
+		m->m_flags |= M_LARGESEND;
 #ifdef TUBA
 	if (tp->t_tuba_pcb)
 		error = tuba_output(m, tp);
@@ -63,6 +63,7 @@
 int 	tcp_mssdflt = TCP_MSS;
 int 	tcp_rttdflt = TCPTV_SRTTDFLT / PR_SLOWHZ;
 int	tcp_do_rfc1323 = 1;
+int	tcp_do_largesend = 1;
 
 extern	struct inpcb *tcp_last_inpcb;
 
@@ -73,6 +73,7 @@ tcp_fasttimo()
 	register struct tcpcb *tp;
 	int s = splnet();
 
+	tcp_lro_flush();
 	inp = tcb.inp_next;
 	if (inp)
 	for (; inp != &tcb; inp = inp->inp_next)
@@ -229,6 +229,9 @@ struct	tcpstat {
 	u_long	tcps_predack;		/* times hdr predict ok for acks */
 	u_long	tcps_preddat;		/* times hdr predict ok for data pkts */
 	u_long	tcps_pcbcachemiss;
+	u_long	tcps_sndlarge;		/* large-send super-segments sent */
+	u_long	tcps_lroflush;		/* coalesced chains passed up */
+	u_long	tcps_lromerged;		/* segments merged into a chain */
 };
 
 #ifdef KERNEL
@@ -252,6 +255,8 @@ void	 tcp_drain (void);
 void	 tcp_fasttimo (void);
 void	 tcp_init (void);
 void	 tcp_input (struct mbuf *, int);
+void	 tcp_lro_flush (void);
+void	 tcp_lro_input (struct mbuf *, int);
 int	 tcp_mss (struct tcpcb *, u_int);
 struct tcpcb *
 	 tcp_newtcpcb (struct inpcb *);
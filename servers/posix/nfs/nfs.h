@@ -54,8 +54,9 @@
 #define	NFS_MAXATTRTIMO 60
 #define	NFS_WSIZE	8192		/* Def. write data size <= 8192 */
 #define	NFS_RSIZE	8192		/* Def. read data size <= 8192 */
-#define	NFS_DEFRAHEAD	1		/* Def. read ahead # blocks */
-#define	NFS_MAXRAHEAD	4		/* Max. read ahead # blocks */
+#define	NFS_DEFRAHEAD	8		/* Def. max. read ahead # blocks */
+#define	NFS_MAXRAHEAD	32		/* Max. read ahead # blocks */
+#define	NFS_DEFASYNCWIN	32		/* Def. async bufs per mount */
 #define	NFS_MAXREADDIR	NFS_MAXDATA	/* Max. size of directory read */
 #define	NFS_MAXUIDHASH	64		/* Max. # of hashed uid entries/mp */
 #define	NFS_MAXASYNCDAEMON 20	/* Max. number async_daemons runable */
@@ -98,6 +99,23 @@ struct nfsd_cargs {
 	char		*ncd_authstr;	/* Authenticator string */
 };
 
+/*
+ * Client statistics of the mount on nms_dirp, filled in by
+ * nfssvc(NFSSVC_MNTSTAT).  The mean round trip time is nms_rttsum
+ * divided by nms_rttcnt, in NFS_HZ ticks.
+ */
+struct nfs_mntstat {
+	char		*nms_dirp;	/* Mount dir path */
+	u_long		nms_rpcs;	/* Replies received (ret) */
+	u_long		nms_rttsum;	/* Sum of timed rtts (ret) */
+	u_long		nms_rttcnt;	/* Replies timed in nms_rttsum (ret) */
+	u_quad_t	nms_rbytes;	/* Bytes read through the cache (ret) */
+	u_quad_t	nms_wbytes;	/* Bytes written through the cache (ret) */
+	int		nms_asyncwin;	/* Max. async bufs outstanding (ret) */
+	int		nms_bufqlen;	/* Async bufs queued now (ret) */
+	int		nms_readahead;	/* Max. read-ahead depth (ret) */
+};
+
 /*
  * Stats structure
  */
@@ -134,6 +152,7 @@ struct nfsstats {
 	int	srvnqnfs_leases;
 	int	srvnqnfs_maxleases;
 	int	srvnqnfs_getleases;
+	int	srvcache_evictions;
 };
 
 /*
@@ -146,6 +165,7 @@ struct nfsstats {
 #define	NFSSVC_GOTAUTH	0x040
 #define	NFSSVC_AUTHINFAIL 0x080
 #define	NFSSVC_MNTD	0x100
+#define	NFSSVC_MNTSTAT	0x200
 
 /*
  * The set of signals the interrupt an I/O in progress for NFSMNT_INT mounts.
@@ -253,8 +273,29 @@ struct nfssvc_sock {
 	struct mbuf	*ns_recend;
 	int		ns_numuids;
 	struct nfsuid	*ns_uidh[NUIDHASHSIZ];
+	int		ns_inflight;	/* nfsds serving this socket */
+	u_long		ns_lastaddr;	/* last datagram client served */
+	int		ns_lastcnt;	/* and its requests in a row */
+	struct mbuf	*ns_evict;	/* queued nqnfs eviction notices */
 };
 
+/*
+ * A connection-oriented socket may not have more than nfsrv_maxinflight
+ * nfsds working on it at once.
+ */
+#define	NFSRV_SLPFULL(slp) \
+	(((slp)->ns_so->so_proto->pr_flags & PR_CONNREQUIRED) && \
+	 (slp)->ns_inflight >= nfsrv_maxinflight)
+
+/*
+ * Client of a queued datagram request, for per-host fairness, and how
+ * far down the queue to look for another one.
+ */
+#define	NFSRV_RECADDR(m) \
+	(mtod((m), struct sockaddr *)->sa_family == AF_INET ? \
+	 mtod((m), struct sockaddr_in *)->sin_addr.s_addr : 0)
+#define	NFSRV_MAXSCAN	16
+
 /* Bits for "ns_flag" */
 #define	SLP_VALID	0x01
 #define	SLP_DOREC	0x02
@@ -60,6 +60,7 @@
 struct buf *incore(), *nfs_getcacheblk();
 extern struct proc *nfs_iodwant[NFS_MAXASYNCDAEMON];
 extern int nfs_numasync;
+int nfs_asyncwin = NFS_DEFASYNCWIN;	/* nm_asyncwin of new mounts */
 
 /*
  * Vnode op for read using bio
@@ -191,11 +192,21 @@ nfs_bioread(vp, uio, ioflag, cred)
 		not_readin = 1;
 
 		/*
-		 * Start the read ahead(s), as required.
+		 * Start the read ahead(s), as required.  The depth
+		 * doubles with each sequential read up to nm_readahead
+		 * and drops back to nothing on a seek.
 		 */
-		if (nfs_numasync > 0 && nmp->nm_readahead > 0 &&
-		    lbn == vp->v_lastr + 1) {
-		    for (nra = 0; nra < nmp->nm_readahead &&
+		if (lbn == vp->v_lastr + 1) {
+		    if (np->n_rahead == 0)
+			np->n_rahead = 1;
+		    else if (np->n_rahead < nmp->nm_readahead)
+			np->n_rahead <<= 1;
+		    if (np->n_rahead > nmp->nm_readahead)
+			np->n_rahead = nmp->nm_readahead;
+		} else if (lbn != vp->v_lastr)
+		    np->n_rahead = 0;
+		if (nfs_numasync > 0 && np->n_rahead > 0) {
+		    for (nra = 0; nra < np->n_rahead &&
 			(lbn + 1 + nra) * biosize < np->n_size; nra++) {
 			rabn = (lbn + 1 + nra) * (biosize / DEV_BSIZE);
 			if (!incore(vp, rabn)) {
@@ -207,8 +218,10 @@ nfs_bioread(vp, uio, ioflag, cred)
 				if (nfs_asyncio(rabp, cred)) {
 				    rabp->b_flags |= B_INVAL;
 				    brelse(rabp);
+				    break;
 				}
-			    }
+			    } else
+				brelse(rabp);
 			}
 		    }
 		}
@@ -624,38 +637,43 @@ nfs_vinvalbuf(vp, flags, cred, p, intrflg)
 }
 
 /*
- * Initiate asynchronous I/O. Return an error if no nfsiods are available.
- * This is mainly to avoid queueing async I/O requests when the nfsiods
- * are all hung on a dead server.
+ * Initiate asynchronous I/O.  The buffer is queued whether or not an
+ * nfsiod is idle, so a mount can keep up to nm_asyncwin reads and
+ * writes waiting behind the ones in progress; an nfsiod finishing an
+ * rpc goes straight on to the next.  Return an error if there are no
+ * nfsiods or the mount's window is full.  The window is mainly to
+ * avoid queueing without bound when the nfsiods are all hung on a
+ * dead server.
  */
 nfs_asyncio(bp, cred)
 	register struct buf *bp;
 	struct ucred *cred;
 {
+	register struct nfsmount *nmp = VFSTONFS(bp->b_vp->v_mount);
 	register int i;
 
-	if (nfs_numasync == 0)
+	if (nfs_numasync == 0 || nmp->nm_bufqlen >= nmp->nm_asyncwin)
 		return (EIO);
+	if (bp->b_flags & B_READ) {
+		if (bp->b_rcred == NOCRED && cred != NOCRED) {
+			crhold(cred);
+			bp->b_rcred = cred;
+		}
+	} else {
+		if (bp->b_wcred == NOCRED && cred != NOCRED) {
+			crhold(cred);
+			bp->b_wcred = cred;
+		}
+	}
+	TAILQ_INSERT_TAIL(&nfs_bufq, bp, b_freelist);
+	nmp->nm_bufqlen++;
 	for (i = 0; i < NFS_MAXASYNCDAEMON; i++)
-	    if (nfs_iodwant[i]) {
-		if (bp->b_flags & B_READ) {
-			if (bp->b_rcred == NOCRED && cred != NOCRED) {
-				crhold(cred);
-				bp->b_rcred = cred;
-			}
-		} else {
-			if (bp->b_wcred == NOCRED && cred != NOCRED) {
-				crhold(cred);
-				bp->b_wcred = cred;
-			}
+		if (nfs_iodwant[i]) {
+			nfs_iodwant[i] = (struct proc *)0;
+			wakeup((caddr_t)&nfs_iodwant[i]);
+			break;
 		}
-	
-		TAILQ_INSERT_TAIL(&nfs_bufq, bp, b_freelist);
-		nfs_iodwant[i] = (struct proc *)0;
-		wakeup((caddr_t)&nfs_iodwant[i]);
-		return (0);
-	    }
-	return (EIO);
+	return (0);
 }
 
 /*
@@ -700,6 +718,7 @@ nfs_doio(bp, cr, p)
 		nfsstats.read_bios++;
 		error = nfs_readrpc(vp, uiop, cr);
 		if (!error) {
+		    nmp->nm_rbytes += bp->b_bcount - uiop->uio_resid;
 		    bp->b_validoff = 0;
 		    if (uiop->uio_resid) {
 			/*
@@ -765,6 +784,8 @@ nfs_doio(bp, cr, p)
 	    else
 		error = nfs_writerpc(vp, uiop, cr, 0);
 	    bp->b_flags &= ~(B_WRITEINPROG | B_APPENDWRITE);
+	    if (!error)
+		nmp->nm_wbytes += bp->b_dirtyend - bp->b_dirtyoff;
 
 	    /*
 	     * For an interrupted write, the buffer is still valid and the
@@ -141,6 +141,7 @@ loop:
 	np->n_sillyrename = (struct sillyrename *)0;
 	np->n_size = 0;
 	np->n_mtime = 0;
+	np->n_rahead = 0;
 	if (VFSTONFS(mntp)->nm_flag & NFSMNT_NQNFS) {
 		np->n_brev = 0;
 		np->n_lrev = 0;
@@ -74,12 +74,19 @@
 #include <nfs/nfsmount.h>
 
 /*
- * List head for the lease queue and other global data.
- * At any time a lease is linked into a list ordered by increasing expiry time.
+ * Timer wheel, lease hash table and other global data.
+ * At any time a lease is linked into the wheel slot of its expiry second.
+ * The hash mixes the file system id with the first two words of the file
+ * id (inode and generation for ufs), so that leases on several exported
+ * file systems do not pile up on the same chains.
  */
-#define	NQFHHASH(f)	((*((u_int *)(f)))&nqfheadhash)
+#define	NQFHHASH(s, f) \
+	(((s)->val[0] + ((u_int *)(f))[0] + ((u_int *)(f))[1] * 31) & \
+	 nqfheadhash)
 
-union nqsrvthead nqthead;
+union nqsrvthead nqwheel[NQ_WHEELSIZ];
+time_t nqwheeltime;		/* Next expiry second to be scanned */
+time_t nqlastexpiry;		/* Latest expiry handed out */
 struct nqlease **nqfhead;
 u_long nqfheadhash;
 time_t nqnfsstarttime = (time_t)0;
@@ -91,7 +98,7 @@ int nqsrv_maxnumlease = NQ_MAXNUMLEASE;
 void nqsrv_instimeq(), nqsrv_send_eviction(), nfs_sndunlock();
 void nqsrv_unlocklease(), nqsrv_waitfor_expiry(), nfsrv_slpderef();
 void nqsrv_addhost(), nqsrv_locklease(), nqnfs_serverd();
-void nqnfs_clientlease();
+void nqnfs_clientlease(), nqsrv_flushevict();
 struct mbuf *nfsm_rpchead();
 
 /*
@@ -193,7 +200,7 @@ nqsrv_getlease(vp, duration, flags, nd, nam, cachablep, frev, cred)
 			splx(s);
 			return (error);
 		}
-		lpp = &nqfhead[NQFHHASH(fh.fh_fid.fid_data)];
+		lpp = &nqfhead[NQFHHASH(&fh.fh_fsid, fh.fh_fid.fid_data)];
 		for (lp = *lpp; lp; lp = lp->lc_fhnext)
 			if (fh.fh_fsid.val[0] == lp->lc_fsid.val[0] &&
 			    fh.fh_fsid.val[1] == lp->lc_fsid.val[1] &&
@@ -360,14 +367,14 @@ nqsrv_addhost(lph, slp, nam)
 }
 
 /*
- * Update the lease expiry time and position it in the timer queue correctly.
+ * Update the lease expiry time and move it to the timer wheel slot for
+ * the new expiry second.
  */
 void
 nqsrv_instimeq(lp, duration)
 	register struct nqlease *lp;
 	u_long duration;
 {
-	register struct nqlease *tlp;
 	time_t newexpiry;
 
 	newexpiry = get_seconds() + duration + nqsrv_clockskew;
@@ -376,16 +383,11 @@ nqsrv_instimeq(lp, duration)
 	if (lp->lc_chain1[0])
 		remque(lp);
 	lp->lc_expiry = newexpiry;
-
-	/*
-	 * Find where in the queue it should be.
-	 */
-	tlp = nqthead.th_chain[1];
-	while (tlp->lc_expiry > newexpiry && tlp != (struct nqlease *)&nqthead)
-		tlp = tlp->lc_chain1[1];
-	if (tlp == nqthead.th_chain[1])
+	if (newexpiry > nqlastexpiry) {
+		nqlastexpiry = newexpiry;
 		NQSTORENOVRAM(newexpiry);
-	insque(lp, tlp);
+	}
+	insque(lp, NQWHEELSLOT(newexpiry)->th_chain[1]);
 }
 
 /*
@@ -433,6 +435,10 @@ nqsrv_cmpnam(slp, nam, lph)
 
 /*
  * Send out eviction notice messages to all other hosts for the lease.
+ * The notice is the same for every host, so it is built once and copied.
+ * Notices for a connection-oriented host are queued on its socket and go
+ * out in one send together with any others queued for it; if the socket
+ * is busy, the nfsd holding the send lock flushes them when it is done.
  */
 void
 nqsrv_send_eviction(vp, lp, slp, nam, cred)
@@ -443,87 +449,97 @@ nqsrv_send_eviction(vp, lp, slp, nam, cred)
 	struct ucred *cred;
 {
 	register struct nqhost *lph = &lp->lc_host;
-	register struct mbuf *m;
+	register struct mbuf *m, *n;
 	register int siz;
 	struct nqm *lphnext = lp->lc_morehosts;
-	struct mbuf *mreq, *mb, *mb2, *nam2, *mheadend;
+	struct mbuf *mreq, *mb, *mb2, *nam2, *mheadend, *m0 = (struct mbuf *)0;
+	struct nfssvc_sock *lslp;
 	struct socket *so;
 	struct sockaddr_in *saddr;
 	fhandle_t *fhp;
 	caddr_t bpos, cp;
 	u_long xid;
 	int len = 1, ok = 1, i = 0;
-	int sotype, *solockp;
 
 	while (ok && (lph->lph_flag & LC_VALID)) {
 		if (nqsrv_cmpnam(slp, nam, lph))
 			lph->lph_flag |= LC_VACATED;
 		else if ((lph->lph_flag & (LC_LOCAL | LC_VACATED)) == 0) {
-			if (lph->lph_flag & LC_UDP) {
-				MGET(nam2, M_WAIT, MT_SONAME);
-				saddr = mtod(nam2, struct sockaddr_in *);
-				nam2->m_len = saddr->sin_len =
-					sizeof (struct sockaddr_in);
-				saddr->sin_family = AF_INET;
-				saddr->sin_addr.s_addr = lph->lph_inetaddr;
-				saddr->sin_port = lph->lph_port;
+			if (lph->lph_flag & LC_UDP)
 				so = nfs_udpsock->ns_so;
-			} else if (lph->lph_flag & LC_CLTP) {
-				nam2 = lph->lph_nam;
+			else if (lph->lph_flag & LC_CLTP)
 				so = nfs_cltpsock->ns_so;
-			} else if (lph->lph_slp->ns_flag & SLP_VALID) {
-				nam2 = (struct mbuf *)0;
+			else if (lph->lph_slp->ns_flag & SLP_VALID)
 				so = lph->lph_slp->ns_so;
-			} else
-				goto nextone;
-			sotype = so->so_type;
-			if (so->so_proto->pr_flags & PR_CONNREQUIRED)
-				solockp = &lph->lph_slp->ns_solock;
 			else
-				solockp = (int *)0;
-			nfsm_reqhead((struct vnode *)0, NQNFSPROC_EVICTED,
-				NFSX_FH);
-			nfsm_build(cp, caddr_t, NFSX_FH);
-			memset(cp, 0, NFSX_FH);
-			fhp = (fhandle_t *)cp;
-			fhp->fh_fsid = vp->v_mount->mnt_stat.f_fsid;
-			VFS_VPTOFH(vp, &fhp->fh_fid);
-			m = mreq;
-			siz = 0;
-			while (m) {
-				siz += m->m_len;
-				m = m->m_next;
-			}
-			if (siz <= 0 || siz > NFS_MAXPACKET) {
-				printf("mbuf siz=%d\n",siz);
-				panic("Bad nfs svc reply");
+				goto nextone;
+			if (m0 == (struct mbuf *)0) {
+				nfsm_reqhead((struct vnode *)0,
+					NQNFSPROC_EVICTED, NFSX_FH);
+				nfsm_build(cp, caddr_t, NFSX_FH);
+				memset(cp, 0, NFSX_FH);
+				fhp = (fhandle_t *)cp;
+				fhp->fh_fsid = vp->v_mount->mnt_stat.f_fsid;
+				VFS_VPTOFH(vp, &fhp->fh_fid);
+				m = mreq;
+				siz = 0;
+				while (m) {
+					siz += m->m_len;
+					m = m->m_next;
+				}
+				if (siz <= 0 || siz > NFS_MAXPACKET) {
+					printf("mbuf siz=%d\n",siz);
+					panic("Bad nfs svc reply");
+				}
+				m0 = nfsm_rpchead(cred, TRUE, NQNFSPROC_EVICTED,
+					RPCAUTH_UNIX, 5*NFSX_UNSIGNED, (char *)0,
+					mreq, siz, &mheadend, &xid);
 			}
-			m = nfsm_rpchead(cred, TRUE, NQNFSPROC_EVICTED,
-				RPCAUTH_UNIX, 5*NFSX_UNSIGNED, (char *)0,
-				mreq, siz, &mheadend, &xid);
+			m = m_copym(m0, 0, M_COPYALL, M_WAIT);
 			/*
 			 * For stream protocols, prepend a Sun RPC
 			 * Record Mark.
 			 */
-			if (sotype == SOCK_STREAM) {
+			if (so->so_type == SOCK_STREAM) {
 				M_PREPEND(m, NFSX_UNSIGNED, M_WAIT);
 				*mtod(m, u_long *) = htonl(0x80000000 |
 					(m->m_pkthdr.len - NFSX_UNSIGNED));
 			}
-			if (((lph->lph_flag & (LC_UDP | LC_CLTP)) == 0 &&
-			    (lph->lph_slp->ns_flag & SLP_VALID) == 0) ||
-			    (solockp && (*solockp & NFSMNT_SNDLOCK)))
-				m_freem(m);
-			else {
-				if (solockp)
-					*solockp |= NFSMNT_SNDLOCK;
-				(void) nfs_send(so, nam2, m,
+			if (lph->lph_flag & LC_UDP) {
+				MGET(nam2, M_WAIT, MT_SONAME);
+				saddr = mtod(nam2, struct sockaddr_in *);
+				nam2->m_len = saddr->sin_len =
+					sizeof (struct sockaddr_in);
+				saddr->sin_family = AF_INET;
+				saddr->sin_addr.s_addr = lph->lph_inetaddr;
+				saddr->sin_port = lph->lph_port;
+				(void) nfs_send(so, nam2, m, (struct nfsreq *)0);
+				MFREE(nam2, m);
+			} else if (lph->lph_flag & LC_CLTP)
+				(void) nfs_send(so, lph->lph_nam, m,
 						(struct nfsreq *)0);
-				if (solockp)
-					nfs_sndunlock(solockp);
+			else {
+				lslp = lph->lph_slp;
+				if ((lslp->ns_flag & SLP_VALID) == 0) {
+					m_freem(m);
+					goto nextone;
+				}
+				if (lslp->ns_evict) {
+					lslp->ns_evict->m_pkthdr.len +=
+						m->m_pkthdr.len;
+					m->m_flags &= ~M_PKTHDR;
+					for (n = lslp->ns_evict; n->m_next;
+					     n = n->m_next)
+						;
+					n->m_next = m;
+				} else
+					lslp->ns_evict = m;
+				if ((lslp->ns_solock & NFSMNT_SNDLOCK) == 0) {
+					lslp->ns_solock |= NFSMNT_SNDLOCK;
+					nqsrv_flushevict(lslp);
+					nfs_sndunlock(&lslp->ns_solock);
+				}
 			}
-			if (lph->lph_flag & LC_UDP)
-				MFREE(nam2, m);
 		}
 nextone:
 		if (++i == len) {
@@ -537,6 +553,28 @@ nextone:
 		} else
 			lph++;
 	}
+	if (m0)
+		m_freem(m0);
+}
+
+/*
+ * Send the eviction notices queued on a connection-oriented socket.
+ * The caller holds the socket's send lock.
+ */
+void
+nqsrv_flushevict(slp)
+	register struct nfssvc_sock *slp;
+{
+	register struct mbuf *m;
+
+	while (m = slp->ns_evict) {
+		slp->ns_evict = (struct mbuf *)0;
+		if (slp->ns_flag & SLP_VALID)
+			(void) nfs_send(slp->ns_so, (struct mbuf *)0, m,
+					(struct nfsreq *)0);
+		else
+			m_freem(m);
+	}
 }
 
 /*
@@ -583,25 +621,42 @@ tryagain:
 
 /*
  * Nqnfs server timer that maintains the server lease queue.
- * Scan the lease queue for expired entries:
+ * Scan the timer wheel slots for the seconds that have passed since the
+ * last call for expired entries:
  * - when one is found, wakeup anyone waiting for it
  *   else dequeue and free
+ * An expired lease that cannot be freed yet is moved to the current slot,
+ * so that it is looked at again on the next tick.  Entries in a slot that
+ * expire on a later turn of the wheel are skipped.
  */
 void
 nqnfs_serverd()
 {
 	register struct nqlease *lp, *lq;
 	register struct nqhost *lph;
+	register union nqsrvthead *th;
 	struct nqlease *nextlp;
 	struct nqm *lphnext, *olphnext;
 	struct mbuf *n;
+	time_t t, now;
 	int i, len, ok;
 
-	lp = nqthead.th_chain[0];
-	while (lp != (struct nqlease *)&nqthead) {
-		if (lp->lc_expiry >= get_seconds())
-			break;
+	now = get_seconds();
+	if (now - nqwheeltime >= NQ_WHEELSIZ)
+		nqwheeltime = now - NQ_WHEELSIZ + 1;
+	for (t = nqwheeltime; t < now; t++) {
+	    th = NQWHEELSLOT(t);
+	    lp = th->th_chain[0];
+	    while (lp != (struct nqlease *)th) {
 		nextlp = lp->lc_chain1[0];
+		if (lp->lc_expiry > t) {
+			lp = nextlp;
+			continue;
+		}
+		if (lp->lc_flag & (LC_EXPIREDWANTED | LC_LOCKED | LC_WANTED)) {
+			remque(lp);
+			insque(lp, NQWHEELSLOT(now)->th_chain[1]);
+		}
 		if (lp->lc_flag & LC_EXPIREDWANTED) {
 			lp->lc_flag &= ~LC_EXPIREDWANTED;
 			wakeup((caddr_t)&lp->lc_flag);
@@ -667,7 +722,9 @@ nqnfs_serverd()
 		    }
 		}
 		lp = nextlp;
+	    }
 	}
+	nqwheeltime = now;
 }
 
 /*
@@ -751,7 +808,7 @@ nqnfsrv_vacated(nfsd, mrep, md, dpos, cred, nam, mrq)
 	/*
 	 * Find the lease by searching the hash list.
 	 */
-	for (lp = nqfhead[NQFHHASH(fhp->fh_fid.fid_data)]; lp;
+	for (lp = nqfhead[NQFHHASH(&fhp->fh_fsid, fhp->fh_fid.fid_data)]; lp;
 	     lp = lp->lc_fhnext)
 		if (fhp->fh_fsid.val[0] == lp->lc_fsid.val[0] &&
 		    fhp->fh_fsid.val[1] == lp->lc_fsid.val[1] &&
@@ -1110,17 +1167,33 @@ lease_updatetime(deltat)
 {
 	register struct nqlease *lp;
 	register struct nfsnode *np;
+	register union nqsrvthead *th;
+	struct nqlease *lq;
 	struct mount *mp;
 	struct nfsmount *nmp;
 	int s;
 
 	if (nqnfsstarttime != 0)
 		nqnfsstarttime += deltat;
+
+	/*
+	 * Each lease changes slot with its expiry time, so empty the wheel
+	 * onto a list linked through lc_chain1[1] and rebuild it.
+	 */
 	s = splsoftclock();
-	lp = nqthead.th_chain[0];
-	while (lp != (struct nqlease *)&nqthead) {
+	lq = (struct nqlease *)0;
+	for (th = nqwheel; th < &nqwheel[NQ_WHEELSIZ]; th++)
+		while ((lp = th->th_chain[0]) != (struct nqlease *)th) {
+			remque(lp);
+			lp->lc_chain1[1] = lq;
+			lq = lp;
+		}
+	nqwheeltime += deltat;
+	nqlastexpiry += deltat;
+	while (lp = lq) {
+		lq = lp->lc_chain1[1];
 		lp->lc_expiry += deltat;
-		lp = lp->lc_chain1[0];
+		insque(lp, NQWHEELSLOT(lp->lc_expiry)->th_chain[1]);
 	}
 	splx(s);
 
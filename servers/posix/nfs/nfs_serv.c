@@ -62,6 +62,7 @@
 #include <sys/vnode.h>
 #include <sys/mount.h>
 #include <sys/mbuf.h>
+#include <sys/buf.h>
 #include <sys/dirent.h>
 #include <sys/stat.h>
 
@@ -81,6 +82,47 @@ extern u_long nfs_false, nfs_true;
 nfstype nfs_type[9] = { NFNON, NFREG, NFDIR, NFBLK, NFCHR, NFLNK, NFNON,
 		      NFCHR, NFNON };
 
+extern int nfs_loanmin;
+
+/*
+ * Lend the file data of a read out of the buffer cache, one block at
+ * a time, as a chain of external mbufs (see nfsm_loan).
+ */
+static struct mbuf *
+nfsrv_readloan(vp, off, len)
+	struct vnode *vp;
+	off_t off;
+	int len;
+{
+	struct mbuf *top, **mp;
+	register struct mbuf *m;
+	struct buf *bp;
+	char *cp;
+	int n;
+
+	top = 0;
+	mp = &top;
+	while (len > 0) {
+		if (VOP_BLKATOFF(vp, off, &cp, &bp))
+			goto bad;
+		n = (char *)bp->b_data + bp->b_bcount - cp;
+		if (n > len)
+			n = len;
+		m = n > 0 ? nfsm_loan(cp, n) : 0;
+		brelse(bp);
+		if (m == 0)
+			goto bad;
+		*mp = m;
+		mp = &m->m_next;
+		off += n;
+		len -= n;
+	}
+	return (top);
+bad:
+	m_freem(top);
+	return (0);
+}
+
 /*
  * nqnfs access service
  */
@@ -475,7 +517,27 @@ nfsrv_read(nfsd, mrep, md, dpos, cred, nam, mrq)
 	nfsm_build(fp, struct nfsv2_fattr *, NFSX_FATTR(nfsd->nd_nqlflag != NQL_NOVAL));
 	nfsm_build(tl, u_long *, NFSX_UNSIGNED);
 	len = left = cnt;
-	if (cnt > 0) {
+	if (cnt > 0 && nfs_loanmin > 0 && cnt >= nfs_loanmin &&
+	    (m = nfsrv_readloan(vp, off,
+	    (int)(off + cnt > vap->va_size ? vap->va_size - off : cnt)))) {
+		/*
+		 * Chain the loaned blocks behind the header and leave a
+		 * pad mbuf for nfsm_adj to zero below.
+		 */
+		mb->m_next = m;
+		for (len = 0; ; m = m->m_next) {
+			len += m->m_len;
+			if (m->m_next == 0)
+				break;
+		}
+		cnt = nfsm_rndup(len);
+		if (cnt > len) {
+			MGET(m2, M_WAIT, MT_DATA);
+			m2->m_len = cnt - len;
+			m->m_next = m2;
+		}
+		uiop->uio_resid = 0;
+	} else if (cnt > 0) {
 		/*
 		 * Generate the mbuf list with the uio_iov ref. to it.
 		 */
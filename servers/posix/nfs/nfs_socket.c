@@ -156,6 +156,7 @@ int	nfs_sbwait();
 void	nfs_disconnect(), nfs_realign(), nfsrv_wakenfsd(), nfs_sndunlock();
 void	nfs_rcvunlock(), nqnfs_serverd(), nqnfs_clientlease();
 struct mbuf *nfsm_rpchead();
+extern int nfsrv_quantum, nfsrv_maxinflight;
 int nfsrtton = 0;
 struct nfsrtt nfsrtt;
 struct nfsd nfsd_head;
@@ -795,6 +796,7 @@ nfsmout:
 				}
 				rep->r_flags &= ~R_SENT;
 				nmp->nm_sent -= NFS_CWNDSCALE;
+				nmp->nm_rpcs++;
 				/*
 				 * Update rtt using a gain of 0.125 on the mean
 				 * and a gain of 0.25 on the deviation.
@@ -809,6 +811,8 @@ nfsmout:
 					 * add 1.
 					 */
 					t1 = rep->r_rtt + 1;
+					nmp->nm_rttsum += t1;
+					nmp->nm_rttcnt++;
 					t1 -= (NFS_SRTT(rep) >> 3);
 					NFS_SRTT(rep) += t1;
 					if (t1 < 0)
@@ -1784,13 +1788,42 @@ nfsrv_dorec(slp, nd)
 	register struct nfssvc_sock *slp;
 	register struct nfsd *nd;
 {
-	register struct mbuf *m;
-	int error;
+	register struct mbuf *m, *prev;
+	int error, n;
 
 	if ((slp->ns_flag & SLP_VALID) == 0 ||
 	    (m = slp->ns_rec) == (struct mbuf *)0)
 		return (ENOBUFS);
-	if (slp->ns_rec = m->m_nextpkt)
+
+	/*
+	 * All clients of a datagram socket share its queue.  Once one
+	 * host has had nfsrv_quantum requests in a row, take the first
+	 * queued request from another host ahead of it.
+	 */
+	prev = (struct mbuf *)0;
+	if (m->m_type == MT_SONAME) {
+		if (NFSRV_RECADDR(m) != slp->ns_lastaddr) {
+			slp->ns_lastaddr = NFSRV_RECADDR(m);
+			slp->ns_lastcnt = 0;
+		} else if (++slp->ns_lastcnt >= nfsrv_quantum) {
+			for (n = 0, prev = m; prev->m_nextpkt &&
+			    n < NFSRV_MAXSCAN; prev = prev->m_nextpkt, n++)
+				if (NFSRV_RECADDR(prev->m_nextpkt) !=
+				    slp->ns_lastaddr)
+					break;
+			if (prev->m_nextpkt && n < NFSRV_MAXSCAN) {
+				m = prev->m_nextpkt;
+				slp->ns_lastaddr = NFSRV_RECADDR(m);
+				slp->ns_lastcnt = 0;
+			} else
+				prev = (struct mbuf *)0;
+		}
+	}
+	if (prev) {
+		if ((prev->m_nextpkt = m->m_nextpkt) == (struct mbuf *)0)
+			slp->ns_recend = prev;
+		m->m_nextpkt = (struct mbuf *)0;
+	} else if (slp->ns_rec = m->m_nextpkt)
 		m->m_nextpkt = (struct mbuf *)0;
 	else
 		slp->ns_recend = (struct mbuf *)0;
@@ -1976,12 +2009,13 @@ nfsrv_wakenfsd(slp)
 
 	if ((slp->ns_flag & SLP_VALID) == 0)
 		return;
-	while (nd != (struct nfsd *)&nfsd_head) {
+	while (nd != (struct nfsd *)&nfsd_head && !NFSRV_SLPFULL(slp)) {
 		if (nd->nd_flag & NFSD_WAITING) {
 			nd->nd_flag &= ~NFSD_WAITING;
 			if (nd->nd_slp)
 				panic("nfsd wakeup");
 			slp->ns_sref++;
+			slp->ns_inflight++;
 			nd->nd_slp = slp;
 			wakeup((caddr_t)nd);
 			return;
@@ -68,10 +68,15 @@
 
 long numnfsrvcache, desirednfsrvcache = NFSRVCACHESIZ;
 
-#define	NFSRCHASH(xid)		(((xid) + ((xid) >> 24)) & rheadhash)
-static struct nfsrvcache *nfsrvlruhead, **nfsrvlrutail = &nfsrvlruhead;
-static struct nfsrvcache **rheadhtbl;
-static u_long rheadhash;
+#define	NFSRCHASH(xid)	(((xid) + ((xid) >> 24)) & (NFSRVHASHSIZ - 1))
+static struct nfsrvbucket nfsrvbuckets[NFSRVHASHSIZ];
+
+/*
+ * Non-idempotent requests seen in the current sample period, and the
+ * smoothed rate per second from earlier ones.  The cache is sized to
+ * hold NFSRVCACHESECS worth of them.
+ */
+static long nfsrvreqcnt, nfsrvreqrate, nfsrvreqtime;
 
 #define	NETFAMILY(rp) \
 		(((rp)->rc_flag & RC_INETADDR) ? AF_INET : AF_ISO)
@@ -137,8 +142,142 @@ static int repliesstatus[NFS_NPROCS] = {
  */
 nfsrv_initcache()
 {
+	register struct nfsrvbucket *rb;
+
+	for (rb = nfsrvbuckets; rb < &nfsrvbuckets[NFSRVHASHSIZ]; rb++) {
+		rb->rb_hash = NULL;
+		rb->rb_lru = NULL;
+		rb->rb_lrutail = &rb->rb_lru;
+		rb->rb_count = 0;
+		rb->rb_flag = 0;
+	}
+}
+
+static void
+nfsrv_lockbucket(rb)
+	register struct nfsrvbucket *rb;
+{
+
+	while (rb->rb_flag & RC_LOCKED) {
+		rb->rb_flag |= RC_WANTED;
+		(void) tsleep((caddr_t)rb, PZERO-1, "nfsrc", 0);
+	}
+	rb->rb_flag |= RC_LOCKED;
+}
+
+static void
+nfsrv_unlockbucket(rb)
+	register struct nfsrvbucket *rb;
+{
+
+	rb->rb_flag &= ~RC_LOCKED;
+	if (rb->rb_flag & RC_WANTED) {
+		rb->rb_flag &= ~RC_WANTED;
+		wakeup((caddr_t)rb);
+	}
+}
+
+static void
+nfsrv_lruremove(rb, rp)
+	register struct nfsrvbucket *rb;
+	register struct nfsrvcache *rp;
+{
+
+	if (rp->rc_prev == NULL)
+		return;
+	if (rp->rc_next)
+		rp->rc_next->rc_prev = rp->rc_prev;
+	else
+		rb->rb_lrutail = rp->rc_prev;
+	*rp->rc_prev = rp->rc_next;
+	rp->rc_next = NULL;
+	rp->rc_prev = NULL;
+	rb->rb_count--;
+}
+
+static void
+nfsrv_lruinsert(rb, rp)
+	register struct nfsrvbucket *rb;
+	register struct nfsrvcache *rp;
+{
+
+	rp->rc_next = NULL;
+	rp->rc_prev = rb->rb_lrutail;
+	*rb->rb_lrutail = rp;
+	rb->rb_lrutail = &rp->rc_next;
+	rb->rb_count++;
+}
+
+/*
+ * Unhash an entry, which must be off the lru list, and free it.
+ */
+static void
+nfsrv_freeentry(rp)
+	register struct nfsrvcache *rp;
+{
+	struct mbuf *mb;
+
+	if (rp->rc_forw)
+		rp->rc_forw->rc_back = rp->rc_back;
+	*rp->rc_back = rp->rc_forw;
+	if (rp->rc_flag & RC_REPMBUF)
+		m_freem(rp->rc_reply);
+	if (rp->rc_flag & RC_NAM)
+		MFREE(rp->rc_nam, mb);
+	free((caddr_t)rp, M_NFSD);
+	numnfsrvcache--;
+}
+
+/*
+ * Trim a bucket's lru list to its share of desirednfsrvcache.  Only
+ * completed non-idempotent entries are on the list; in progress ones
+ * stay hashed until nfsrv_updatecache, so a retransmission of a
+ * request still being done is always dropped.
+ */
+static void
+nfsrv_trimbucket(rb)
+	register struct nfsrvbucket *rb;
+{
+	register struct nfsrvcache *rp;
+	int max;
 
-	rheadhtbl = hashinit(desirednfsrvcache, M_NFSD, &rheadhash);
+	max = desirednfsrvcache / NFSRVHASHSIZ;
+	if (max < 1)
+		max = 1;
+	while (rb->rb_count > max) {
+		rp = rb->rb_lru;
+		nfsrv_lruremove(rb, rp);
+		nfsrv_freeentry(rp);
+		nfsstats.srvcache_evictions++;
+	}
+}
+
+/*
+ * Count a non-idempotent request and, once per sample period,
+ * resize the cache from the smoothed request rate.
+ */
+static void
+nfsrv_sizecache()
+{
+	struct timeval tv;
+	long secs, rate;
+
+	nfsrvreqcnt++;
+	get_time(&tv);
+	secs = tv.tv_sec - nfsrvreqtime;
+	if (secs < NFSRVCACHEPERIOD)
+		return;
+	if (nfsrvreqtime) {
+		rate = nfsrvreqcnt / secs;
+		nfsrvreqrate = (3 * nfsrvreqrate + rate) / 4;
+		desirednfsrvcache = nfsrvreqrate * NFSRVCACHESECS;
+		if (desirednfsrvcache < NFSRVCACHEMIN)
+			desirednfsrvcache = NFSRVCACHEMIN;
+		else if (desirednfsrvcache > NFSRVCACHEMAX)
+			desirednfsrvcache = NFSRVCACHEMAX;
+	}
+	nfsrvreqtime = tv.tv_sec;
+	nfsrvreqcnt = 0;
 }
 
 /*
@@ -153,7 +292,8 @@ nfsrv_initcache()
  * - if completed within DELAY of the current time, return DROP it
  * - if completed a longer time ago return REPLY if the reply was cached or
  *   return DOIT
- * Update/add new request at end of lru list
+ * Only the request's hash bucket is locked.  New and redone entries
+ * are kept off the lru list until nfsrv_updatecache.
  */
 nfsrv_getcache(nam, nd, repp)
 	struct mbuf *nam;
@@ -161,6 +301,7 @@ nfsrv_getcache(nam, nd, repp)
 	struct mbuf **repp;
 {
 	register struct nfsrvcache *rp, *rq, **rpp;
+	register struct nfsrvbucket *rb;
 	struct mbuf *mb;
 	struct sockaddr_in *saddr;
 	caddr_t bpos;
@@ -168,28 +309,11 @@ nfsrv_getcache(nam, nd, repp)
 
 	if (nd->nd_nqlflag != NQL_NOVAL)
 		return (RC_DOIT);
-	rpp = &rheadhtbl[NFSRCHASH(nd->nd_retxid)];
-loop:
-	for (rp = *rpp; rp; rp = rp->rc_forw) {
+	rb = &nfsrvbuckets[NFSRCHASH(nd->nd_retxid)];
+	nfsrv_lockbucket(rb);
+	for (rp = rb->rb_hash; rp; rp = rp->rc_forw) {
 	    if (nd->nd_retxid == rp->rc_xid && nd->nd_procnum == rp->rc_proc &&
 		netaddr_match(NETFAMILY(rp), &rp->rc_haddr, nam)) {
-			if ((rp->rc_flag & RC_LOCKED) != 0) {
-				rp->rc_flag |= RC_WANTED;
-				(void) tsleep((caddr_t)rp, PZERO-1, "nfsrc", 0);
-				goto loop;
-			}
-			rp->rc_flag |= RC_LOCKED;
-			/* If not at end of LRU chain, move it there */
-			if (rp->rc_next) {
-				/* remove from LRU chain */
-				*rp->rc_prev = rp->rc_next;
-				rp->rc_next->rc_prev = rp->rc_prev;
-				/* and replace at end of it */
-				rp->rc_next = NULL;
-				rp->rc_prev = nfsrvlrutail;
-				*nfsrvlrutail = rp;
-				nfsrvlrutail = &rp->rc_next;
-			}
 			if (rp->rc_state == RC_UNUSED)
 				panic("nfsrv cache");
 			if (rp->rc_state == RC_INPROG) {
@@ -206,51 +330,25 @@ loop:
 						M_WAIT);
 				ret = RC_REPLY;
 			} else {
+				/* Done, but no valid reply was saved */
 				nfsstats.srvcache_idemdonehits++;
 				rp->rc_state = RC_INPROG;
 				ret = RC_DOIT;
 			}
-			rp->rc_flag &= ~RC_LOCKED;
-			if (rp->rc_flag & RC_WANTED) {
-				rp->rc_flag &= ~RC_WANTED;
-				wakeup((caddr_t)rp);
-			}
+			nfsrv_lruremove(rb, rp);
+			if (rp->rc_state == RC_DONE)
+				nfsrv_lruinsert(rb, rp);
+			nfsrv_unlockbucket(rb);
 			return (ret);
 		}
 	}
 	nfsstats.srvcache_misses++;
-	if (numnfsrvcache < desirednfsrvcache) {
-		rp = (struct nfsrvcache *)malloc((u_long)sizeof *rp,
-		    M_NFSD, M_WAITOK);
-		memset((char *)rp, 0, sizeof *rp);
-		numnfsrvcache++;
-		rp->rc_flag = RC_LOCKED;
-	} else {
-		rp = nfsrvlruhead;
-		while ((rp->rc_flag & RC_LOCKED) != 0) {
-			rp->rc_flag |= RC_WANTED;
-			(void) tsleep((caddr_t)rp, PZERO-1, "nfsrc", 0);
-			rp = nfsrvlruhead;
-		}
-		rp->rc_flag |= RC_LOCKED;
-		/* remove from hash chain */
-		if (rq = rp->rc_forw)
-			rq->rc_back = rp->rc_back;
-		*rp->rc_back = rq;
-		/* remove from LRU chain */
-		*rp->rc_prev = rp->rc_next;
-		rp->rc_next->rc_prev = rp->rc_prev;
-		if (rp->rc_flag & RC_REPMBUF)
-			m_freem(rp->rc_reply);
-		if (rp->rc_flag & RC_NAM)
-			MFREE(rp->rc_nam, mb);
-		rp->rc_flag &= (RC_LOCKED | RC_WANTED);
-	}
-	/* place at end of LRU list */
-	rp->rc_next = NULL;
-	rp->rc_prev = nfsrvlrutail;
-	*nfsrvlrutail = rp;
-	nfsrvlrutail = &rp->rc_next;
+	if (nonidempotent[nd->nd_procnum])
+		nfsrv_sizecache();
+	rp = (struct nfsrvcache *)malloc((u_long)sizeof *rp,
+	    M_NFSD, M_WAITOK);
+	memset((char *)rp, 0, sizeof *rp);
+	numnfsrvcache++;
 	rp->rc_state = RC_INPROG;
 	rp->rc_xid = nd->nd_retxid;
 	saddr = mtod(nam, struct sockaddr_in *);
@@ -267,21 +365,20 @@ loop:
 	};
 	rp->rc_proc = nd->nd_procnum;
 	/* insert into hash chain */
+	rpp = &rb->rb_hash;
 	if (rq = *rpp)
 		rq->rc_back = &rp->rc_forw;
 	rp->rc_forw = rq;
 	rp->rc_back = rpp;
 	*rpp = rp;
-	rp->rc_flag &= ~RC_LOCKED;
-	if (rp->rc_flag & RC_WANTED) {
-		rp->rc_flag &= ~RC_WANTED;
-		wakeup((caddr_t)rp);
-	}
+	nfsrv_unlockbucket(rb);
 	return (RC_DOIT);
 }
 
 /*
- * Update a request cache entry after the rpc has been done
+ * Update a request cache entry after the rpc has been done.
+ * Idempotent requests are never replayed from the cache, so their
+ * entries go away; non-idempotent ones go on the end of the lru.
  */
 void
 nfsrv_updatecache(nam, nd, repvalid, repmbuf)
@@ -291,25 +388,26 @@ nfsrv_updatecache(nam, nd, repvalid, repmbuf)
 	struct mbuf *repmbuf;
 {
 	register struct nfsrvcache *rp;
+	register struct nfsrvbucket *rb;
 
 	if (nd->nd_nqlflag != NQL_NOVAL)
 		return;
-loop:
-	for (rp = rheadhtbl[NFSRCHASH(nd->nd_retxid)]; rp; rp = rp->rc_forw) {
+	rb = &nfsrvbuckets[NFSRCHASH(nd->nd_retxid)];
+	nfsrv_lockbucket(rb);
+	for (rp = rb->rb_hash; rp; rp = rp->rc_forw) {
 	    if (nd->nd_retxid == rp->rc_xid && nd->nd_procnum == rp->rc_proc &&
 		netaddr_match(NETFAMILY(rp), &rp->rc_haddr, nam)) {
-			if ((rp->rc_flag & RC_LOCKED) != 0) {
-				rp->rc_flag |= RC_WANTED;
-				(void) tsleep((caddr_t)rp, PZERO-1, "nfsrc", 0);
-				goto loop;
+			nfsrv_lruremove(rb, rp);
+			if (!nonidempotent[nd->nd_procnum]) {
+				nfsrv_freeentry(rp);
+				break;
 			}
-			rp->rc_flag |= RC_LOCKED;
 			rp->rc_state = RC_DONE;
 			/*
 			 * If we have a valid reply update status and save
-			 * the reply for non-idempotent rpc's.
+			 * the reply.
 			 */
-			if (repvalid && nonidempotent[nd->nd_procnum]) {
+			if (repvalid) {
 				if (repliesstatus[nd->nd_procnum]) {
 					rp->rc_status = nd->nd_repstat;
 					rp->rc_flag |= RC_REPSTATUS;
@@ -319,14 +417,12 @@ loop:
 					rp->rc_flag |= RC_REPMBUF;
 				}
 			}
-			rp->rc_flag &= ~RC_LOCKED;
-			if (rp->rc_flag & RC_WANTED) {
-				rp->rc_flag &= ~RC_WANTED;
-				wakeup((caddr_t)rp);
-			}
-			return;
+			nfsrv_lruinsert(rb, rp);
+			nfsrv_trimbucket(rb);
+			break;
 		}
 	}
+	nfsrv_unlockbucket(rb);
 }
 
 /*
@@ -335,14 +431,14 @@ loop:
 void
 nfsrv_cleancache()
 {
-	register struct nfsrvcache *rp, *nextrp;
+	register struct nfsrvbucket *rb;
 
-	for (rp = nfsrvlruhead; rp; rp = nextrp) {
-		nextrp = rp->rc_next;
-		free(rp, M_NFSD);
+	for (rb = nfsrvbuckets; rb < &nfsrvbuckets[NFSRVHASHSIZ]; rb++) {
+		nfsrv_lockbucket(rb);
+		while (rb->rb_hash) {
+			nfsrv_lruremove(rb, rb->rb_hash);
+			nfsrv_freeentry(rb->rb_hash);
+		}
+		nfsrv_unlockbucket(rb);
 	}
-	memset((char *)rheadhtbl, 0, (rheadhash + 1) * sizeof(void *));
-	nfsrvlruhead = NULL;
-	nfsrvlrutail = &nfsrvlruhead;
-	numnfsrvcache = 0;
 }
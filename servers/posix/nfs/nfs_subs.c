@@ -56,6 +56,8 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 
+#include <vm/vm.h>
+
 #include <nfs/rpcv2.h>
 #include <nfs/nfsv2.h>
 #include <nfs/nfsnode.h>
@@ -96,6 +98,7 @@ extern u_long nqnfs_prog, nqnfs_vers;
 extern int nqsrv_clockskew;
 extern int nqsrv_writeslack;
 extern int nqsrv_maxlease;
+extern int nqsrv_maxnumlease;
 
 /*
  * Create the header for an rpc request packet
@@ -260,6 +263,51 @@ nfsm_rpchead(cr, nqnfs, procid, auth_type, auth_len, auth_str, mrest,
 	return (mreq);
 }
 
+/*
+ * Bulk file data moves between buffer cache blocks and mbufs through
+ * the VM system where it can.  Runs of at least nfs_loanmin bytes are
+ * lent to an mbuf instead of copied into one (nfsm_loan), and whole
+ * pages that line up on both sides are placed into the block with
+ * vm_copy instead of memcpy.  0 turns both off.
+ */
+int	nfs_loanmin = 8192;
+u_long	nfs_loanbytes;			/* bytes lent to mbufs */
+u_long	nfs_pagecopybytes;		/* bytes placed with vm_copy */
+
+/*
+ * Wrap len bytes at addr in an external mbuf without copying them:
+ * the pages are mapped copy-on-write into a new region with vm_read,
+ * which the mbuf hands back with vm_deallocate when it is freed.
+ * A loan may span several pages; m_copym maps only the pages under
+ * the bytes it copies, so TCP sends and IP fragments taken from the
+ * middle of one are safe.
+ */
+struct mbuf *
+nfsm_loan(addr, len)
+	caddr_t addr;
+	int len;
+{
+	register struct mbuf *m;
+	vm_offset_t pgoff, new_addr;
+	mach_msg_type_number_t count;
+
+	pgoff = (vm_offset_t)addr - trunc_page((vm_offset_t)addr);
+	if (vm_read(mach_task_self(), (vm_offset_t)addr - pgoff,
+	    round_page(len + pgoff), &new_addr, &count) != KERN_SUCCESS)
+		return (0);
+	m = mclgetx((void (*)(char *))mcl_vm_free_routine, (caddr_t)new_addr,
+	    (caddr_t)(new_addr + pgoff), len, M_WAIT);
+	if (m == 0) {
+		(void) vm_deallocate(mach_task_self(), new_addr,
+		    (vm_size_t)count);
+		return (0);
+	}
+	m->m_ext.ext_size = count;
+	m->m_flags &= ~M_PKTHDR;
+	nfs_loanbytes += len;
+	return (m);
+}
+
 /*
  * copies mbuf chain to the uio scatter/gather list
  */
@@ -273,7 +321,7 @@ nfsm_mbuftouio(mrep, uiop, siz, dpos)
 	register int xfer, left, len;
 	register struct mbuf *mp;
 	long uiosiz, rem;
-	int error = 0;
+	int error = 0, n;
 
 	mp = *mrep;
 	mbufcp = *dpos;
@@ -303,9 +351,21 @@ nfsm_mbuftouio(mrep, uiop, siz, dpos)
 				(mbufcp, uiocp, xfer);
 			else
 #endif
-			if (uiop->uio_segflg == UIO_SYSSPACE)
-				memcpy(uiocp, mbufcp, xfer);
-			else
+			if (uiop->uio_segflg == UIO_SYSSPACE) {
+				n = trunc_page(xfer);
+				if (nfs_loanmin > 0 && n >= nfs_loanmin &&
+				    trunc_page((vm_offset_t)mbufcp) ==
+				    (vm_offset_t)mbufcp &&
+				    trunc_page((vm_offset_t)uiocp) ==
+				    (vm_offset_t)uiocp &&
+				    vm_copy(mach_task_self(),
+				    (vm_offset_t)mbufcp, (vm_size_t)n,
+				    (vm_offset_t)uiocp) == KERN_SUCCESS) {
+					xfer = n;
+					nfs_pagecopybytes += n;
+				} else
+					memcpy(uiocp, mbufcp, xfer);
+			} else
 				copyout(mbufcp, uiocp, xfer);
 			left -= xfer;
 			len -= xfer;
@@ -345,6 +405,7 @@ nfsm_uiotombuf(uiop, mq, siz, bpos)
 {
 	register char *uiocp;
 	register struct mbuf *mp, *mp2;
+	struct mbuf *mp3;
 	register int xfer, left, mlen;
 	int uiosiz, clflg, rem;
 	char *cp;
@@ -364,6 +425,19 @@ nfsm_uiotombuf(uiop, mq, siz, bpos)
 			left = siz;
 		uiosiz = left;
 		while (left > 0) {
+			/*
+			 * Lend whole pages of a buffer cache block.
+			 */
+			if (uiop->uio_segflg == UIO_SYSSPACE &&
+			    nfs_loanmin > 0 && left >= nfs_loanmin &&
+			    trunc_page((vm_offset_t)uiocp) ==
+			    (vm_offset_t)uiocp &&
+			    (mp3 = nfsm_loan(uiocp, (int)trunc_page(left)))) {
+				mp2->m_next = mp3;
+				mp = mp2 = mp3;
+				xfer = mp->m_len;
+				goto next;
+			}
 			mlen = M_TRAILINGSPACE(mp);
 			if (mlen == 0) {
 				MGET(mp, M_WAIT, MT_DATA);
@@ -387,6 +461,7 @@ nfsm_uiotombuf(uiop, mq, siz, bpos)
 			else
 				copyin(uiocp, mtod(mp, caddr_t)+mp->m_len, xfer);
 			mp->m_len += xfer;
+next:
 			left -= xfer;
 			uiocp += xfer;
 			uiop->uio_offset += xfer;
@@ -617,9 +692,11 @@ nfs_init()
 		NQLOADNOVRAM(nqnfsstarttime);
 		nqnfs_prog = txdr_unsigned(NQNFS_PROG);
 		nqnfs_vers = txdr_unsigned(NQNFS_VER1);
-		nqthead.th_head[0] = &nqthead;
-		nqthead.th_head[1] = &nqthead;
-		nqfhead = hashinit(NQLCHSZ, M_NQLEASE, &nqfheadhash);
+		for (i = 0; i < NQ_WHEELSIZ; i++)
+			nqwheel[i].th_head[0] = nqwheel[i].th_head[1] =
+			    &nqwheel[i];
+		nqfhead = hashinit(max(NQLCHSZ, nqsrv_maxnumlease),
+		    M_NQLEASE, &nqfheadhash);
 	}
 
 	/*
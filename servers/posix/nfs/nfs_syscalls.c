@@ -84,13 +84,22 @@ extern int nfsrtton;
 struct nfssvc_sock *nfs_udpsock, *nfs_cltpsock;
 int nuidhash_max = NFS_MAXUIDHASH;
 static int nfs_numnfsd = 0;
+/*
+ * An nfsd serves at most nfsrv_quantum requests in a row from one
+ * socket while other sockets are waiting, and hands on to another
+ * datagram client after as many from one host.  A connection gets at
+ * most half of the nfsds, so one busy client cannot take them all.
+ */
+int nfsrv_quantum = 4;
+int nfsrv_maxinflight = 1;
 int nfsd_waiting = 0;
 static int notstarted = 1;
 static int modify_flag = 0;
 static struct nfsdrt nfsdrt;
 void nfsrv_cleancache(), nfsrv_rcv(), nfsrv_wakenfsd(), nfs_sndunlock();
 static void nfsd_rt();
-void nfsrv_slpderef(), nfsrv_init();
+void nfsrv_slpderef(), nfsrv_init(), nqsrv_flushevict();
+static void nfsrv_slprelease();
 
 static int nfs_asyncdaemon[NFS_MAXASYNCDAEMON];
 /*
@@ -158,12 +167,40 @@ nfssvc(p, uap, retval)
 	struct nfsd_args nfsdarg;
 	struct nfsd_srvargs nfsd_srvargs, *nsd = &nfsd_srvargs;
 	struct nfsd_cargs ncd;
+	struct nfs_mntstat nms;
 	struct nfsd *nfsd;
 	struct nfssvc_sock *slp;
 	struct nfsuid *nuidp, **nuh;
 	struct nfsmount *nmp;
 	int error;
 
+	/*
+	 * Anyone may read the statistics of a mount.
+	 */
+	if (uap->flag & NFSSVC_MNTSTAT) {
+		if (error = copyin(uap->argp, (caddr_t)&nms, sizeof (nms)))
+			return (error);
+		NDINIT(&nd, LOOKUP, FOLLOW | LOCKLEAF, UIO_USERSPACE,
+			nms.nms_dirp, p);
+		if (error = namei(&nd))
+			return (error);
+		if ((nd.ni_vp->v_flag & VROOT) == 0 ||
+		    nd.ni_vp->v_mount->mnt_stat.f_type != MOUNT_NFS) {
+			vput(nd.ni_vp);
+			return (EINVAL);
+		}
+		nmp = VFSTONFS(nd.ni_vp->v_mount);
+		nms.nms_rpcs = nmp->nm_rpcs;
+		nms.nms_rttsum = nmp->nm_rttsum;
+		nms.nms_rttcnt = nmp->nm_rttcnt;
+		nms.nms_rbytes = nmp->nm_rbytes;
+		nms.nms_wbytes = nmp->nm_wbytes;
+		nms.nms_asyncwin = nmp->nm_asyncwin;
+		nms.nms_bufqlen = nmp->nm_bufqlen;
+		nms.nms_readahead = nmp->nm_readahead;
+		vput(nd.ni_vp);
+		return (copyout((caddr_t)&nms, uap->argp, sizeof (nms)));
+	}
 	/*
 	 * Must be super user
 	 */
@@ -383,7 +420,7 @@ nfssvc_nfsd(nsd, argp, p)
 	struct timeval starttime;
 	struct nfsuid *uidp;
 	int error, cacherep, s;
-	int sotype;
+	int sotype, nreq = 0;
 	struct timeval time;
 
 	s = splnet();
@@ -396,6 +433,7 @@ nfssvc_nfsd(nsd, argp, p)
 		insque(nd, &nfsd_head);
 		nd->nd_nqlflag = NQL_NOVAL;
 		nfs_numnfsd++;
+		nfsrv_maxinflight = max(1, nfs_numnfsd / 2);
 	}
 	/*
 	 * Loop getting rpc requests until SIGKILL.
@@ -416,9 +454,11 @@ nfssvc_nfsd(nsd, argp, p)
 				slp = nfssvc_sockhead.ns_next;
 				while (slp != &nfssvc_sockhead) {
 				    if ((slp->ns_flag & (SLP_VALID | SLP_DOREC))
-					== (SLP_VALID | SLP_DOREC)) {
+					== (SLP_VALID | SLP_DOREC) &&
+					!NFSRV_SLPFULL(slp)) {
 					    slp->ns_flag &= ~SLP_DOREC;
 					    slp->ns_sref++;
+					    slp->ns_inflight++;
 					    nd->nd_slp = slp;
 					    break;
 				    }
@@ -438,19 +478,20 @@ nfssvc_nfsd(nsd, argp, p)
 						(struct nfsreq *)0);
 					nfsrv_rcv(slp->ns_so, (caddr_t)slp,
 						M_WAIT);
+					if (slp->ns_evict)
+						nqsrv_flushevict(slp);
 					nfs_sndunlock(&slp->ns_solock);
 				}
 				error = nfsrv_dorec(slp, nd);
 				nd->nd_flag |= NFSD_REQINPROG;
+				nreq = 0;
 			}
 		} else {
 			error = 0;
 			slp = nd->nd_slp;
 		}
 		if (error || (slp->ns_flag & SLP_VALID) == 0) {
-			nd->nd_slp = (struct nfssvc_sock *)0;
-			nd->nd_flag &= ~NFSD_REQINPROG;
-			nfsrv_slpderef(slp);
+			nfsrv_slprelease(nd, slp);
 			continue;
 		}
 		splx(s);
@@ -521,9 +562,16 @@ nfssvc_nfsd(nsd, argp, p)
 				notstarted = 0;
 		}
 		if (notstarted) {
-			if (nd->nd_nqlflag == NQL_NOVAL)
+			if (nd->nd_nqlflag == NQL_NOVAL) {
+				/*
+				 * In progress entries are never evicted, so
+				 * give back the one just made.
+				 */
+				if (cacherep == RC_DOIT && nam2)
+					nfsrv_updatecache(nam2, nd, FALSE,
+					    (struct mbuf *)0);
 				cacherep = RC_DROPIT;
-			else if (nd->nd_procnum != NFSPROC_WRITE) {
+			} else if (nd->nd_procnum != NFSPROC_WRITE) {
 				nd->nd_procnum = NFSPROC_NOOP;
 				nd->nd_repstat = NQNFS_TRYLATER;
 				cacherep = RC_DOIT;
@@ -531,6 +579,13 @@ nfssvc_nfsd(nsd, argp, p)
 				modify_flag = 1;
 		} else if (nd->nd_flag & NFSD_AUTHFAIL) {
 			nd->nd_flag &= ~NFSD_AUTHFAIL;
+			/*
+			 * The entry made for the request is under its own
+			 * procedure, which the noop reply will not find.
+			 */
+			if (cacherep == RC_DOIT && nam2)
+				nfsrv_updatecache(nam2, nd, FALSE,
+				    (struct mbuf *)0);
 			nd->nd_procnum = NFSPROC_NOOP;
 			nd->nd_repstat = NQNFS_AUTHERR;
 			cacherep = RC_DOIT;
@@ -596,11 +651,14 @@ nfssvc_nfsd(nsd, argp, p)
 				m_freem(nd->nd_mrep);
 			if (error == EPIPE)
 				nfsrv_zapsock(slp);
-			if (solockp)
+			if (solockp) {
+				if (slp->ns_evict)
+					nqsrv_flushevict(slp);
 				nfs_sndunlock(solockp);
+			}
 			if (error == EINTR || error == ERESTART) {
-				nfsrv_slpderef(slp);
 				s = splnet();
+				nfsrv_slprelease(nd, slp);
 				goto done;
 			}
 			break;
@@ -612,11 +670,14 @@ nfssvc_nfsd(nsd, argp, p)
 			break;
 		};
 		s = splnet();
-		if (nfsrv_dorec(slp, nd)) {
-			nd->nd_flag &= ~NFSD_REQINPROG;
-			nd->nd_slp = (struct nfssvc_sock *)0;
-			nfsrv_slpderef(slp);
-		}
+		/*
+		 * Give way to other sockets with work waiting once this
+		 * one has had its quantum.
+		 */
+		if ((++nreq >= nfsrv_quantum &&
+		    (nfsd_head.nd_flag & NFSD_CHECKSLP)) ||
+		    nfsrv_dorec(slp, nd))
+			nfsrv_slprelease(nd, slp);
 	}
 done:
 	remque(nd);
@@ -625,9 +686,39 @@ done:
 	nsd->nsd_nfsd = (struct nfsd *)0;
 	if (--nfs_numnfsd == 0)
 		nfsrv_init(TRUE);	/* Reinitialize everything */
+	else
+		nfsrv_maxinflight = max(1, nfs_numnfsd / 2);
 	return (error);
 }
 
+/*
+ * An nfsd lets go of the socket it has been serving.  If the socket
+ * still has work, it goes to the back of the list for the next nfsd
+ * looking for some.
+ */
+static void
+nfsrv_slprelease(nd, slp)
+	register struct nfsd *nd;
+	register struct nfssvc_sock *slp;
+{
+
+	nd->nd_flag &= ~NFSD_REQINPROG;
+	nd->nd_slp = (struct nfssvc_sock *)0;
+	slp->ns_inflight--;
+	if ((slp->ns_flag & SLP_VALID) &&
+	    (slp->ns_rec || (slp->ns_flag & SLP_NEEDQ))) {
+		slp->ns_prev->ns_next = slp->ns_next;
+		slp->ns_next->ns_prev = slp->ns_prev;
+		slp->ns_prev = nfssvc_sockhead.ns_prev;
+		slp->ns_prev->ns_next = slp;
+		slp->ns_next = &nfssvc_sockhead;
+		nfssvc_sockhead.ns_prev = slp;
+		slp->ns_flag |= SLP_DOREC;
+		nfsd_head.nd_flag |= NFSD_CHECKSLP;
+	}
+	nfsrv_slpderef(slp);
+}
+
 /*
  * Asynchronous I/O daemons for client nfs.
  * They do read-ahead and write-behind operations on the block I/O cache.
@@ -665,6 +756,7 @@ nfssvc_iod(p)
 		while ((bp = nfs_bufq.tqh_first) != NULL) {
 			/* Take one off the front of the list */
 			TAILQ_REMOVE(&nfs_bufq, bp, b_freelist);
+			VFSTONFS(bp->b_vp->v_mount)->nm_bufqlen--;
 			if (bp->b_flags & B_READ)
 			    (void) nfs_doio(bp, bp->b_rcred, (struct proc *)0);
 			else
@@ -705,6 +797,8 @@ nfsrv_zapsock(slp)
 			MFREE(slp->ns_nam, m);
 		m_freem(slp->ns_raw);
 		m_freem(slp->ns_rec);
+		m_freem(slp->ns_evict);
+		slp->ns_evict = (struct mbuf *)0;
 		nuidp = slp->ns_lrunext;
 		while (nuidp != (struct nfsuid *)slp) {
 			onuidp = nuidp;
@@ -91,6 +91,7 @@ struct nfs_diskless nfs_diskless = { 0 };
 
 extern u_long nfs_procids[NFS_NPROCS];
 extern u_long nfs_prog, nfs_vers;
+extern int nfs_asyncwin;
 void nfs_disconnect (struct nfsmount *);
 void nfsargs_ntoh (struct nfs_args *);
 static struct mount *nfs_mountdiskless (char *, char *, int,
@@ -431,6 +432,7 @@ mountnfs(argp, mp, nam, pth, hst, vpp)
 	nmp->nm_rsize = NFS_RSIZE;
 	nmp->nm_numgrps = NFS_MAXGRPS;
 	nmp->nm_readahead = NFS_DEFRAHEAD;
+	nmp->nm_asyncwin = nfs_asyncwin;
 	nmp->nm_leaseterm = NQ_DEFLEASE;
 	nmp->nm_deadthresh = NQ_DEADTHRESH;
 	nmp->nm_tnext = (struct nfsnode *)nmp;
@@ -46,6 +46,7 @@
  * First define what the actual subs. return
  */
 extern struct mbuf *nfsm_reqh();
+extern struct mbuf *nfsm_loan();
 
 #define	M_HASCL(m)	((m)->m_flags & M_EXT)
 #define	NFSMINOFF(m) \
@@ -61,7 +61,9 @@ struct	nfsmount {
 	int	nm_deadthresh;		/* Threshold of timeouts-->dead server*/
 	int	nm_rsize;		/* Max size of read rpc */
 	int	nm_wsize;		/* Max size of write rpc */
-	int	nm_readahead;		/* Num. of blocks to readahead */
+	int	nm_readahead;		/* Max. blocks to readahead */
+	int	nm_asyncwin;		/* Max. async bufs outstanding */
+	int	nm_bufqlen;		/* Async bufs queued for nfsiods */
 	int	nm_leaseterm;		/* Term (sec) for NQNFS lease */
 	struct nfsnode *nm_tnext;	/* Head of lease timer queue */
 	struct nfsnode *nm_tprev;
@@ -70,6 +72,11 @@ struct	nfsmount {
 	int	nm_authtype;		/* Authenticator type */
 	int	nm_authlen;		/* and length */
 	char	*nm_authstr;		/* Authenticator string */
+	u_long	nm_rpcs;		/* Replies received */
+	u_long	nm_rttsum;		/* Sum of timed rtts, NFS_HZ ticks */
+	u_long	nm_rttcnt;		/* Replies timed in nm_rttsum */
+	u_quad_t nm_rbytes;		/* Bytes read through the cache */
+	u_quad_t nm_wbytes;		/* Bytes written through the cache */
 };
 
 #ifdef KERNEL
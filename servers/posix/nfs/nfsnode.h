@@ -74,7 +74,7 @@ struct nfsnode {
 	time_t	n_expiry;		 /* Lease expiry time */
 	struct	nfsnode *n_tnext;	 /* Nqnfs timer chain */
 	struct	nfsnode *n_tprev;		
-	long	spare1;			/* To 8 byte boundary */
+	long	n_rahead;		/* Current read ahead depth */
 	struct	sillyrename n_silly;	/* Silly rename struct */
 	struct	timeval n_atim;		/* Special file times */
 	struct	timeval n_mtim;
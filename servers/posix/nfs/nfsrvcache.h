@@ -40,7 +40,12 @@
  * Definitions for the server recent request cache
  */
 
-#define	NFSRVCACHESIZ	256
+#define	NFSRVCACHESIZ	256		/* Initial target size */
+#define	NFSRVCACHEMIN	256		/* Never below the old fixed size */
+#define	NFSRVCACHEMAX	4096
+#define	NFSRVCACHESECS	60		/* Retry window to cover */
+#define	NFSRVCACHEPERIOD 10		/* Request rate sample period */
+#define	NFSRVHASHSIZ	64		/* Hash buckets, power of 2 */
 
 struct nfsrvcache {
 	struct	nfsrvcache *rc_forw;		/* Hash chain links */
@@ -58,6 +63,22 @@ struct nfsrvcache {
 	u_char	rc_flag;		/* Flag bits */
 };
 
+/*
+ * A hash bucket.  Each is locked on its own and keeps its own lru
+ * list, oldest first.  Requests in progress are hashed but not on the
+ * lru, so they are never evicted; there is at most one per nfsd.
+ * Idempotent requests are cached only while they are in progress, to
+ * drop retransmissions; completed non-idempotent requests go on the
+ * lru and stay until evicted, to answer them.
+ */
+struct nfsrvbucket {
+	struct	nfsrvcache *rb_hash;		/* Hash chain */
+	struct	nfsrvcache *rb_lru;		/* Lru list */
+	struct	nfsrvcache **rb_lrutail;
+	int	rb_count;			/* Entries on lru list */
+	int	rb_flag;			/* RC_LOCKED, RC_WANTED */
+};
+
 #define	rc_reply	rc_un.ru_repmb
 #define	rc_status	rc_un.ru_repstat
 #define	rc_inetaddr	rc_haddr.had_inetaddr
@@ -54,7 +54,8 @@
 #define	NQ_MAXNUMLEASE	2048	/* Upper bound on number of server leases */
 #define	NQ_DEADTHRESH	NQ_NEVERDEAD	/* Default nm_deadthresh */
 #define	NQ_NEVERDEAD	9	/* Greater than max. nm_timeouts */
-#define	NQLCHSZ		256	/* Server hash table size */
+#define	NQLCHSZ		256	/* Min. server hash table size */
+#define	NQ_WHEELSIZ	128	/* Timer wheel slots, > max lease (sec) */
 
 #define	NQNFS_PROG	300105	/* As assigned by Sun */
 #define	NQNFS_VER1	1
@@ -74,9 +75,9 @@
  * The first one lives in nqlease and any others are held in a linked
  * list of nqm structures hanging off of nqlease.
  *
- * Each nqlease structure is chained into two lists. The first is a list
- * ordered by increasing expiry time for nqsrv_timer() and the second is a chain
- * hashed on lc_fh.
+ * Each nqlease structure is chained into two lists. The first is the slot
+ * of the timer wheel for its expiry second, scanned by nqnfs_serverd(), and
+ * the second is a chain hashed on lc_fh.
  */
 #define	LC_MOREHOSTSIZ	10
 
@@ -108,7 +109,7 @@ struct nqhost {
 #define	lph_slp		lph_un.un_conn.conn_slp
 
 struct nqlease {
-	struct nqlease *lc_chain1[2];	/* Timer queue list (must be first) */
+	struct nqlease *lc_chain1[2];	/* Timer wheel slot (must be first) */
 	struct nqlease *lc_fhnext;	/* Fhandle hash list */
 	struct nqlease **lc_fhprev;
 	time_t		lc_expiry;	/* Expiry time (sec) */
@@ -184,12 +185,16 @@ struct nqm {
 		    NQL_WRITE : nqnfs_piggy[p]) : 0))
 
 /*
- * List head for timer queue.
+ * List heads for the timer wheel. A lease expiring at second t lives in
+ * slot t modulo NQ_WHEELSIZ, so leases are queued in constant time and
+ * each tick of nqnfs_serverd() only looks at the slots that have come due.
  */
 extern union nqsrvthead {
 	union	nqsrvthead *th_head[2];
 	struct	nqlease *th_chain[2];
-} nqthead;
+} nqwheel[NQ_WHEELSIZ];
+#define	NQWHEELSLOT(t)	(&nqwheel[(t) & (NQ_WHEELSIZ - 1)])
+
 extern struct nqlease **nqfhead;
 extern u_long nqfheadhash;
 
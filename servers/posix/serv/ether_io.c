@@ -61,6 +61,8 @@
 #include <netinet/in_systm.h>
 #include <netinet/in_var.h>
 #include <netinet/ip.h>
+#include <netinet/ip_var.h>
+#include <netinet/tcp.h>
 #include <netinet/if_ether.h>
 
 #if NS
@@ -116,6 +118,131 @@ void xxx(s,p,i)
 /* XXX Fixed in MK83A */
 /*#define ETHER_SYNCH_OUTPUT 1*/
 
+/*
+ * Hand one contiguous frame to the device.
+ */
+static void
+ether_write(es, data_addr, totlen)
+	register struct ether_softc *es;
+	char *data_addr;
+	unsigned int totlen;
+{
+#if ETHER_SYNCH_OUTPUT
+	int written;
+#endif /* ETHER_SYNCH_OUTPUT */
+
+xxx("ether_start:", data_addr, totlen);
+#if ETHER_SYNCH_OUTPUT
+	(void) device_write(es->es_port,
+			    0,	/* mode */
+			    0,	/* recnum */
+			    data_addr,
+			    totlen,
+			    &written);
+#else /* ETHER_SYNCH_OUTPUT */
+	(void) device_write_request(es->es_port, MACH_PORT_NULL,
+				    0,	/* mode */
+				    0,	/* recnum */
+				    data_addr,
+				    totlen);
+#endif /* ETHER_SYNCH_OUTPUT */
+}
+
+/*
+ * Large send: cut a TCP super-segment from tcp_output into frames
+ * that fit the MTU.  The link, IP and TCP headers are copied once
+ * into the frame buffer and serve as the template for every frame;
+ * only the lengths, IP id, sequence number, FIN/PUSH and the two
+ * checksums are redone per frame.
+ */
+static void
+ether_largesend(es, m, totlen)
+	register struct ether_softc *es;
+	struct mbuf *m;
+	unsigned int totlen;
+{
+	char packet[ETHERMTU+sizeof(struct ether_header)];
+	register struct ip *ip;
+	register struct tcphdr *th;
+	struct ip iptmpl;
+	struct {
+		struct	in_addr ph_src, ph_dst;
+		u_char	ph_x1, ph_pr;
+		u_short	ph_len;
+	} ph;
+	struct mbuf m0, m1;
+	unsigned int hlen, thlen, off, len, seglen;
+	tcp_seq seq;
+	int flags;
+
+	hlen = sizeof (struct ether_header) + sizeof (struct ip) +
+	    sizeof (struct tcphdr);
+	if (totlen < hlen)
+		goto bad;
+	m_copydata(m, 0, hlen, packet);
+	ip = (struct ip *)(packet + sizeof (struct ether_header));
+	th = (struct tcphdr *)(ip + 1);
+	if (((struct ether_header *)packet)->ether_type !=
+	    htons(ETHERTYPE_IP) || ip->ip_p != IPPROTO_TCP ||
+	    (ip->ip_hl << 2) != sizeof (struct ip))
+		goto bad;
+	thlen = th->th_off << 2;
+	hlen += thlen - sizeof (struct tcphdr);
+	if (thlen < sizeof (struct tcphdr) || es->es_if.if_mtu > ETHERMTU ||
+	    es->es_if.if_mtu <= sizeof (struct ip) + thlen)
+		goto bad;
+	m_copydata(m, 0, hlen, packet);
+	seglen = es->es_if.if_mtu - sizeof (struct ip) - thlen;
+
+	iptmpl = *ip;
+	seq = ntohl(th->th_seq);
+	flags = th->th_flags;
+	ph.ph_src = ip->ip_src;
+	ph.ph_dst = ip->ip_dst;
+	ph.ph_x1 = 0;
+	ph.ph_pr = IPPROTO_TCP;
+
+	/*
+	 * in_cksum walks mbuf chains; borrow two on the stack to
+	 * checksum the pseudo header followed by the frame.
+	 */
+	m0.m_next = &m1;
+	m0.m_data = (caddr_t)&ph;
+	m0.m_len = sizeof (ph);
+	m1.m_next = 0;
+	m1.m_data = (caddr_t)th;
+
+	for (off = hlen; off < totlen; off += len) {
+		len = min(seglen, totlen - off);
+		m_copydata(m, off, len, packet + hlen);
+
+		th->th_seq = htonl(seq);
+		th->th_flags = flags;
+		if (off + len < totlen)
+			th->th_flags &= ~(TH_FIN|TH_PUSH);
+		ph.ph_len = htons((u_short)(thlen + len));
+		m1.m_len = thlen + len;
+		th->th_sum = 0;
+		th->th_sum = in_cksum(&m0, sizeof (ph) + thlen + len);
+
+		*ip = iptmpl;
+		ip->ip_len = htons((u_short)(sizeof (struct ip) + thlen + len));
+		if (off != hlen)
+			ip->ip_id = htons(ip_id++);
+		ip->ip_sum = 0;
+		m1.m_data = (caddr_t)ip;
+		m1.m_len = sizeof (struct ip);
+		ip->ip_sum = in_cksum(&m1, sizeof (struct ip));
+		m1.m_data = (caddr_t)th;
+
+		ether_write(es, packet, hlen + len);
+		seq += len;
+	}
+	return;
+bad:
+	es->es_if.if_oerrors++;
+}
+
 /*
  * Ethernet trigger routine.
  */
@@ -124,9 +251,6 @@ int ether_start(ifp)
 {
 	register struct ether_softc *es = (struct ether_softc *)ifp;
 	register struct mbuf *m;
-#if ETHER_SYNCH_OUTPUT
-	int written;
-#endif /* ETHER_SYNCH_OUTPUT */
 
 	IF_DEQUEUE(&ifp->if_snd, m);
 	if (m == 0)
@@ -137,7 +261,6 @@ int ether_start(ifp)
 	 */
 	{
 	    unsigned int  totlen;
-	    char *data_addr;
 	    register struct mbuf *m1;
 
 	    totlen = 0;
@@ -146,26 +269,17 @@ int ether_start(ifp)
 		 m1 = m1->m_next)
 		totlen += m1->m_len;
 
-	    if (m->m_next == 0) {
+	    if (totlen > ifp->if_mtu + sizeof(struct ether_header)) {
+		/*
+		 * Large-send super-segment from tcp_output.
+		 */
+		ether_largesend(es, m, totlen);
+	    }
+	    else if (m->m_next == 0) {
 		/*
 		 * All data in one chunk
 		 */
-		data_addr = mtod(m, char *);
-xxx("ether_start:", data_addr, totlen);
-#if ETHER_SYNCH_OUTPUT
-		(void) device_write(es->es_port,
-				    0,	/* mode */
-				    0,	/* recnum */
-				    data_addr,
-				    totlen,
-				    &written);
-#else /* ETHER_SYNCH_OUTPUT */
-		(void) device_write_request(es->es_port, MACH_PORT_NULL,
-					    0,	/* mode */
-					    0,	/* recnum */
-					    data_addr,
-					    totlen);
-#endif /* ETHER_SYNCH_OUTPUT */
+		ether_write(es, mtod(m, char *), totlen);
 	    }
 	    else {
 		/*
@@ -175,20 +289,7 @@ xxx("ether_start:", data_addr, totlen);
 		char packet[ETHERMTU+sizeof(struct ether_header)];
 if(debug_netcode) printf("ether_start: copy\n");
 		(void) m_copydata(m, 0, totlen, packet);
-#if ETHER_SYNCH_OUTPUT
-		(void) device_write(es->es_port,
-				    0,	/* mode */
-				    0,	/* recnum */
-				    packet,
-				    totlen,
-				    &written);
-#else /* ETHER_SYNCH_OUTPUT */
-		(void) device_write_request(es->es_port, MACH_PORT_NULL,
-					    0,	/* mode */
-					    0,	/* recnum */
-					    packet,
-					    totlen);
-#endif /* ETHER_SYNCH_OUTPUT */
+		ether_write(es, packet, totlen);
 	    }
 	}
 	m_freem(m);	/* sent */
@@ -601,6 +702,7 @@ iface_find(char *name)
 	ifp->if_output =	ether_output;
 	ifp->if_start =		ether_start;
 	ifp->if_ioctl =		ether_ioctl;
+	ifp->if_lsmax =		IP_MAXPACKET;
 
 	memcpy(es->es_addr, if_addr, sizeof(es->es_addr));
 
@@ -56,11 +56,13 @@
 
 #include <ufs/ufs/quota.h>
 #include <ufs/ufs/inode.h>
+#include <ufs/ufs/ufsmount.h>
 
 #include <ufs/ext2fs/ext2_fs.h>
 #include <ufs/ext2fs/ext2_fs_sb.h>
 #include <ufs/ext2fs/fs.h>
 #include <ufs/ext2fs/ext2_extern.h>
+#include <ufs/ext2fs/ext2_journal.h>
 
 extern u_long nextgennumber;
 
@@ -109,7 +111,7 @@ ext2_alloc(ip, lbn, bpref, size, cred, bnp)
 {
 	register struct ext2_sb_info *fs;
 	daddr_t bno;
-	int cg, error;
+	int cg, error, retried = 0;
 	
 	*bnp = 0;
 	fs = ip->i_e2fs;
@@ -131,6 +133,7 @@ ext2_alloc(ip, lbn, bpref, size, cred, bnp)
 	if (error = chkdq(ip, (long)btodb(size), cred, 0))
 		return (error);
 #endif
+retry:
 	if (bpref >= fs->s_es->s_blocks_count)
 		bpref = 0;
 	/* call the Linux code */
@@ -178,6 +181,15 @@ ext2_alloc(ip, lbn, bpref, size, cred, bnp)
 		*bnp = bno;
 		return (0);
 	}
+	/*
+	 * Blocks freed since the last commit are not handed out until it
+	 * is made; make it and look again before giving up.
+	 */
+	if (!retried && EXT2_JOURNALING(ITOV(ip)->v_mount) &&
+	    ext2_journal_commit(ITOV(ip)->v_mount) == 0) {
+		retried = 1;
+		goto retry;
+	}
 #if QUOTA
 	/*
 	 * Restore user's disk quota because allocation failed.
@@ -54,6 +54,8 @@ struct vnode;
 struct mbuf;
 struct dinode;
 struct ext2_group_desc;
+struct ext2_journal;
+struct ext2_super_block;
 
 __BEGIN_DECLS
 int	ext2_alloc (struct inode *,
@@ -102,6 +104,20 @@ struct  ext2_group_desc * get_group_desc (struct mount * ,
 void	ext2_discard_prealloc (struct inode *);
 int	ext2_inactive (struct vop_inactive_args *);
 int 	ll_w_block (struct buf *, int );
+void	mark_buffer_dirty (struct mount *, struct buf *);
+void	ext2_journal_bfree (struct mount *, u_long, caddr_t);
+int	ext2_journal_bwrite (struct buf *);
+caddr_t	ext2_journal_cbitmap (struct mount *, u_long);
+int	ext2_journal_check (struct mount *);
+int	ext2_journal_checkpoint (struct mount *, int);
+void	ext2_journal_close (struct ext2_journal *);
+int	ext2_journal_commit (struct mount *);
+void	ext2_journal_dirty (struct mount *, struct buf *);
+int	ext2_journal_open (struct vnode *, struct ext2_super_block *, int,
+	    struct ext2_journal **);
+void	ext2_journal_revoke (struct mount *, u_long, u_long);
+int	ext2_journal_start (struct ext2_journal *);
+int	ext2_journal_stop (struct ext2_journal *);
 
 int	bwrite();		/* FFS needs a bwrite routine.  XXX */
 
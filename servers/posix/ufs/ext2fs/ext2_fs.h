@@ -301,14 +301,50 @@ struct ext2_super_block {
 	__u32	s_rev_level;		/* Revision level */
 	__u16	s_def_resuid;		/* Default uid for reserved blocks */
 	__u16	s_def_resgid;		/* Default gid for reserved blocks */
-	__u32	s_reserved[235];	/* Padding to the end of the block */
+	/*
+	 * These fields are for EXT2_DYNAMIC_REV super blocks only.
+	 */
+	__u32	s_first_ino;		/* First non-reserved inode */
+	__u16	s_inode_size;		/* size of inode structure */
+	__u16	s_block_group_nr;	/* block group # of this superblock */
+	__u32	s_feature_compat;	/* compatible feature set */
+	__u32	s_feature_incompat;	/* incompatible feature set */
+	__u32	s_feature_ro_compat;	/* readonly-compatible feature set */
+	__u8	s_uuid[16];		/* 128-bit uuid for volume */
+	char	s_volume_name[16];	/* volume name */
+	char	s_last_mounted[64];	/* directory where last mounted */
+	__u32	s_algorithm_usage_bitmap; /* For compression */
+	__u8	s_prealloc_blocks;	/* Nr of blocks to try to preallocate*/
+	__u8	s_prealloc_dir_blocks;	/* Nr to preallocate for dirs */
+	__u16	s_padding1;
+	__u8	s_journal_uuid[16];	/* uuid of journal superblock */
+	__u32	s_journal_inum;		/* inode number of journal file */
+	__u32	s_journal_dev;		/* device number of journal file */
+	__u32	s_last_orphan;		/* start of list of inodes to delete */
+	__u32	s_reserved[197];	/* Padding to the end of the block */
 };
 
 #define EXT2_OS_LINUX		0
 #define EXT2_OS_HURD		1
 #define EXT2_OS_MASIX		2
 
-#define EXT2_CURRENT_REV	0
+#define EXT2_GOOD_OLD_REV	0	/* The good old (original) format */
+#define EXT2_DYNAMIC_REV	1	/* V2 format w/ dynamic inode sizes */
+
+#define EXT2_CURRENT_REV	EXT2_GOOD_OLD_REV
+
+/*
+ * Feature set definitions
+ */
+#define EXT2_HAS_COMPAT_FEATURE(es,mask)			\
+	((es)->s_rev_level >= EXT2_DYNAMIC_REV &&		\
+	 ((es)->s_feature_compat & (mask)))
+#define EXT2_HAS_INCOMPAT_FEATURE(es,mask)			\
+	((es)->s_rev_level >= EXT2_DYNAMIC_REV &&		\
+	 ((es)->s_feature_incompat & (mask)))
+
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL		0x0004
+#define EXT2_FEATURE_INCOMPAT_RECOVER		0x0004
 
 #define	EXT2_DEF_RESUID		0
 #define	EXT2_DEF_RESGID		0
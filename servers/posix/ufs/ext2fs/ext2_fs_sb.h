@@ -30,6 +30,20 @@
 
 #define EXT2_MAX_GROUP_LOADED	8
 
+#ifdef LITES
+/*
+ * In-core summary of a blocks group, kept so that the bitmaps need not
+ * be scanned from their start: no block (inode) below gs_bfirst
+ * (gs_ifirst) is free, and no run of free blocks is longer than
+ * gs_bmaxrun.  Both are only hints and are rebuilt at each mount.
+ */
+struct ext2_gsum {
+	unsigned int gs_bfirst;		/* first possibly free block */
+	unsigned int gs_ifirst;		/* first possibly free inode */
+	unsigned int gs_bmaxrun;	/* bound on the longest free run */
+};
+#endif
+
 #ifdef LITES
 #define buffer_head buf
 #define MAXMNTLEN	512
@@ -79,6 +93,7 @@ struct ext2_sb_info {
 	unsigned int  s_fsbtodb;		/* shift to get disk block */
 	char    s_rd_only;                      /* read-only 		*/
 	char    s_dirt;                         /* fs modified flag */
+	struct ext2_gsum * s_gsum;		/* per group summaries */
 
 	char    fs_fsmnt[MAXMNTLEN];            /* name mounted on */
 #endif
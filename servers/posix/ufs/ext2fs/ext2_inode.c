@@ -65,6 +65,7 @@
 #include <ufs/ext2fs/ext2_fs_sb.h>
 #include <ufs/ext2fs/fs.h>
 #include <ufs/ext2fs/ext2_extern.h>
+#include <ufs/ext2fs/ext2_journal.h>
 
 static int ext2_indirtrunc (struct inode *, daddr_t, daddr_t, daddr_t, int,
 	    long *);
@@ -128,6 +129,15 @@ ext2_update(ap)
 	}
 	ext2_di2ei( &ip->i_din, (char *)bp->b_data + EXT2_INODE_SIZE *
 	    ino_to_fsbo(fs, ip->i_number));
+	/*
+	 * With a journal the inode block is logged instead; its commit
+	 * keeps the order callers asking to wait rely on.
+	 */
+	if (EXT2_JOURNALING(ITOV(ip)->v_mount)) {
+		ext2_journal_dirty(ITOV(ip)->v_mount, bp);
+		bdwrite(bp);
+		return (ext2_journal_check(ITOV(ip)->v_mount));
+	}
 	if (ap->a_waitfor)
 		return (bwrite(bp));
 	else {
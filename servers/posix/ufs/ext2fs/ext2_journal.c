@@ -0,0 +1,1342 @@
+/*
+ *	File:	ufs/ext2fs/ext2_journal.c
+ *
+ *	Write-ahead journal of ext2 metadata, in the on-disk format of
+ *	the ext3 journaling layer (JBD).
+ *
+ *	Without a journal, bitmaps, group descriptors, inodes and
+ *	directory blocks are written in place, many of them at once, and
+ *	a crash leaves the file system to fsck.  When the super block
+ *	has COMPAT_HAS_JOURNAL and an internal journal file, a change to
+ *	one of those blocks is instead noted by ext2_journal_dirty, and
+ *	the buffer is kept from being written home with B_LOCKED.  A
+ *	commit copies every block changed since the previous one into
+ *	the log in one sweep, behind descriptor and revoke blocks, and
+ *	then writes a commit block; only then may the blocks go home.  So
+ *	many operations share a few sequential writes.  Commits are made
+ *	by sync and fsync, and when the running transaction grows to
+ *	j_maxtrans blocks.  Space in the log is reclaimed by writing
+ *	committed blocks home and moving the tail up (checkpointing).
+ *
+ *	A logged block that is freed is revoked, so that recovery does
+ *	not write stale metadata over whatever the block holds next.  No
+ *	freed block is allocated again before the freeing commits, for
+ *	until then recovery gives it back to its old owner; the block
+ *	bitmap as of the last commit is kept for that.
+ *	Recovery runs at mount time in the usual three passes: find the
+ *	last committed transaction, collect the revocations, replay.
+ *
+ *	Only the blocks above are logged.  Indirect blocks keep their
+ *	synchronous writes, the super block is written in place, and its
+ *	free counts are recomputed from the group descriptors at mount.
+ *	File data is ordered against the commit only by fsync, as in the
+ *	writeback mode of ext3.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/buf.h>
+#include <sys/proc.h>
+#include <sys/mount.h>
+#include <sys/vnode.h>
+#include <sys/malloc.h>
+#include <sys/queue.h>
+
+#include <ufs/ufs/quota.h>
+#include <ufs/ufs/inode.h>
+#include <ufs/ufs/ufsmount.h>
+
+#include <ufs/ext2fs/ext2_extern.h>
+#include <ufs/ext2fs/ext2_fs.h>
+#include <ufs/ext2fs/ext2_fs_sb.h>
+#include <ufs/ext2fs/fs.h>
+#include <ufs/ext2fs/ext2_journal.h>
+
+int	ext2_dojournal = 1;		/* log metadata if the fs has a journal */
+
+extern int nbuf;
+
+#define	JFSBTODB(jp, b)	((daddr_t)(b) << (jp)->j_fsbtodb)
+#define	JNEXT(jp, b)	((b) + 1 == (jp)->j_last ? (jp)->j_first : (b) + 1)
+#define	JHASH(jp, b)	(&(jp)->j_hashtbl[(b) & (jp)->j_hash])
+
+/* Tags in a descriptor block; the first is followed by the uuid. */
+#define	JTAGS(jp) \
+	(((jp)->j_bsize - sizeof (struct journal_header) - 16) / \
+	    sizeof (struct journal_block_tag))
+/* Block numbers in a revoke block. */
+#define	JREVOKES(jp) \
+	(((jp)->j_bsize - sizeof (struct journal_revoke_header)) / \
+	    sizeof (u_int32_t))
+
+/*
+ * Find the device block holding block lbn of the journal file.
+ */
+static int
+ext2_journal_bmap(jp, lbn, bnp)
+	register struct ext2_journal *jp;
+	u_long lbn;
+	daddr_t *bnp;
+{
+	struct buf *bp;
+	u_long nindir, span;
+	u_int32_t bn;
+	int level, error;
+
+	nindir = jp->j_bsize / sizeof (u_int32_t);
+	if (lbn < NDADDR)
+		bn = jp->j_din.di_db[lbn];
+	else {
+		lbn -= NDADDR;
+		level = 0;
+		span = nindir;
+		while (lbn >= span) {
+			lbn -= span;
+			span *= nindir;
+			if (++level == NIADDR)
+				return (EFBIG);
+		}
+		bn = jp->j_din.di_ib[level];
+		while (bn != 0) {
+			span /= nindir;
+			if (error = bread(jp->j_devvp, JFSBTODB(jp, bn),
+			    (int)jp->j_bsize, NOCRED, &bp)) {
+				brelse(bp);
+				return (error);
+			}
+			bn = ((u_int32_t *)bp->b_data)[lbn / span];
+			brelse(bp);
+			lbn %= span;
+			if (level-- == 0)
+				break;
+		}
+	}
+	/* The journal file has no holes. */
+	if (bn == 0)
+		return (EIO);
+	*bnp = JFSBTODB(jp, bn);
+	return (0);
+}
+
+/*
+ * Read block lbn of the log.
+ */
+static int
+ext2_journal_bread(jp, lbn, bpp)
+	struct ext2_journal *jp;
+	u_long lbn;
+	struct buf **bpp;
+{
+	daddr_t bn;
+	int error;
+
+	*bpp = NULL;
+	if (error = ext2_journal_bmap(jp, lbn, &bn))
+		return (error);
+	if (error = bread(jp->j_devvp, bn, (int)jp->j_bsize, NOCRED, bpp)) {
+		brelse(*bpp);
+		*bpp = NULL;
+	}
+	return (error);
+}
+
+/*
+ * Record the tail of the log in the journal super block; a tail of 0
+ * says that the log is empty and tid is the next transaction.
+ */
+static int
+ext2_journal_wsb(jp, start, tid)
+	struct ext2_journal *jp;
+	u_long start;
+	u_int32_t tid;
+{
+	struct journal_superblock *jsb;
+	struct buf *bp;
+	int error;
+
+	if (error = ext2_journal_bread(jp, 0, &bp))
+		return (error);
+	jsb = (struct journal_superblock *)bp->b_data;
+	jsb->s_start = htonl(start);
+	jsb->s_sequence = htonl(tid);
+	if (jp->j_flags & J_V2)
+		jsb->s_feature_incompat |= htonl(JFS_FEATURE_INCOMPAT_REVOKE);
+	return (bwrite(bp));
+}
+
+static struct ext2_jblock *
+ext2_journal_lookup(jp, blocknr)
+	struct ext2_journal *jp;
+	u_long blocknr;
+{
+	register struct ext2_jblock *jb;
+
+	for (jb = JHASH(jp, blocknr)->lh_first; jb; jb = jb->jb_hash.le_next)
+		if (jb->jb_blocknr == blocknr)
+			return (jb);
+	return (NULL);
+}
+
+static struct ext2_jblist *
+ext2_journal_list(jp, state)
+	struct ext2_journal *jp;
+	int state;
+{
+
+	switch (state) {
+	case JB_RUNNING:
+		return (&jp->j_running);
+	case JB_COMMITTING:
+		return (&jp->j_committing);
+	case JB_CHECKPOINT:
+		return (&jp->j_checkpoint);
+	}
+	return (&jp->j_home);
+}
+
+static void
+ext2_journal_move(jp, jb, state)
+	struct ext2_journal *jp;
+	struct ext2_jblock *jb;
+	int state;
+{
+
+	TAILQ_REMOVE(ext2_journal_list(jp, jb->jb_state), jb, jb_list);
+	jb->jb_state = state;
+	TAILQ_INSERT_TAIL(ext2_journal_list(jp, state), jb, jb_list);
+}
+
+static void
+ext2_journal_forget(jp, jb)
+	struct ext2_journal *jp;
+	struct ext2_jblock *jb;
+{
+
+	LIST_REMOVE(jb, jb_hash);
+	TAILQ_REMOVE(ext2_journal_list(jp, jb->jb_state), jb, jb_list);
+	if (jb->jb_flags & JB_REVOKE) {
+		TAILQ_REMOVE(&jp->j_revoked, jb, jb_rlist);
+		jp->j_nrevoked--;
+	}
+	bsd_free(jb, M_TEMP);
+}
+
+/*
+ * The buffer of jb, if it is still in core and still holds the block.
+ */
+static struct buf *
+ext2_journal_incore(jp, jb)
+	struct ext2_journal *jp;
+	struct ext2_jblock *jb;
+{
+	struct buf *bp;
+
+	if ((bp = incore(jb->jb_vp, jb->jb_lblkno)) == NULL ||
+	    bp->b_blkno != JFSBTODB(jp, jb->jb_blocknr))
+		return (NULL);
+	return (bp);
+}
+
+/*
+ * Let the buffer of jb be written home again.
+ */
+static void
+ext2_journal_unpin(jp, jb)
+	struct ext2_journal *jp;
+	struct ext2_jblock *jb;
+{
+	struct buf *bp;
+	int s;
+
+	s = splbio();
+	if ((bp = ext2_journal_incore(jp, jb)) != NULL &&
+	    (bp->b_flags & B_LOCKED)) {
+		bp->b_flags &= ~B_LOCKED;
+		if ((bp->b_flags & B_BUSY) == 0) {
+			/* Move it from the locked queue to a normal one. */
+			bremfree(bp);
+			bp->b_flags |= B_BUSY;
+			brelse(bp);
+		}
+	}
+	splx(s);
+}
+
+/*
+ * Unpin and forget every block, when logging stops.
+ */
+static void
+ext2_journal_forgetall(jp)
+	register struct ext2_journal *jp;
+{
+	register struct ext2_jblock *jb;
+	struct ext2_jtrans *jt;
+	struct ext2_jbitmap *cb;
+	int state;
+
+	for (state = JB_RUNNING; state <= JB_HOME; state++)
+		while ((jb = ext2_journal_list(jp, state)->tqh_first) != NULL) {
+			if (state == JB_RUNNING || state == JB_COMMITTING)
+				ext2_journal_unpin(jp, jb);
+			ext2_journal_forget(jp, jb);
+		}
+	while ((jt = jp->j_trans.tqh_first) != NULL) {
+		TAILQ_REMOVE(&jp->j_trans, jt, jt_list);
+		bsd_free(jt, M_TEMP);
+	}
+	while ((cb = jp->j_cbitmaps.lh_first) != NULL) {
+		LIST_REMOVE(cb, cb_list);
+		bsd_free(cb->cb_data, M_TEMP);
+		bsd_free(cb, M_TEMP);
+	}
+	jp->j_nrunning = 0;
+}
+
+static void
+ext2_journal_lock(jp)
+	struct ext2_journal *jp;
+{
+
+	while (jp->j_flags & J_BUSY) {
+		jp->j_flags |= J_WANTED;
+		tsleep((caddr_t)jp, PRIBIO, "ext2jnl", 0);
+	}
+	jp->j_flags |= J_BUSY;
+}
+
+static void
+ext2_journal_unlock(jp)
+	struct ext2_journal *jp;
+{
+
+	if (jp->j_flags & J_WANTED)
+		wakeup((caddr_t)jp);
+	jp->j_flags &= ~(J_BUSY | J_WANTED);
+}
+
+/*
+ * Free log blocks, and log blocks a commit of nblocks blocks and
+ * nrevoked revocations takes.
+ */
+static u_long
+ext2_journal_space(jp)
+	struct ext2_journal *jp;
+{
+	u_long size = jp->j_last - jp->j_first;
+
+	return (size - (jp->j_head + size - jp->j_tail) % size - 1);
+}
+
+static u_long
+ext2_journal_needs(jp, nblocks, nrevoked)
+	struct ext2_journal *jp;
+	u_long nblocks, nrevoked;
+{
+
+	return (nblocks + howmany(nblocks, JTAGS(jp)) +
+	    howmany(nrevoked, JREVOKES(jp)) + 1);
+}
+
+/*
+ * bp, a metadata buffer of mp, has just been changed: add it to the
+ * running transaction and keep it from going home until that commits.
+ * Called with the buffer owned, and does not wait for I/O, so that a
+ * commit sees all or none of what an operation changes between two
+ * sleeps.
+ */
+void
+ext2_journal_dirty(mp, bp)
+	struct mount *mp;
+	struct buf *bp;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+	register struct ext2_jblock *jb;
+	u_long blocknr;
+
+	if (jp == NULL || !jp->j_active)
+		return;
+	if (bp->b_vp != jp->j_devvp && bp->b_blkno == bp->b_lblkno)
+		VOP_BMAP(bp->b_vp, bp->b_lblkno, NULL, &bp->b_blkno, NULL);
+	blocknr = (u_long)bp->b_blkno >> jp->j_fsbtodb;
+	if ((jb = ext2_journal_lookup(jp, blocknr)) == NULL) {
+		jb = bsd_malloc(sizeof (*jb), M_TEMP, M_WAITOK);
+		memset(jb, 0, sizeof (*jb));
+		jb->jb_blocknr = blocknr;
+		jb->jb_state = JB_HOME;
+		LIST_INSERT_HEAD(JHASH(jp, blocknr), jb, jb_hash);
+		TAILQ_INSERT_TAIL(&jp->j_home, jb, jb_list);
+	}
+	jb->jb_vp = bp->b_vp;
+	jb->jb_lblkno = bp->b_lblkno;
+	bp->b_flags |= B_LOCKED;
+	if (jb->jb_state == JB_RUNNING || (jb->jb_flags & JB_REDIRTY))
+		return;
+	if (jb->jb_flags & JB_REVOKE) {
+		/* In use again before the revocation was committed. */
+		TAILQ_REMOVE(&jp->j_revoked, jb, jb_rlist);
+		jb->jb_flags &= ~JB_REVOKE;
+		jp->j_nrevoked--;
+	}
+	jb->jb_flags &= ~JB_FREED;
+	jp->j_nrunning++;
+	if (jb->jb_state == JB_COMMITTING)
+		jb->jb_flags |= JB_REDIRTY;
+	else
+		ext2_journal_move(jp, jb, JB_RUNNING);
+}
+
+/*
+ * Blocks [blocknr, blocknr + count) of mp are being freed.  A change
+ * to one of them not committed yet is dropped, and one that may be
+ * replayed is revoked with the running transaction.
+ */
+void
+ext2_journal_revoke(mp, blocknr, count)
+	struct mount *mp;
+	u_long blocknr, count;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+	register struct ext2_jblock *jb;
+
+	if (jp == NULL || !jp->j_active)
+		return;
+	for (; count > 0; blocknr++, count--) {
+		if ((jb = ext2_journal_lookup(jp, blocknr)) == NULL)
+			continue;
+		if (jb->jb_state == JB_RUNNING || (jb->jb_flags & JB_REDIRTY)) {
+			jb->jb_flags &= ~JB_REDIRTY;
+			jp->j_nrunning--;
+			ext2_journal_unpin(jp, jb);
+		}
+		if (jb->jb_state == JB_COMMITTING)
+			jb->jb_flags |= JB_FREED;
+		else if ((jb->jb_flags & JB_LOGGED) == 0) {
+			/* Never reached the log. */
+			ext2_journal_forget(jp, jb);
+			continue;
+		} else
+			ext2_journal_move(jp, jb, JB_HOME);
+		if ((jb->jb_flags & (JB_REVOKE | JB_REVOKING)) == 0) {
+			jb->jb_flags |= JB_REVOKE;
+			TAILQ_INSERT_TAIL(&jp->j_revoked, jb, jb_rlist);
+			jp->j_nrevoked++;
+		}
+	}
+}
+
+/*
+ * Bits in map, the block bitmap of group, are about to be cleared.
+ * Keep the bitmap as of the last commit, if it is not kept already,
+ * until the running transaction commits.
+ */
+void
+ext2_journal_bfree(mp, group, map)
+	struct mount *mp;
+	u_long group;
+	caddr_t map;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+	register struct ext2_jbitmap *cb;
+	register u_long i;
+	caddr_t data;
+
+	if (jp == NULL || !jp->j_active)
+		return;
+	for (cb = jp->j_cbitmaps.lh_first; cb; cb = cb->cb_list.le_next)
+		if (cb->cb_group == group)
+			break;
+	if (cb == NULL) {
+		/* Nothing freed in the group since the last commit. */
+		data = bsd_malloc(jp->j_bsize, M_TEMP, M_WAITOK);
+		cb = bsd_malloc(sizeof (*cb), M_TEMP, M_WAITOK);
+		cb->cb_group = group;
+		cb->cb_data = data;
+		memcpy(data, map, jp->j_bsize);
+		LIST_INSERT_HEAD(&jp->j_cbitmaps, cb, cb_list);
+	} else if (cb->cb_tid != jp->j_tid) {
+		/*
+		 * Kept for a transaction being committed: what it allocated
+		 * is about to become the committed state as well.
+		 */
+		for (i = 0; i < jp->j_bsize; i++)
+			cb->cb_data[i] |= map[i];
+	}
+	cb->cb_tid = jp->j_tid;
+}
+
+/*
+ * The block bitmap of group as of the last commit, or NULL if no
+ * block has been freed in it since.
+ */
+caddr_t
+ext2_journal_cbitmap(mp, group)
+	struct mount *mp;
+	u_long group;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+	register struct ext2_jbitmap *cb;
+
+	if (jp == NULL || !jp->j_active)
+		return (NULL);
+	for (cb = jp->j_cbitmaps.lh_first; cb; cb = cb->cb_list.le_next)
+		if (cb->cb_group == group)
+			return (cb->cb_data);
+	return (NULL);
+}
+
+/*
+ * Write the buffer of a committed block home, unless it is clean,
+ * gone, or dirty in a later transaction.  With MNT_WAIT, a buffer
+ * that is busy, perhaps on its way home already, is waited for.  A
+ * buffer held by the file system, a bitmap or a group descriptor,
+ * is always busy.
+ */
+static int
+ext2_journal_writehome(jp, jb, waitfor)
+	register struct ext2_journal *jp;
+	struct ext2_jblock *jb;
+	int waitfor;
+{
+	register struct ext2_sb_info *fs = jp->j_fs;
+	struct buf *bp;
+	int i, s;
+
+	s = splbio();
+	bp = ext2_journal_incore(jp, jb);
+	if (bp == NULL || (bp->b_flags & B_LOCKED) ||
+	    (bp->b_flags & (B_DELWRI | B_BUSY)) == 0) {
+		splx(s);
+		return (0);
+	}
+	if (bp->b_flags & B_BUSY) {
+		for (i = 0; i < fs->s_db_per_group; i++)
+			if (fs->s_group_desc[i] == bp)
+				goto held;
+		for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
+			if (fs->s_inode_bitmap[i] == bp ||
+			    fs->s_block_bitmap[i] == bp)
+				goto held;
+		splx(s);
+		if (waitfor != MNT_WAIT)
+			return (0);
+		bp = getblk(jb->jb_vp, jb->jb_lblkno, bp->b_bcount, 0, 0);
+		if ((bp->b_flags & (B_DELWRI | B_LOCKED)) != B_DELWRI) {
+			brelse(bp);
+			return (0);
+		}
+	} else {
+		bremfree(bp);
+		bp->b_flags |= B_BUSY;
+		splx(s);
+	}
+	if (waitfor != MNT_WAIT) {
+		bawrite(bp);
+		return (0);
+	}
+	return (bwrite(bp));
+held:
+	splx(s);
+	if ((bp->b_flags & B_DELWRI) == 0)
+		return (0);
+	return (ll_w_block(bp, waitfor == MNT_WAIT));
+}
+
+/*
+ * Move the tail up to the oldest transaction holding the last copy
+ * of some block that is not home yet, or to the head, and forget the
+ * copies that can no longer be replayed.
+ */
+static int
+ext2_journal_advance(jp)
+	register struct ext2_journal *jp;
+{
+	register struct ext2_jblock *jb, *njb;
+	struct ext2_jtrans *jt;
+	struct vnode *vp;
+	u_int32_t mintid, tailtid;
+	u_long tail;
+	int found, error, s;
+
+	/*
+	 * Blocks written home by the checkpoint or evicted from the cache
+	 * may still be on their way, on the device or, for a directory
+	 * block, on the directory.  Wait for them all before their copies
+	 * in the log can go, starting over after each sleep.
+	 */
+	s = splbio();
+loop:
+	for (jb = jp->j_home.tqh_first; jb; jb = jb->jb_list.tqe_next) {
+		vp = jb->jb_vp;
+		if (vp != NULL && vp->v_numoutput) {
+			vp->v_flag |= VBWAIT;
+			sleep((caddr_t)&vp->v_numoutput, PRIBIO + 1);
+			goto loop;
+		}
+	}
+	splx(s);
+
+	found = 0;
+	mintid = 0;
+	for (jb = jp->j_running.tqh_first; jb; jb = jb->jb_list.tqe_next)
+		if ((jb->jb_flags & JB_LOGGED) &&
+		    (!found || TID_LT(jb->jb_ctid, mintid))) {
+			mintid = jb->jb_ctid;
+			found = 1;
+		}
+	for (jb = jp->j_checkpoint.tqh_first; jb; jb = jb->jb_list.tqe_next)
+		if (!found || TID_LT(jb->jb_ctid, mintid)) {
+			mintid = jb->jb_ctid;
+			found = 1;
+		}
+	tail = jp->j_head;
+	tailtid = jp->j_tid;
+	while ((jt = jp->j_trans.tqh_first) != NULL) {
+		if (found && !TID_LT(jt->jt_tid, mintid)) {
+			tail = jt->jt_start;
+			tailtid = jt->jt_tid;
+			break;
+		}
+		TAILQ_REMOVE(&jp->j_trans, jt, jt_list);
+		bsd_free(jt, M_TEMP);
+	}
+	if (tail == jp->j_tail && tailtid == jp->j_tailtid)
+		return (0);
+	if (error = ext2_journal_wsb(jp, tail, tailtid))
+		return (error);
+	jp->j_tail = tail;
+	jp->j_tailtid = tailtid;
+	for (jb = jp->j_home.tqh_first; jb; jb = njb) {
+		njb = jb->jb_list.tqe_next;
+		if (TID_LT(jb->jb_ctid, tailtid))
+			ext2_journal_forget(jp, jb);
+	}
+	return (0);
+}
+
+/*
+ * Write committed blocks home.  With MNT_WAIT, wait for them and move
+ * the tail of the log up; otherwise only start the writes that need
+ * no sleep.
+ */
+static int
+ext2_journal_checkpoint1(jp, waitfor)
+	register struct ext2_journal *jp;
+	int waitfor;
+{
+	register struct ext2_jblock *jb;
+	int error, allerror = 0;
+
+	if (waitfor != MNT_WAIT) {
+		for (jb = jp->j_checkpoint.tqh_first; jb;
+		    jb = jb->jb_list.tqe_next)
+			(void) ext2_journal_writehome(jp, jb, waitfor);
+		return (0);
+	}
+	while ((jb = jp->j_checkpoint.tqh_first) != NULL) {
+		ext2_journal_move(jp, jb, JB_HOME);
+		if (error = ext2_journal_writehome(jp, jb, waitfor))
+			allerror = error;
+	}
+	if (allerror)
+		return (allerror);
+	return (ext2_journal_advance(jp));
+}
+
+/*
+ * A write to the log failed.  Write home what has been committed,
+ * mark the log empty if possible and go on without it; the file
+ * system is marked for fsck.
+ */
+static void
+ext2_journal_abort(jp, error)
+	register struct ext2_journal *jp;
+	int error;
+{
+	register struct ext2_jblock *jb;
+
+	printf("EXT2-fs: journal write error %d, logging stopped\n", error);
+	while ((jb = jp->j_committing.tqh_first) != NULL)
+		ext2_journal_move(jp, jb, JB_RUNNING);
+	(void) ext2_journal_checkpoint1(jp, MNT_WAIT);
+	(void) ext2_journal_wsb(jp, 0, jp->j_tid);
+	ext2_journal_forgetall(jp);
+	jp->j_active = 0;
+	jp->j_fs->s_es->s_state |= EXT2_ERROR_FS;
+	jp->j_fs->s_dirt = 1;
+}
+
+static caddr_t
+ext2_journal_newblock(jp, bp, type, tid)
+	struct ext2_journal *jp;
+	struct buf *bp;
+	int type;
+	u_int32_t tid;
+{
+	struct journal_header *jh;
+
+	memset(bp->b_data, 0, jp->j_bsize);
+	jh = (struct journal_header *)bp->b_data;
+	jh->h_magic = htonl(JFS_MAGIC_NUMBER);
+	jh->h_blocktype = htonl(type);
+	jh->h_sequence = htonl(tid);
+	return (bp->b_data);
+}
+
+static void
+ext2_journal_release(bpp, from, to)
+	struct buf **bpp;
+	int from, to;
+{
+
+	for (; from < to; from++) {
+		bpp[from]->b_flags |= B_INVAL;
+		brelse(bpp[from]);
+	}
+}
+
+/*
+ * Commit the running transaction: log every block changed in it and
+ * the revocations, write the commit block, and let the blocks go home.
+ */
+static int
+ext2_journal_commit1(jp)
+	register struct ext2_journal *jp;
+{
+	register struct ext2_jblock *jb;
+	struct ext2_jblock *njb;
+	struct ext2_jbitmap *cb, *ncb;
+	struct ext2_jblist revoking;
+	struct ext2_jtrans *jt;
+	struct journal_block_tag *tag;
+	struct journal_revoke_header *rh;
+	struct buf **bpp, *bp;
+	u_int32_t tid;
+	u_long nlog, blk;
+	daddr_t bn;
+	caddr_t p;
+	int i, used, ntags, nrev, error, s;
+
+	if (jp->j_nrunning == 0 && jp->j_nrevoked == 0)
+		return (0);
+	/*
+	 * Get the log buffers first: that may sleep, and meanwhile the
+	 * transaction may grow.
+	 */
+again:
+	nlog = ext2_journal_needs(jp, jp->j_nrunning, jp->j_nrevoked);
+	if (nlog > ext2_journal_space(jp)) {
+		if (error = ext2_journal_checkpoint1(jp, MNT_WAIT))
+			return (error);
+		if (nlog > ext2_journal_space(jp))
+			panic("ext2_journal_commit: log full");
+	}
+	bpp = bsd_malloc(nlog * sizeof (struct buf *), M_TEMP, M_WAITOK);
+	for (i = 0, blk = jp->j_head; i < nlog; i++, blk = JNEXT(jp, blk)) {
+		if (error = ext2_journal_bmap(jp, blk, &bn)) {
+			ext2_journal_release(bpp, 0, i);
+			bsd_free(bpp, M_TEMP);
+			return (error);
+		}
+		bpp[i] = getblk(jp->j_devvp, bn, (int)jp->j_bsize, 0, 0);
+	}
+	if (ext2_journal_needs(jp, jp->j_nrunning, jp->j_nrevoked) > nlog) {
+		ext2_journal_release(bpp, 0, nlog);
+		bsd_free(bpp, M_TEMP);
+		goto again;
+	}
+
+	/*
+	 * Nothing sleeps from here until the writes are started: the log
+	 * gets the blocks as they are now, and what changes them next
+	 * goes into the following transaction.
+	 */
+	tid = jp->j_tid++;
+	while ((jb = jp->j_running.tqh_first) != NULL)
+		ext2_journal_move(jp, jb, JB_COMMITTING);
+	jp->j_nrunning = 0;
+	used = 0;
+	TAILQ_INIT(&revoking);
+	rh = NULL;
+	nrev = 0;
+	while ((jb = jp->j_revoked.tqh_first) != NULL) {
+		TAILQ_REMOVE(&jp->j_revoked, jb, jb_rlist);
+		jb->jb_flags = (jb->jb_flags & ~JB_REVOKE) | JB_REVOKING;
+		TAILQ_INSERT_TAIL(&revoking, jb, jb_rlist);
+		if (rh == NULL || nrev == JREVOKES(jp)) {
+			rh = (struct journal_revoke_header *)
+			    ext2_journal_newblock(jp, bpp[used++],
+			    JFS_REVOKE_BLOCK, tid);
+			nrev = 0;
+		}
+		((u_int32_t *)(rh + 1))[nrev++] = htonl(jb->jb_blocknr);
+		rh->r_count = htonl(sizeof (*rh) + nrev * sizeof (u_int32_t));
+	}
+	jp->j_nrevoked = 0;
+	tag = NULL;
+	ntags = 0;
+	p = NULL;
+	for (jb = jp->j_committing.tqh_first; jb; jb = njb) {
+		njb = jb->jb_list.tqe_next;
+		if ((bp = ext2_journal_incore(jp, jb)) == NULL ||
+		    (bp->b_flags & B_LOCKED) == 0) {
+			/* Thrown away since it was changed. */
+			if (jb->jb_flags & JB_LOGGED)
+				ext2_journal_move(jp, jb, JB_HOME);
+			else
+				ext2_journal_forget(jp, jb);
+			continue;
+		}
+		if (bp->b_bcount != jp->j_bsize)
+			panic("ext2_journal_commit: size");
+		if (tag == NULL || ntags == JTAGS(jp)) {
+			if (tag != NULL)
+				tag->t_flags |= htonl(JFS_FLAG_LAST_TAG);
+			p = ext2_journal_newblock(jp, bpp[used++],
+			    JFS_DESCRIPTOR_BLOCK, tid) +
+			    sizeof (struct journal_header);
+			ntags = 0;
+		}
+		tag = (struct journal_block_tag *)p;
+		tag->t_blocknr = htonl(jb->jb_blocknr);
+		tag->t_flags = 0;
+		p += sizeof (*tag);
+		if (ntags++ == 0) {
+			memcpy(p, jp->j_uuid, 16);
+			p += 16;
+		} else
+			tag->t_flags |= htonl(JFS_FLAG_SAME_UUID);
+		memcpy(bpp[used]->b_data, bp->b_data, jp->j_bsize);
+		if (*(u_int32_t *)bpp[used]->b_data ==
+		    htonl(JFS_MAGIC_NUMBER)) {
+			*(u_int32_t *)bpp[used]->b_data = 0;
+			tag->t_flags |= htonl(JFS_FLAG_ESCAPE);
+		}
+		used++;
+	}
+	if (tag != NULL)
+		tag->t_flags |= htonl(JFS_FLAG_LAST_TAG);
+	(void) ext2_journal_newblock(jp, bpp[used++], JFS_COMMIT_BLOCK, tid);
+	ext2_journal_release(bpp, used, nlog);
+
+	/*
+	 * Write the log, wait for it, then write the commit block.
+	 */
+	for (i = 0; i < used - 1; i++) {
+		bpp[i]->b_flags |= B_NOCACHE;
+		bawrite(bpp[i]);
+	}
+	s = splbio();
+	while (jp->j_devvp->v_numoutput) {
+		jp->j_devvp->v_flag |= VBWAIT;
+		sleep((caddr_t)&jp->j_devvp->v_numoutput, PRIBIO + 1);
+	}
+	splx(s);
+	bpp[used - 1]->b_flags |= B_NOCACHE;
+	error = bwrite(bpp[used - 1]);
+	bsd_free(bpp, M_TEMP);
+	while ((jb = revoking.tqh_first) != NULL) {
+		TAILQ_REMOVE(&revoking, jb, jb_rlist);
+		jb->jb_flags &= ~JB_REVOKING;
+	}
+	if (error) {
+		ext2_journal_abort(jp, error);
+		return (error);
+	}
+
+	jt = bsd_malloc(sizeof (*jt), M_TEMP, M_WAITOK);
+	jt->jt_tid = tid;
+	jt->jt_start = jp->j_head;
+	TAILQ_INSERT_TAIL(&jp->j_trans, jt, jt_list);
+	for (i = 0; i < used; i++)
+		jp->j_head = JNEXT(jp, jp->j_head);
+	while ((jb = jp->j_committing.tqh_first) != NULL) {
+		jb->jb_flags |= JB_LOGGED;
+		jb->jb_ctid = tid;
+		if (jb->jb_flags & JB_REDIRTY) {
+			jb->jb_flags &= ~JB_REDIRTY;
+			ext2_journal_move(jp, jb, JB_RUNNING);
+			continue;
+		}
+		ext2_journal_unpin(jp, jb);
+		if (jb->jb_flags & JB_FREED) {
+			jb->jb_flags &= ~JB_FREED;
+			ext2_journal_move(jp, jb, JB_HOME);
+		} else
+			ext2_journal_move(jp, jb, JB_CHECKPOINT);
+	}
+	/* Blocks freed up to tid may be allocated again. */
+	for (cb = jp->j_cbitmaps.lh_first; cb; cb = ncb) {
+		ncb = cb->cb_list.le_next;
+		if (!TID_LT(tid, cb->cb_tid)) {
+			LIST_REMOVE(cb, cb_list);
+			bsd_free(cb->cb_data, M_TEMP);
+			bsd_free(cb, M_TEMP);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Commit the running transaction of mp, and checkpoint if the log is
+ * more than half full.
+ */
+int
+ext2_journal_commit(mp)
+	struct mount *mp;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+	int error;
+
+	if (jp == NULL || !jp->j_active)
+		return (0);
+	ext2_journal_lock(jp);
+	error = ext2_journal_commit1(jp);
+	if (error == 0 && jp->j_active &&
+	    ext2_journal_space(jp) < (jp->j_last - jp->j_first) / 2)
+		error = ext2_journal_checkpoint1(jp, MNT_WAIT);
+	ext2_journal_unlock(jp);
+	return (error);
+}
+
+/*
+ * Commit if the running transaction has grown to its limit.  Called
+ * where the caller may sleep and holds no buffer of the transaction.
+ */
+int
+ext2_journal_check(mp)
+	struct mount *mp;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+
+	if (jp == NULL || !jp->j_active ||
+	    ext2_journal_needs(jp, jp->j_nrunning, jp->j_nrevoked) <
+	    jp->j_maxtrans)
+		return (0);
+	return (ext2_journal_commit(mp));
+}
+
+int
+ext2_journal_checkpoint(mp, waitfor)
+	struct mount *mp;
+	int waitfor;
+{
+	register struct ext2_journal *jp = VFSTOUFS(mp)->um_journal;
+	int error;
+
+	if (jp == NULL || !jp->j_active)
+		return (0);
+	ext2_journal_lock(jp);
+	error = ext2_journal_checkpoint1(jp, waitfor);
+	ext2_journal_unlock(jp);
+	return (error);
+}
+
+/*
+ * Write a changed metadata buffer: with a journal, add it to the
+ * running transaction and delay the write; otherwise write it now.
+ */
+int
+ext2_journal_bwrite(bp)
+	struct buf *bp;
+{
+	struct mount *mp = bp->b_vp->v_mount;
+
+	if (!EXT2_JOURNALING(mp))
+		return (bwrite(bp));
+	ext2_journal_dirty(mp, bp);
+	bdwrite(bp);
+	return (ext2_journal_check(mp));
+}
+
+/*
+ * Revocations found in the log during recovery.
+ */
+struct ext2_jrevoke {
+	LIST_ENTRY(ext2_jrevoke) jr_hash;
+	u_long	jr_blocknr;
+	u_int32_t jr_tid;		/* latest revoking transaction */
+};
+
+LIST_HEAD(ext2_jrhead, ext2_jrevoke);
+
+#define	PASS_SCAN	0
+#define	PASS_REVOKE	1
+#define	PASS_REPLAY	2
+
+static void
+ext2_journal_setrevoke(tbl, mask, blocknr, tid)
+	struct ext2_jrhead *tbl;
+	u_long mask, blocknr;
+	u_int32_t tid;
+{
+	register struct ext2_jrevoke *jr;
+
+	for (jr = tbl[blocknr & mask].lh_first; jr; jr = jr->jr_hash.le_next)
+		if (jr->jr_blocknr == blocknr) {
+			if (TID_LT(jr->jr_tid, tid))
+				jr->jr_tid = tid;
+			return;
+		}
+	jr = bsd_malloc(sizeof (*jr), M_TEMP, M_WAITOK);
+	jr->jr_blocknr = blocknr;
+	jr->jr_tid = tid;
+	LIST_INSERT_HEAD(&tbl[blocknr & mask], jr, jr_hash);
+}
+
+/*
+ * The copy of blocknr logged by transaction tid was revoked by it or
+ * a later one.
+ */
+static int
+ext2_journal_revoked(tbl, mask, blocknr, tid)
+	struct ext2_jrhead *tbl;
+	u_long mask, blocknr;
+	u_int32_t tid;
+{
+	register struct ext2_jrevoke *jr;
+
+	for (jr = tbl[blocknr & mask].lh_first; jr; jr = jr->jr_hash.le_next)
+		if (jr->jr_blocknr == blocknr)
+			return (!TID_LT(jr->jr_tid, tid));
+	return (0);
+}
+
+static int
+ext2_journal_replay(jp, blk, blocknr, flags)
+	struct ext2_journal *jp;
+	u_long blk, blocknr;
+	u_int32_t flags;
+{
+	struct buf *bp, *hbp;
+	int error;
+
+	if (error = ext2_journal_bread(jp, blk, &bp))
+		return (error);
+	hbp = getblk(jp->j_devvp, JFSBTODB(jp, blocknr), (int)jp->j_bsize,
+	    0, 0);
+	memcpy(hbp->b_data, bp->b_data, jp->j_bsize);
+	if (flags & JFS_FLAG_ESCAPE)
+		*(u_int32_t *)hbp->b_data = htonl(JFS_MAGIC_NUMBER);
+	brelse(bp);
+	bawrite(hbp);
+	return (0);
+}
+
+/*
+ * One pass over the log from the tail.  PASS_SCAN finds the first
+ * transaction that did not commit and leaves it in *endp; the other
+ * passes stop there.
+ */
+static int
+ext2_journal_pass(jp, pass, endp, tbl, mask, nreplayp)
+	register struct ext2_journal *jp;
+	int pass;
+	u_int32_t *endp;
+	struct ext2_jrhead *tbl;
+	u_long mask;
+	int *nreplayp;
+{
+	struct journal_header *jh;
+	struct journal_block_tag *tag;
+	struct buf *bp;
+	u_int32_t tid, flags;
+	u_long blk, off, count;
+	int error;
+
+	blk = jp->j_tail;
+	tid = jp->j_tailtid;
+	for (;;) {
+		if (pass != PASS_SCAN && tid == *endp)
+			break;
+		if (error = ext2_journal_bread(jp, blk, &bp))
+			return (error);
+		jh = (struct journal_header *)bp->b_data;
+		if (jh->h_magic != htonl(JFS_MAGIC_NUMBER) ||
+		    ntohl(jh->h_sequence) != tid) {
+			brelse(bp);
+			break;
+		}
+		blk = JNEXT(jp, blk);
+		switch (ntohl(jh->h_blocktype)) {
+		case JFS_DESCRIPTOR_BLOCK:
+			off = sizeof (*jh);
+			while (off + sizeof (*tag) <= jp->j_bsize) {
+				tag = (struct journal_block_tag *)
+				    (bp->b_data + off);
+				flags = ntohl(tag->t_flags);
+				off += sizeof (*tag);
+				if ((flags & JFS_FLAG_SAME_UUID) == 0)
+					off += 16;
+				if (pass == PASS_REPLAY &&
+				    !ext2_journal_revoked(tbl, mask,
+				    ntohl(tag->t_blocknr), tid)) {
+					if (error = ext2_journal_replay(jp, blk,
+					    ntohl(tag->t_blocknr), flags)) {
+						brelse(bp);
+						return (error);
+					}
+					(*nreplayp)++;
+				}
+				blk = JNEXT(jp, blk);
+				if (flags & JFS_FLAG_LAST_TAG)
+					break;
+			}
+			break;
+
+		case JFS_COMMIT_BLOCK:
+			tid++;
+			break;
+
+		case JFS_REVOKE_BLOCK:
+			if (pass != PASS_REVOKE)
+				break;
+			count = ntohl(((struct journal_revoke_header *)
+			    bp->b_data)->r_count);
+			if (count > jp->j_bsize)
+				count = jp->j_bsize;
+			for (off = sizeof (struct journal_revoke_header);
+			    off + sizeof (u_int32_t) <= count;
+			    off += sizeof (u_int32_t))
+				ext2_journal_setrevoke(tbl, mask,
+				    ntohl(*(u_int32_t *)(bp->b_data + off)),
+				    tid);
+			break;
+
+		default:
+			brelse(bp);
+			goto done;
+		}
+		brelse(bp);
+	}
+done:
+	if (pass == PASS_SCAN)
+		*endp = tid;
+	return (0);
+}
+
+/*
+ * Replay the log after a crash and mark it empty.
+ */
+static int
+ext2_journal_recover(jp)
+	register struct ext2_journal *jp;
+{
+	struct ext2_jrhead *tbl;
+	struct ext2_jrevoke *jr;
+	u_int32_t end;
+	u_long mask, i;
+	int pass, nreplay, error;
+
+	tbl = hashinit(256, M_TEMP, &mask);
+	nreplay = 0;
+	error = 0;
+	for (pass = PASS_SCAN; pass <= PASS_REPLAY && error == 0; pass++)
+		error = ext2_journal_pass(jp, pass, &end, tbl, mask, &nreplay);
+	for (i = 0; i <= mask; i++)
+		while ((jr = tbl[i].lh_first) != NULL) {
+			LIST_REMOVE(jr, jr_hash);
+			bsd_free(jr, M_TEMP);
+		}
+	bsd_free(tbl, M_TEMP);
+	/* Wait for the replay, and drop what is cached of the device. */
+	if (error == 0)
+		error = vinvalbuf(jp->j_devvp, V_SAVE, NOCRED,
+		    (struct proc *)0, 0, 0);
+	if (error)
+		return (error);
+	printf("EXT2-fs: journal recovered, %d blocks from transactions %u to %u\n",
+	    nreplay, jp->j_tailtid, end - 1);
+	jp->j_tail = 0;
+	jp->j_tailtid = end;
+	return (ext2_journal_wsb(jp, 0, end));
+}
+
+/*
+ * Find the journal of the file system with super block es, on devvp,
+ * and recover it if needed.  *jpp is left NULL if the file system is
+ * not to be logged.  es is read again after a recovery.
+ */
+int
+ext2_journal_open(devvp, es, ronly, jpp)
+	struct vnode *devvp;
+	struct ext2_super_block *es;
+	int ronly;
+	struct ext2_journal **jpp;
+{
+	register struct ext2_journal *jp;
+	struct journal_superblock *jsb;
+	struct ext2_group_desc *gdp;
+	struct buf *bp;
+	u_long bsize, ino, dpb, ipb, blk;
+	int error, unknown;
+
+	*jpp = NULL;
+	if (!EXT2_HAS_COMPAT_FEATURE(es, EXT2_FEATURE_COMPAT_HAS_JOURNAL))
+		return (0);
+	if (es->s_journal_inum == 0 || es->s_journal_dev != 0) {
+		printf("EXT2-fs: external journal not supported\n");
+		return (EXT2_HAS_INCOMPAT_FEATURE(es,
+		    EXT2_FEATURE_INCOMPAT_RECOVER) ? EINVAL : 0);
+	}
+	jp = bsd_malloc(sizeof (*jp), M_UFSMNT, M_WAITOK);
+	memset(jp, 0, sizeof (*jp));
+	TAILQ_INIT(&jp->j_running);
+	TAILQ_INIT(&jp->j_committing);
+	TAILQ_INIT(&jp->j_checkpoint);
+	TAILQ_INIT(&jp->j_home);
+	TAILQ_INIT(&jp->j_revoked);
+	TAILQ_INIT(&jp->j_trans);
+	LIST_INIT(&jp->j_cbitmaps);
+	jp->j_devvp = devvp;
+	jp->j_bsize = bsize = EXT2_MIN_BLOCK_SIZE << es->s_log_block_size;
+	jp->j_fsbtodb = es->s_log_block_size + 1;
+
+	/*
+	 * The file system is not set up yet: find the journal inode by
+	 * hand, through its group descriptor.
+	 */
+	ino = es->s_journal_inum - 1;
+	dpb = bsize / sizeof (struct ext2_group_desc);
+	blk = es->s_first_data_block + 1 + ino / es->s_inodes_per_group / dpb;
+	if (error = bread(devvp, JFSBTODB(jp, blk), (int)bsize, NOCRED, &bp)) {
+		brelse(bp);
+		goto bad;
+	}
+	gdp = (struct ext2_group_desc *)bp->b_data +
+	    ino / es->s_inodes_per_group % dpb;
+	ipb = bsize / EXT2_INODE_SIZE;
+	blk = gdp->bg_inode_table + ino % es->s_inodes_per_group / ipb;
+	brelse(bp);
+	if (error = bread(devvp, JFSBTODB(jp, blk), (int)bsize, NOCRED, &bp)) {
+		brelse(bp);
+		goto bad;
+	}
+	ext2_ei2di((char *)bp->b_data + EXT2_INODE_SIZE * (ino % ipb),
+	    &jp->j_din);
+	brelse(bp);
+
+	if (error = ext2_journal_bread(jp, 0, &bp))
+		goto bad;
+	jsb = (struct journal_superblock *)bp->b_data;
+	if (jsb->s_header.h_magic != htonl(JFS_MAGIC_NUMBER) ||
+	    (jsb->s_header.h_blocktype != htonl(JFS_SUPERBLOCK_V1) &&
+	    jsb->s_header.h_blocktype != htonl(JFS_SUPERBLOCK_V2)) ||
+	    ntohl(jsb->s_blocksize) != bsize ||
+	    ntohl(jsb->s_first) == 0 ||
+	    ntohl(jsb->s_first) >= ntohl(jsb->s_maxlen) ||
+	    ntohl(jsb->s_maxlen) > jp->j_din.di_size / bsize) {
+		printf("EXT2-fs: bad journal super block\n");
+		brelse(bp);
+		error = EINVAL;
+		goto bad;
+	}
+	unknown = 0;
+	if (jsb->s_header.h_blocktype == htonl(JFS_SUPERBLOCK_V2)) {
+		jp->j_flags |= J_V2;
+		memcpy(jp->j_uuid, jsb->s_uuid, sizeof (jp->j_uuid));
+		unknown = ntohl(jsb->s_feature_incompat) &
+		    ~JFS_KNOWN_INCOMPAT_FEATURES;
+	}
+	jp->j_first = ntohl(jsb->s_first);
+	jp->j_last = ntohl(jsb->s_maxlen);
+	jp->j_tail = ntohl(jsb->s_start);
+	jp->j_tailtid = ntohl(jsb->s_sequence);
+	brelse(bp);
+	if (unknown) {
+		printf("EXT2-fs: journal has unsupported features %x\n",
+		    unknown);
+		if (jp->j_tail != 0) {
+			error = EINVAL;
+			goto bad;
+		}
+		ext2_journal_close(jp);
+		return (0);
+	}
+	jp->j_hashtbl = hashinit((int)(jp->j_last - jp->j_first) / 4 + 1,
+	    M_TEMP, &jp->j_hash);
+	jp->j_maxtrans = (jp->j_last - jp->j_first) / 8;
+	if (jp->j_maxtrans > nbuf / 4)
+		jp->j_maxtrans = nbuf / 4;
+
+	if (jp->j_tail != 0) {
+		if (ronly) {
+			printf("EXT2-fs: journal needs recovery, mount read-write\n");
+			error = EROFS;
+			goto bad;
+		}
+		if (error = ext2_journal_recover(jp))
+			goto bad;
+		/* The super block may have been replayed. */
+		if (error = bread(devvp, SBLOCK, SBSIZE, NOCRED, &bp)) {
+			brelse(bp);
+			goto bad;
+		}
+		memcpy(es, bp->b_data, sizeof (struct ext2_super_block));
+		brelse(bp);
+	}
+	jp->j_tid = jp->j_tailtid;
+	*jpp = jp;
+	return (0);
+bad:
+	ext2_journal_close(jp);
+	return (error);
+}
+
+/*
+ * Start logging, the file system being mounted read-write.
+ */
+int
+ext2_journal_start(jp)
+	register struct ext2_journal *jp;
+{
+	int error;
+
+	if (!ext2_dojournal || jp->j_active)
+		return (0);
+	if ((jp->j_flags & J_V2) == 0 || jp->j_maxtrans < 8) {
+		printf("EXT2-fs: journal too old or too small, not logging\n");
+		return (0);
+	}
+	jp->j_head = jp->j_tail = jp->j_first;
+	jp->j_tailtid = jp->j_tid;
+	if (error = ext2_journal_wsb(jp, jp->j_tail, jp->j_tailtid))
+		return (error);
+	jp->j_active = 1;
+	return (0);
+}
+
+/*
+ * Stop logging: commit, write everything home and mark the log empty.
+ */
+int
+ext2_journal_stop(jp)
+	register struct ext2_journal *jp;
+{
+	int error;
+
+	if (!jp->j_active)
+		return (0);
+	ext2_journal_lock(jp);
+	if ((error = ext2_journal_commit1(jp)) == 0 && jp->j_active &&
+	    (error = ext2_journal_checkpoint1(jp, MNT_WAIT)) == 0) {
+		if (jp->j_running.tqh_first != NULL || jp->j_nrevoked != 0)
+			error = EBUSY;
+		else if ((error = ext2_journal_wsb(jp, 0, jp->j_tid)) == 0) {
+			ext2_journal_forgetall(jp);
+			jp->j_active = 0;
+		}
+	}
+	ext2_journal_unlock(jp);
+	return (error);
+}
+
+void
+ext2_journal_close(jp)
+	register struct ext2_journal *jp;
+{
+
+	ext2_journal_forgetall(jp);
+	if (jp->j_hashtbl != NULL)
+		bsd_free(jp->j_hashtbl, M_TEMP);
+	bsd_free(jp, M_UFSMNT);
+}
@@ -0,0 +1,171 @@
+/*
+ *	File:	ufs/ext2fs/ext2_journal.h
+ *
+ *	Metadata journal of an ext2 file system, kept in the on-disk
+ *	format of the ext3 journaling layer (JBD), see ext2_journal.c.
+ *	Users must include <ufs/ufs/inode.h> first.
+ */
+
+#ifndef _UFS_EXT2FS_EXT2_JOURNAL_H_
+#define	_UFS_EXT2FS_EXT2_JOURNAL_H_
+
+#include <sys/queue.h>
+
+/*
+ * On-disk structures.  Every field is big-endian.
+ */
+#define	JFS_MAGIC_NUMBER	0xc03b3998
+
+#define	JFS_DESCRIPTOR_BLOCK	1
+#define	JFS_COMMIT_BLOCK	2
+#define	JFS_SUPERBLOCK_V1	3
+#define	JFS_SUPERBLOCK_V2	4
+#define	JFS_REVOKE_BLOCK	5
+
+struct journal_header {
+	u_int32_t h_magic;
+	u_int32_t h_blocktype;
+	u_int32_t h_sequence;		/* transaction id */
+};
+
+/*
+ * A descriptor block holds one tag per block that follows it in the
+ * log; a tag without JFS_FLAG_SAME_UUID is followed by the uuid.
+ */
+struct journal_block_tag {
+	u_int32_t t_blocknr;		/* home of the logged block */
+	u_int32_t t_flags;
+};
+
+#define	JFS_FLAG_ESCAPE		1	/* block began with the magic */
+#define	JFS_FLAG_SAME_UUID	2	/* no uuid follows the tag */
+#define	JFS_FLAG_DELETED	4
+#define	JFS_FLAG_LAST_TAG	8	/* last tag of the descriptor */
+
+struct journal_revoke_header {
+	struct	journal_header r_header;
+	u_int32_t r_count;		/* bytes used, header included */
+};
+
+struct journal_superblock {
+	struct	journal_header s_header;
+	u_int32_t s_blocksize;
+	u_int32_t s_maxlen;		/* blocks in the journal file */
+	u_int32_t s_first;		/* first log block */
+	u_int32_t s_sequence;		/* first transaction in the log */
+	u_int32_t s_start;		/* its first block, 0 if clean */
+	u_int32_t s_errno;
+	/* JFS_SUPERBLOCK_V2 only */
+	u_int32_t s_feature_compat;
+	u_int32_t s_feature_incompat;
+	u_int32_t s_feature_ro_compat;
+	u_char	s_uuid[16];
+	u_int32_t s_nr_users;
+	u_int32_t s_dynsuper;
+	u_int32_t s_max_transaction;
+	u_int32_t s_max_trans_data;
+	u_int32_t s_padding[44];
+	u_char	s_users[16 * 48];
+};
+
+#define	JFS_FEATURE_INCOMPAT_REVOKE	0x00000001
+#define	JFS_KNOWN_INCOMPAT_FEATURES	JFS_FEATURE_INCOMPAT_REVOKE
+
+/*
+ * A metadata block logged since the tail of the journal, found by its
+ * home block number.  jb_vp and jb_lblkno name its buffer: a block of
+ * the device for bitmaps, group descriptors and inodes, a directory
+ * block otherwise.  While the block is dirty in the running transaction
+ * (JB_RUNNING, or JB_REDIRTY while it is being logged) the buffer
+ * carries B_LOCKED and is not written home.
+ */
+struct ext2_jblock {
+	LIST_ENTRY(ext2_jblock) jb_hash;	/* by jb_blocknr */
+	TAILQ_ENTRY(ext2_jblock) jb_list;	/* list of jb_state */
+	TAILQ_ENTRY(ext2_jblock) jb_rlist;	/* j_revoked */
+	struct	vnode *jb_vp;
+	daddr_t	jb_lblkno;
+	u_long	jb_blocknr;
+	u_int32_t jb_ctid;		/* latest committed copy, if JB_LOGGED */
+	short	jb_state;
+	short	jb_flags;
+};
+
+/* jb_state */
+#define	JB_RUNNING	1		/* dirty in the running transaction */
+#define	JB_COMMITTING	2		/* being logged */
+#define	JB_CHECKPOINT	3		/* committed, maybe not home yet */
+#define	JB_HOME		4		/* home, or freed, but still logged */
+
+/* jb_flags */
+#define	JB_LOGGED	0x01		/* a committed copy may be replayed */
+#define	JB_REDIRTY	0x02		/* dirtied again while being logged */
+#define	JB_FREED	0x04		/* freed while being logged */
+#define	JB_REVOKE	0x08		/* on j_revoked */
+#define	JB_REVOKING	0x10		/* revoke record being committed */
+
+/*
+ * A committed transaction still between the tail and the head.
+ */
+struct ext2_jtrans {
+	TAILQ_ENTRY(ext2_jtrans) jt_list;
+	u_int32_t jt_tid;
+	u_long	jt_start;		/* its first log block */
+};
+
+/*
+ * The block bitmap of a group as of the last commit, kept from the
+ * first block freed in the group after it until the freeing commits.
+ * A block set in either this or the bitmap itself is not allocated,
+ * so a block freed in the log is not written over before recovery
+ * would stop treating it as its old owner's.
+ */
+struct ext2_jbitmap {
+	LIST_ENTRY(ext2_jbitmap) cb_list;
+	u_long	cb_group;
+	u_int32_t cb_tid;		/* latest transaction freeing in it */
+	caddr_t	cb_data;
+};
+
+TAILQ_HEAD(ext2_jblist, ext2_jblock);
+
+struct ext2_journal {
+	struct	vnode *j_devvp;
+	struct	ext2_sb_info *j_fs;	/* set once the fs is set up */
+	struct	dinode j_din;		/* the journal file */
+	u_long	j_bsize;
+	int	j_fsbtodb;
+	u_long	j_first, j_last;	/* the log is [j_first, j_last) */
+	u_long	j_tail;			/* s_start on disk */
+	u_int32_t j_tailtid;		/* s_sequence on disk */
+	u_long	j_head;			/* next log block to write */
+	u_int32_t j_tid;		/* running transaction */
+	int	j_maxtrans;		/* log blocks before a commit */
+	int	j_active;		/* mounted read-write, logging */
+	int	j_flags;
+	u_char	j_uuid[16];
+	struct	ext2_jblist j_running;	/* JB_RUNNING */
+	struct	ext2_jblist j_committing; /* JB_COMMITTING */
+	struct	ext2_jblist j_checkpoint; /* JB_CHECKPOINT */
+	struct	ext2_jblist j_home;	/* JB_HOME */
+	struct	ext2_jblist j_revoked;	/* revoked by j_tid */
+	int	j_nrunning, j_nrevoked;
+	TAILQ_HEAD(, ext2_jtrans) j_trans;
+	LIST_HEAD(, ext2_jbitmap) j_cbitmaps;
+	LIST_HEAD(ext2_jbhash, ext2_jblock) *j_hashtbl;
+	u_long	j_hash;
+};
+
+/* j_flags */
+#define	J_BUSY		0x01		/* commit or checkpoint running */
+#define	J_WANTED	0x02		/* someone waits for J_BUSY */
+#define	J_V2		0x04		/* version 2 super block */
+
+/* Transaction ids wrap. */
+#define	TID_LT(a, b)	((int32_t)((a) - (b)) < 0)
+
+/* The file system of mp logs its metadata. */
+#define	EXT2_JOURNALING(mp) \
+	(VFSTOUFS(mp)->um_journal != NULL && VFSTOUFS(mp)->um_journal->j_active)
+
+#endif /* !_UFS_EXT2FS_EXT2_JOURNAL_H_ */
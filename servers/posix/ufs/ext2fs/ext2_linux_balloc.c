@@ -53,6 +53,17 @@ unsigned long ext2_count_free (struct buffer_head *, unsigned int);
 
 #define in_range(b, first, len)		((b) >= (first) && (b) <= (first) + (len) - 1)
 
+/*
+ * Length of the free run ext2_new_block looks for first, and so of the
+ * blocks it reserves at once for a growing file: writers extending
+ * different files at the same time each get an extent of their own
+ * instead of interleaving their blocks.
+ */
+int	ext2_prealloc_window = 16;
+
+static int ext2_scanrun (char *, int, int, int, int *);
+static int ext2_runlen (char *, int, int, int, int);
+
 /* got rid of get_group_desc since it can already be found in 
  * ext2_linux_ialloc.c
  */
@@ -176,6 +187,7 @@ void ext2_free_blocks (struct mount * mp, unsigned long block,
 	int bitmap_nr;
 	struct ext2_group_desc * gdp;
 	struct ext2_super_block * es = sb->s_es;
+	struct ext2_gsum * gs;
 
 	if (!sb) {
 		printf ("ext2_free_blocks: nonexistent device");
@@ -217,6 +229,7 @@ void ext2_free_blocks (struct mount * mp, unsigned long block,
 			    "Block = %lu, count = %lu",
 			    block, count);
 
+	ext2_journal_bfree(mp, block_group, bh->b_data);
 	for (i = 0; i < count; i++) {
 		if (!clear_bit (bit + i, bh->b_data))
 			printf ("ext2_free_blocks: "
@@ -228,8 +241,21 @@ void ext2_free_blocks (struct mount * mp, unsigned long block,
 		}
 	}
 
-	mark_buffer_dirty(bh2);
-	mark_buffer_dirty(bh, 1);
+	/*
+	 * The freed blocks may join free runs on either side into one
+	 * longer than gs_bmaxrun; if so, make it a guess again.
+	 */
+	gs = &sb->s_gsum[block_group];
+	if (bit < gs->gs_bfirst)
+		gs->gs_bfirst = bit;
+	if (gs->gs_bmaxrun < EXT2_BLOCKS_PER_GROUP(sb) &&
+	    ext2_runlen (bh->b_data, bit, count, EXT2_BLOCKS_PER_GROUP(sb),
+			 gs->gs_bmaxrun) > gs->gs_bmaxrun)
+		gs->gs_bmaxrun = EXT2_BLOCKS_PER_GROUP(sb);
+
+	mark_buffer_dirty(mp, bh2);
+	mark_buffer_dirty(mp, bh);
+	ext2_journal_revoke(mp, block, count);
 /****
 	if (sb->s_flags & MS_SYNCHRONOUS) {
 		ll_rw_block (WRITE, 1, &bh);
@@ -244,9 +270,13 @@ void ext2_free_blocks (struct mount * mp, unsigned long block,
 /*
  * ext2_new_block uses a goal block to assist allocation.  If the goal is
  * free, or there is a free block within 32 blocks of the goal, that block
- * is allocated.  Otherwise a forward search is made for a free block; within 
- * each block group the search first looks for an entire free byte in the block
- * bitmap, and then for any free bit if that fails.
+ * is allocated.  Otherwise a forward search is made for a free block; the
+ * rest of the goal's group is searched first for a free run of
+ * ext2_prealloc_window blocks, then for any free bit.  Failing that, the
+ * other groups are searched for such a run, passing over those whose
+ * summary shows they have none, and only then for any free bit.
+ * With a journal, a block freed by a transaction that has not committed
+ * is passed over; 0 is returned if no other block is found.
  */
 int ext2_new_block (struct mount * mp, unsigned long goal,
 		    u32 * prealloc_count,
@@ -255,11 +285,12 @@ int ext2_new_block (struct mount * mp, unsigned long goal,
 	struct ext2_sb_info *sb = VFSTOUFS(mp)->um_e2fs;
 	struct buffer_head * bh;
 	struct buffer_head * bh2;
-	char * p, * r;
-	int i, j, k, tmp;
+	int i, j, k, tmp, maxrun, busy;
 	int bitmap_nr;
 	struct ext2_group_desc * gdp;
 	struct ext2_super_block * es = sb->s_es;
+	struct ext2_gsum * gs;
+	char * cmap;
 
 #ifdef EXT2FS_DEBUG
 	static int goal_hits = 0, goal_attempts = 0;
@@ -272,6 +303,7 @@ int ext2_new_block (struct mount * mp, unsigned long goal,
 
         ext2_debug ("goal=%lu.\n", goal);
 
+	busy = 0;
 repeat:
 	/*
 	 * First, test whether the goal block is free.
@@ -318,19 +350,21 @@ repeat:
 		/*
 		 * There has been no free block found in the near vicinity
 		 * of the goal: do a search forward through the block groups,
-		 * searching in each group first for an entire free byte in
-		 * the bitmap and then for any free bit.
+		 * searching in each group first for a free run of
+		 * ext2_prealloc_window blocks and then for any free bit.
 		 * 
 		 * Search first in the remainder of the current group; then,
 		 * cyclicly search through the rest of the groups.
 		 */
-		p = ((char *) bh->b_data) + (j >> 3);
-		r = memscan(p, 0, (EXT2_BLOCKS_PER_GROUP(sb) - j + 7) >> 3);
-		k = (r - ((char *) bh->b_data)) << 3;
-		if (k < EXT2_BLOCKS_PER_GROUP(sb)) {
+		gs = &sb->s_gsum[i];
+		k = ext2_scanrun (bh->b_data, j, EXT2_BLOCKS_PER_GROUP(sb),
+				  ext2_prealloc_window, &maxrun);
+		if (k >= 0) {
 			j = k;
 			goto search_back;
 		}
+		if (j <= gs->gs_bfirst)
+			gs->gs_bmaxrun = maxrun;
 		k = find_next_zero_bit ((unsigned long *) bh->b_data, 
 					EXT2_BLOCKS_PER_GROUP(sb),
 					j);
@@ -343,8 +377,33 @@ repeat:
 	ext2_debug ("Bit not found in block group %d.\n", i); 
 
 	/*
-	 * Now search the rest of the groups.  We assume that 
-	 * i and gdp correctly point to the last group visited.
+	 * Now search the rest of the groups for a free run.  We assume
+	 * that i and gdp correctly point to the last group visited.  As no
+	 * block below gs_bfirst is free, a failed scan from there tells
+	 * the longest run in the group, and the group is not read again
+	 * for a run until blocks are freed in it.
+	 */
+	for (k = 0; k < sb->s_groups_count; k++) {
+		i++;
+		if (i >= sb->s_groups_count)
+			i = 0;
+		gdp = get_group_desc (mp, i, &bh2);
+		gs = &sb->s_gsum[i];
+		if (gdp->bg_free_blocks_count < ext2_prealloc_window ||
+		    gs->gs_bmaxrun < ext2_prealloc_window)
+			continue;
+		bitmap_nr = load_block_bitmap (mp, i);
+		bh = sb->s_block_bitmap[bitmap_nr];
+		j = ext2_scanrun (bh->b_data, gs->gs_bfirst,
+				  EXT2_BLOCKS_PER_GROUP(sb),
+				  ext2_prealloc_window, &maxrun);
+		if (j >= 0)
+			goto got_block;
+		gs->gs_bmaxrun = maxrun;
+	}
+
+	/*
+	 * No group has a run that long: take any free block.
 	 */
 	for (k = 0; k < sb->s_groups_count; k++) {
 		i++;
@@ -360,14 +419,9 @@ repeat:
 	}
 	bitmap_nr = load_block_bitmap (mp, i);
 	bh = sb->s_block_bitmap[bitmap_nr];
-	r = memscan(bh->b_data, 0, EXT2_BLOCKS_PER_GROUP(sb) >> 3);
-	j = (r - bh->b_data) << 3;
-
-	if (j < EXT2_BLOCKS_PER_GROUP(sb))
-		goto search_back;
-	else
-		j = find_first_zero_bit ((unsigned long *) bh->b_data,
-					 EXT2_BLOCKS_PER_GROUP(sb));
+	j = find_next_zero_bit ((unsigned long *) bh->b_data,
+				EXT2_BLOCKS_PER_GROUP(sb),
+				sb->s_gsum[i].gs_bfirst);
 	if (j >= EXT2_BLOCKS_PER_GROUP(sb)) {
 		printf ( "ext2_new_block: "
 			 "Free blocks count corrupted for block group %d", i);
@@ -377,7 +431,7 @@ repeat:
 
 search_back:
 	/* 
-	 * We have succeeded in finding a free byte in the block
+	 * We have succeeded in finding free blocks in the block
 	 * bitmap.  Now search backwards up to 7 bits to find the
 	 * start of this group of free blocks.
 	 */
@@ -385,6 +439,28 @@ search_back:
 	
 got_block:
 
+	/*
+	 * A block freed since the last commit is still its old owner's to
+	 * recovery; take the next one free in the committed bitmap too,
+	 * or go on to the next group.
+	 */
+	cmap = ext2_journal_cbitmap (mp, i);
+	if (cmap != NULL && test_bit (j, cmap)) {
+		for (k = j + 1; k < EXT2_BLOCKS_PER_GROUP(sb); k++)
+			if (!test_bit (k, bh->b_data) && !test_bit (k, cmap))
+				break;
+		if (k >= EXT2_BLOCKS_PER_GROUP(sb)) {
+			if (++busy >= sb->s_groups_count) {
+				unlock_super (VFSTOUFS(mp)->um_devvp);
+				return 0;
+			}
+			goal = (i + 1) * EXT2_BLOCKS_PER_GROUP(sb) +
+			       es->s_first_data_block;
+			goto repeat;
+		}
+		j = k;
+	}
+
 	ext2_debug ("using block group %d(%d)\n", i, gdp->bg_free_blocks_count);
 
 	tmp = j + i * EXT2_BLOCKS_PER_GROUP(sb) + es->s_first_data_block;
@@ -412,9 +488,10 @@ got_block:
 	if (prealloc_block) {
 		*prealloc_count = 0;
 		*prealloc_block = tmp + 1;
-		for (k = 1;
-		     k < 8 && (j + k) < EXT2_BLOCKS_PER_GROUP(sb); k++) {
-			if (set_bit (j + k, bh->b_data))
+		for (k = 1; k < ext2_prealloc_window &&
+		     (j + k) < EXT2_BLOCKS_PER_GROUP(sb); k++) {
+			if ((cmap != NULL && test_bit (j + k, cmap)) ||
+			    set_bit (j + k, bh->b_data))
 				break;
 			(*prealloc_count)++;
 		}	
@@ -425,9 +502,15 @@ got_block:
 	}
 #endif
 
+	gs = &sb->s_gsum[i];
+	if (j <= gs->gs_bfirst)
+		gs->gs_bfirst = find_next_zero_bit ((unsigned long *) bh->b_data,
+						    EXT2_BLOCKS_PER_GROUP(sb),
+						    j + 1);
+
 	j = tmp;
 
-	mark_buffer_dirty(bh);
+	mark_buffer_dirty(mp, bh);
 /****
 	if (sb->s_flags & MS_SYNCHRONOUS) {
 		ll_rw_block (WRITE, 1, &bh);
@@ -446,13 +529,83 @@ got_block:
 		    "Goal hits %d of %d.\n", j, goal_hits, goal_attempts);
 
 	gdp->bg_free_blocks_count--;
-	mark_buffer_dirty(bh2, 1);
+	mark_buffer_dirty(mp, bh2);
 	es->s_free_blocks_count--;
 	sb->s_dirt = 1;
 	unlock_super (VFSTOUFS(mp)->um_devvp);
 	return j;
 }
 
+/*
+ * Search bits start up to size of a bitmap for a run of want clear
+ * ones, and return where it begins, or -1 with the longest run seen
+ * in *maxrunp.  Whole words that are all set or all clear are passed
+ * over at once; on a nearly full or nearly empty group they are most
+ * of the map.
+ */
+static int ext2_scanrun (char * map, int start, int size, int want,
+			 int * maxrunp)
+{
+	const int bpl = sizeof (unsigned long) * 8;
+	unsigned long w;
+	int bit, run, runstart, maxrun;
+
+	run = maxrun = 0;
+	runstart = bit = start;
+	while (bit < size) {
+		if ((bit & (bpl - 1)) == 0 && bit + bpl <= size) {
+			w = ((unsigned long *) map)[bit / bpl];
+			if (w == ~0UL) {
+				if (run > maxrun)
+					maxrun = run;
+				run = 0;
+				bit += bpl;
+				continue;
+			}
+			if (w == 0) {
+				if (run == 0)
+					runstart = bit;
+				run += bpl;
+				bit += bpl;
+				if (run >= want)
+					return runstart;
+				continue;
+			}
+		}
+		if (test_bit (bit, map)) {
+			if (run > maxrun)
+				maxrun = run;
+			run = 0;
+		} else {
+			if (run++ == 0)
+				runstart = bit;
+			if (run >= want)
+				return runstart;
+		}
+		bit++;
+	}
+	if (run > maxrun)
+		maxrun = run;
+	*maxrunp = maxrun;
+	return -1;
+}
+
+/*
+ * Length of the free run holding the count bits from bit on, counted
+ * only until it passes limit.
+ */
+static int ext2_runlen (char * map, int bit, int count, int size, int limit)
+{
+	int j, run = count;
+
+	for (j = bit; j > 0 && run <= limit && !test_bit (j - 1, map); j--)
+		run++;
+	for (j = bit + count; j < size && run <= limit && !test_bit (j, map);
+	     j++)
+		run++;
+	return run;
+}
+
 unsigned long ext2_count_free_blocks (struct mount * mp)
 {
 	struct ext2_sb_info *sb = VFSTOUFS(mp)->um_e2fs;
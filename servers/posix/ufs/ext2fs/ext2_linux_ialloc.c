@@ -40,6 +40,7 @@
 #include <ufs/ext2fs/ext2_fs.h>
 #include <ufs/ext2fs/ext2_fs_sb.h>
 #include <ufs/ext2fs/fs.h>
+#include <ufs/ext2fs/ext2_extern.h>
 #include <sys/stat.h>
 
 #if defined(i386) || defined(__i386__)
@@ -50,12 +51,14 @@
 #include <ufs/ext2fs/generic-bitops.h>
 #endif
 
-/* this is supposed to mark a buffer dirty on ready for delayed writing
+/* this is supposed to mark a buffer dirty on ready for delayed writing;
+ * with a journal the change also joins the running transaction
  */
-void mark_buffer_dirty(struct buf *bh)
+void mark_buffer_dirty(struct mount *mp, struct buf *bh)
 {
 	bh->b_flags |= B_DELWRI;
 	bh->b_flags &= ~(B_READ | B_ERROR);
+	ext2_journal_dirty(mp, bh);
 } 
 
 /* 
@@ -238,10 +241,12 @@ void ext2_free_inode (struct inode * inode)
 		gdp->bg_free_inodes_count++;
 		if (S_ISDIR(inode->i_mode)) 
 			gdp->bg_used_dirs_count--;
-		mark_buffer_dirty(bh2);
+		mark_buffer_dirty(ITOV(inode)->v_mount, bh2);
 		es->s_free_inodes_count++;
+		if (bit < sb->s_gsum[block_group].gs_ifirst)
+			sb->s_gsum[block_group].gs_ifirst = bit;
 	}
-	mark_buffer_dirty(bh);
+	mark_buffer_dirty(ITOV(inode)->v_mount, bh);
 /*** XXX
 	if (sb->s_flags & MS_SYNCHRONOUS) {
 		ll_rw_block (WRITE, 1, &bh);
@@ -402,14 +407,17 @@ repeat:
 	}
 	bitmap_nr = load_inode_bitmap (ITOV(dir)->v_mount, i);
 	bh = sb->s_inode_bitmap[bitmap_nr];
-	if ((j = find_first_zero_bit ((unsigned long *) bh->b_data,
-				      EXT2_INODES_PER_GROUP(sb))) <
+	/* no inode below gs_ifirst is free */
+	if ((j = find_next_zero_bit ((unsigned long *) bh->b_data,
+				     EXT2_INODES_PER_GROUP(sb),
+				     sb->s_gsum[i].gs_ifirst)) <
 	    EXT2_INODES_PER_GROUP(sb)) {
 		if (set_bit (j, bh->b_data)) {
 			printf ( "ext2_new_inode:"
 				      "bit already set for inode %d", j);
 			goto repeat;
 		}
+		sb->s_gsum[i].gs_ifirst = j + 1;
 /* Linux now does the following:
 		mark_buffer_dirty(bh, 1);
 		if (sb->s_flags & MS_SYNCHRONOUS) {
@@ -417,7 +425,7 @@ repeat:
 			wait_on_buffer (bh);
 		}
 */
-		mark_buffer_dirty(bh);
+		mark_buffer_dirty(ITOV(dir)->v_mount, bh);
 	} else {
 		if (gdp->bg_free_inodes_count != 0) {
 			printf ( "ext2_new_inode:"
@@ -439,7 +447,7 @@ repeat:
 	gdp->bg_free_inodes_count--;
 	if (S_ISDIR(mode))
 		gdp->bg_used_dirs_count++;
-	mark_buffer_dirty(bh2);
+	mark_buffer_dirty(ITOV(dir)->v_mount, bh2);
 	es->s_free_inodes_count--;
 	/* mark_buffer_dirty(sb->u.ext2_sb.s_sbh, 1); */
 	sb->s_dirt = 1;
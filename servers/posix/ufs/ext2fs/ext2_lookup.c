@@ -879,7 +879,7 @@ ext2_direnter(ip, dvp, cnp)
 		ep = (struct ext2_dir_entry *)((char *)ep + dsize);
 	}
 	memcpy((caddr_t)ep, (caddr_t)&newdir, (u_int)newentrysize);
-	error = VOP_BWRITE(bp);
+	error = ext2_journal_bwrite(bp);
 	dp->i_flag |= IN_CHANGE | IN_UPDATE;
 	if (!error && dp->i_endoff && dp->i_endoff < dp->i_size)
 		error = VOP_TRUNCATE(dvp, (off_t)dp->i_endoff, IO_SYNC,
@@ -919,7 +919,7 @@ ext2_dirremove(dvp, cnp)
 		    VOP_BLKATOFF(dvp, (off_t)dp->i_offset, (char **)&ep, &bp))
 			return (error);
 		ep->inode = 0;
-		error = VOP_BWRITE(bp);
+		error = ext2_journal_bwrite(bp);
 		dp->i_flag |= IN_CHANGE | IN_UPDATE;
 		return (error);
 	}
@@ -930,7 +930,7 @@ ext2_dirremove(dvp, cnp)
 	    (char **)&ep, &bp))
 		return (error);
 	ep->rec_len += dp->i_reclen;
-	error = VOP_BWRITE(bp);
+	error = ext2_journal_bwrite(bp);
 	dp->i_flag |= IN_CHANGE | IN_UPDATE;
 	return (error);
 }
@@ -953,7 +953,7 @@ ext2_dirrewrite(dp, ip, cnp)
 	if (error = VOP_BLKATOFF(vdp, (off_t)dp->i_offset, (char **)&ep, &bp))
 		return (error);
 	ep->inode = ip->i_number;
-	error = VOP_BWRITE(bp);
+	error = ext2_journal_bwrite(bp);
 	dp->i_flag |= IN_CHANGE | IN_UPDATE;
 	return (error);
 }
@@ -283,6 +283,8 @@ WRITE(ap)
 		struct timeval time;
 		get_time(&time);
 		error = VOP_UPDATE(vp, &time, &time, 1);
+		if (error == 0)
+			error = ext2_journal_commit(vp->v_mount);
 	}
 	return (error);
 }
@@ -68,6 +68,7 @@
 #include <ufs/ext2fs/ext2_extern.h>
 #include <ufs/ext2fs/ext2_fs.h>
 #include <ufs/ext2fs/ext2_fs_sb.h>
+#include <ufs/ext2fs/ext2_journal.h>
 
 int ext2_sbupdate (struct ufsmount *, int);
 
@@ -178,14 +179,25 @@ ext2_mount(mp, path, data, ndp, p)
 			if (vfs_busy(mp))
 				return (EBUSY);
 			error = ext2_flushfiles(mp, flags, p);
+			if (!error && ump->um_journal != NULL &&
+			    (error = ext2_journal_stop(ump->um_journal)) == 0)
+				fs->s_es->s_feature_incompat &=
+				    ~EXT2_FEATURE_INCOMPAT_RECOVER;
 			vfs_unbusy(mp);
 		}
 		if (!error && (mp->mnt_flag & MNT_RELOAD))
 			error = ext2_reload(mp, ndp->ni_cnd.cn_cred, p);
 		if (error)
 			return (error);
-		if (fs->s_rd_only && (mp->mnt_flag & MNT_WANTRDWR))
+		if (fs->s_rd_only && (mp->mnt_flag & MNT_WANTRDWR)) {
+			if (ump->um_journal != NULL &&
+			    (error = ext2_journal_start(ump->um_journal)))
+				return (error);
+			if (EXT2_JOURNALING(mp))
+				fs->s_es->s_feature_incompat |=
+				    EXT2_FEATURE_INCOMPAT_RECOVER;
 			fs->s_rd_only = 0;
+		}
 		if (fs->s_rd_only == 0) {
 			/* don't say it's clean */
 			fs->s_es->s_state &= ~EXT2_VALID_FS;
@@ -387,6 +399,15 @@ static int compute_sb_data(devvp, es, fs)
     }
     fs->s_loaded_inode_bitmaps = 0;
     fs->s_loaded_block_bitmaps = 0;
+
+    /* start out believing every group may hold a free run of any length */
+    fs->s_gsum = bsd_malloc(fs->s_groups_count * sizeof (struct ext2_gsum),
+		M_UFSMNT, M_WAITOK);
+    for (i = 0; i < fs->s_groups_count; i++) {
+	    fs->s_gsum[i].gs_bfirst = 0;
+	    fs->s_gsum[i].gs_ifirst = 0;
+	    fs->s_gsum[i].gs_bmaxrun = EXT2_BLOCKS_PER_GROUP(fs);
+    }
     return 0;
 }
 
@@ -443,6 +464,7 @@ ext2_reload(mountp, cred, p)
 	}
 	fs = VFSTOUFS(mountp)->um_e2fs;
 	memcpy(fs->s_es, bp->b_data, sizeof(struct ext2_super_block));
+	bsd_free(fs->s_gsum, M_UFSMNT);
 
 	if(error = compute_sb_data(devvp, es, fs)) {
 		brelse(bp);
@@ -505,6 +527,7 @@ ext2_mountfs(devvp, mp, p)
 	struct buf *bp;
 	register struct ext2_sb_info *fs;
 	struct ext2_super_block * es;
+	struct ext2_group_desc *gdp;
 	dev_t dev = devvp->v_rdev;
 	struct partinfo dpart;
 	caddr_t base;
@@ -567,12 +590,17 @@ ext2_mountfs(devvp, mp, p)
 	ump->um_e2fs->s_es = bsd_malloc(sizeof(struct ext2_super_block), 
 		M_UFSMNT, M_WAITOK);
 	memcpy(ump->um_e2fs->s_es, es, (u_int)sizeof(struct ext2_super_block));
-	if(error = compute_sb_data(devvp, ump->um_e2fs->s_es, ump->um_e2fs)) {
-		brelse(bp);
-		return error;
-	}
 	brelse(bp);
 	bp = NULL;
+	/*
+	 * Replay the journal, if there is one, before the rest of the
+	 * metadata is read in.
+	 */
+	if (error = ext2_journal_open(devvp, ump->um_e2fs->s_es, ronly,
+	    &ump->um_journal))
+		goto out;
+	if(error = compute_sb_data(devvp, ump->um_e2fs->s_es, ump->um_e2fs))
+		goto out;
 	fs = ump->um_e2fs;
 	fs->s_rd_only = ronly;	/* ronly is set according to mnt_flags */
 	if (!(fs->s_es->s_state & EXT2_VALID_FS)) {
@@ -602,6 +630,30 @@ ext2_mountfs(devvp, mp, p)
 	ump->um_seqinc = EXT2_FRAGS_PER_BLOCK(fs);
 	for (i = 0; i < MAXQUOTAS; i++)
 		ump->um_quotas[i] = NULLVP; 
+	if (ump->um_journal != NULL) {
+		ump->um_journal->j_fs = fs;
+		/*
+		 * The super block is not logged: take its free counts
+		 * from the group descriptors, which are.
+		 */
+		es = fs->s_es;
+		es->s_free_blocks_count = es->s_free_inodes_count = 0;
+		for (i = 0; i < fs->s_groups_count; i++) {
+			gdp = (struct ext2_group_desc *)fs->s_group_desc[i /
+			    EXT2_DESC_PER_BLOCK(fs)]->b_data +
+			    i % EXT2_DESC_PER_BLOCK(fs);
+			es->s_free_blocks_count += gdp->bg_free_blocks_count;
+			es->s_free_inodes_count += gdp->bg_free_inodes_count;
+		}
+		if (ronly == 0) {
+			if (error = ext2_journal_start(ump->um_journal))
+				printf("EXT2-fs: cannot start journal (%d)\n",
+				    error);
+			if (EXT2_JOURNALING(mp))
+				es->s_feature_incompat |=
+				    EXT2_FEATURE_INCOMPAT_RECOVER;
+		}
+	}
 		devvp->v_specflags |= SI_MOUNTEDON; 
 		if (ronly == 0) 
 			ext2_sbupdate(ump, MNT_WAIT);
@@ -611,6 +663,8 @@ out:
 		brelse(bp);
 	(void)VOP_CLOSE(devvp, ronly ? FREAD : FREAD|FWRITE, NOCRED, p);
 	if (ump) {
+		if (ump->um_journal != NULL)
+			ext2_journal_close(ump->um_journal);
 		bsd_free(ump->um_fs, M_UFSMNT);
 		bsd_free(ump, M_UFSMNT);
 		mp->mnt_data = (qaddr_t)0;
@@ -642,6 +696,11 @@ ext2_unmount(mp, mntflags, p)
 	ump = VFSTOUFS(mp);
 	fs = ump->um_e2fs;
 	ronly = fs->s_rd_only;
+	if (ump->um_journal != NULL && ump->um_journal->j_active) {
+		if (error = ext2_journal_stop(ump->um_journal))
+			return (error);
+		fs->s_es->s_feature_incompat &= ~EXT2_FEATURE_INCOMPAT_RECOVER;
+	}
 	if (!ronly) {
 		fs->s_es->s_state |= EXT2_VALID_FS;	/* was fs_clean = 1 */
 		ext2_sbupdate(ump, MNT_WAIT);
@@ -661,6 +720,9 @@ ext2_unmount(mp, mntflags, p)
 	error = VOP_CLOSE(ump->um_devvp, ronly ? FREAD : FREAD|FWRITE,
 		NOCRED, p);
 	vrele(ump->um_devvp);
+	if (ump->um_journal != NULL)
+		ext2_journal_close(ump->um_journal);
+	bsd_free(fs->s_gsum, M_UFSMNT);
 	bsd_free(fs->s_es, M_UFSMNT);
 	bsd_free(fs, M_UFSMNT);
 	bsd_free(ump, M_UFSMNT);
@@ -820,8 +882,14 @@ loop:
 	}
 	/*
 	 * Force stale file system control information to be flushed.
+	 * With a journal, commit what was logged above and write home
+	 * what is committed; nothing else of the device is dirty.
 	 */
-	if (error = VOP_FSYNC(ump->um_devvp, cred, waitfor, p))
+	if (EXT2_JOURNALING(mp)) {
+		if ((error = ext2_journal_commit(mp)) ||
+		    (error = ext2_journal_checkpoint(mp, waitfor)))
+			allerror = error;
+	} else if (error = VOP_FSYNC(ump->um_devvp, cred, waitfor, p))
 		allerror = error;
 #if QUOTA
 	qsync(mp);
@@ -1030,18 +1098,24 @@ printf("\nupdating superblock, waitfor=%s\n", waitfor == MNT_WAIT ? "yes":"no");
 		bawrite(bp);
 
 	/* write group descriptors back on disk */
-	for(i = 0; i < fs->s_db_per_group; i++) 
+	for(i = 0; i < fs->s_db_per_group; i++) {
 		/* Godmar thinks: we must avoid using any of the b*write
 		 * functions here: we want to keep the buffer locked
 		 * so we use my 'housemade' write routine:
 		 */
+		/* B_LOCKED: logged, it goes home after the commit */
+		if (fs->s_group_desc[i]->b_flags & B_LOCKED)
+			continue;
 		error |= ll_w_block(fs->s_group_desc[i], waitfor == MNT_WAIT);
+	}
 
         for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
-                if (fs->s_inode_bitmap[i])
+                if (fs->s_inode_bitmap[i] &&
+		    (fs->s_inode_bitmap[i]->b_flags & B_LOCKED) == 0)
                         ll_w_block (fs->s_inode_bitmap[i], 1);
         for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
-                if (fs->s_block_bitmap[i])
+                if (fs->s_block_bitmap[i] &&
+		    (fs->s_block_bitmap[i]->b_flags & B_LOCKED) == 0)
                         ll_w_block (fs->s_block_bitmap[i], 1);
 
 	return (error);
@@ -64,12 +64,14 @@
 #include <ufs/ufs/quota.h>
 #include <ufs/ufs/inode.h>
 #include <ufs/ufs/dir.h>
+#include <ufs/ufs/ufsmount.h>
 #include <ufs/ufs/ufs_extern.h>
 
 #include <ufs/ext2fs/ext2_fs.h>
 #include <ufs/ext2fs/ext2_fs_sb.h>
 #include <ufs/ext2fs/fs.h>
 #include <ufs/ext2fs/ext2_extern.h>
+#include <ufs/ext2fs/ext2_journal.h>
 
 /* Global vfs data structures for ufs. */
 int (**ext2_vnodeop_p)();
@@ -258,7 +260,7 @@ ext2_fsync(ap)
 	register struct buf *bp;
 	struct timeval tv;
 	struct buf *nbp;
-	int s;
+	int s, error, committed = 0;
 
 	/* 
 	 * Clean memory object.
@@ -276,7 +278,8 @@ loop:
 	s = splbio();
 	for (bp = vp->v_dirtyblkhd.lh_first; bp; bp = nbp) {
 		nbp = bp->b_vnbufs.le_next;
-		if ((bp->b_flags & B_BUSY))
+		/* B_LOCKED: logged, and not to go home before the commit. */
+		if ((bp->b_flags & (B_BUSY | B_LOCKED)))
 			continue;
 		if ((bp->b_flags & B_DELWRI) == 0)
 			panic("ext2_fsync: not dirty");
@@ -299,7 +302,8 @@ loop:
 			sleep((caddr_t)&vp->v_numoutput, PRIBIO + 1);
 		}
 #if DIAGNOSTIC
-		if (vp->v_dirtyblkhd.lh_first) {
+		if (vp->v_dirtyblkhd.lh_first &&
+		    !EXT2_JOURNALING(vp->v_mount)) {
 			vprint("ext2_fsync: dirty", vp);
 			goto loop;
 		}
@@ -307,5 +311,16 @@ loop:
 	}
 	splx(s);
 	get_time(&tv);
-	return (VOP_UPDATE(ap->a_vp, &tv, &tv, ap->a_waitfor == MNT_WAIT));
+	error = VOP_UPDATE(ap->a_vp, &tv, &tv, ap->a_waitfor == MNT_WAIT);
+	if (error || ap->a_waitfor != MNT_WAIT || committed ||
+	    !EXT2_JOURNALING(vp->v_mount))
+		return (error);
+	/*
+	 * Commit what was logged for the file.  Its directory blocks may
+	 * then go home, and vinvalbuf expects none of them left dirty.
+	 */
+	if (error = ext2_journal_commit(vp->v_mount))
+		return (error);
+	committed = 1;
+	goto loop;
 }
@@ -40,32 +40,30 @@ static inline unsigned long ffz(unsigned long word) {
     return sizeof(unsigned long) * 8;
 }
 
-static inline int find_first_zero_bit(void *addr, unsigned size) {
-    unsigned long *p = (unsigned long *)addr;
-    unsigned bits = size;
-    unsigned index = 0;
-    while (bits >= sizeof(unsigned long) * 8) {
-        if (~(*p))
-            return index + ffz(*p);
-        p++;
-        index += sizeof(unsigned long) * 8;
-        bits -= sizeof(unsigned long) * 8;
-    }
-    if (bits) {
-        unsigned long last = *p | (~0UL << bits);
-        if (~last)
-            return index + ffz(last);
-        index += bits;
-    }
-    return index;
-}
-
+/*
+ * The searches use the byte layout of test_bit and set_bit, bit nr in
+ * byte nr / 8, so that they agree on hosts of either byte order.
+ */
 static inline int find_next_zero_bit(void *addr, int size, int offset) {
-    for (int bit = offset; bit < size; bit++) {
+    unsigned char *p = (unsigned char *)addr;
+    int bit = offset;
+
+    /* bit by bit up to a byte boundary, then a byte at a time */
+    for (; bit < size && (bit & 7); bit++) {
+        if (!test_bit(bit, addr))
+            return bit;
+    }
+    while (bit + 8 <= size && p[bit >> 3] == 0xff)
+        bit += 8;
+    for (; bit < size; bit++) {
         if (!test_bit(bit, addr))
             return bit;
     }
     return size;
 }
 
+static inline int find_first_zero_bit(void *addr, unsigned size) {
+    return find_next_zero_bit(addr, (int)size, 0);
+}
+
 #endif /* _GENERIC_BITOPS_H */
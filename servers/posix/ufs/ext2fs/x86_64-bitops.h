@@ -70,13 +70,24 @@ static inline int find_first_zero_bit(void *addr, unsigned size)
 
 static inline int find_next_zero_bit(void *addr, int size, int offset)
 {
-    int bit = offset;
-    while (bit < size) {
-        if (!test_bit(bit, addr))
-            return bit;
-        bit++;
+    unsigned long *p = (unsigned long *)addr + (offset >> 6);
+    int res;
+
+    if (offset >= size)
+        return size;
+    if (offset & 63) {
+        /* treat the bits below offset in its word as set */
+        unsigned long word = *p | ((1UL << (offset & 63)) - 1);
+        if (word != ~0UL) {
+            res = (offset & ~63) + ffz(word);
+            return res < size ? res : size;
+        }
+        p++;
+        offset = (offset & ~63) + 64;
+        if (offset >= size)
+            return size;
     }
-    return size;
+    return offset + find_first_zero_bit(p, size - offset);
 }
 
 static inline char *memscan(void *addr, unsigned char c, int size)
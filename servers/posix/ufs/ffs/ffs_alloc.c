@@ -49,6 +49,7 @@
 
 #include <ufs/ufs/quota.h>
 #include <ufs/ufs/inode.h>
+#include <ufs/ufs/ufsmount.h>
 
 #include <ufs/ffs/fs.h>
 #include <ufs/ffs/ffs_extern.h>
@@ -65,6 +66,9 @@ static u_long	ffs_hashalloc
 		    (struct inode *, int, long, int, u_long (*)());
 static ino_t	ffs_nodealloccg (struct inode *, int, daddr_t, int);
 static daddr_t	ffs_mapsearch (struct fs *, struct cg *, daddr_t, int);
+static void	ffs_cgsumupdate (struct fs *, struct cg *);
+static int	ffs_scanfree (u_char *, int, int, u_char *, int);
+static int	ffs_scanused (u_char *, int, int);
 
 /*
  * Allocate a block in the file system.
@@ -94,7 +98,8 @@ ffs_alloc(ip, lbn, bpref, size, cred, bnp)
 {
 	register struct fs *fs;
 	daddr_t bno;
-	int cg, error;
+	long delayed;
+	int cg, error, retried = 0;
 	
 	*bnp = 0;
 	fs = ip->i_fs;
@@ -107,9 +112,15 @@ ffs_alloc(ip, lbn, bpref, size, cred, bnp)
 	if (cred == NOCRED)
 		panic("ffs_alloc: missing credential\n");
 #endif /* DIAGNOSTIC */
-	if (size == fs->fs_bsize && fs->fs_cstotal.cs_nbfree == 0)
+retry:
+	/*
+	 * Blocks reserved for delayed allocation are spoken for.
+	 */
+	delayed = VFSTOUFS(ITOV(ip)->v_mount)->um_delayed;
+	if (size == fs->fs_bsize && fs->fs_cstotal.cs_nbfree <= delayed)
 		goto nospace;
-	if (cred->cr_uid != 0 && freespace(fs, fs->fs_minfree) <= 0)
+	if (cred->cr_uid != 0 &&
+	    freespace(fs, fs->fs_minfree) - blkstofrags(fs, delayed) <= 0)
 		goto nospace;
 #if QUOTA
 	if (error = chkdq(ip, (long)btodb(size), cred, 0))
@@ -136,11 +147,63 @@ ffs_alloc(ip, lbn, bpref, size, cred, bnp)
 	(void) chkdq(ip, (long)-btodb(size), cred, FORCE);
 #endif
 nospace:
+	/*
+	 * Removed files whose blocks are held for ordered writes may
+	 * free enough; let them go and try once more.
+	 */
+	if (!retried && DOINGSOFTDEP(ITOV(ip)) &&
+	    softdep_process_worklist(ITOV(ip)->v_mount)) {
+		retried = 1;
+		goto retry;
+	}
 	ffs_fserr(fs, cred->cr_uid, "file system full");
 	uprintf("\n%s: write failed, file system is full\n", fs->fs_fsmnt);
 	return (ENOSPC);
 }
 
+/*
+ * Assign disk blocks to up to len blocks of a delayed extent, see
+ * ffs_balloc, as one contiguous run starting near bpref.  Space and
+ * quota were charged when the blocks were reserved, so neither is
+ * checked here.  Returns the number of blocks in the run, the first
+ * of which is left in *bnp, or 0 if not even one block is free.
+ */
+int
+ffs_allocrun(ip, bpref, len, bnp)
+	register struct inode *ip;
+	daddr_t bpref;
+	int len;
+	daddr_t *bnp;
+{
+	register struct fs *fs;
+	daddr_t bno;
+	int cg;
+
+	fs = ip->i_fs;
+	if (bpref >= fs->fs_size)
+		bpref = 0;
+	if (bpref == 0)
+		cg = ino_to_cg(fs, ip->i_number);
+	else
+		cg = dtog(fs, bpref);
+	if (len > fs->fs_contigsumsize)
+		len = fs->fs_contigsumsize;
+	for (; len > 1; len >>= 1) {
+		bno = (daddr_t)ffs_hashalloc(ip, cg, (long)bpref, len,
+		    (u_long (*)())ffs_clusteralloc);
+		if (bno > 0) {
+			*bnp = bno;
+			return (len);
+		}
+	}
+	bno = (daddr_t)ffs_hashalloc(ip, cg, (long)bpref, (int)fs->fs_bsize,
+	    (u_long (*)())ffs_alloccg);
+	if (bno <= 0)
+		return (0);
+	*bnp = bno;
+	return (1);
+}
+
 /*
  * Reallocate a fragment to a bigger size
  *
@@ -159,8 +222,9 @@ ffs_realloccg(ip, lbprev, bpref, osize, nsize, cred, bpp)
 {
 	register struct fs *fs;
 	struct buf *bp;
-	int cg, request, error;
+	int cg, request, error, retried = 0;
 	daddr_t bprev, bno;
+	long delayed;
 	
 	*bpp = 0;
 	fs = ip->i_fs;
@@ -175,7 +239,10 @@ ffs_realloccg(ip, lbprev, bpref, osize, nsize, cred, bpp)
 	if (cred == NOCRED)
 		panic("ffs_realloccg: missing credential\n");
 #endif /* DIAGNOSTIC */
-	if (cred->cr_uid != 0 && freespace(fs, fs->fs_minfree) <= 0)
+retry:
+	delayed = VFSTOUFS(ITOV(ip)->v_mount)->um_delayed;
+	if (cred->cr_uid != 0 &&
+	    freespace(fs, fs->fs_minfree) - blkstofrags(fs, delayed) <= 0)
 		goto nospace;
 	if ((bprev = ip->i_db[lbprev]) == 0) {
 		printf("dev = 0x%x, bsize = %d, bprev = %d, fs = %s\n",
@@ -259,8 +326,17 @@ ffs_realloccg(ip, lbprev, bpref, osize, nsize, cred, bpp)
 		/* NOTREACHED */
 		return ENODEV;
 	}
-	bno = (daddr_t)ffs_hashalloc(ip, cg, (long)bpref, request,
-	    (u_long (*)())ffs_alloccg);
+	/*
+	 * A whole block may not come out of the delayed reservations;
+	 * settle for the exact size if that is a fragment.
+	 */
+	if (request == fs->fs_bsize && fs->fs_cstotal.cs_nbfree <= delayed)
+		request = nsize;
+	if (request < fs->fs_bsize || fs->fs_cstotal.cs_nbfree > delayed)
+		bno = (daddr_t)ffs_hashalloc(ip, cg, (long)bpref, request,
+		    (u_long (*)())ffs_alloccg);
+	else
+		bno = 0;
 	if (bno > 0) {
 		bp->b_blkno = fsbtodb(fs, bno);
 		(void) vnode_pager_uncache(ITOV(ip));
@@ -285,8 +361,13 @@ ffs_realloccg(ip, lbprev, bpref, osize, nsize, cred, bpp)
 	brelse(bp);
 nospace:
 	/*
-	 * no space available
+	 * no space available, unless held removed files free some
 	 */
+	if (!retried && DOINGSOFTDEP(ITOV(ip)) &&
+	    softdep_process_worklist(ITOV(ip)->v_mount)) {
+		retried = 1;
+		goto retry;
+	}
 	ffs_fserr(fs, cred->cr_uid, "file system full");
 	uprintf("\n%s: write failed, file system is full\n", fs->fs_fsmnt);
 	return (ENOSPC);
@@ -387,6 +468,12 @@ ffs_reallocblks(ap)
 			goto fail;
 		ebap = (daddr_t *)ebp->b_data;
 	}
+	/*
+	 * The new blocks are taken before the old ones are freed, so
+	 * they must not come out of the delayed reservations.
+	 */
+	if (fs->fs_cstotal.cs_nbfree - VFSTOUFS(vp->v_mount)->um_delayed < len)
+		goto fail;
 	/*
 	 * Search the block map looking for an allocation of the desired size.
 	 */
@@ -776,6 +863,7 @@ ffs_fragextend(ip, cg, bprev, osize, nsize)
 		fs->fs_cstotal.cs_nffree--;
 		fs->fs_cs(fs, cg).cs_nffree--;
 	}
+	ffs_cgsumupdate(fs, cgp);
 	fs->fs_fmod = 1;
 	bdwrite(bp);
 	return (bprev);
@@ -802,7 +890,8 @@ ffs_alloccg(ip, cg, bpref, size)
 	struct timeval time;
 
 	fs = ip->i_fs;
-	if (fs->fs_cs(fs, cg).cs_nbfree == 0 && size == fs->fs_bsize)
+	if (fs->fs_cs(fs, cg).cs_nbfree == 0 && (size == fs->fs_bsize ||
+	    fs_cgsum(fs, cg).cgs_frmax < numfrags(fs, size)))
 		return (NULL);
 	error = bread(ip->i_devvp, fsbtodb(fs, cgtod(fs, cg)),
 		(int)fs->fs_cgsize, NOCRED, &bp);
@@ -838,6 +927,16 @@ ffs_alloccg(ip, cg, bpref, size)
 		 * allocated, and hacked up
 		 */
 		if (cgp->cg_cs.cs_nbfree == 0) {
+			ffs_cgsumupdate(fs, cgp);
+			brelse(bp);
+			return (NULL);
+		}
+		/*
+		 * Nor may a block reserved for delayed allocation be
+		 * broken up, see ffs_balloc.
+		 */
+		if (fs->fs_cstotal.cs_nbfree <=
+		    VFSTOUFS(ITOV(ip)->v_mount)->um_delayed) {
 			brelse(bp);
 			return (NULL);
 		}
@@ -851,6 +950,7 @@ ffs_alloccg(ip, cg, bpref, size)
 		fs->fs_cs(fs, cg).cs_nffree += i;
 		fs->fs_fmod = 1;
 		cgp->cg_frsum[i]++;
+		ffs_cgsumupdate(fs, cgp);
 		bdwrite(bp);
 		return (bno);
 	}
@@ -868,6 +968,7 @@ ffs_alloccg(ip, cg, bpref, size)
 	cgp->cg_frsum[allocsiz]--;
 	if (frags != allocsiz)
 		cgp->cg_frsum[allocsiz - frags]++;
+	ffs_cgsumupdate(fs, cgp);
 	bdwrite(bp);
 	return (cg * fs->fs_fpg + bno);
 }
@@ -1008,7 +1109,8 @@ ffs_clusteralloc(ip, cg, bpref, len)
 	u_char *mapp;
 
 	fs = ip->i_fs;
-	if (fs->fs_cs(fs, cg).cs_nbfree < len)
+	if (fs->fs_cs(fs, cg).cs_nbfree < len ||
+	    fs_cgsum(fs, cg).cgs_clmax < len)
 		return (NULL);
 	if (bread(ip->i_devvp, fsbtodb(fs, cgtod(fs, cg)), (int)fs->fs_cgsize,
 	    NOCRED, &bp))
@@ -1016,6 +1118,7 @@ ffs_clusteralloc(ip, cg, bpref, len)
 	cgp = (struct cg *)bp->b_data;
 	if (!cg_chkmagic(cgp))
 		goto fail;
+	ffs_cgsumupdate(fs, cgp);
 	/*
 	 * Check to see if a cluster of the needed size (or bigger) is
 	 * available in this cylinder group.
@@ -1095,7 +1198,7 @@ ffs_nodealloccg(ip, cg, ipref, mode)
 	register struct fs *fs;
 	register struct cg *cgp;
 	struct buf *bp;
-	int error, start, len, loc, map, i;
+	int error, start, len, map, i;
 	struct timeval time;
 
 	fs = ip->i_fs;
@@ -1120,20 +1223,17 @@ ffs_nodealloccg(ip, cg, ipref, mode)
 			goto gotit;
 	}
 	start = cgp->cg_irotor / NBBY;
-	len = howmany(fs->fs_ipg - cgp->cg_irotor, NBBY);
-	loc = skpc(0xff, len, &cg_inosused(cgp)[start]);
-	if (loc == 0) {
-		len = start + 1;
-		start = 0;
-		loc = skpc(0xff, len, &cg_inosused(cgp)[0]);
-		if (loc == 0) {
+	len = howmany(fs->fs_ipg, NBBY);
+	i = ffs_scanused(cg_inosused(cgp), start, len);
+	if (i < 0) {
+		i = ffs_scanused(cg_inosused(cgp), 0, start + 1);
+		if (i < 0) {
 			printf("cg = %d, irotor = %d, fs = %s\n",
 			    cg, cgp->cg_irotor, fs->fs_fsmnt);
 			panic("ffs_nodealloccg: map corrupted");
 			/* NOTREACHED */
 		}
 	}
-	i = start + len - loc;
 	map = cg_inosused(cgp)[i];
 	ipref = i * NBBY;
 	for (i = 1; i < (1 << NBBY); i <<= 1, ipref++) {
@@ -1264,6 +1364,7 @@ ffs_blkfree(ip, bno, size)
 			cg_blktot(cgp)[i]++;
 		}
 	}
+	ffs_cgsumupdate(fs, cgp);
 	fs->fs_fmod = 1;
 	bdwrite(bp);
 }
@@ -1345,7 +1446,7 @@ ffs_mapsearch(fs, cgp, bpref, allocsiz)
 	int allocsiz;
 {
 	daddr_t bno;
-	int start, len, loc, i;
+	int start, len, loc, i, mask;
 	int blk, field, subfield, pos;
 
 	/*
@@ -1356,24 +1457,23 @@ ffs_mapsearch(fs, cgp, bpref, allocsiz)
 		start = dtogd(fs, bpref) / NBBY;
 	else
 		start = cgp->cg_frotor / NBBY;
-	len = howmany(fs->fs_fpg, NBBY) - start;
-	loc = scanc((u_int)len, (u_char *)&cg_blksfree(cgp)[start],
-		(u_char *)fragtbl[fs->fs_frag],
-		(u_char)(1 << (allocsiz - 1 + (fs->fs_frag % NBBY))));
-	if (loc == 0) {
+	len = howmany(fs->fs_fpg, NBBY);
+	mask = 1 << (allocsiz - 1 + (fs->fs_frag % NBBY));
+	loc = ffs_scanfree(cg_blksfree(cgp), start, len,
+		(u_char *)fragtbl[fs->fs_frag], mask);
+	if (loc < 0) {
 		len = start + 1;
 		start = 0;
-		loc = scanc((u_int)len, (u_char *)&cg_blksfree(cgp)[0],
-			(u_char *)fragtbl[fs->fs_frag],
-			(u_char)(1 << (allocsiz - 1 + (fs->fs_frag % NBBY))));
-		if (loc == 0) {
+		loc = ffs_scanfree(cg_blksfree(cgp), 0, len,
+			(u_char *)fragtbl[fs->fs_frag], mask);
+		if (loc < 0) {
 			printf("start = %d, len = %d, fs = %s\n",
 			    start, len, fs->fs_fsmnt);
 			panic("ffs_alloccg: map corrupted");
 			/* NOTREACHED */
 		}
 	}
-	bno = (start + len - loc) * NBBY;
+	bno = loc * NBBY;
 	cgp->cg_frotor = bno;
 	/*
 	 * found the byte in the map
@@ -1478,6 +1578,90 @@ ffs_clusteracct(fs, cgp, blkno, cnt)
 		sump[forw] -= cnt;
 }
 
+/*
+ * Recompute the in-core summary of a cylinder group's free runs from
+ * the counts in its header, after the group has been read or changed.
+ */
+static void
+ffs_cgsumupdate(fs, cgp)
+	register struct fs *fs;
+	register struct cg *cgp;
+{
+	register struct cgsum *csp = &fs_cgsum(fs, cgp->cg_cgx);
+	register int i;
+	long *sump;
+
+	for (i = fs->fs_frag - 1; i > 0; i--)
+		if (cgp->cg_frsum[i] != 0)
+			break;
+	csp->cgs_frmax = i;
+	if (fs->fs_contigsumsize <= 0) {
+		csp->cgs_clmax = 0;
+		return;
+	}
+	sump = cg_clustersum(cgp);
+	for (i = fs->fs_contigsumsize; i > 0; i--)
+		if (sump[i] > 0)
+			break;
+	csp->cgs_clmax = i;
+}
+
+/*
+ * Scan the bytes start up to end of a free fragment map for one with
+ * a run matching mask in tbl, one of the fragtbl tables, as scanc()
+ * would.  A byte with no free fragments never matches, so whole words
+ * of zero are passed over at once; on a nearly full file system they
+ * are most of the map.  Returns the index of the byte, or -1.
+ */
+static int
+ffs_scanfree(map, start, end, tbl, mask)
+	register u_char *map;
+	int start, end;
+	register u_char *tbl;
+	register int mask;
+{
+	register int i = start;
+
+	while (i < end) {
+		if (((u_long)&map[i] & (sizeof (u_long) - 1)) == 0)
+			while (i + (int)sizeof (u_long) <= end &&
+			    *(u_long *)&map[i] == 0)
+				i += sizeof (u_long);
+		if (i >= end)
+			break;
+		if (tbl[map[i]] & mask)
+			return (i);
+		i++;
+	}
+	return (-1);
+}
+
+/*
+ * Scan the bytes start up to end of an inode map for one with an
+ * unused inode, passing over whole words of used ones at once.
+ * Returns the index of the byte, or -1.
+ */
+static int
+ffs_scanused(map, start, end)
+	register u_char *map;
+	int start, end;
+{
+	register int i = start;
+
+	while (i < end) {
+		if (((u_long)&map[i] & (sizeof (u_long) - 1)) == 0)
+			while (i + (int)sizeof (u_long) <= end &&
+			    *(u_long *)&map[i] == ~0UL)
+				i += sizeof (u_long);
+		if (i >= end)
+			break;
+		if (map[i] != 0xff)
+			return (i);
+		i++;
+	}
+	return (-1);
+}
+
 /*
  * Fserr prints the name of a file system with an error diagnostic.
  * 
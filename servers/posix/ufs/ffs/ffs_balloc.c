@@ -33,6 +33,7 @@
  *	@(#)ffs_balloc.c	8.4 (Berkeley) 9/23/93
  */
 
+#include "quota.h"
 #include "diagnostic.h"
 
 #include <sys/param.h>
@@ -41,16 +42,43 @@
 #include <sys/proc.h>
 #include <sys/file.h>
 #include <sys/vnode.h>
+#include <sys/mount.h>
 
 #include <vm/vm.h>
 
 #include <ufs/ufs/quota.h>
 #include <ufs/ufs/inode.h>
+#include <ufs/ufs/ufsmount.h>
 #include <ufs/ufs/ufs_extern.h>
 
 #include <ufs/ffs/fs.h>
 #include <ufs/ffs/ffs_extern.h>
 
+/*
+ * Delayed allocation.  A whole block appended to a regular file is
+ * not given a disk address when it is written: space and quota are
+ * reserved, the buffer is held in core with B_LOCKED, and the block
+ * joins the inode's delayed extent, i_dalen blocks from i_dalbn.
+ * When the extent is full, the file is written elsewhere, synced or
+ * truncated, ffs_delayflush assigns the whole extent in as few
+ * contiguous runs as the cylinder groups allow, fills in each block
+ * map once per run, and hands the buffers to cluster_write.
+ */
+int	ffs_dodelay = 1;		/* delay allocation of appended blocks */
+int	ffs_delaymax = 64;		/* most blocks in one delayed extent */
+int	ffs_delaybufs;			/* buffers held by delayed extents */
+
+extern int nbuf;
+
+#ifdef DEBUG
+extern int doclusterwrite;
+#else
+#define doclusterwrite 1
+#endif
+
+static struct buf *ffs_delay (struct inode *, daddr_t, struct ucred *);
+static void	ffs_delaydrop (struct inode *, daddr_t);
+
 /*
  * Balloc defines the structure of file system storage
  * by allocating the physical blocks on a device given
@@ -70,7 +98,7 @@ ffs_balloc(ip, bn, size, cred, bpp, flags)
 	struct vnode *vp = ITOV(ip);
 	struct indir indirs[NIADDR + 2];
 	daddr_t newb, lbn, *bap, pref;
-	int osize, nsize, num, i, error;
+	int osize, nsize, num, i, error, delay;
 
 	*bpp = NULL;
 	if (bn < 0)
@@ -78,6 +106,36 @@ ffs_balloc(ip, bn, size, cred, bpp, flags)
 	fs = ip->i_fs;
 	lbn = bn;
 
+	/*
+	 * A block of the delayed extent is still in core and is simply
+	 * handed back, unless it is to be written synchronously and so
+	 * needs its disk address now.
+	 */
+	if (ip->i_dalen && bn >= ip->i_dalbn &&
+	    bn < ip->i_dalbn + ip->i_dalen) {
+		if ((flags & B_SYNC) == 0) {
+			*bpp = getblk(vp, bn, fs->fs_bsize, 0, 0);
+			return (0);
+		}
+		if (error = ffs_delayflush(ip))
+			return (error);
+	}
+	/*
+	 * A whole block written at the end of the file may be delayed.
+	 * Anything else allocated past the delayed extent, or a block
+	 * that will not fit in it, has the extent assigned first so that
+	 * it is laid out behind it.
+	 */
+	delay = ffs_dodelay && vp->v_type == VREG && size == fs->fs_bsize &&
+	    (flags & (B_SYNC | B_CLRBUF)) == 0 &&
+	    blkoff(fs, ip->i_size) == 0 && lblkno(fs, ip->i_size) == bn &&
+	    ffs_delaybufs < nbuf / 4;
+	if (ip->i_dalen && bn >= ip->i_dalbn + ip->i_dalen &&
+	    (!delay || bn != ip->i_dalbn + ip->i_dalen ||
+	    ip->i_dalen >= ffs_delaymax))
+		if (error = ffs_delayflush(ip))
+			return (error);
+
 	/*
 	 * If the next write will extend the file into a new block,
 	 * and the file is currently composed of a fragment
@@ -136,6 +194,10 @@ ffs_balloc(ip, bn, size, cred, bpp, flags)
 					return (error);
 			}
 		} else {
+			if (delay && (bp = ffs_delay(ip, bn, cred)) != NULL) {
+				*bpp = bp;
+				return (0);
+			}
 			if (ip->i_size < (bn + 1) * fs->fs_bsize)
 				nsize = fragroundup(fs, size);
 			else
@@ -244,6 +306,11 @@ ffs_balloc(ip, bn, size, cred, bpp, flags)
 	 * Get the data block, allocating if necessary.
 	 */
 	if (nb == 0) {
+		if (delay && (nbp = ffs_delay(ip, lbn, cred)) != NULL) {
+			brelse(bp);
+			*bpp = nbp;
+			return (0);
+		}
 		pref = ffs_blkpref(ip, lbn, indirs[i].in_off, &bap[0]);
 		if (error = ffs_alloc(ip,
 		    lbn, pref, (int)fs->fs_bsize, cred, &newb)) {
@@ -282,3 +349,181 @@ ffs_balloc(ip, bn, size, cred, bpp, flags)
 	*bpp = nbp;
 	return (0);
 }
+
+/*
+ * Reserve space and quota for block bn at the end of the file and add
+ * it to the delayed extent.  The buffer returned keeps its logical
+ * block number as its disk address until ffs_delayflush assigns one;
+ * only then is it counted in i_blocks, so that the dinode never counts
+ * a block that is not allocated.  Returns NULL if the reservation cannot be made, in which case the
+ * block is allocated at once.
+ */
+static struct buf *
+ffs_delay(ip, bn, cred)
+	register struct inode *ip;
+	daddr_t bn;
+	struct ucred *cred;
+{
+	register struct fs *fs = ip->i_fs;
+	struct ufsmount *ump = VFSTOUFS(ITOV(ip)->v_mount);
+	struct buf *bp;
+
+	if (fs->fs_cstotal.cs_nbfree <= ump->um_delayed + 1)
+		return (NULL);
+	if (cred->cr_uid != 0 && freespace(fs, fs->fs_minfree) -
+	    blkstofrags(fs, ump->um_delayed + 1) <= 0)
+		return (NULL);
+#if QUOTA
+	if (chkdq(ip, (long)btodb(fs->fs_bsize), cred, 0))
+		return (NULL);
+#endif
+	if (ip->i_dalen++ == 0)
+		ip->i_dalbn = bn;
+	ump->um_delayed++;
+	ffs_delaybufs++;
+	ip->i_flag |= IN_CHANGE | IN_UPDATE;
+	bp = getblk(ITOV(ip), bn, fs->fs_bsize, 0, 0);
+	bp->b_flags |= B_LOCKED;
+	return (bp);
+}
+
+/*
+ * Forget the blocks of the delayed extent from lbn on: their buffers
+ * are thrown away and their reservations returned.
+ */
+static void
+ffs_delaydrop(ip, lbn)
+	register struct inode *ip;
+	daddr_t lbn;
+{
+	register struct fs *fs = ip->i_fs;
+	struct vnode *vp = ITOV(ip);
+	struct buf *bp;
+	daddr_t end;
+	long n;
+
+	end = ip->i_dalbn + ip->i_dalen;
+	if ((n = end - lbn) <= 0)
+		return;
+	for (; lbn < end; lbn++) {
+		bp = getblk(vp, lbn, fs->fs_bsize, 0, 0);
+		bp->b_flags &= ~(B_LOCKED | B_DELWRI);
+		bp->b_flags |= B_INVAL;
+		brelse(bp);
+	}
+	ip->i_dalen -= n;
+	VFSTOUFS(vp->v_mount)->um_delayed -= n;
+	ffs_delaybufs -= n;
+#if QUOTA
+	(void) chkdq(ip, -n * btodb(fs->fs_bsize), NOCRED, 0);
+#endif
+}
+
+/*
+ * Throw away the whole delayed extent; used by ffs_truncate when
+ * the file is cut back to before it.
+ */
+void
+ffs_delaycancel(ip)
+	struct inode *ip;
+{
+
+	if (ip->i_dalen)
+		ffs_delaydrop(ip, ip->i_dalbn);
+}
+
+/*
+ * Assign disk blocks to the delayed extent and start writing it.
+ * Each block map covering the extent, the inode or an indirect
+ * block, is filled in with as few contiguous runs as possible and
+ * written once.  Every other allocation leaves um_delayed whole
+ * blocks free, so this cannot run out of space.  If a block map
+ * cannot be read, the rest of the extent is dropped with its
+ * reservations and the error returned, as for a failed write.
+ */
+int
+ffs_delayflush(ip)
+	register struct inode *ip;
+{
+	register struct fs *fs = ip->i_fs;
+	struct vnode *vp = ITOV(ip);
+	struct ufsmount *ump = VFSTOUFS(vp->v_mount);
+	struct indir indirs[NIADDR + 2];
+	struct buf *bp, *ibp;
+	daddr_t lbn, bno, *bap;
+	long cnt, i, n;
+	int off, num, error;
+
+	while ((cnt = ip->i_dalen) > 0) {
+		lbn = ip->i_dalbn;
+		ibp = NULL;
+		if (lbn < NDADDR) {
+			bap = &ip->i_db[0];
+			off = lbn;
+			if (cnt > NDADDR - off)
+				cnt = NDADDR - off;
+		} else {
+			/*
+			 * The indirect blocks were allocated when the
+			 * extent was reserved.
+			 */
+			if (error = ufs_getlbns(vp, lbn, indirs, &num)) {
+				ffs_delaydrop(ip, lbn);
+				return (error);
+			}
+			--num;
+			error = bread(vp, indirs[num].in_lbn, (int)fs->fs_bsize,
+			    NOCRED, &ibp);
+			if (error) {
+				brelse(ibp);
+				ffs_delaydrop(ip, lbn);
+				return (error);
+			}
+			bap = (daddr_t *)ibp->b_data;
+			off = indirs[num].in_off;
+			if (cnt > NINDIR(fs) - off)
+				cnt = NINDIR(fs) - off;
+		}
+		for (i = 0; i < cnt; ) {
+			n = ffs_allocrun(ip, ffs_blkpref(ip, lbn + i, off + i,
+			    bap), (int)(cnt - i), &bno);
+			if (n == 0)
+				panic("ffs_delayflush: reserved blocks gone");
+			for (; n > 0; n--, i++, bno += fs->fs_frag) {
+				bap[off + i] = bno;
+				bp = getblk(vp, lbn + i, fs->fs_bsize, 0, 0);
+				bp->b_blkno = fsbtodb(fs, bno);
+				bp->b_flags &= ~B_LOCKED;
+				bdwrite(bp);
+			}
+		}
+		if (ibp)
+			bdwrite(ibp);
+		ip->i_dalbn += i;
+		ip->i_dalen -= i;
+		ump->um_delayed -= i;
+		ffs_delaybufs -= i;
+		ip->i_blocks += i * btodb(fs->fs_bsize);
+		ip->i_flag |= IN_CHANGE | IN_UPDATE;
+
+		/*
+		 * Now that the map is released, push the run through
+		 * cluster_write, which sees it as contiguous and writes
+		 * it in MAXBSIZE transfers.
+		 */
+		for (n = 0; n < i; n++) {
+			if (!incore(vp, lbn + n))
+				continue;
+			bp = getblk(vp, lbn + n, fs->fs_bsize, 0, 0);
+			if ((bp->b_flags & B_DELWRI) == 0) {
+				brelse(bp);
+				continue;
+			}
+			if (doclusterwrite)
+				cluster_write(bp, ip->i_size);
+			else
+				bawrite(bp);
+		}
+	}
+	return (0);
+}
@@ -50,6 +50,7 @@ struct mbuf;
 __BEGIN_DECLS
 int	ffs_alloc (struct inode *,
 	    daddr_t, daddr_t, int, struct ucred *, daddr_t *);
+int	ffs_allocrun (struct inode *, daddr_t, int, daddr_t *);
 int	ffs_balloc (struct inode *,
 	    daddr_t, int, struct ucred *, struct buf **, int);
 int	ffs_blkatoff (struct vop_blkatoff_args *);
@@ -57,6 +58,8 @@ int	ffs_blkfree (struct inode *, daddr_t, long);
 daddr_t	ffs_blkpref (struct inode *, daddr_t, int, daddr_t *);
 int	ffs_bmap (struct vop_bmap_args *);
 void	ffs_clrblock (struct fs *, u_char *, daddr_t);
+void	ffs_delaycancel (struct inode *);
+int	ffs_delayflush (struct inode *);
 int	ffs_fhtovp (struct mount *, struct fid *, struct mbuf *,
 	    struct vnode **, int *, struct ucred **);
 void	ffs_fragacct (struct fs *, int, int32_t [], int);
@@ -74,6 +77,7 @@ int	ffs_realloccg (struct inode *,
 int	ffs_reclaim (struct vop_reclaim_args *);
 void	ffs_setblock (struct fs *, u_char *, daddr_t);
 int	ffs_statfs (struct mount *, struct statfs *, struct proc *);
+int	ffs_strategy (struct vop_strategy_args *);
 int	ffs_sync (struct mount *, int, struct ucred *, struct proc *);
 int	ffs_truncate (struct vop_truncate_args *);
 int	ffs_unmount (struct mount *, int, struct proc *);
@@ -86,6 +90,15 @@ int	ffs_write (struct vop_write_args *);
 
 int	bwrite();		/* FFS needs a bwrite routine.  XXX */
 
+void	softdep_checkworklist (void);
+void	softdep_disk_prewrite (struct buf *);
+void	softdep_flushremove (struct inode *);
+void	softdep_initialize (void);
+int	softdep_process_worklist (struct mount *);
+void	softdep_purge (struct vnode *);
+void	softdep_setup_direnter (struct vnode *, daddr_t, struct inode *);
+void	softdep_setup_remove (struct inode *, struct inode *);
+
 #ifdef DIAGNOSTIC
 void	ffs_checkoverlap (struct buf *, struct inode *);
 #endif
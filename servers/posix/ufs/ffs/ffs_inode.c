@@ -64,6 +64,7 @@ static int ffs_indirtrunc (struct inode *, daddr_t, daddr_t, daddr_t, int,
 int
 ffs_init()
 {
+	softdep_initialize();
 	return (ufs_init());
 }
 
@@ -112,6 +113,12 @@ ffs_update(ap)
 	}
 	ip->i_flag &= ~(IN_ACCESS | IN_CHANGE | IN_MODIFIED | IN_UPDATE);
 	fs = ip->i_fs;
+	/*
+	 * A directory entry removed for this inode must be on disk
+	 * before the link count that went with it.
+	 */
+	if (ip->i_remdir)
+		softdep_flushremove(ip);
 	/*
 	 * Ensure that uid and gid are correct. This is a temporary
 	 * fix until fsck has been changed to do the update.
@@ -191,6 +198,17 @@ ffs_truncate(ap)
 		oip->i_flag |= IN_CHANGE | IN_UPDATE;
 		return (VOP_UPDATE(ovp, &tv, &tv, 0));
 	}
+	/*
+	 * A delayed extent wholly past the new end of file is dropped
+	 * without ever being allocated; otherwise it is assigned so that
+	 * the code below sees complete block maps.
+	 */
+	if (oip->i_dalen) {
+		if (length <= (off_t)oip->i_dalbn << oip->i_fs->fs_bshift)
+			ffs_delaycancel(oip);
+		else if (error = ffs_delayflush(oip))
+			return (error);
+	}
 #if QUOTA
 	if (error = getinoquota(oip))
 		return (error);
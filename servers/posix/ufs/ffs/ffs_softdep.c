@@ -0,0 +1,282 @@
+/*
+ *	File:	ufs/ffs/ffs_softdep.c
+ *
+ *	Ordered delayed writes of FFS directory and inode metadata.
+ *
+ *	Without this, creating or removing a name costs synchronous
+ *	writes of the inode and of the directory block, issued in the
+ *	order that keeps the file system consistent.  With it the
+ *	writes are delayed and the order is kept by remembering, for
+ *	each update, what must reach the disk first:
+ *
+ *	- A new entry must not be written before the inode it names.
+ *	  softdep_setup_direnter records that the directory block
+ *	  depends on the inode's block; ffs_strategy calls
+ *	  softdep_disk_prewrite, which writes such blocks first.
+ *
+ *	- A removed entry must be written before the inode loses the
+ *	  link or is freed.  softdep_setup_remove notes the directory
+ *	  block in the inode; ffs_update calls softdep_flushremove to
+ *	  write that block before the inode.  A file whose last link
+ *	  went is kept referenced on a work list, so that truncating
+ *	  and freeing it, and with that the directory write, is left
+ *	  to ffs_sync instead of the process removing it.
+ *
+ *	Dependencies only ever lead from a directory block to an inode
+ *	block, or from an inode's own update to a directory block that
+ *	has no pending update of that inode, so forcing them cannot
+ *	cycle and no update ever has to be rolled back.  Anything not
+ *	covered, rename in particular, keeps its synchronous writes.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/buf.h>
+#include <sys/vnode.h>
+#include <sys/mount.h>
+#include <sys/malloc.h>
+#include <sys/queue.h>
+
+#include <ufs/ufs/quota.h>
+#include <ufs/ufs/inode.h>
+#include <ufs/ufs/ufsmount.h>
+#include <ufs/ufs/ufs_extern.h>
+
+#include <ufs/ffs/fs.h>
+#include <ufs/ffs/ffs_extern.h>
+
+int	ffs_dosoftdep = 1;		/* delay ordered metadata writes */
+int	softdep_maxfree = 500;		/* removed files held for ffs_sync */
+
+/*
+ * Directory block (sd_vp, sd_lbn) must not be written before the
+ * device block sd_blkno holding an inode it names.
+ */
+struct sdep {
+	LIST_ENTRY(sdep) sd_hash;
+	struct	vnode *sd_vp;		/* directory */
+	daddr_t	sd_lbn;			/* its block */
+	daddr_t	sd_blkno;		/* inode block on i_devvp */
+	struct	vnode *sd_devvp;
+};
+
+static LIST_HEAD(sdephead, sdep) *sdephashtbl;
+static u_long sdephash;
+#define	SDEPHASH(vp, lbn) \
+	(&sdephashtbl[((u_long)(vp) / sizeof (struct vnode) + (lbn)) & sdephash])
+
+/*
+ * Files whose last link was removed, held until their directory
+ * blocks have been written.
+ */
+struct sdfree {
+	TAILQ_ENTRY(sdfree) sf_list;
+	struct	vnode *sf_vp;
+};
+
+static TAILQ_HEAD(, sdfree) sdfreelist;
+static int sdfreecnt;
+
+void
+softdep_initialize()
+{
+
+	sdephashtbl = hashinit(desiredvnodes, M_TEMP, &sdephash);
+	TAILQ_INIT(&sdfreelist);
+}
+
+/*
+ * Write out the buffer of (vp, lbn) if it is dirty; one being written
+ * already is waited for.
+ */
+static void
+softdep_push(vp, lbn)
+	struct vnode *vp;
+	daddr_t lbn;
+{
+	struct buf *bp;
+
+	if ((bp = incore(vp, lbn)) == NULL)
+		return;
+	bp = getblk(vp, lbn, bp->b_bcount, 0, 0);
+	if (bp->b_flags & B_DELWRI)
+		(void) bwrite(bp);
+	else
+		brelse(bp);
+}
+
+/*
+ * The entry for ip just made in directory block lbn of dvp must not
+ * reach the disk before ip does.  The caller has already handed the
+ * inode to ffs_update.
+ */
+void
+softdep_setup_direnter(dvp, lbn, ip)
+	struct vnode *dvp;
+	daddr_t lbn;
+	struct inode *ip;
+{
+	register struct sdep *sd;
+	struct sdephead *sdh;
+	struct fs *fs = ip->i_fs;
+	daddr_t blkno;
+
+	blkno = fsbtodb(fs, ino_to_fsba(fs, ip->i_number));
+	sdh = SDEPHASH(dvp, lbn);
+	for (sd = sdh->lh_first; sd; sd = sd->sd_hash.le_next)
+		if (sd->sd_vp == dvp && sd->sd_lbn == lbn &&
+		    sd->sd_blkno == blkno)
+			return;
+	sd = (struct sdep *)malloc(sizeof (*sd), M_TEMP, M_WAITOK);
+	VTOI(dvp)->i_sdepcnt++;
+	sd->sd_vp = dvp;
+	sd->sd_lbn = lbn;
+	sd->sd_blkno = blkno;
+	sd->sd_devvp = ip->i_devvp;
+	LIST_INSERT_HEAD(sdh, sd, sd_hash);
+}
+
+/*
+ * Called by ffs_strategy before a directory block goes to disk:
+ * write the inode blocks its new entries depend on.
+ */
+void
+softdep_disk_prewrite(bp)
+	struct buf *bp;
+{
+	register struct sdep *sd, *nsd;
+	struct sdephead *sdh;
+
+	sdh = SDEPHASH(bp->b_vp, bp->b_lblkno);
+	for (sd = sdh->lh_first; sd; sd = nsd) {
+		nsd = sd->sd_hash.le_next;
+		if (sd->sd_vp != bp->b_vp || sd->sd_lbn != bp->b_lblkno)
+			continue;
+		LIST_REMOVE(sd, sd_hash);
+		VTOI(sd->sd_vp)->i_sdepcnt--;
+		softdep_push(sd->sd_devvp, sd->sd_blkno);
+		free(sd, M_TEMP);
+		nsd = sdh->lh_first;
+	}
+}
+
+/*
+ * Forget the dependencies of a directory being reclaimed; whatever
+ * of it was dirty has been written or thrown away by now, so there
+ * are rarely any left to look for.
+ */
+void
+softdep_purge(vp)
+	struct vnode *vp;
+{
+	register struct sdep *sd, *nsd;
+	u_long i;
+
+	if (VTOI(vp)->i_sdepcnt == 0)
+		return;
+	VTOI(vp)->i_sdepcnt = 0;
+	for (i = 0; i <= sdephash; i++)
+		for (sd = sdephashtbl[i].lh_first; sd; sd = nsd) {
+			nsd = sd->sd_hash.le_next;
+			if (sd->sd_vp == vp) {
+				LIST_REMOVE(sd, sd_hash);
+				free(sd, M_TEMP);
+			}
+		}
+}
+
+/*
+ * The entry for ip at dp->i_offset has just been removed from dp
+ * with a delayed write.  Remember the block so that ip is not written
+ * before it.  If the file's last link went, keep it referenced so it
+ * is not freed until softdep_process_worklist.
+ */
+void
+softdep_setup_remove(dp, ip)
+	struct inode *dp, *ip;
+{
+	struct vnode *vp = ITOV(ip);
+	struct sdfree *sf;
+	daddr_t lbn;
+
+	lbn = lblkno(dp->i_fs, dp->i_offset);
+	if (ip->i_remdir && (ip->i_remdir != dp->i_number ||
+	    ip->i_remlbn != lbn))
+		softdep_flushremove(ip);
+	ip->i_remdir = dp->i_number;
+	ip->i_remlbn = lbn;
+	if (ip->i_nlink > 0 || ip == dp)
+		return;
+	sf = (struct sdfree *)malloc(sizeof (*sf), M_TEMP, M_WAITOK);
+	VREF(vp);
+	sf->sf_vp = vp;
+	TAILQ_INSERT_TAIL(&sdfreelist, sf, sf_list);
+	sdfreecnt++;
+}
+
+/*
+ * Write the directory block from which an entry for ip was removed,
+ * if that has not happened yet.  Called before ip itself is written.
+ */
+void
+softdep_flushremove(ip)
+	struct inode *ip;
+{
+	struct vnode *dvp;
+
+	if (ip->i_remdir == 0)
+		return;
+	if (ip->i_remdir == ip->i_number)
+		dvp = ITOV(ip);
+	else
+		dvp = ufs_ihashlookup(ip->i_dev, ip->i_remdir);
+	/*
+	 * A directory no longer in core had its dirty blocks written
+	 * when it was reclaimed.
+	 */
+	if (dvp != NULL)
+		softdep_push(dvp, ip->i_remlbn);
+	ip->i_remdir = 0;
+}
+
+/*
+ * Let go of the removed files held for mp, or for every file system
+ * if mp is NULL.  The last vrele truncates and frees each file, and
+ * ffs_update writes the directory blocks first.  Returns the number
+ * of files let go.
+ */
+int
+softdep_process_worklist(mp)
+	struct mount *mp;
+{
+	register struct sdfree *sf, *nsf;
+	struct vnode *vp;
+	int cnt = 0;
+
+	for (sf = sdfreelist.tqh_first; sf; sf = nsf) {
+		nsf = sf->sf_list.tqe_next;
+		vp = sf->sf_vp;
+		if (mp != NULL && vp->v_mount != mp)
+			continue;
+		TAILQ_REMOVE(&sdfreelist, sf, sf_list);
+		sdfreecnt--;
+		free(sf, M_TEMP);
+		vrele(vp);
+		cnt++;
+		/* vrele may have slept; the list may have changed. */
+		nsf = sdfreelist.tqh_first;
+	}
+	return (cnt);
+}
+
+/*
+ * Called after a remove: if too many files are being held, let them
+ * go now rather than at the next sync.
+ */
+void
+softdep_checkworklist()
+{
+
+	if (sdfreecnt > softdep_maxfree)
+		(void) softdep_process_worklist((struct mount *)NULL);
+}
@@ -79,6 +79,7 @@ struct vfsops ufs_vfsops = {
 };
 
 extern u_long nextgennumber;
+extern int ffs_dosoftdep;
 
 /*
  * Called by main() when ufs is going to be mounted as root.
@@ -171,13 +172,17 @@ ffs_mount(mp, path, data, ndp, p)
 				return (EBUSY);
 			error = ffs_flushfiles(mp, flags, p);
 			vfs_unbusy(mp);
+			if (!error)
+				ump->um_softdep = 0;
 		}
 		if (!error && (mp->mnt_flag & MNT_RELOAD))
 			error = ffs_reload(mp, ndp->ni_cnd.cn_cred, p);
 		if (error)
 			return (error);
-		if (fs->fs_ronly && (mp->mnt_flag & MNT_WANTRDWR))
+		if (fs->fs_ronly && (mp->mnt_flag & MNT_WANTRDWR)) {
 			fs->fs_ronly = 0;
+			ump->um_softdep = ffs_dosoftdep;
+		}
 		if (fs->fs_ronly == 0) {
 			fs->fs_clean = 0;
 			ffs_sbupdate(ump, MNT_WAIT);
@@ -296,6 +301,10 @@ ffs_reload(mountp, cred, p)
 		memcpy(fs->fs_csp[fragstoblks(fs, bp->b_data, i)], (u_int)size);
 		brelse(bp);
 	}
+	for (i = 0; i < fs->fs_ncg; i++) {
+		fs_cgsum(fs, i).cgs_frmax = fs->fs_frag - 1;
+		fs_cgsum(fs, i).cgs_clmax = fs->fs_contigsumsize;
+	}
 loop:
 	for (vp = mountp->mnt_vnodelist.lh_first; vp != NULL; vp = nvp) {
 		nvp = vp->v_mntvnodes.le_next;
@@ -406,8 +415,8 @@ ffs_mountfs(devvp, mp, p)
 		fs->fs_clean = 0;
 	}
 	blks = howmany(fs->fs_cssize, fs->fs_fsize);
-	base = space = bsd_malloc((u_long)fs->fs_cssize, M_UFSMNT,
-	    M_WAITOK);
+	base = space = bsd_malloc((u_long)fs->fs_cssize +
+	    fs->fs_ncg * sizeof (struct cgsum), M_UFSMNT, M_WAITOK);
 	for (i = 0; i < blks; i += fs->fs_frag) {
 		size = fs->fs_bsize;
 		if (i + fs->fs_frag > blks)
@@ -424,6 +433,10 @@ ffs_mountfs(devvp, mp, p)
 		brelse(bp);
 		bp = NULL;
 	}
+	for (i = 0; i < fs->fs_ncg; i++) {
+		fs_cgsum(fs, i).cgs_frmax = fs->fs_frag - 1;
+		fs_cgsum(fs, i).cgs_clmax = fs->fs_contigsumsize;
+	}
 	mp->mnt_data = (qaddr_t)ump;
 	mp->mnt_stat.f_fsid.val[0] = (long)dev;
 	mp->mnt_stat.f_fsid.val[1] = MOUNT_UFS;
@@ -435,6 +448,7 @@ ffs_mountfs(devvp, mp, p)
 	ump->um_nindir = fs->fs_nindir;
 	ump->um_bptrtodb = fs->fs_fsbtodb;
 	ump->um_seqinc = fs->fs_frag;
+	ump->um_softdep = ffs_dosoftdep && !ronly;
 	for (i = 0; i < MAXQUOTAS; i++)
 		ump->um_quotas[i] = NULLVP;
 	devvp->v_specflags |= SI_MOUNTEDON;
@@ -537,6 +551,7 @@ ffs_flushfiles(mp, flags, p)
 	if (!doforce)
 		flags &= ~FORCECLOSE;
 	ump = VFSTOUFS(mp);
+	softdep_process_worklist(mp);
 #if QUOTA
 	if (mp->mnt_flag & MNT_QUOTA) {
 		if (error = vflush(mp, NULLVP, SKIPSYSTEM|flags))
@@ -576,8 +591,8 @@ ffs_statfs(mp, sbp, p)
 	sbp->f_bsize = fs->fs_fsize;
 	sbp->f_iosize = fs->fs_bsize;
 	sbp->f_blocks = fs->fs_dsize;
-	sbp->f_bfree = fs->fs_cstotal.cs_nbfree * fs->fs_frag +
-		fs->fs_cstotal.cs_nffree;
+	sbp->f_bfree = (fs->fs_cstotal.cs_nbfree - ump->um_delayed) *
+		fs->fs_frag + fs->fs_cstotal.cs_nffree;
 	sbp->f_bavail = (fs->fs_dsize * (100 - fs->fs_minfree) / 100) -
 		(fs->fs_dsize - sbp->f_bfree);
 	sbp->f_files =  fs->fs_ncg * fs->fs_ipg - ROOTINO;
@@ -611,6 +626,12 @@ ffs_sync(mp, waitfor, cred, p)
 	int error, allerror = 0;
 
 	fs = ump->um_fs;
+	/*
+	 * Free the files removed since the last sync; their inodes
+	 * are written below.
+	 */
+	if (ump->um_softdep)
+		softdep_process_worklist(mp);
 	/*
 	 * Write back modified superblock.
 	 * Consistency check that the superblock
@@ -58,6 +58,7 @@
 #include <ufs/ufs/quota.h>
 #include <ufs/ufs/inode.h>
 #include <ufs/ufs/dir.h>
+#include <ufs/ufs/ufsmount.h>
 #include <ufs/ufs/ufs_extern.h>
 
 #include <ufs/ffs/fs.h>
@@ -96,7 +97,7 @@ struct vnodeopv_entry_desc ffs_vnodeop_entries[] = {
 	{ &vop_lock_desc, ufs_lock },			/* lock */
 	{ &vop_unlock_desc, ufs_unlock },		/* unlock */
 	{ &vop_bmap_desc, ufs_bmap },			/* bmap */
-	{ &vop_strategy_desc, ufs_strategy },		/* strategy */
+	{ &vop_strategy_desc, ffs_strategy },		/* strategy */
 	{ &vop_print_desc, ufs_print },			/* print */
 	{ &vop_islocked_desc, ufs_islocked },		/* islocked */
 	{ &vop_pathconf_desc, ufs_pathconf },		/* pathconf */
@@ -247,7 +248,7 @@ ffs_fsync(ap)
 	register struct buf *bp;
 	struct timeval tv;
 	struct buf *nbp;
-	int s;
+	int s, error;
 
 	/* 
 	 * Clean memory object.
@@ -256,6 +257,13 @@ ffs_fsync(ap)
 	 */
 	vn_pager_sync(vp, ap->a_waitfor);
 
+	/*
+	 * Give the delayed extent, if any, its disk blocks; its buffers
+	 * cannot be written before.
+	 */
+	if (VTOI(vp)->i_dalen && (error = ffs_delayflush(VTOI(vp))))
+		return (error);
+
 	/*
 	 * Flush all dirty buffers associated with a vnode.
 	 */
@@ -296,3 +304,21 @@ loop:
 	get_time(&tv);
 	return (VOP_UPDATE(ap->a_vp, &tv, &tv, ap->a_waitfor == MNT_WAIT));
 }
+
+/*
+ * Strategy for FFS files: before a directory block is written, the
+ * inodes its new entries name are written, see ffs_softdep.c.
+ */
+int
+ffs_strategy(ap)
+	struct vop_strategy_args /* {
+		struct buf *a_bp;
+	} */ *ap;
+{
+	register struct buf *bp = ap->a_bp;
+
+	if ((bp->b_flags & B_READ) == 0 && bp->b_vp->v_type == VDIR &&
+	    DOINGSOFTDEP(bp->b_vp))
+		softdep_disk_prewrite(bp);
+	return (ufs_strategy(ap));
+}
@@ -302,6 +302,21 @@ struct fs {
 #define fs_cs(fs, indx) \
 	fs_csp[(indx) >> (fs)->fs_csshift][(indx) & ~(fs)->fs_csmask]
 
+/*
+ * In-core summary of the free runs in each cylinder group, so that the
+ * allocator can pass over groups that cannot satisfy a request without
+ * reading their maps.  It is never written to disk; it lives in the
+ * allocation holding the fs_cs array, just past its fs_cssize bytes.
+ * Until a group's map has been read, both fields are the largest value
+ * possible.
+ */
+struct cgsum {
+	u_char	cgs_frmax;		/* longest free run of frags < fs_frag */
+	u_char	cgs_clmax;		/* longest free cluster, in blocks */
+};
+#define	fs_cgsum(fs, cg) \
+	(((struct cgsum *)((caddr_t)(fs)->fs_csp[0] + (fs)->fs_cssize))[cg])
+
 /*
  * Cylinder group block for a file system.
  */
@@ -319,9 +319,19 @@ struct segment {
 #define	SEGM_CKP	0x01		/* doing a checkpoint */
 #define	SEGM_CLEAN	0x02		/* cleaner call; don't sort */
 #define	SEGM_SYNC	0x04		/* wait for segment */
+#define	SEGM_NOWAIT	0x08		/* cleaner; don't wait for clean segs */
 	u_long	seg_flags;		/* run-time flags for this segment */
 };
 
+/*
+ * Clean segments the in-server cleaner holds back for its checkpoint,
+ * and the count at or below which ordinary writers wait for it.  The
+ * second must stay above the first or the cleaner has nothing left to
+ * copy live blocks into by the time writers block.
+ */
+#define	LFS_CLEAN_RESERVE	2
+#define	LFS_WRITE_RESERVE	(LFS_CLEAN_RESERVE + 2)
+
 #define ISSPACE(F, BB, C)						\
 	(((C)->cr_uid == 0 && (F)->lfs_bfree >= (BB)) ||		\
 	((C)->cr_uid != 0 && IS_FREESPACE(F, BB)))
@@ -348,6 +358,7 @@ struct lfs_stats {
 	int	wait_exceeded;
 	int	write_exceeded;
 	int	flush_invoked;
+	int	segscleaned;		/* by lfs_cleanerd */
 };
 extern struct lfs_stats lfs_stats;
 #endif
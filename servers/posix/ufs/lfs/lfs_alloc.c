@@ -191,6 +191,7 @@ ip->i_din.di_spare[1] = 0xdeadbeef;
 #endif
 	ip->i_lockf = 0;
 	ip->i_diroff = 0;
+	ip->i_dirhash = NULL;
 	ip->i_mode = 0;
 	ip->i_size = 0;
 	ip->i_blocks = 0;
@@ -36,7 +36,10 @@
 #include <sys/types.h>
 
 /*
- * Simple, general purpose, fast checksum.  Data must be short-aligned.
+ * Simple, general purpose, fast checksum: the exclusive or of the
+ * u_shorts of str.  Data must be short-aligned.  Once aligned it is
+ * taken a u_long at a time, four to a pass, and the lanes of the sum
+ * are folded together at the end, which gives the same result.
  * Returns a u_long in case we ever want to do something more rigorous.
  *
  * XXX
@@ -47,12 +50,23 @@ cksum(str, len)
 	register void *str;
 	register size_t len;
 {
-	register u_long sum;
+	register u_long sum, *lp;
+	register u_short *sp;
+	int shift;
 	
 	len &= ~(sizeof(u_short) - 1);
-	for (sum = 0; len; len -= sizeof(u_short)) {
-		sum ^= *(u_short *)str;
-		++(u_short *)str;
-	}
-	return (sum);
+	sp = str;
+	for (sum = 0; len && ((u_long)sp & (sizeof(u_long) - 1));
+	    len -= sizeof(u_short))
+		sum ^= *sp++;
+	for (lp = (u_long *)sp; len >= 4 * sizeof(u_long);
+	    len -= 4 * sizeof(u_long), lp += 4)
+		sum ^= lp[0] ^ lp[1] ^ lp[2] ^ lp[3];
+	for (; len >= sizeof(u_long); len -= sizeof(u_long))
+		sum ^= *lp++;
+	for (sp = (u_short *)lp; len; len -= sizeof(u_short))
+		sum ^= *sp++;
+	for (shift = sizeof(u_long) * NBBY / 2; shift >= 16; shift >>= 1)
+		sum ^= sum >> shift;
+	return (sum & 0xffff);
 }
@@ -0,0 +1,538 @@
+/*
+ *	File:	ufs/lfs/lfs_cleaner.c
+ *
+ *	Segment cleaner run by the server itself.
+ *
+ *	A log-structured file system only writes to clean segments,
+ *	and the segments it has written are only made clean again by
+ *	copying what is still live in them elsewhere.  The user level
+ *	cleaner does this through lfs_bmapv, lfs_markv and
+ *	lfs_segclean; when it is not running, writers stall as soon
+ *	as the disk has been written over once.  lfs_cleanerd does the
+ *	same work in a thread of the server:
+ *
+ *	- Every lfs_clean_interval seconds, and whenever a writer runs
+ *	  short of clean segments, each read-write LFS is looked at.
+ *	  While file systems are being written, cleaning is left until
+ *	  fewer than lfs_clean_lowat percent of the segments are clean,
+ *	  and then done one segment per pass as long as more than
+ *	  LFS_CLEAN_URGENT remain, so that the cleaner does not compete
+ *	  with the writers for the disk.  When they are idle it cleans
+ *	  up to lfs_clean_nseg segments per pass until lfs_clean_hiwat
+ *	  percent are clean.
+ *
+ *	- Segments are picked by the cost-benefit policy of Sprite LFS:
+ *	  those with the highest (1 - u) * age / (1 + u), u being the
+ *	  fraction of the segment still live and age the time since it
+ *	  was written.  Cold segments are cleaned at a higher u than
+ *	  hot ones, whose blocks are likely to die on their own.
+ *
+ *	- Each segment is read whole, in MAXPHYS transfers, and its
+ *	  partial segments are walked to find the blocks and inodes
+ *	  still in use.  These are rewritten by lfs_markv1, as for the
+ *	  user level cleaner.  A checkpoint is then taken before the
+ *	  segments are marked clean, so that the one on disk never
+ *	  refers to a segment that may be written over.
+ *
+ *	lfs_stats.segscleaned counts the segments cleaned; together
+ *	with blocktot and cleanblocks it gives the write amplification,
+ *	which is printed after each pass if lfs_clean_verbose is set.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/proc.h>
+#include <sys/buf.h>
+#include <sys/mount.h>
+#include <sys/vnode.h>
+#include <sys/malloc.h>
+#include <sys/kernel.h>
+#include <sys/uio.h>
+
+#include <ufs/ufs/quota.h>
+#include <ufs/ufs/inode.h>
+#include <ufs/ufs/ufsmount.h>
+#include <ufs/ufs/ufs_extern.h>
+
+#include <ufs/lfs/lfs.h>
+#include <ufs/lfs/lfs_extern.h>
+
+int	lfs_doclean = 1;		/* clean segments in the server */
+int	lfs_clean_interval = 5;		/* seconds between passes */
+int	lfs_clean_lowat = 10;		/* % clean below which writers wait */
+int	lfs_clean_hiwat = 25;		/* % clean to reach when idle */
+int	lfs_clean_nseg = 4;		/* segments cleaned per pass */
+int	lfs_clean_verbose = 0;		/* report each pass */
+
+#define	LFS_CLEAN_URGENT	4	/* clean segments left before hurrying */
+#define	LFS_CLEAN_MAXSEG	16	/* bound on lfs_clean_nseg */
+
+extern int lfs_allclean_wakeup;
+
+static int lfs_cleaner_running;
+static int lfs_clean_lastfg;		/* foreground writes at the last pass */
+
+struct lfs_victim {
+	u_long	v_sn;			/* segment number */
+	u_long	v_score;		/* cost-benefit ratio */
+	u_long	v_live;			/* live bytes */
+	int	v_flags;		/* su_flags */
+};
+
+static void	lfs_cleaner_thread (void);
+static void	lfs_cleanfs (struct mount *, int);
+static int	lfs_pickvictims (struct lfs *, struct lfs_victim *, int,
+		    u_long);
+static int	lfs_cleanseg (struct mount *, struct lfs_victim *);
+static int	lfs_cleanread (struct lfs *, daddr_t, caddr_t, u_long);
+static int	lfs_cleanscan (struct lfs *, caddr_t, daddr_t, u_long,
+		    BLOCK_INFO *);
+static int	lfs_cleaninos (struct lfs *, struct dinode *, daddr_t,
+		    u_long, BLOCK_INFO *);
+static void	lfs_cleansort (BLOCK_INFO *, int);
+
+/*
+ * Start the cleaner, once, when the first LFS is mounted read-write.
+ */
+void
+lfs_cleanerd()
+{
+	extern void ux_create_thread();
+
+	if (!lfs_doclean || lfs_cleaner_running)
+		return;
+	lfs_cleaner_running = 1;
+	ux_create_thread(lfs_cleaner_thread);
+}
+
+static void
+lfs_cleaner_thread()
+{
+	register struct mount *mp, *nmp;
+	struct proc *p;
+	int fg, busy;
+
+	system_proc(&p, "LFSCleaner");
+	unix_master();
+
+	for (;;) {
+		fg = lfs_stats.psegwrites - lfs_stats.pcleanwrites;
+		busy = fg != lfs_clean_lastfg;
+		for (mp = mountlist.tqh_first; mp != NULL; mp = nmp) {
+			if (mp->mnt_stat.f_type != MOUNT_LFS ||
+			    mp->mnt_flag & (MNT_MLOCK | MNT_RDONLY) ||
+			    vfs_busy(mp)) {
+				nmp = mp->mnt_list.tqe_next;
+				continue;
+			}
+			lfs_cleanfs(mp, busy);
+			nmp = mp->mnt_list.tqe_next;
+			vfs_unbusy(mp);
+		}
+		/* Our own checkpoints are not the writers'. */
+		lfs_clean_lastfg = lfs_stats.psegwrites - lfs_stats.pcleanwrites;
+		(void) tsleep(&lfs_allclean_wakeup, PVFS, "lfsclean",
+		    lfs_clean_interval * hz);
+	}
+}
+
+/*
+ * Clean what segments of mp are worth cleaning now.
+ */
+static void
+lfs_cleanfs(mp, busy)
+	struct mount *mp;
+	int busy;
+{
+	struct lfs *fs = VFSTOUFS(mp)->um_lfs;
+	struct lfs_victim v[LFS_CLEAN_MAXSEG];
+	CLEANERINFO *cip;
+	SEGUSE *sup;
+	struct buf *bp;
+	u_long clean, lowat, hiwat, segbytes, budget, now;
+	int i, n, want, cleaned;
+
+	LFS_CLEANERINFO(cip, fs, bp);
+	clean = cip->clean;
+	brelse(bp);
+
+	lowat = fs->lfs_nseg * lfs_clean_lowat / 100;
+	hiwat = fs->lfs_nseg * lfs_clean_hiwat / 100;
+	if (lowat < LFS_CLEAN_URGENT + 1)
+		lowat = LFS_CLEAN_URGENT + 1;
+	if (hiwat < lowat)
+		hiwat = lowat;
+	if (clean >= (busy ? lowat : hiwat) ||
+	    clean <= LFS_CLEAN_RESERVE)
+		return;
+	if (busy && clean > LFS_CLEAN_URGENT)
+		want = 1;
+	else if ((want = lfs_clean_nseg) > LFS_CLEAN_MAXSEG)
+		want = LFS_CLEAN_MAXSEG;
+	if (want < 1)
+		want = 1;
+
+	/*
+	 * Whatever is live in the victims must fit in the clean segments,
+	 * less those the checkpoint itself may need.
+	 */
+	segbytes = fs->lfs_ssize << fs->lfs_bshift;
+	budget = (clean - LFS_CLEAN_RESERVE < want ?
+	    clean - LFS_CLEAN_RESERVE : want) * segbytes;
+	if ((n = lfs_pickvictims(fs, v, want, budget)) == 0)
+		return;
+
+	for (i = 0; i < n; i++)
+		if (lfs_cleanseg(mp, &v[i]))
+			v[i].v_sn = fs->lfs_nseg;
+	if (lfs_segwrite(mp, SEGM_CKP | SEGM_SYNC | SEGM_NOWAIT))
+		return;
+
+	/*
+	 * Only segments left with nothing but their summaries are clean;
+	 * one that still holds live data (a block lfs_markv1 could not
+	 * move, say) is made younger so that it is not picked again at
+	 * once.
+	 */
+	now = get_seconds();
+	cleaned = 0;
+	for (i = 0; i < n; i++) {
+		if (v[i].v_sn == fs->lfs_nseg)
+			continue;
+		LFS_SEGENTRY(sup, fs, v[i].v_sn, bp);
+		if (sup->su_nbytes > sup->su_nsums * LFS_SUMMARY_SIZE) {
+			sup->su_lastmod = now;
+			(void) VOP_BWRITE(bp);
+			continue;
+		}
+		brelse(bp);
+		if (lfs_segclean1(fs, v[i].v_sn) == 0)
+			cleaned++;
+	}
+	lfs_stats.segscleaned += cleaned;
+	if (lfs_clean_verbose && lfs_stats.blocktot > lfs_stats.cleanblocks) {
+		/* Blocks written for each one written by the file system. */
+		i = lfs_stats.blocktot * 100 /
+		    (lfs_stats.blocktot - lfs_stats.cleanblocks);
+		printf("lfs_cleanerd: %s: cleaned %d of %d, %lu clean, ",
+		    fs->lfs_fsmnt, cleaned, n, clean + cleaned);
+		printf("write amplification %d.%02d\n", i / 100, i % 100);
+	}
+}
+
+/*
+ * Fill v with up to want dirty segments, best cost-benefit ratio
+ * first, holding no more than budget live bytes between them.  Returns
+ * how many were found.
+ */
+static int
+lfs_pickvictims(fs, v, want, budget)
+	struct lfs *fs;
+	struct lfs_victim *v;
+	int want;
+	u_long budget;
+{
+	SEGUSE *sup;
+	struct buf *bp;
+	u_long sn, cur, next, segbytes, nbytes, u, age, score, now;
+	int flags, i, n;
+
+	now = get_seconds();
+	cur = datosn(fs, fs->lfs_curseg);
+	next = datosn(fs, fs->lfs_nextseg);
+	n = 0;
+	for (sn = 0; sn < fs->lfs_nseg; sn++) {
+		if (sn == cur || sn == next)
+			continue;
+		LFS_SEGENTRY(sup, fs, sn, bp);
+		flags = sup->su_flags;
+		nbytes = sup->su_nbytes;
+		age = now > sup->su_lastmod ? now - sup->su_lastmod : 0;
+		brelse(bp);
+		if ((flags & (SEGUSE_DIRTY | SEGUSE_ACTIVE)) != SEGUSE_DIRTY)
+			continue;
+
+		/* u in thousandths of the space the segment can hold. */
+		segbytes = fs->lfs_ssize << fs->lfs_bshift;
+		if (flags & SEGUSE_SUPERBLOCK)
+			segbytes -= LFS_SBPAD;
+		if (nbytes >= segbytes)
+			continue;
+		u = (u_quad_t)nbytes * 1000 / segbytes;
+		score = (u_quad_t)(1000 - u) * age / (1000 + u);
+
+		if (n == want && score <= v[n - 1].v_score)
+			continue;
+		if (n < want)
+			n++;
+		for (i = n - 1; i > 0 && v[i - 1].v_score < score; i--)
+			v[i] = v[i - 1];
+		v[i].v_sn = sn;
+		v[i].v_score = score;
+		v[i].v_live = nbytes;
+		v[i].v_flags = flags;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (v[i].v_live > budget)
+			break;
+		budget -= v[i].v_live;
+	}
+	return (i);
+}
+
+/*
+ * Rewrite whatever is still live in the segment of vp.
+ */
+static int
+lfs_cleanseg(mp, vp)
+	struct mount *mp;
+	struct lfs_victim *vp;
+{
+	struct lfs *fs = VFSTOUFS(mp)->um_lfs;
+	BLOCK_INFO *bip;
+	caddr_t buf;
+	daddr_t daddr;
+	u_long size;
+	int error, nbi;
+
+	daddr = sntoda(fs, vp->v_sn);
+	size = fs->lfs_ssize << fs->lfs_bshift;
+	if (vp->v_flags & SEGUSE_SUPERBLOCK) {
+		/* As lfs_newseg, the log starts after the superblock. */
+		size -= LFS_SBPAD;
+		daddr += btodb(LFS_SBPAD);
+	}
+
+	buf = malloc(size, M_SEGMENT, M_WAITOK);
+	if (error = lfs_cleanread(fs, daddr, buf, size)) {
+		free(buf, M_SEGMENT);
+		return (error);
+	}
+	nbi = lfs_cleanscan(fs, buf, daddr, size, NULL);
+	bip = malloc((nbi ? nbi : 1) * sizeof(BLOCK_INFO),
+	    M_SEGMENT, M_WAITOK);
+	nbi = lfs_cleanscan(fs, buf, daddr, size, bip);
+	lfs_cleansort(bip, nbi);
+	error = nbi ? lfs_markv1(mp, bip, nbi, UIO_SYSSPACE) : 0;
+	free(bip, M_SEGMENT);
+	free(buf, M_SEGMENT);
+	return (error);
+}
+
+/*
+ * Read size bytes of the disk at daddr into addr, bypassing the
+ * buffer cache.
+ */
+static int
+lfs_cleanread(fs, daddr, addr, size)
+	struct lfs *fs;
+	daddr_t daddr;
+	caddr_t addr;
+	u_long size;
+{
+	struct inode *ip = VTOI(fs->lfs_ivnode);
+	struct buf *bp;
+	u_long n;
+	int error;
+
+	for (error = 0; size > 0 && error == 0;
+	    size -= n, addr += n, daddr += btodb(n)) {
+		n = size < MAXPHYS ? size : MAXPHYS;
+		bp = lfs_newbuf(ip->i_devvp, daddr, 0);
+		bp->b_dev = ip->i_dev;
+		bp->b_data = addr;
+		bp->b_bufsize = bp->b_bcount = n;
+		bp->b_flags = B_BUSY | B_READ;
+		bp->b_iodone = NULL;
+		VOP_STRATEGY(bp);
+		error = biowait(bp);
+		brelvp(bp);
+		free(bp, M_SEGMENT);
+	}
+	return (error);
+}
+
+/*
+ * Walk the partial segments in buf, the size bytes of the disk at
+ * daddr, and fill bip with the blocks and inodes of them still in
+ * use.  With bip NULL, just count how many entries might be needed.
+ * The walk stops at the first summary that does not check, or that is
+ * older than the one before it: the rest was written in an earlier
+ * pass over the disk.
+ */
+static int
+lfs_cleanscan(fs, buf, daddr, size, bip)
+	struct lfs *fs;
+	caddr_t buf;
+	daddr_t daddr;
+	u_long size;
+	BLOCK_INFO *bip;
+{
+	SEGSUM *ssp;
+	FINFO *fip;
+	IFILE *ifp;
+	struct buf *bp;
+	daddr_t *iaddrp, blkaddr;
+	caddr_t p, data, end;
+	u_long lastcreate, datasum, version;
+	int i, j, k, live, nbi, nblocks, ninob;
+
+	nbi = 0;
+	end = buf + size;
+	lastcreate = 0;
+	for (p = buf; p + LFS_SUMMARY_SIZE <= end;
+	    p += LFS_SUMMARY_SIZE + (nblocks << fs->lfs_bshift)) {
+		ssp = (SEGSUM *)p;
+		if (ssp->ss_sumsum != cksum(&ssp->ss_datasum,
+		    LFS_SUMMARY_SIZE - sizeof(ssp->ss_sumsum)) ||
+		    ssp->ss_create < lastcreate)
+			break;
+		lastcreate = ssp->ss_create;
+
+		ninob = (ssp->ss_ninos + INOPB(fs) - 1) / INOPB(fs);
+		nblocks = ninob;
+		fip = (FINFO *)(ssp + 1);
+		for (i = ssp->ss_nfinfo; i--;
+		    fip = (FINFO *)&fip->fi_blocks[fip->fi_nblocks]) {
+			if ((caddr_t)fip->fi_blocks >= p + LFS_SUMMARY_SIZE)
+				return (nbi);
+			nblocks += fip->fi_nblocks;
+		}
+		if (nblocks == 0 ||
+		    nblocks > (end - p - LFS_SUMMARY_SIZE) >> fs->lfs_bshift)
+			break;
+
+		/* As lfs_writeseg, from the first word of each block. */
+		datasum = 0;
+		for (data = p + LFS_SUMMARY_SIZE, i = nblocks; i--;
+		    data += fs->lfs_bsize)
+			datasum ^= *(u_long *)data;
+		if (ssp->ss_datasum != cksum(&datasum, sizeof(datasum)))
+			break;
+
+		if (bip == NULL) {
+			nbi += ssp->ss_ninos;
+			for (fip = (FINFO *)(ssp + 1), i = ssp->ss_nfinfo; i--;
+			    fip = (FINFO *)&fip->fi_blocks[fip->fi_nblocks])
+				nbi += fip->fi_nblocks;
+			continue;
+		}
+
+		/*
+		 * The blocks are in the order of the FINFOs, with the inode
+		 * blocks, whose addresses run backward from the end of the
+		 * summary, slipped in between.
+		 */
+		data = p + LFS_SUMMARY_SIZE;
+		blkaddr = daddr + btodb(data - buf);
+		iaddrp = (daddr_t *)(p + LFS_SUMMARY_SIZE) - 1;
+		k = 0;
+		fip = (FINFO *)(ssp + 1);
+		for (i = ssp->ss_nfinfo; i--;
+		    fip = (FINFO *)&fip->fi_blocks[fip->fi_nblocks]) {
+			if (fip->fi_ino == LFS_IFILE_INUM)
+				live = 1;
+			else {
+				LFS_IENTRY(ifp, fs, fip->fi_ino, bp);
+				live = ifp->if_daddr != LFS_UNUSED_DADDR &&
+				    ifp->if_version == fip->fi_version;
+				brelse(bp);
+			}
+			version = fip->fi_version;
+			for (j = 0; j < fip->fi_nblocks; j++) {
+				for (; k < ninob && *iaddrp == blkaddr;
+				    k++, iaddrp--) {
+					nbi += lfs_cleaninos(fs,
+					    (struct dinode *)data, blkaddr,
+					    ssp->ss_create, bip + nbi);
+					data += fs->lfs_bsize;
+					blkaddr += fsbtodb(fs, 1);
+				}
+				if (live) {
+					bip[nbi].bi_inode = fip->fi_ino;
+					bip[nbi].bi_lbn = fip->fi_blocks[j];
+					bip[nbi].bi_daddr = blkaddr;
+					bip[nbi].bi_segcreate = ssp->ss_create;
+					bip[nbi].bi_version = version;
+					bip[nbi].bi_bp = data;
+					nbi++;
+				}
+				data += fs->lfs_bsize;
+				blkaddr += fsbtodb(fs, 1);
+			}
+		}
+		for (; k < ninob && *iaddrp == blkaddr; k++, iaddrp--) {
+			nbi += lfs_cleaninos(fs, (struct dinode *)data,
+			    blkaddr, ssp->ss_create, bip + nbi);
+			data += fs->lfs_bsize;
+			blkaddr += fsbtodb(fs, 1);
+		}
+	}
+	return (nbi);
+}
+
+/*
+ * Add to bip the inodes of the inode block at daddr whose current
+ * copy it holds.  The ifile's own inode is left to the checkpoint.
+ */
+static int
+lfs_cleaninos(fs, dip, daddr, create, bip)
+	struct lfs *fs;
+	struct dinode *dip;
+	daddr_t daddr;
+	u_long create;
+	BLOCK_INFO *bip;
+{
+	IFILE *ifp;
+	struct buf *bp;
+	ino_t ino, maxino;
+	int i, n;
+
+	maxino = (lblkno(fs, VTOI(fs->lfs_ivnode)->i_size) -
+	    fs->lfs_cleansz - fs->lfs_segtabsz) * fs->lfs_ifpb;
+	n = 0;
+	for (i = INOPB(fs); i--; dip++) {
+		ino = dip->di_inumber;
+		if (ino <= LFS_IFILE_INUM || ino >= maxino)
+			continue;
+		LFS_IENTRY(ifp, fs, ino, bp);
+		if (ifp->if_daddr == daddr) {
+			bip[n].bi_inode = ino;
+			bip[n].bi_lbn = LFS_UNUSED_LBN;
+			bip[n].bi_daddr = daddr;
+			bip[n].bi_segcreate = create;
+			bip[n].bi_version = ifp->if_version;
+			bip[n].bi_bp = dip;
+			n++;
+		}
+		brelse(bp);
+	}
+	return (n);
+}
+
+/*
+ * Sort by inode, as lfs_markv1 wants, and by block within an inode.
+ */
+static void
+lfs_cleansort(bip, n)
+	BLOCK_INFO *bip;
+	int n;
+{
+	BLOCK_INFO t;
+	int gap, i, j;
+
+#define	BI_LT(a, b)	((a)->bi_inode < (b)->bi_inode || \
+	(a)->bi_inode == (b)->bi_inode && \
+	(u_long)(a)->bi_lbn < (u_long)(b)->bi_lbn)
+
+	for (gap = n / 2; gap > 0; gap /= 2)
+		for (i = gap; i < n; i++)
+			for (j = i - gap;
+			    j >= 0 && BI_LT(&bip[j + gap], &bip[j]); j -= gap) {
+				t = bip[j];
+				bip[j] = bip[j + gap];
+				bip[j + gap] = t;
+			}
+#undef	BI_LT
+}
@@ -49,6 +49,7 @@ int	 lfs_balloc (struct vnode *, u_long, daddr_t, struct buf **);
 int	 lfs_blkatoff (struct vop_blkatoff_args *);
 int	 lfs_bwrite (struct vop_bwrite_args *);
 int	 lfs_check (struct vnode *, daddr_t);
+void	 lfs_cleanerd (void);
 int	 lfs_close (struct vop_close_args *);
 int	 lfs_create (struct vop_create_args *);
 int	 lfs_fhtovp (struct mount *, struct fid *, struct mbuf *,
@@ -62,6 +63,7 @@ int	 lfs_init (void);
 int	 lfs_initseg (struct lfs *);
 int	 lfs_link (struct vop_link_args *);
 int	 lfs_makeinode (int, struct nameidata *, struct inode **);
+int	 lfs_markv1 (struct mount *, BLOCK_INFO *, int, int);
 int	 lfs_mkdir (struct vop_mkdir_args *);
 int	 lfs_mknod (struct vop_mknod_args *);
 int	 lfs_mount (struct mount *,
@@ -75,6 +77,7 @@ int	 lfs_rmdir (struct vop_rmdir_args *);
 int	 lfs_rename (struct vop_rename_args *);
 void	 lfs_seglock (struct lfs *, unsigned long flags);
 void	 lfs_segunlock (struct lfs *);
+int	 lfs_segclean1 (struct lfs *, u_long);
 int	 lfs_segwrite (struct mount *, int);
 int	 lfs_statfs (struct mount *, struct statfs *, struct proc *);
 int	 lfs_symlink (struct vop_symlink_args *);
@@ -222,21 +222,22 @@ lfs_segwrite(mp, flags)
 	fs = VFSTOUFS(mp)->um_lfs;
 
  	/*
- 	 * If we have fewer than 2 clean segments, wait until cleaner
-	 * writes.
+	 * If we are down to LFS_WRITE_RESERVE clean segments, wait until
+	 * the cleaner writes.  The cleaner itself goes on into the segments
+	 * above LFS_CLEAN_RESERVE.
  	 */
 	do {
 		LFS_CLEANERINFO(cip, fs, bp);
 		clean = cip->clean;
 		brelse(bp);
-		if (clean <= 2) {
+		if (clean <= LFS_WRITE_RESERVE && !(flags & SEGM_NOWAIT)) {
 			printf ("segs clean: %d\n", clean);
 			wakeup(&lfs_allclean_wakeup);
 			if (error = tsleep(&fs->lfs_avail, PRIBIO + 1,
 			    "lfs writer", 0))
 				return (error);
 		}
-	} while (clean <= 2 );
+	} while (clean <= LFS_WRITE_RESERVE && !(flags & SEGM_NOWAIT));
 
 	/*
 	 * Allocate a segment structure and enough space to hold pointers to
@@ -757,7 +758,7 @@ lfs_writeseg(fs, sp)
 	SEGSUM *ssp;
 	dev_t i_dev;
 	size_t size;
-	u_long *datap, *dp;
+	u_long datasum, word;
 	int ch_per_blk, do_again, i, nblocks, num, s;
 	int (*strategy)(struct vop_strategy_args *);
 	struct vop_strategy_args vop_strategy_a;
@@ -789,23 +790,22 @@ lfs_writeseg(fs, sp)
 	 * Compute checksum across data and then across summary; the first
 	 * block (the summary block) is skipped.  Set the create time here
 	 * so that it's guaranteed to be later than the inode mod times.
-	 *
-	 * XXX
-	 * Fix this to do it inline, instead of malloc/copy.
+	 * The checksum is an exclusive or, so the first words of the blocks
+	 * are summed as they are found instead of being copied out first.
 	 */
-	datap = dp = malloc(nblocks * sizeof(u_long), M_SEGMENT, M_WAITOK);
+	datasum = 0;
 	for (bpp = sp->bpp, i = nblocks - 1; i--;) {
 		if ((*++bpp)->b_flags & B_INVAL) {
-			if (copyin((*bpp)->b_saveaddr, dp++, sizeof(u_long)))
+			if (copyin((*bpp)->b_saveaddr, &word, sizeof(u_long)))
 				panic("lfs_writeseg: copyin failed");
 		} else
-			*dp++ = ((u_long *)(*bpp)->b_data)[0];
+			word = ((u_long *)(*bpp)->b_data)[0];
+		datasum ^= word;
 	}
 	ssp->ss_create = get_seconds();
-	ssp->ss_datasum = cksum(datap, (nblocks - 1) * sizeof(u_long));
+	ssp->ss_datasum = cksum(&datasum, sizeof(u_long));
 	ssp->ss_sumsum =
 	    cksum(&ssp->ss_datasum, LFS_SUMMARY_SIZE - sizeof(ssp->ss_sumsum));
-	free(datap, M_SEGMENT);
 #if DIAGNOSTIC
 	if (fs->lfs_bfree < fsbtodb(fs, ninos) + LFS_SUMMARY_SIZE / DEV_BSIZE)
 		panic("lfs_writeseg: No diskspace for summary");
@@ -828,7 +828,9 @@ lfs_writeseg(fs, sp)
 	 * XXX
 	 * This should be removed if the new virtual memory system allows us to
 	 * easily make the buffers contiguous in kernel memory and if that's
-	 * fast enough.
+	 * fast enough.  The block device interface takes one contiguous
+	 * region per request, as device_write does, so the chunk cannot be
+	 * handed down as a list of the buffers instead.
 	 */
 	ch_per_blk = MAXPHYS / fs->lfs_bsize;
 	for (bpp = sp->bpp, i = nblocks; i;) {
@@ -42,6 +42,7 @@
 #include <sys/vnode.h>
 #include <sys/malloc.h>
 #include <sys/kernel.h>
+#include <sys/uio.h>
 
 #include <ufs/ufs/quota.h>
 #include <ufs/ufs/inode.h>
@@ -90,19 +91,9 @@ lfs_markv(p, uap, retval)
 	struct lfs_markv_args *uap;
 	int *retval;
 {
-	struct segment *sp;
-	BLOCK_INFO *blkp;
-	IFILE *ifp;
-	struct buf *bp, **bpp;
-	struct inode *ip;
-	struct lfs *fs;
 	struct mount *mntp;
-	struct vnode *vp;
 	fsid_t fsid;
 	void *start;
-	ino_t lastino;
-	daddr_t b_daddr, v_daddr;
-	u_long bsize;
 	int cnt, error;
 
 	if (error = suser(p->p_ucred, &p->p_acflag))
@@ -115,8 +106,35 @@ lfs_markv(p, uap, retval)
 
 	cnt = uap->blkcnt;
 	start = malloc(cnt * sizeof(BLOCK_INFO), M_SEGMENT, M_WAITOK);
-	if (error = copyin(uap->blkiov, start, cnt * sizeof(BLOCK_INFO)))
-		goto err1;
+	if ((error = copyin(uap->blkiov, start, cnt * sizeof(BLOCK_INFO))) == 0)
+		error = lfs_markv1(mntp, start, cnt, UIO_USERSPACE);
+	free(start, M_SEGMENT);
+	return (error);
+}
+
+/*
+ * The work of lfs_markv, on cnt entries at start sorted by inode.  The
+ * bi_bp buffers of the entries are in user space for the cleaner
+ * process, or in the server for lfs_cleanerd.
+ */
+int
+lfs_markv1(mntp, start, cnt, segflg)
+	struct mount *mntp;
+	BLOCK_INFO *start;
+	int cnt;
+	int segflg;		/* UIO_USERSPACE or UIO_SYSSPACE */
+{
+	struct segment *sp;
+	BLOCK_INFO *blkp;
+	IFILE *ifp;
+	struct buf *bp, **bpp;
+	struct inode *ip;
+	struct lfs *fs;
+	struct vnode *vp;
+	ino_t lastino;
+	daddr_t b_daddr, v_daddr;
+	u_long bsize;
+	int error;
 
 	/* Mark blocks/inodes dirty.  */
 	fs = VFSTOUFS(mntp)->um_lfs;
@@ -169,8 +187,8 @@ lfs_markv(p, uap, retval)
 
 			/* Get the vnode/inode. */
 			if (lfs_fastvget(mntp, blkp->bi_inode, v_daddr, &vp,
-			    blkp->bi_lbn == LFS_UNUSED_LBN ? 
-			    blkp->bi_bp : NULL)) {
+			    blkp->bi_lbn == LFS_UNUSED_LBN &&
+			    segflg == UIO_USERSPACE ? blkp->bi_bp : NULL)) {
 #if DIAGNOSTIC
 				printf("lfs_markv: VFS_VGET failed (%d)\n",
 				    blkp->bi_inode);
@@ -195,17 +213,28 @@ lfs_markv(p, uap, retval)
 		 * is an indirect block, we want to actually put it in the
 		 * buffer cache so that it can be updated in the finish_meta
 		 * section.  If it's not, we need to allocate a fake buffer
-		 * so that writeseg can perform the copyin and write the buffer.
+		 * so that writeseg can perform the copyin and write the buffer;
+		 * a block already in the server is copied into a new one.
 		 */
-		if (blkp->bi_lbn >= 0)	/* Data Block */
-			bp = lfs_fakebuf(vp, blkp->bi_lbn, bsize,
-			    blkp->bi_bp);
-		else {
+		if (blkp->bi_lbn >= 0) {	/* Data Block */
+			if (segflg == UIO_USERSPACE)
+				bp = lfs_fakebuf(vp, blkp->bi_lbn, bsize,
+				    blkp->bi_bp);
+			else {
+				bp = lfs_newbuf(vp, blkp->bi_lbn, bsize);
+				memcpy(bp->b_data, blkp->bi_bp, bsize);
+			}
+		} else {
 			bp = getblk(vp, blkp->bi_lbn, bsize, 0, 0);
-			if (!(bp->b_flags & (B_DELWRI | B_DONE | B_CACHE)) &&
-			    (error = copyin(blkp->bi_bp, bp->b_data,
-			    bsize)))
-				goto err2;
+			if (!(bp->b_flags & (B_DELWRI | B_DONE | B_CACHE))) {
+				if (segflg == UIO_USERSPACE)
+					error = copyin(blkp->bi_bp, bp->b_data,
+					    bsize);
+				else
+					memcpy(bp->b_data, blkp->bi_bp, bsize);
+				if (error)
+					goto err2;
+			}
 			if (error = VOP_BWRITE(bp))
 				goto err2;
 		}
@@ -224,7 +253,6 @@ lfs_markv(p, uap, retval)
 	}
 	(void) lfs_writeseg(fs, sp);
 	lfs_segunlock(fs);
-	free(start, M_SEGMENT);
 	return (error);
 
 /*
@@ -239,12 +267,12 @@ err2:	lfs_vunref(vp);
 	for (bpp = --sp->cbpp; bpp >= sp->bpp; --bpp)
 		if ((*bpp)->b_flags & B_CALL) {
 			brelvp(*bpp);
+			if (!((*bpp)->b_flags & B_INVAL))
+				free((*bpp)->b_data, M_SEGMENT);
 			free(*bpp, M_SEGMENT);
 		} else
 			brelse(*bpp);
 	lfs_segunlock(fs);
-err1:	
-	free(start, M_SEGMENT);
 	return (error);
 }
 
@@ -326,11 +354,7 @@ lfs_segclean(p, uap, retval)
 	struct lfs_segclean_args *uap;
 	int *retval;
 {
-	CLEANERINFO *cip;
-	SEGUSE *sup;
-	struct buf *bp;
 	struct mount *mntp;
-	struct lfs *fs;
 	fsid_t fsid;
 	int error;
 
@@ -342,16 +366,35 @@ lfs_segclean(p, uap, retval)
 	if ((mntp = getvfs(&fsid)) == NULL)
 		return (EINVAL);
 
-	fs = VFSTOUFS(mntp)->um_lfs;
+	return (lfs_segclean1(VFSTOUFS(mntp)->um_lfs, uap->segment));
+}
+
+/*
+ * The work of lfs_segclean.  A segment that is already clean is left
+ * alone, so that the cleaner process and lfs_cleanerd cannot count one
+ * segment twice.
+ */
+int
+lfs_segclean1(fs, segment)
+	struct lfs *fs;
+	u_long segment;
+{
+	CLEANERINFO *cip;
+	SEGUSE *sup;
+	struct buf *bp;
 
-	if (datosn(fs, fs->lfs_curseg) == uap->segment)
+	if (datosn(fs, fs->lfs_curseg) == segment)
 		return (EBUSY);
 
-	LFS_SEGENTRY(sup, fs, uap->segment, bp);
+	LFS_SEGENTRY(sup, fs, segment, bp);
 	if (sup->su_flags & SEGUSE_ACTIVE) {
 		brelse(bp);
 		return (EBUSY);
 	}
+	if (!(sup->su_flags & SEGUSE_DIRTY)) {
+		brelse(bp);
+		return (0);
+	}
 	fs->lfs_avail += fsbtodb(fs, fs->lfs_ssize) - 1;
 	fs->lfs_bfree += (sup->su_nsums * LFS_SUMMARY_SIZE / DEV_BSIZE) +
 	    sup->su_ninos * btodb(fs->lfs_bsize);
@@ -504,10 +547,10 @@ lfs_fastvget(mp, ino, daddr, vpp, dinp)
 	ip->i_lfs = ump->um_lfs;
 
 	/* Read in the disk contents for the inode, copy into the inode. */
-	if (dinp)
+	if (dinp) {
 		if (error = copyin(dinp, &ip->i_din, sizeof(struct dinode)))
 			return (error);
-	else {
+	} else {
 		if (error = bread(ump->um_devvp, daddr,
 		    (int)ump->um_lfs->lfs_bsize, NOCRED, &bp)) {
 			/*
@@ -122,8 +122,10 @@ lfs_mount(mp, path, data, ndp, p)
 			fs->fs_ronly = 0;
 #else
 		fs = ump->um_lfs;
-		if (fs->lfs_ronly && (mp->mnt_flag & MNT_RDONLY) == 0)
+		if (fs->lfs_ronly && (mp->mnt_flag & MNT_RDONLY) == 0) {
 			fs->lfs_ronly = 0;
+			lfs_cleanerd();
+		}
 #endif
 		if (args.fspec == 0) {
 			/*
@@ -248,6 +250,7 @@ lfs_mountfs(devvp, mp, p)
 
 	/* Allocate the mount structure, copy the superblock into it. */
 	ump = (struct ufsmount *)malloc(sizeof *ump, M_UFSMNT, M_WAITOK);
+	memset((caddr_t)ump, 0, sizeof *ump);
 	fs = ump->um_lfs = malloc(sizeof(struct lfs), M_UFSMNT, M_WAITOK);
 	memcpy(fs, bp->b_data, sizeof(struct lfs));
 	if (sizeof(struct lfs) < LFS_SBPAD)			/* XXX why? */
@@ -297,6 +300,8 @@ lfs_mountfs(devvp, mp, p)
 	VREF(vp);
 	vput(vp);
 
+	if (ronly == 0)
+		lfs_cleanerd();
 	return (0);
 out:
 	if (bp)
@@ -0,0 +1,40 @@
+/*
+ *	File:	ufs/ufs/dirhash.h
+ *
+ *	In-memory hash index of a large directory, see ufs_dirhash.c.
+ */
+
+#ifndef _UFS_UFS_DIRHASH_H_
+#define	_UFS_UFS_DIRHASH_H_
+
+#include <sys/queue.h>
+
+/*
+ * dh_hash is an open addressed table, probed linearly, of the directory
+ * offsets of all live entries keyed by the hash of their names.  Offsets
+ * are kept as ints to halve the table on 64-bit machines; directories
+ * large enough to overflow one are simply not hashed.  dh_blkfree holds
+ * the free space in each DIRBLKSIZ block in DIRALIGN units, so that a
+ * block that can take a new entry (possibly after compaction) is found
+ * without reading the directory.
+ */
+struct dirhash {
+	TAILQ_ENTRY(dirhash) dh_list;	/* LRU list of all hashes */
+	struct	inode *dh_ip;		/* directory indexed */
+	int	*dh_hash;		/* name hash -> entry offset */
+	int	dh_hlen;		/* slots in dh_hash */
+	int	dh_hused;		/* slots live or deleted */
+	u_char	*dh_blkfree;		/* free space per block */
+	int	dh_nblk;		/* blocks dh_blkfree has room for */
+	int	dh_dirblks;		/* blocks in the directory */
+	int	dh_memreq;		/* bytes charged to ufs_dirhashmem */
+};
+
+#define	DIRHASH_EMPTY	(-1)		/* slot never used */
+#define	DIRHASH_DEL	(-2)		/* slot of a removed entry */
+#define	DIRALIGN	4		/* dh_blkfree unit */
+
+/* A table is rebuilt once live and deleted slots pass this fraction. */
+#define	DIRHASH_FULL(dh)	((dh)->dh_hused >= (dh)->dh_hlen / 4 * 3)
+
+#endif /* !_UFS_UFS_DIRHASH_H_ */
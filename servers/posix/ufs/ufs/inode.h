@@ -79,7 +79,7 @@ struct inode {
 #define i_e2fs  inode_u.e2fs
 	struct	dquot *i_dquot[MAXQUOTAS];	/* Dquot structures. */
 	u_quad_t i_modrev;	/* Revision level for lease. */
-	struct	lockf *i_lockf;	/* Head of byte-level lock list. */
+	struct	lockf *i_lockf;	/* Root of byte-level lock tree. */
 	void	*i_lockholder;	/* DEBUG: holder of inode lock. */
 	void	*i_lockwaiter;	/* DEBUG: latest blocked for inode lock. */
 	/*
@@ -91,7 +91,13 @@ struct inode {
 	doff_t	i_offset;	/* Offset of free space in directory. */
 	ino_t	i_ino;		/* Inode number of found directory. */
 	u_long	i_reclen;	/* Size of found directory entry. */
-	long	i_spare[11];	/* Spares to round up to 128 bytes. */
+	struct	dirhash *i_dirhash; /* Hashing for large directories. */
+	daddr_t	i_dalbn;	/* FFS: first block of delayed extent. */
+	long	i_dalen;	/* FFS: blocks in delayed extent. */
+	ino_t	i_remdir;	/* FFS: directory of a removed entry, */
+	daddr_t	i_remlbn;	/*   and its block still to be written. */
+	long	i_sdepcnt;	/* FFS: entries in dir waiting on inodes. */
+	long	i_spare[5];	/* Spares to round up to 128 bytes. */
 	/*
 	 * The on-disk dinode itself.
 	 */
@@ -38,9 +38,11 @@
 
 /*
  * The lockf structure is a kernel structure which contains the information
- * associated with a byte range lock.  The lockf structures are linked into
- * the inode structure. Locks are sorted by the starting byte of the lock for
- * efficiency.
+ * associated with a byte range lock.  The locks held on an inode form an
+ * interval tree rooted in the inode: an AVL tree sorted by the starting
+ * byte of the lock in which each node also keeps the largest end byte
+ * below it, so the locks overlapping a range are found without looking
+ * at the others.  A lock waiting to be granted is not in the tree.
  */
 struct lockf {
 	short	lf_flags;	 /* Lock semantics: F_POSIX, F_FLOCK, F_WAIT */
@@ -49,8 +51,13 @@ struct lockf {
 	off_t	lf_end;		 /* The byte # of the end of the lock (-1=EOF)*/
 	caddr_t	lf_id;		 /* The id of the resource holding the lock */
 	struct	inode *lf_inode; /* Back pointer to the inode */
-	struct	lockf *lf_next;	 /* A pointer to the next lock on this inode */
+	struct	lockf *lf_next;	 /* The lock we are blocked on, if any */
 	struct	lockf *lf_block; /* The list of blocked locks */
+	struct	lockf *lf_left;	 /* Locks starting before this one */
+	struct	lockf *lf_right; /* Locks starting at or after this one */
+	struct	lockf *lf_parent;
+	off_t	lf_maxend;	 /* Largest lf_end in this subtree (-1=EOF) */
+	int	lf_height;	 /* Height of this subtree */
 };
 
 /* Maximum length of sleep chains to traverse to try and detect deadlock. */
@@ -59,8 +66,7 @@ struct lockf {
 __BEGIN_DECLS
 void	 lf_addblock (struct lockf *, struct lockf *);
 int	 lf_clearlock (struct lockf *);
-int	 lf_findoverlap (struct lockf *,
-	    struct lockf *, int, struct lockf ***, struct lockf **);
+int	 lf_findoverlap (struct lockf *, int, struct lockf **);
 struct lockf *
 	 lf_getblock (struct lockf *);
 int	 lf_getlock (struct lockf *, struct flock *);
@@ -0,0 +1,546 @@
+/*
+ *	File:	ufs/ufs/ufs_dirhash.c
+ *
+ *	In-memory hash index for large directories.
+ *
+ *	The first ufs_lookup in a directory of at least ufs_dirhashminsize
+ *	bytes reads it through once and builds a table from entry names to
+ *	directory offsets, plus the free space left in every DIRBLKSIZ
+ *	block.  Lookups then go straight to the entry, or prove it absent,
+ *	and creates find room for the new entry without a linear scan.
+ *	ufs_direnter and ufs_dirremove keep the index in step with every
+ *	block they write.  All hashes together are held to ufs_dirhashmaxmem
+ *	bytes: the least recently used ones are dropped to make room and
+ *	are rebuilt when next needed.  The on-disk format is unchanged, and
+ *	whenever the index and the directory disagree the index is thrown
+ *	away and ufs_lookup falls back to its linear search.
+ *
+ *	All calls are made with the directory inode locked, which is also
+ *	what keeps ufsdirhash_recycle from freeing a hash in use across a
+ *	sleep in VOP_BLKATOFF.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/buf.h>
+#include <sys/mount.h>
+#include <sys/vnode.h>
+#include <sys/malloc.h>
+
+#include <ufs/ufs/quota.h>
+#include <ufs/ufs/inode.h>
+#include <ufs/ufs/dir.h>
+#include <ufs/ufs/dirhash.h>
+#include <ufs/ufs/ufsmount.h>
+#include <ufs/ufs/ufs_extern.h>
+
+int	ufs_dirhashminsize = 5 * DIRBLKSIZ;	/* smallest directory hashed */
+int	ufs_dirhashmaxmem = 4 * 1024 * 1024;	/* memory for all hashes */
+int	ufs_dirhashmem;				/* memory in use */
+
+static TAILQ_HEAD(dirhashlist, dirhash) ufsdirhash_list;
+
+#define	FSFMT(vp)	((vp)->v_mount->mnt_maxsymlinklen <= 0)
+
+/* Smallest possible entry, one character name. */
+#define	DIRHASH_MINENTRY \
+	((sizeof (struct direct) - (MAXNAMLEN+1)) + ((1+1 + 3) &~ 3))
+
+static int	ufsdirhash_recycle (int);
+
+void
+ufsdirhash_init()
+{
+
+	TAILQ_INIT(&ufsdirhash_list);
+}
+
+/*
+ * FNV-1a over the name.
+ */
+static u_long
+ufsdirhash_hash(name, namelen)
+	register char *name;
+	register int namelen;
+{
+	register u_long h = 2166136261U;
+
+	while (--namelen >= 0) {
+		h ^= (u_char)*name++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static int
+ufsdirhash_namlen(vp, ep)
+	struct vnode *vp;
+	struct direct *ep;
+{
+
+#	if (BYTE_ORDER == LITTLE_ENDIAN)
+		if (vp->v_mount->mnt_maxsymlinklen > 0)
+			return (ep->d_namlen);
+		else
+			return (ep->d_type);
+#	else
+		return (ep->d_namlen);
+#	endif
+}
+
+/*
+ * Enter a name at offset in the table.
+ */
+static void
+ufsdirhash_insert(dh, ep, offset)
+	register struct dirhash *dh;
+	struct direct *ep;
+	doff_t offset;
+{
+	register int slot;
+
+	slot = ufsdirhash_hash(ep->d_name,
+	    ufsdirhash_namlen(ITOV(dh->dh_ip), ep)) % dh->dh_hlen;
+	while (dh->dh_hash[slot] >= 0)
+		slot = (slot + 1) % dh->dh_hlen;
+	if (dh->dh_hash[slot] == DIRHASH_EMPTY)
+		dh->dh_hused++;
+	dh->dh_hash[slot] = offset;
+}
+
+/*
+ * Find the slot holding offset for the name of ep, or -1.
+ */
+static int
+ufsdirhash_findslot(dh, ep, offset)
+	register struct dirhash *dh;
+	struct direct *ep;
+	doff_t offset;
+{
+	register int slot;
+
+	slot = ufsdirhash_hash(ep->d_name,
+	    ufsdirhash_namlen(ITOV(dh->dh_ip), ep)) % dh->dh_hlen;
+	for (; dh->dh_hash[slot] != DIRHASH_EMPTY;
+	     slot = (slot + 1) % dh->dh_hlen)
+		if (dh->dh_hash[slot] == offset)
+			return (slot);
+	return (-1);
+}
+
+/*
+ * Make room for memreqd more bytes of hashes, dropping the least
+ * recently used ones that are not in use.  On success the bytes are
+ * charged to ufs_dirhashmem.
+ */
+static int
+ufsdirhash_recycle(memreqd)
+	int memreqd;
+{
+	register struct dirhash *dh;
+
+	if (memreqd > ufs_dirhashmaxmem)
+		return (-1);
+	while (ufs_dirhashmem + memreqd > ufs_dirhashmaxmem) {
+		for (dh = ufsdirhash_list.tqh_first; dh != NULL;
+		     dh = dh->dh_list.tqe_next)
+			if ((dh->dh_ip->i_flag & IN_LOCKED) == 0)
+				break;
+		if (dh == NULL)
+			return (-1);
+		ufsdirhash_free(dh->dh_ip);
+	}
+	ufs_dirhashmem += memreqd;
+	return (0);
+}
+
+/*
+ * Get a hash for the directory ip, building it if the directory is
+ * large enough.  Returns 0 if ip->i_dirhash may be used, else -1.
+ */
+int
+ufsdirhash_build(ip)
+	register struct inode *ip;
+{
+	register struct dirhash *dh;
+	register struct direct *ep;
+	struct vnode *vp = ITOV(ip);
+	struct buf *bp = NULL;
+	doff_t pos;
+	long bmask;
+	int dirblks, nblk, hlen, memreqd, size, i;
+
+	if (dh = ip->i_dirhash) {
+		TAILQ_REMOVE(&ufsdirhash_list, dh, dh_list);
+		TAILQ_INSERT_TAIL(&ufsdirhash_list, dh, dh_list);
+		return (0);
+	}
+	if (ip->i_size < ufs_dirhashminsize || ip->i_size >= 0x7fffffff / 2)
+		return (-1);
+
+	/*
+	 * Size the table for the directory filled with minimum sized
+	 * entries, with half as many slots again so that probe chains
+	 * stay short.  A directory that outgrows it is rehashed.
+	 */
+	dirblks = howmany(ip->i_size, DIRBLKSIZ);
+	nblk = dirblks * 2;
+	hlen = dirblks * (DIRBLKSIZ / DIRHASH_MINENTRY) / 2 * 3;
+	memreqd = sizeof (*dh) + hlen * sizeof (int) + nblk;
+	if (ufsdirhash_recycle(memreqd))
+		return (-1);
+	dh = (struct dirhash *)malloc(sizeof (*dh), M_TEMP, M_WAITOK);
+	dh->dh_hash = (int *)malloc(hlen * sizeof (int), M_TEMP, M_WAITOK);
+	dh->dh_blkfree = (u_char *)malloc(nblk, M_TEMP, M_WAITOK);
+	for (i = 0; i < hlen; i++)
+		dh->dh_hash[i] = DIRHASH_EMPTY;
+	memset(dh->dh_blkfree, 0, nblk);
+	dh->dh_ip = ip;
+	dh->dh_hlen = hlen;
+	dh->dh_hused = 0;
+	dh->dh_nblk = nblk;
+	dh->dh_dirblks = dirblks;
+	dh->dh_memreq = memreqd;
+
+	bmask = vp->v_mount->mnt_stat.f_iosize - 1;
+	for (pos = 0; pos < ip->i_size; pos += ep->d_reclen) {
+		if ((pos & bmask) == 0) {
+			if (bp != NULL)
+				brelse(bp);
+			if (VOP_BLKATOFF(vp, (off_t)pos, NULL, &bp)) {
+				bp = NULL;
+				goto fail;
+			}
+		}
+		ep = (struct direct *)((char *)bp->b_data + (pos & bmask));
+		if (ep->d_reclen == 0 || (ep->d_reclen & (DIRALIGN - 1)) ||
+		    ep->d_reclen > DIRBLKSIZ - (pos & (DIRBLKSIZ - 1)))
+			goto fail;
+		size = ep->d_reclen;
+		if (ep->d_ino) {
+			if (DIRHASH_FULL(dh))
+				goto fail;
+			ufsdirhash_insert(dh, ep, pos);
+			size -= DIRSIZ(FSFMT(vp), ep);
+		}
+		dh->dh_blkfree[pos / DIRBLKSIZ] += size / DIRALIGN;
+	}
+	if (bp != NULL)
+		brelse(bp);
+	ip->i_dirhash = dh;
+	TAILQ_INSERT_TAIL(&ufsdirhash_list, dh, dh_list);
+	return (0);
+
+fail:
+	if (bp != NULL)
+		brelse(bp);
+	free((caddr_t)dh->dh_hash, M_TEMP);
+	free((caddr_t)dh->dh_blkfree, M_TEMP);
+	free((caddr_t)dh, M_TEMP);
+	ufs_dirhashmem -= memreqd;
+	return (-1);
+}
+
+/*
+ * Throw away the hash of a directory.
+ */
+void
+ufsdirhash_free(ip)
+	struct inode *ip;
+{
+	register struct dirhash *dh;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return;
+	ip->i_dirhash = NULL;
+	TAILQ_REMOVE(&ufsdirhash_list, dh, dh_list);
+	ufs_dirhashmem -= dh->dh_memreq;
+	free((caddr_t)dh->dh_hash, M_TEMP);
+	free((caddr_t)dh->dh_blkfree, M_TEMP);
+	free((caddr_t)dh, M_TEMP);
+}
+
+/*
+ * Look up a name.  Returns 0 with the entry's offset in *offp and the
+ * buffer holding it in *bpp, ENOENT if the name is not in the directory,
+ * or EJUSTRETURN if the hash cannot answer and a linear search is needed.
+ * If prevoffp is not null, the offset of the entry before the one found
+ * in its DIRBLKSIZ block is returned there, as ufs_lookup needs for a
+ * DELETE; the entry's own offset is returned if it starts the block.
+ */
+int
+ufsdirhash_lookup(ip, name, namelen, offp, bpp, prevoffp)
+	struct inode *ip;
+	char *name;
+	int namelen;
+	doff_t *offp;
+	struct buf **bpp;
+	doff_t *prevoffp;
+{
+	register struct dirhash *dh;
+	register struct direct *ep;
+	struct vnode *vp = ITOV(ip);
+	struct buf *bp = NULL;
+	doff_t off, blkoff = -1, prev;
+	long bmask;
+	int slot;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return (EJUSTRETURN);
+	bmask = vp->v_mount->mnt_stat.f_iosize - 1;
+	for (slot = ufsdirhash_hash(name, namelen) % dh->dh_hlen;
+	     (off = dh->dh_hash[slot]) != DIRHASH_EMPTY;
+	     slot = (slot + 1) % dh->dh_hlen) {
+		if (off == DIRHASH_DEL)
+			continue;
+		if (off >= ip->i_size)
+			goto bad;
+		if (bp == NULL || (off & ~bmask) != blkoff) {
+			if (bp != NULL)
+				brelse(bp);
+			blkoff = off & ~bmask;
+			if (VOP_BLKATOFF(vp, (off_t)blkoff, NULL, &bp)) {
+				bp = NULL;
+				goto bad;
+			}
+		}
+		ep = (struct direct *)((char *)bp->b_data + (off & bmask));
+		if (ep->d_ino == 0 || ep->d_reclen == 0 ||
+		    ep->d_reclen > DIRBLKSIZ - (off & (DIRBLKSIZ - 1)))
+			goto bad;
+		if (ufsdirhash_namlen(vp, ep) != namelen ||
+		    memcmp(name, ep->d_name, (unsigned)namelen))
+			continue;
+		if (prevoffp != NULL) {
+			prev = off & ~(DIRBLKSIZ - 1);
+			while (prev < off) {
+				ep = (struct direct *)((char *)bp->b_data +
+				    (prev & bmask));
+				if (ep->d_reclen == 0)
+					goto bad;
+				if (prev + ep->d_reclen == off)
+					break;
+				prev += ep->d_reclen;
+			}
+			if (prev > off)
+				goto bad;
+			*prevoffp = prev;
+		}
+		*offp = off;
+		*bpp = bp;
+		return (0);
+	}
+	if (bp != NULL)
+		brelse(bp);
+	return (ENOENT);
+
+bad:
+	if (bp != NULL)
+		brelse(bp);
+	ufsdirhash_free(ip);
+	return (EJUSTRETURN);
+}
+
+/*
+ * Find room for an entry of slotneeded bytes.  Returns the offset of the
+ * region to use, with its size in *slotsizep, in the form ufs_lookup
+ * leaves in i_offset and i_count for ufs_direnter, or -1 if the new
+ * entry belongs in a new block at the end of the directory.
+ */
+doff_t
+ufsdirhash_findfree(ip, slotneeded, slotsizep)
+	struct inode *ip;
+	int slotneeded;
+	int *slotsizep;
+{
+	register struct dirhash *dh;
+	register struct direct *ep;
+	struct vnode *vp = ITOV(ip);
+	struct buf *bp;
+	char *dirbuf;
+	doff_t pos, off, slotstart;
+	int b, size, freebytes;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return (-1);
+	for (b = 0; b < dh->dh_dirblks; b++)
+		if (dh->dh_blkfree[b] * DIRALIGN >= slotneeded)
+			break;
+	if (b == dh->dh_dirblks)
+		return (-1);
+
+	/*
+	 * The block has enough free space, possibly spread over several
+	 * entries.  Start the region at the first entry with room to
+	 * spare and end it once enough has been gathered.
+	 */
+	pos = b * DIRBLKSIZ;
+	if (pos >= ip->i_size || VOP_BLKATOFF(vp, (off_t)pos, &dirbuf, &bp)) {
+		ufsdirhash_free(ip);
+		return (-1);
+	}
+	slotstart = -1;
+	freebytes = 0;
+	for (off = 0; off < DIRBLKSIZ; off += ep->d_reclen) {
+		ep = (struct direct *)(dirbuf + off);
+		if (ep->d_reclen == 0 || ep->d_reclen > DIRBLKSIZ - off)
+			break;
+		size = ep->d_reclen;
+		if (ep->d_ino)
+			size -= DIRSIZ(FSFMT(vp), ep);
+		if (size <= 0)
+			continue;
+		if (slotstart < 0)
+			slotstart = off;
+		freebytes += size;
+		if (freebytes >= slotneeded) {
+			*slotsizep = off + ep->d_reclen - slotstart;
+			brelse(bp);
+			return (pos + slotstart);
+		}
+	}
+	brelse(bp);
+	ufsdirhash_free(ip);
+	return (-1);
+}
+
+/*
+ * An entry has been written at offset.
+ */
+void
+ufsdirhash_add(ip, ep, offset)
+	struct inode *ip;
+	struct direct *ep;
+	doff_t offset;
+{
+	register struct dirhash *dh;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return;
+	if (DIRHASH_FULL(dh)) {
+		ufsdirhash_free(ip);
+		return;
+	}
+	ufsdirhash_insert(dh, ep, offset);
+}
+
+/*
+ * The entry ep at offset is about to be removed.
+ */
+void
+ufsdirhash_remove(ip, ep, offset)
+	struct inode *ip;
+	struct direct *ep;
+	doff_t offset;
+{
+	register struct dirhash *dh;
+	int slot;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return;
+	if ((slot = ufsdirhash_findslot(dh, ep, offset)) < 0) {
+		ufsdirhash_free(ip);
+		return;
+	}
+	dh->dh_hash[slot] = DIRHASH_DEL;
+}
+
+/*
+ * The entry ep is about to be moved from oldoff to newoff by
+ * compaction.
+ */
+void
+ufsdirhash_move(ip, ep, oldoff, newoff)
+	struct inode *ip;
+	struct direct *ep;
+	doff_t oldoff, newoff;
+{
+	register struct dirhash *dh;
+	int slot;
+
+	if ((dh = ip->i_dirhash) == NULL || oldoff == newoff)
+		return;
+	if ((slot = ufsdirhash_findslot(dh, ep, oldoff)) < 0) {
+		ufsdirhash_free(ip);
+		return;
+	}
+	dh->dh_hash[slot] = newoff;
+}
+
+/*
+ * A block has been appended at offset, with freebytes left in it.
+ */
+void
+ufsdirhash_newblk(ip, offset, freebytes)
+	struct inode *ip;
+	doff_t offset;
+	int freebytes;
+{
+	register struct dirhash *dh;
+	int b;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return;
+	b = offset / DIRBLKSIZ;
+	if (b != dh->dh_dirblks || b >= dh->dh_nblk) {
+		ufsdirhash_free(ip);
+		return;
+	}
+	dh->dh_blkfree[b] = freebytes / DIRALIGN;
+	dh->dh_dirblks++;
+}
+
+/*
+ * Recount the free space in the DIRBLKSIZ block holding offset, which
+ * has just been changed; blkbuf points to the start of the block.
+ */
+void
+ufsdirhash_checkblk(ip, blkbuf, offset)
+	struct inode *ip;
+	char *blkbuf;
+	doff_t offset;
+{
+	register struct dirhash *dh;
+	register struct direct *ep;
+	int off, size, freebytes, b;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return;
+	b = offset / DIRBLKSIZ;
+	if (b >= dh->dh_dirblks) {
+		ufsdirhash_free(ip);
+		return;
+	}
+	freebytes = 0;
+	for (off = 0; off < DIRBLKSIZ; off += ep->d_reclen) {
+		ep = (struct direct *)(blkbuf + off);
+		if (ep->d_reclen == 0 || ep->d_reclen > DIRBLKSIZ - off) {
+			ufsdirhash_free(ip);
+			return;
+		}
+		size = ep->d_reclen;
+		if (ep->d_ino)
+			size -= DIRSIZ(FSFMT(ITOV(ip)), ep);
+		freebytes += size;
+	}
+	dh->dh_blkfree[b] = freebytes / DIRALIGN;
+}
+
+/*
+ * The directory is about to be truncated to offset.  Only empty
+ * blocks are ever cut off, so just forget them.
+ */
+void
+ufsdirhash_dirtrunc(ip, offset)
+	struct inode *ip;
+	doff_t offset;
+{
+	register struct dirhash *dh;
+	int b;
+
+	if ((dh = ip->i_dirhash) == NULL)
+		return;
+	b = howmany(offset, DIRBLKSIZ);
+	if (b < dh->dh_dirblks)
+		dh->dh_dirblks = b;
+}
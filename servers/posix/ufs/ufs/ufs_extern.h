@@ -113,6 +113,18 @@ int	 ufs_symlink (struct vop_symlink_args *);
 int	 ufs_unlock (struct vop_unlock_args *);
 int	 ufs_vinit (struct mount *,
 	    int (**)(), int (**)(), struct vnode **);
+void	 ufsdirhash_add (struct inode *, struct direct *, doff_t);
+int	 ufsdirhash_build (struct inode *);
+void	 ufsdirhash_checkblk (struct inode *, char *, doff_t);
+void	 ufsdirhash_dirtrunc (struct inode *, doff_t);
+doff_t	 ufsdirhash_findfree (struct inode *, int, int *);
+void	 ufsdirhash_free (struct inode *);
+void	 ufsdirhash_init (void);
+int	 ufsdirhash_lookup (struct inode *, char *, int, doff_t *,
+	    struct buf **, doff_t *);
+void	 ufsdirhash_move (struct inode *, struct direct *, doff_t, doff_t);
+void	 ufsdirhash_newblk (struct inode *, doff_t, int);
+void	 ufsdirhash_remove (struct inode *, struct direct *, doff_t);
 int	 ufsspec_close (struct vop_close_args *);
 int	 ufsspec_read (struct vop_read_args *);
 int	 ufsspec_write (struct vop_write_args *);
@@ -53,6 +53,7 @@
 #include <ufs/ufs/inode.h>
 #include <ufs/ufs/ufsmount.h>
 #include <ufs/ufs/ufs_extern.h>
+#include <ufs/ffs/ffs_extern.h>
 
 u_long	nextgennumber;		/* Next generation number to assign. */
 int	prtactive = 0;		/* 1 => print out reclaim of active vnodes */
@@ -71,6 +72,7 @@ ufs_init()
 		printf("ufs_init: bad size %d\n", sizeof(struct inode));
 #endif
 	ufs_ihashinit();
+	ufsdirhash_init();
 	dqinit();
 	return (0);
 }
@@ -158,6 +160,9 @@ ufs_reclaim(ap)
 	 * Purge old data structures associated with the inode.
 	 */
 	cache_purge(vp);
+	ufsdirhash_free(ip);
+	if (vp->v_type == VDIR && DOINGSOFTDEP(vp))
+		softdep_purge(vp);
 	if (ip->i_devvp) {
 		vrele(ip->i_devvp);
 		ip->i_devvp = 0;
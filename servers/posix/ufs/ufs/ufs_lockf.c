@@ -63,6 +63,23 @@ int	lockf_debug = 0;
 #define NOLOCKF (struct lockf *)0
 #define SELF	0x1
 #define OTHERS	0x2
+#define CONFLICT 0x4		/* only locks that conflict, with OTHERS */
+
+#define LF_HEIGHT(lf)	((lf) == NOLOCKF ? 0 : (lf)->lf_height)
+
+static void	 lf_fix (struct lockf *);
+static void	 lf_insert (struct inode *, struct lockf *);
+static void	 lf_rebalance (struct inode *, struct lockf *);
+static void	 lf_relink (struct inode *, struct lockf *, struct lockf *,
+		    struct lockf *);
+static void	 lf_remove (struct inode *, struct lockf *);
+static void	 lf_resize (struct lockf *, off_t, off_t);
+static struct lockf *
+		 lf_rotleft (struct inode *, struct lockf *);
+static struct lockf *
+		 lf_rotright (struct inode *, struct lockf *);
+static struct lockf *
+		 lf_search (struct lockf *, struct lockf *, int);
 
 /*
  * Set a byte-range lock.
@@ -73,9 +90,9 @@ lf_setlock(lock)
 {
 	register struct lockf *block;
 	struct inode *ip = lock->lf_inode;
-	struct lockf **prev, *overlap, *ltmp;
+	struct lockf *overlap, *ltmp;
 	static char lockstr[] = "lockf";
-	int ovcase, priority, needtolink, error;
+	int ovcase, priority, error;
 
 #ifdef LOCKF_DEBUG
 	if (lockf_debug & 1)
@@ -204,15 +221,11 @@ lf_setlock(lock)
 	 * downgrade or upgrade any overlapping locks this
 	 * process already owns.
 	 *
-	 * Skip over locks owned by other processes.
-	 * Handle any locks that overlap and are owned by ourselves.
+	 * Only our own overlapping locks are looked at; they
+	 * never overlap each other.
 	 */
-	prev = &ip->i_lockf;
-	block = ip->i_lockf;
-	needtolink = 1;
 	for (;;) {
-		if (ovcase = lf_findoverlap(block, lock, SELF, &prev, &overlap))
-			block = overlap->lf_next;
+		ovcase = lf_findoverlap(lock, SELF, &overlap);
 		/*
 		 * Six cases:
 		 *	0) no overlap
@@ -224,10 +237,7 @@ lf_setlock(lock)
 		 */
 		switch (ovcase) {
 		case 0: /* no overlap */
-			if (needtolink) {
-				*prev = lock;
-				lock->lf_next = overlap;
-			}
+			lf_insert(ip, lock);
 			break;
 
 		case 1: /* overlap == lock */
@@ -252,12 +262,8 @@ lf_setlock(lock)
 				lock = overlap; /* for debug output below */
 				break;
 			}
-			if (overlap->lf_start == lock->lf_start) {
-				*prev = lock;
-				lock->lf_next = overlap;
-				overlap->lf_start = lock->lf_end + 1;
-			} else
-				lf_split(overlap, lock);
+			lf_split(overlap, lock);
+			lf_insert(ip, lock);
 			lf_wakelock(overlap);
 			break;
 
@@ -270,46 +276,30 @@ lf_setlock(lock)
 			    overlap->lf_type == F_WRLCK) {
 				lf_wakelock(overlap);
 			} else {
+				for (ltmp = overlap->lf_block; ltmp != NOLOCKF;
+				     ltmp = ltmp->lf_block)
+					ltmp->lf_next = lock;
 				ltmp = lock->lf_block;
 				lock->lf_block = overlap->lf_block;
 				lf_addblock(lock, ltmp);
 			}
 			/*
-			 * Add the new lock if necessary and delete the overlap.
+			 * Delete the overlap; the new lock goes in once
+			 * no overlaps are left.
 			 */
-			if (needtolink) {
-				*prev = lock;
-				lock->lf_next = overlap->lf_next;
-				prev = &lock->lf_next;
-				needtolink = 0;
-			} else
-				*prev = overlap->lf_next;
+			lf_remove(ip, overlap);
 			bsd_free(overlap, M_LOCKF);
 			continue;
 
 		case 4: /* overlap starts before lock */
-			/*
-			 * Add lock after overlap on the list.
-			 */
-			lock->lf_next = overlap->lf_next;
-			overlap->lf_next = lock;
-			overlap->lf_end = lock->lf_start - 1;
-			prev = &lock->lf_next;
+			lf_resize(overlap, overlap->lf_start, lock->lf_start - 1);
 			lf_wakelock(overlap);
-			needtolink = 0;
 			continue;
 
 		case 5: /* overlap ends after lock */
-			/*
-			 * Add the new lock before overlap.
-			 */
-			if (needtolink) {
-				*prev = lock;
-				lock->lf_next = overlap;
-			}
-			overlap->lf_start = lock->lf_end + 1;
+			lf_resize(overlap, lock->lf_end + 1, overlap->lf_end);
 			lf_wakelock(overlap);
-			break;
+			continue;
 		}
 		break;
 	}
@@ -333,11 +323,10 @@ lf_clearlock(unlock)
 	register struct lockf *unlock;
 {
 	struct inode *ip = unlock->lf_inode;
-	register struct lockf *lf = ip->i_lockf;
-	struct lockf *overlap, **prev;
+	struct lockf *overlap;
 	int ovcase;
 
-	if (lf == NOLOCKF)
+	if (ip->i_lockf == NOLOCKF)
 		return (0);
 #ifdef LOCKF_DEBUG
 	if (unlock->lf_type != F_UNLCK)
@@ -345,8 +334,7 @@ lf_clearlock(unlock)
 	if (lockf_debug & 1)
 		lf_print("lf_clearlock", unlock);
 #endif /* LOCKF_DEBUG */
-	prev = &ip->i_lockf;
-	while (ovcase = lf_findoverlap(lf, unlock, SELF, &prev, &overlap)) {
+	while (ovcase = lf_findoverlap(unlock, SELF, &overlap)) {
 		/*
 		 * Wakeup the list of locks to be retried.
 		 */
@@ -355,34 +343,27 @@ lf_clearlock(unlock)
 		switch (ovcase) {
 
 		case 1: /* overlap == lock */
-			*prev = overlap->lf_next;
+			lf_remove(ip, overlap);
 			FREE(overlap, M_LOCKF);
 			break;
 
 		case 2: /* overlap contains lock: split it */
-			if (overlap->lf_start == unlock->lf_start) {
-				overlap->lf_start = unlock->lf_end + 1;
-				break;
-			}
 			lf_split(overlap, unlock);
-			overlap->lf_next = unlock->lf_next;
 			break;
 
 		case 3: /* lock contains overlap */
-			*prev = overlap->lf_next;
-			lf = overlap->lf_next;
+			lf_remove(ip, overlap);
 			bsd_free(overlap, M_LOCKF);
 			continue;
 
 		case 4: /* overlap starts before lock */
-			overlap->lf_end = unlock->lf_start - 1;
-			prev = &overlap->lf_next;
-			lf = overlap->lf_next;
+			lf_resize(overlap, overlap->lf_start,
+			    unlock->lf_start - 1);
 			continue;
 
 		case 5: /* overlap ends after lock */
-			overlap->lf_start = unlock->lf_end + 1;
-			break;
+			lf_resize(overlap, unlock->lf_end + 1, overlap->lf_end);
+			continue;
 		}
 		break;
 	}
@@ -428,143 +409,326 @@ lf_getlock(lock, fl)
 }
 
 /*
- * Walk the list of locks for an inode and
- * return the first blocking lock.
+ * Return the first lock of the inode, in order of starting
+ * byte, that blocks the given lock.
  */
 struct lockf *
 lf_getblock(lock)
 	register struct lockf *lock;
 {
-	struct lockf **prev, *overlap, *lf = lock->lf_inode->i_lockf;
-	int ovcase;
 
-	prev = &lock->lf_inode->i_lockf;
-	while (ovcase = lf_findoverlap(lf, lock, OTHERS, &prev, &overlap)) {
-		/*
-		 * We've found an overlap, see if it blocks us
-		 */
-		if ((lock->lf_type == F_WRLCK || overlap->lf_type == F_WRLCK))
-			return (overlap);
-		/*
-		 * Nope, point to the next one on the list and
-		 * see if it blocks us
-		 */
-		lf = overlap->lf_next;
-	}
-	return (NOLOCKF);
+	return (lf_search(lock->lf_inode->i_lockf, lock, OTHERS | CONFLICT));
 }
 
 /*
- * Walk the list of locks for an inode to
- * find an overlapping lock (if any).
- *
- * NOTE: this returns only the FIRST overlapping lock.  There
- *	 may be more than one.
+ * Find the first lock of the inode, in order of starting byte,
+ * that overlaps the given lock and is owned by the same (SELF)
+ * or another (OTHERS) process, and say how they overlap.
  */
 int
-lf_findoverlap(lf, lock, type, prev, overlap)
-	register struct lockf *lf;
+lf_findoverlap(lock, type, overlap)
 	struct lockf *lock;
 	int type;
-	struct lockf ***prev;
 	struct lockf **overlap;
 {
+	register struct lockf *lf;
 	off_t start, end;
 
-	*overlap = lf;
+#ifdef LOCKF_DEBUG
+	if (lockf_debug & 2)
+		lf_print("lf_findoverlap: looking for overlap in", lock);
+#endif /* LOCKF_DEBUG */
+	*overlap = lf = lf_search(lock->lf_inode->i_lockf, lock, type);
 	if (lf == NOLOCKF)
 		return (0);
 #ifdef LOCKF_DEBUG
 	if (lockf_debug & 2)
-		lf_print("lf_findoverlap: looking for overlap in", lock);
+		lf_print("\tfound", lf);
 #endif /* LOCKF_DEBUG */
 	start = lock->lf_start;
 	end = lock->lf_end;
-	while (lf != NOLOCKF) {
-		if (((type & SELF) && lf->lf_id != lock->lf_id) ||
-		    ((type & OTHERS) && lf->lf_id == lock->lf_id)) {
-			*prev = &lf->lf_next;
-			*overlap = lf = lf->lf_next;
-			continue;
-		}
+	/*
+	 * Five cases, the sixth (no overlap) having been ruled out:
+	 *	1) overlap == lock
+	 *	2) overlap contains lock
+	 *	3) lock contains overlap
+	 *	4) overlap starts before lock
+	 *	5) overlap ends after lock
+	 */
+	if ((lf->lf_start == start) && (lf->lf_end == end)) {
+		/* Case 1 */
 #ifdef LOCKF_DEBUG
 		if (lockf_debug & 2)
-			lf_print("\tchecking", lf);
+			printf("overlap == lock\n");
 #endif /* LOCKF_DEBUG */
-		/*
-		 * OK, check for overlap
-		 *
-		 * Six cases:
-		 *	0) no overlap
-		 *	1) overlap == lock
-		 *	2) overlap contains lock
-		 *	3) lock contains overlap
-		 *	4) overlap starts before lock
-		 *	5) overlap ends after lock
-		 */
-		if ((lf->lf_end != -1 && start > lf->lf_end) ||
-		    (end != -1 && lf->lf_start > end)) {
-			/* Case 0 */
-#ifdef LOCKF_DEBUG
-			if (lockf_debug & 2)
-				printf("no overlap\n");
-#endif /* LOCKF_DEBUG */
-			if ((type & SELF) && end != -1 && lf->lf_start > end)
-				return (0);
-			*prev = &lf->lf_next;
-			*overlap = lf = lf->lf_next;
-			continue;
-		}
-		if ((lf->lf_start == start) && (lf->lf_end == end)) {
-			/* Case 1 */
-#ifdef LOCKF_DEBUG
-			if (lockf_debug & 2)
-				printf("overlap == lock\n");
-#endif /* LOCKF_DEBUG */
-			return (1);
-		}
-		if ((lf->lf_start <= start) &&
-		    (end != -1) &&
-		    ((lf->lf_end >= end) || (lf->lf_end == -1))) {
-			/* Case 2 */
+		return (1);
+	}
+	if ((lf->lf_start <= start) &&
+	    (end != -1) &&
+	    ((lf->lf_end >= end) || (lf->lf_end == -1))) {
+		/* Case 2 */
 #ifdef LOCKF_DEBUG
-			if (lockf_debug & 2)
-				printf("overlap contains lock\n");
+		if (lockf_debug & 2)
+			printf("overlap contains lock\n");
 #endif /* LOCKF_DEBUG */
-			return (2);
-		}
-		if (start <= lf->lf_start &&
-		           (end == -1 ||
-			   (lf->lf_end != -1 && end >= lf->lf_end))) {
-			/* Case 3 */
+		return (2);
+	}
+	if (start <= lf->lf_start &&
+	           (end == -1 ||
+		   (lf->lf_end != -1 && end >= lf->lf_end))) {
+		/* Case 3 */
 #ifdef LOCKF_DEBUG
-			if (lockf_debug & 2)
-				printf("lock contains overlap\n");
+		if (lockf_debug & 2)
+			printf("lock contains overlap\n");
 #endif /* LOCKF_DEBUG */
-			return (3);
-		}
-		if ((lf->lf_start < start) &&
-			((lf->lf_end >= start) || (lf->lf_end == -1))) {
-			/* Case 4 */
+		return (3);
+	}
+	if ((lf->lf_start < start) &&
+		((lf->lf_end >= start) || (lf->lf_end == -1))) {
+		/* Case 4 */
 #ifdef LOCKF_DEBUG
-			if (lockf_debug & 2)
-				printf("overlap starts before lock\n");
+		if (lockf_debug & 2)
+			printf("overlap starts before lock\n");
 #endif /* LOCKF_DEBUG */
-			return (4);
-		}
-		if ((lf->lf_start > start) &&
-			(end != -1) &&
-			((lf->lf_end > end) || (lf->lf_end == -1))) {
-			/* Case 5 */
+		return (4);
+	}
+	if ((lf->lf_start > start) &&
+		(end != -1) &&
+		((lf->lf_end > end) || (lf->lf_end == -1))) {
+		/* Case 5 */
 #ifdef LOCKF_DEBUG
-			if (lockf_debug & 2)
-				printf("overlap ends after lock\n");
+		if (lockf_debug & 2)
+			printf("overlap ends after lock\n");
 #endif /* LOCKF_DEBUG */
-			return (5);
+		return (5);
+	}
+	panic("lf_findoverlap: default");
+	/* NOTREACHED */
+}
+
+/*
+ * Search the subtree at lf for the first lock, in order of starting
+ * byte, that overlaps the given lock and passes the SELF, OTHERS and
+ * CONFLICT tests in type.  Subtrees ending before the lock starts and
+ * locks starting after it ends are skipped, so the cost is the depth
+ * of the tree plus the number of overlapping locks passed over.
+ */
+static struct lockf *
+lf_search(lf, lock, type)
+	register struct lockf *lf;
+	struct lockf *lock;
+	int type;
+{
+	struct lockf *found;
+
+	for (; lf != NOLOCKF; lf = lf->lf_right) {
+		if (lf->lf_maxend != -1 && lf->lf_maxend < lock->lf_start)
+			return (NOLOCKF);
+		if (found = lf_search(lf->lf_left, lock, type))
+			return (found);
+		if (lock->lf_end != -1 && lf->lf_start > lock->lf_end)
+			return (NOLOCKF);
+		if (lf->lf_end != -1 && lf->lf_end < lock->lf_start)
+			continue;
+		if (((type & SELF) && lf->lf_id != lock->lf_id) ||
+		    ((type & OTHERS) && lf->lf_id == lock->lf_id))
+			continue;
+		if ((type & CONFLICT) &&
+		    lock->lf_type != F_WRLCK && lf->lf_type != F_WRLCK)
+			continue;
+		return (lf);
+	}
+	return (NOLOCKF);
+}
+
+/*
+ * Recompute the height and largest end of a subtree from its children.
+ */
+static void
+lf_fix(lf)
+	register struct lockf *lf;
+{
+	register struct lockf *child;
+	int hl, hr;
+
+	hl = LF_HEIGHT(lf->lf_left);
+	hr = LF_HEIGHT(lf->lf_right);
+	lf->lf_height = (hl > hr ? hl : hr) + 1;
+	lf->lf_maxend = lf->lf_end;
+	if ((child = lf->lf_left) != NOLOCKF && lf->lf_maxend != -1 &&
+	    (child->lf_maxend == -1 || child->lf_maxend > lf->lf_maxend))
+		lf->lf_maxend = child->lf_maxend;
+	if ((child = lf->lf_right) != NOLOCKF && lf->lf_maxend != -1 &&
+	    (child->lf_maxend == -1 || child->lf_maxend > lf->lf_maxend))
+		lf->lf_maxend = child->lf_maxend;
+}
+
+/*
+ * Make new take the place of old below parent, or at the root.
+ */
+static void
+lf_relink(ip, parent, old, new)
+	struct inode *ip;
+	struct lockf *parent, *old, *new;
+{
+
+	if (parent == NOLOCKF)
+		ip->i_lockf = new;
+	else if (parent->lf_left == old)
+		parent->lf_left = new;
+	else
+		parent->lf_right = new;
+}
+
+static struct lockf *
+lf_rotleft(ip, lf)
+	struct inode *ip;
+	register struct lockf *lf;
+{
+	register struct lockf *r = lf->lf_right;
+
+	if (lf->lf_right = r->lf_left)
+		r->lf_left->lf_parent = lf;
+	r->lf_parent = lf->lf_parent;
+	lf_relink(ip, lf->lf_parent, lf, r);
+	r->lf_left = lf;
+	lf->lf_parent = r;
+	lf_fix(lf);
+	lf_fix(r);
+	return (r);
+}
+
+static struct lockf *
+lf_rotright(ip, lf)
+	struct inode *ip;
+	register struct lockf *lf;
+{
+	register struct lockf *l = lf->lf_left;
+
+	if (lf->lf_left = l->lf_right)
+		l->lf_right->lf_parent = lf;
+	l->lf_parent = lf->lf_parent;
+	lf_relink(ip, lf->lf_parent, lf, l);
+	l->lf_right = lf;
+	lf->lf_parent = l;
+	lf_fix(lf);
+	lf_fix(l);
+	return (l);
+}
+
+/*
+ * Restore heights, largest ends and balance from lf up to the root.
+ */
+static void
+lf_rebalance(ip, lf)
+	struct inode *ip;
+	register struct lockf *lf;
+{
+	int balance;
+
+	for (; lf != NOLOCKF; lf = lf->lf_parent) {
+		lf_fix(lf);
+		balance = LF_HEIGHT(lf->lf_left) - LF_HEIGHT(lf->lf_right);
+		if (balance > 1) {
+			if (LF_HEIGHT(lf->lf_left->lf_left) <
+			    LF_HEIGHT(lf->lf_left->lf_right))
+				(void) lf_rotleft(ip, lf->lf_left);
+			lf = lf_rotright(ip, lf);
+		} else if (balance < -1) {
+			if (LF_HEIGHT(lf->lf_right->lf_right) <
+			    LF_HEIGHT(lf->lf_right->lf_left))
+				(void) lf_rotright(ip, lf->lf_right);
+			lf = lf_rotleft(ip, lf);
 		}
-		panic("lf_findoverlap: default");
 	}
-	return (0);
+}
+
+/*
+ * Add a lock to the tree of its inode.
+ */
+static void
+lf_insert(ip, lock)
+	struct inode *ip;
+	register struct lockf *lock;
+{
+	register struct lockf *parent, **linkp;
+
+	parent = NOLOCKF;
+	linkp = &ip->i_lockf;
+	while (*linkp != NOLOCKF) {
+		parent = *linkp;
+		if (lock->lf_start < parent->lf_start)
+			linkp = &parent->lf_left;
+		else
+			linkp = &parent->lf_right;
+	}
+	lock->lf_parent = parent;
+	lock->lf_left = lock->lf_right = NOLOCKF;
+	*linkp = lock;
+	lf_rebalance(ip, lock);
+}
+
+/*
+ * Take a lock out of the tree of its inode.
+ */
+static void
+lf_remove(ip, lock)
+	struct inode *ip;
+	register struct lockf *lock;
+{
+	register struct lockf *next, *child, *parent;
+
+	if (lock->lf_left == NOLOCKF || lock->lf_right == NOLOCKF) {
+		child = lock->lf_left ? lock->lf_left : lock->lf_right;
+		parent = lock->lf_parent;
+		if (child != NOLOCKF)
+			child->lf_parent = parent;
+		lf_relink(ip, parent, lock, child);
+		lf_rebalance(ip, parent);
+		return;
+	}
+	/*
+	 * Put the next lock in order, which has no left child,
+	 * in the place of the lock.
+	 */
+	for (next = lock->lf_right; next->lf_left; next = next->lf_left)
+		;
+	parent = next->lf_parent;
+	if (parent == lock)
+		parent = next;
+	else {
+		if (parent->lf_left = next->lf_right)
+			next->lf_right->lf_parent = parent;
+		next->lf_right = lock->lf_right;
+		lock->lf_right->lf_parent = next;
+	}
+	next->lf_left = lock->lf_left;
+	lock->lf_left->lf_parent = next;
+	next->lf_parent = lock->lf_parent;
+	lf_relink(ip, lock->lf_parent, lock, next);
+	lf_rebalance(ip, parent);
+}
+
+/*
+ * Change the range of a lock in the tree.
+ */
+static void
+lf_resize(lock, start, end)
+	register struct lockf *lock;
+	off_t start, end;
+{
+	register struct lockf *lf;
+
+	if (start == lock->lf_start) {
+		lock->lf_end = end;
+		for (lf = lock; lf != NOLOCKF; lf = lf->lf_parent)
+			lf_fix(lf);
+		return;
+	}
+	lf_remove(lock->lf_inode, lock);
+	lock->lf_start = start;
+	lock->lf_end = end;
+	lf_insert(lock->lf_inode, lock);
 }
 
 /*
@@ -596,8 +760,8 @@ lf_addblock(lock, blocked)
 }
 
 /*
- * Split a lock and a contained region into
- * two or three locks as necessary.
+ * Cut the region of lock2 out of lock1, which holds it, leaving
+ * one or two locks in the tree as necessary.  lock2 is not added.
  */
 void
 lf_split(lock1, lock2)
@@ -616,14 +780,11 @@ lf_split(lock1, lock2)
 	 * Check to see if spliting into only two pieces.
 	 */
 	if (lock1->lf_start == lock2->lf_start) {
-		lock1->lf_start = lock2->lf_end + 1;
-		lock2->lf_next = lock1;
+		lf_resize(lock1, lock2->lf_end + 1, lock1->lf_end);
 		return;
 	}
 	if (lock1->lf_end == lock2->lf_end) {
-		lock1->lf_end = lock2->lf_start - 1;
-		lock2->lf_next = lock1->lf_next;
-		lock1->lf_next = lock2;
+		lf_resize(lock1, lock1->lf_start, lock2->lf_start - 1);
 		return;
 	}
 	/*
@@ -633,14 +794,13 @@ lf_split(lock1, lock2)
 	MALLOC(splitlock, struct lockf *, sizeof *splitlock, M_LOCKF, M_WAITOK);
 	memcpy((caddr_t)splitlock, (caddr_t)lock1, sizeof *splitlock);
 	splitlock->lf_start = lock2->lf_end + 1;
+	splitlock->lf_next = NOLOCKF;
 	splitlock->lf_block = NOLOCKF;
-	lock1->lf_end = lock2->lf_start - 1;
+	lf_resize(lock1, lock1->lf_start, lock2->lf_start - 1);
 	/*
 	 * OK, now link it in
 	 */
-	splitlock->lf_next = lock1->lf_next;
-	lock2->lf_next = splitlock;
-	lock1->lf_next = lock2;
+	lf_insert(lock1->lf_inode, splitlock);
 }
 
 /*
@@ -701,13 +861,19 @@ lf_printlist(tag, lock)
 	char *tag;
 	struct lockf *lock;
 {
-	register struct lockf *lf;
+	register struct lockf *lf, *next;
 
 	printf("%s: Lock list for ino %d on dev <%d, %d>:\n",
 		tag, lock->lf_inode->i_number,
 		major(lock->lf_inode->i_dev),
 		minor(lock->lf_inode->i_dev));
-	for (lf = lock->lf_inode->i_lockf; lf; lf = lf->lf_next) {
+	/*
+	 * Walk the tree in order of starting byte.
+	 */
+	if ((lf = lock->lf_inode->i_lockf) != NOLOCKF)
+		while (lf->lf_left)
+			lf = lf->lf_left;
+	for (; lf; lf = next) {
 		printf("\tlock 0x%lx for ", lf);
 		if (lf->lf_flags & F_POSIX)
 			printf("proc %d", ((struct proc *)(lf->lf_id))->p_pid);
@@ -722,6 +888,14 @@ lf_printlist(tag, lock)
 			printf(" block 0x%x\n", lf->lf_block);
 		else
 			printf("\n");
+		if (next = lf->lf_right) {
+			while (next->lf_left)
+				next = next->lf_left;
+		} else {
+			for (next = lf->lf_parent; next && next->lf_right == lf;
+			     next = next->lf_parent)
+				lf = next;
+		}
 	}
 }
 #endif /* LOCKF_DEBUG */
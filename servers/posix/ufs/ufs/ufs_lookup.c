@@ -55,6 +55,9 @@
 #include <ufs/ufs/ufsmount.h>
 #include <ufs/ufs/ufs_extern.h>
 
+#include <ufs/ffs/fs.h>
+#include <ufs/ffs/ffs_extern.h>
+
 struct	nchstats nchstats;
 #if DIAGNOSTIC
 int	dirchk = 1;
@@ -223,6 +226,36 @@ ufs_lookup(ap)
 			cnp->cn_namelen + 3) &~ 3;
 	}
 
+	/*
+	 * A large directory is searched through its dirhash instead,
+	 * if one can be had.  When the name is not there, we go on to
+	 * the notfound code with whatever slot the hash found for a
+	 * new entry.  If the hash cannot answer, fall back to the
+	 * linear search below.
+	 */
+	bmask = VFSTOUFS(vdp->v_mount)->um_mountp->mnt_stat.f_iosize - 1;
+	if (ufsdirhash_build(dp) == 0) {
+		if (slotstatus == NONE && (slotoffset =
+		    ufsdirhash_findfree(dp, slotneeded, &slotsize)) >= 0)
+			slotstatus = COMPACT;
+		numdirpasses = 1;
+		switch (ufsdirhash_lookup(dp, cnp->cn_nameptr,
+		    cnp->cn_namelen, &dp->i_offset, &bp,
+		    nameiop == DELETE ? &prevoff : (doff_t *)NULL)) {
+		case 0:
+			entryoffsetinblock = dp->i_offset & bmask;
+			ep = (struct direct *)((char *)bp->b_data +
+			    entryoffsetinblock);
+			dp->i_ino = ep->d_ino;
+			dp->i_reclen = ep->d_reclen;
+			brelse(bp);
+			goto found;
+		case ENOENT:
+			enduseful = dp->i_size;
+			goto notfound;
+		}
+	}
+
 	/*
 	 * If there is cached information on a previous search of
 	 * this directory, pick up where we last left off.
@@ -234,7 +267,6 @@ ufs_lookup(ap)
 	 * profiling time and hence has been removed in the interest
 	 * of simplicity.
 	 */
-	bmask = VFSTOUFS(vdp->v_mount)->um_mountp->mnt_stat.f_iosize - 1;
 	if (nameiop != LOOKUP || dp->i_diroff == 0 ||
 	    dp->i_diroff > dp->i_size) {
 		entryoffsetinblock = 0;
@@ -353,7 +385,7 @@ searchloop:
 		if (ep->d_ino)
 			enduseful = dp->i_offset;
 	}
-/* notfound: */
+notfound:
 	/*
 	 * If we started in the middle of the directory and failed
 	 * to find our target, we must check the beginning as well.
@@ -693,6 +725,9 @@ ufs_direnter(ip, dvp, cnp)
 		auio.uio_rw = UIO_WRITE;
 		auio.uio_segflg = UIO_SYSSPACE;
 		auio.uio_procp = (struct proc *)0;
+		if (DOINGSOFTDEP(dvp))
+			softdep_setup_direnter(dvp,
+			    lblkno(dp->i_fs, dp->i_offset), ip);
 		error = VOP_WRITE(dvp, &auio, IO_SYNC, cnp->cn_cred);
 		if (DIRBLKSIZ >
 		    VFSTOUFS(dvp->v_mount)->um_mountp->mnt_stat.f_bsize)
@@ -701,6 +736,9 @@ ufs_direnter(ip, dvp, cnp)
 		else if (!error) {
 			dp->i_size = roundup(dp->i_size, DIRBLKSIZ);
 			dp->i_flag |= IN_CHANGE;
+			ufsdirhash_newblk(dp, dp->i_offset,
+			    DIRBLKSIZ - newentrysize);
+			ufsdirhash_add(dp, &newdir, dp->i_offset);
 		}
 		return (error);
 	}
@@ -751,6 +789,10 @@ ufs_direnter(ip, dvp, cnp)
 		dsize = DIRSIZ(FSFMT(dvp), nep);
 		spacefree += nep->d_reclen - dsize;
 		loc += nep->d_reclen;
+		if (nep->d_ino)
+			ufsdirhash_move(dp, nep,
+			    dp->i_offset + ((char *)nep - dirbuf),
+			    dp->i_offset + ((char *)ep - dirbuf));
 		memcpy((caddr_t)ep, (caddr_t)nep, dsize);
 	}
 	/*
@@ -769,11 +811,21 @@ ufs_direnter(ip, dvp, cnp)
 		ep = (struct direct *)((char *)ep + dsize);
 	}
 	memcpy((caddr_t)ep, (caddr_t)&newdir, (u_int)newentrysize);
-	error = VOP_BWRITE(bp);
+	ufsdirhash_add(dp, &newdir, dp->i_offset + ((char *)ep - dirbuf));
+	ufsdirhash_checkblk(dp, dirbuf - (dp->i_offset & (DIRBLKSIZ - 1)),
+	    dp->i_offset);
+	if (DOINGSOFTDEP(dvp)) {
+		softdep_setup_direnter(dvp, bp->b_lblkno, ip);
+		bdwrite(bp);
+		error = 0;
+	} else
+		error = VOP_BWRITE(bp);
 	dp->i_flag |= IN_CHANGE | IN_UPDATE;
-	if (!error && dp->i_endoff && dp->i_endoff < dp->i_size)
+	if (!error && dp->i_endoff && dp->i_endoff < dp->i_size) {
+		ufsdirhash_dirtrunc(dp, dp->i_endoff);
 		error = VOP_TRUNCATE(dvp, (off_t)dp->i_endoff, IO_SYNC,
 		    cnp->cn_cred, cnp->cn_proc);
+	}
 	return (error);
 }
 
@@ -787,7 +839,9 @@ ufs_direnter(ip, dvp, cnp)
  * zero the inode number to mark the entry as free.  If the
  * entry is not the first in the directory, we must reclaim
  * the space of the now empty record by adding the record size
- * to the size of the previous entry.
+ * to the size of the previous entry.  With ordered metadata
+ * (DOINGSOFTDEP) the block is left as a delayed write and the
+ * caller calls softdep_setup_remove.
  */
 int
 ufs_dirremove(dvp, cnp)
@@ -807,8 +861,14 @@ ufs_dirremove(dvp, cnp)
 		if (error =
 		    VOP_BLKATOFF(dvp, (off_t)dp->i_offset, (char **)&ep, &bp))
 			return (error);
+		ufsdirhash_remove(dp, ep, dp->i_offset);
 		ep->d_ino = 0;
-		error = VOP_BWRITE(bp);
+		ufsdirhash_checkblk(dp, (char *)ep, dp->i_offset);
+		if (DOINGSOFTDEP(dvp)) {
+			bdwrite(bp);
+			error = 0;
+		} else
+			error = VOP_BWRITE(bp);
 		dp->i_flag |= IN_CHANGE | IN_UPDATE;
 		return (error);
 	}
@@ -818,8 +878,16 @@ ufs_dirremove(dvp, cnp)
 	if (error = VOP_BLKATOFF(dvp, (off_t)(dp->i_offset - dp->i_count),
 	    (char **)&ep, &bp))
 		return (error);
+	ufsdirhash_remove(dp, (struct direct *)((char *)ep + ep->d_reclen),
+	    dp->i_offset);
 	ep->d_reclen += dp->i_reclen;
-	error = VOP_BWRITE(bp);
+	ufsdirhash_checkblk(dp, (char *)ep -
+	    ((dp->i_offset - dp->i_count) & (DIRBLKSIZ - 1)), dp->i_offset);
+	if (DOINGSOFTDEP(dvp)) {
+		bdwrite(bp);
+		error = 0;
+	} else
+		error = VOP_BWRITE(bp);
 	dp->i_flag |= IN_CHANGE | IN_UPDATE;
 	return (error);
 }
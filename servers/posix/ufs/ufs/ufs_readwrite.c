@@ -263,6 +263,9 @@ WRITE(ap)
 #else
 		if (ioflag & IO_SYNC)
 			(void)bwrite(bp);
+		else if (bp->b_flags & B_LOCKED)
+			/* No disk address yet, see ffs_balloc. */
+			bdwrite(bp);
 		else if (xfersize + blkoffset == fs->fs_bsize)
 			if (doclusterwrite)
 				cluster_write(bp, ip->i_size);
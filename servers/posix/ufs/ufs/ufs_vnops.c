@@ -77,6 +77,7 @@
 #include <ufs/ufs/dir.h>
 #include <ufs/ufs/ufsmount.h>
 #include <ufs/ufs/ufs_extern.h>
+#include <ufs/ffs/ffs_extern.h>
 
 static int ufs_chmod (struct vnode *, int, struct ucred *, struct proc *);
 static int ufs_chown
@@ -651,8 +652,9 @@ ufs_remove(ap)
 	register struct inode *ip;
 	register struct vnode *vp = ap->a_vp;
 	register struct vnode *dvp = ap->a_dvp;
-	int error;
+	int error, softdep;
 
+	softdep = DOINGSOFTDEP(dvp);
 	ip = VTOI(vp);
 	if ((ip->i_flags & (IMMUTABLE | APPEND)) ||
 	    (VTOI(dvp)->i_flags & APPEND)) {
@@ -667,6 +669,8 @@ ufs_remove(ap)
 #endif /* EXT2FS */
 		ip->i_nlink--;
 		ip->i_flag |= IN_CHANGE;
+		if (softdep)
+			softdep_setup_remove(VTOI(dvp), ip);
 	}
 out:
 	if (dvp == vp)
@@ -674,6 +678,8 @@ out:
 	else
 		vput(vp);
 	vput(dvp);
+	if (error == 0 && softdep)
+		softdep_checkworklist();
 	return (error);
 }
 
@@ -722,7 +728,7 @@ ufs_link(ap)
 	ip->i_nlink++;
 	ip->i_flag |= IN_CHANGE;
 	get_time(&tv);
-	error = VOP_UPDATE(tdvp, &tv, &tv, 1);
+	error = VOP_UPDATE(tdvp, &tv, &tv, !DOINGSOFTDEP(tdvp));
 	if (!error)
 #if EXT2FS
 		error = (IS_EXT2_VNODE(vp) ? ext2_direnter : ufs_direnter)
@@ -1121,6 +1127,13 @@ abortit:
 			}
 			goto bad;
 		}
+		/*
+		 * The new name must be on disk before the old one is
+		 * removed below.
+		 */
+		if (DOINGSOFTDEP(tdvp) && (error = VOP_FSYNC(tdvp,
+		    tcnp->cn_cred, MNT_WAIT, tcnp->cn_proc)))
+			goto bad;
 		vput(tdvp);
 	} else {
 		if (xp->i_dev != dp->i_dev || xp->i_dev != ip->i_dev)
@@ -1201,6 +1214,7 @@ abortit:
 		if (doingdirectory) {
 			if (--xp->i_nlink != 0)
 				panic("rename: linked directory");
+			ufsdirhash_free(xp);
 			error = VOP_TRUNCATE(tvp, (off_t)0, IO_SYNC,
 			    tcnp->cn_cred, tcnp->cn_proc);
 		}
@@ -1294,6 +1308,11 @@ abortit:
 #else
 		error = ufs_dirremove(fdvp, fcnp);
 #endif /* EXT2FS */
+		if (!error && DOINGSOFTDEP(fdvp)) {
+			/* Rename keeps its synchronous writes. */
+			softdep_setup_remove(VTOI(fdvp), xp);
+			softdep_flushremove(xp);
+		}
 		if (!error) {
 			xp->i_nlink--;
 			xp->i_flag |= IN_CHANGE;
@@ -1390,7 +1409,7 @@ ufs_mkdir(ap)
 	tvp->v_type = VDIR;	/* Rest init'd in getnewvnode(). */
 	ip->i_nlink = 2;
 	get_time(&tv);
-	error = VOP_UPDATE(tvp, &tv, &tv, 1);
+	error = VOP_UPDATE(tvp, &tv, &tv, !DOINGSOFTDEP(tvp));
 
 	/*
 	 * Bump link count in parent directory
@@ -1440,6 +1459,15 @@ ufs_mkdir(ap)
 		ip->i_size = DIRBLKSIZ;
 		ip->i_flag |= IN_CHANGE;
 	}
+	/*
+	 * With ordered metadata the entry below waits for the inode
+	 * as it stands now, with its first block.
+	 */
+	if (DOINGSOFTDEP(tvp) && (error = VOP_UPDATE(tvp, &tv, &tv, 0))) {
+		dp->i_nlink--;
+		dp->i_flag |= IN_CHANGE;
+		goto bad;
+	}
 
 	/* Directory set up, now install it's entry in the parent directory. */
 #if EXT2FS
@@ -1535,6 +1563,10 @@ ufs_rmdir(ap)
 		goto out;
 	dp->i_nlink--;
 	dp->i_flag |= IN_CHANGE;
+	if (DOINGSOFTDEP(dvp)) {
+		softdep_setup_remove(dp, ip);
+		softdep_setup_remove(dp, dp);
+	}
 	cache_purge(dvp);
 	vput(dvp);
 	dvp = NULL;
@@ -1550,6 +1582,7 @@ ufs_rmdir(ap)
 	 * worry about them later.
 	 */
 	ip->i_nlink -= 2;
+	ufsdirhash_free(ip);
 	error = VOP_TRUNCATE(vp, (off_t)0, IO_SYNC, cnp->cn_cred,
 	    cnp->cn_proc);
 	cache_purge(ITOV(ip));
@@ -2252,10 +2285,11 @@ ufs_makeinode(mode, dvp, vpp, cnp)
 		ip->i_mode &= ~ISGID;
 
 	/*
-	 * Make sure inode goes to disk before directory entry.
+	 * Make sure inode goes to disk before directory entry, either
+	 * now or, with ordered metadata, when the entry is written.
 	 */
 	get_time(&tv);
-	if (error = VOP_UPDATE(tvp, &tv, &tv, 1))
+	if (error = VOP_UPDATE(tvp, &tv, &tv, !DOINGSOFTDEP(tvp)))
 		goto bad;
 #if EXT2FS
         if (error = (IS_EXT2_VNODE(dvp) ? ext2_direnter : ufs_direnter)
@@ -34,6 +34,7 @@
  */
 
 struct buf;
+struct ext2_journal;
 struct inode;
 struct nameidata;
 struct timeval;
@@ -66,6 +67,9 @@ struct ufsmount {
 	time_t	um_btime[MAXQUOTAS];		/* block quota time limit */
 	time_t	um_itime[MAXQUOTAS];		/* inode quota time limit */
 	char	um_qflags[MAXQUOTAS];		/* quota specific flags */
+	long	um_delayed;			/* FFS blocks reserved, unassigned */
+	int	um_softdep;			/* FFS ordered delayed metadata */
+	struct	ext2_journal *um_journal;	/* EXT2 metadata journal */
 	struct	netexport um_export;		/* export information */
 };
 /*
@@ -77,6 +81,9 @@ struct ufsmount {
 /* Convert mount ptr to ufsmount ptr. */
 #define VFSTOUFS(mp)	((struct ufsmount *)((mp)->mnt_data))
 
+/* Metadata of this vnode's FFS file system is ordered, not synchronous. */
+#define	DOINGSOFTDEP(vp)	(VFSTOUFS((vp)->v_mount)->um_softdep)
+
 /*
  * Macros to access file system parameters in the ufsmount structure.
  * Used by ufs_bmap.